@@ -9,8 +9,10 @@
 #ifndef DDP24_H
 #define DDP24_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 /* Word size: 24 bits */
 typedef uint32_t word_t;  /* Using 32-bit for convenience, mask to 24 */
@@ -95,34 +97,187 @@ typedef enum {
     OP_NOP = 077,   /* No Operation */
 } opcode_t;
 
+/* Predecoded instruction.
+ * One per memory word, filled on first fetch and invalidated by stores,
+ * so the hot loop never re-extracts fields or looks up costs.
+ */
+#define DDP24_DEC_VALID     0x01    /* Entry matches memory */
+#define DDP24_DEC_INDIRECT  0x02    /* I bit set */
+
+#define DDP24_H_ILLEGAL     0100    /* Handler slot for unimplemented opcodes */
+
+typedef struct {
+    uint8_t  op;        /* Opcode */
+    uint8_t  handler;   /* Dispatch slot (opcode, or DDP24_H_ILLEGAL) */
+    uint8_t  index;     /* Index register select */
+    uint8_t  flags;     /* DDP24_DEC_* */
+    uint16_t addr;      /* Base address (before indexing) */
+    uint16_t cycles;    /* Static cycle cost */
+} ddp24_decoded_t;
+
+/* Execution engines (all share the semantics in src/ddp24_ops.inc) */
+typedef enum {
+    DDP24_ENGINE_SWITCH = 0,    /* Portable switch dispatch, the reference */
+    DDP24_ENGINE_THREADED,      /* Direct-threaded dispatch */
+    DDP24_ENGINE_JIT,           /* Hot blocks compiled to host code (make JIT=1) */
+} ddp24_engine_t;
+
+/* Why a run returned */
+typedef enum {
+    DDP24_STOP_NONE = 0,        /* No stop pending (never returned) */
+    DDP24_STOP_HALTED,          /* HLT, or the CPU was already halted */
+    DDP24_STOP_BUDGET,          /* Reached the cycle deadline */
+    DDP24_STOP_BREAKPOINT,      /* Requested by a breakpoint */
+    DDP24_STOP_WATCHPOINT,      /* Requested by a watchpoint */
+    DDP24_STOP_IO_WAIT,         /* Requested by a device the CPU is waiting on */
+} ddp24_stop_t;
+
+/* Why an engine halted the CPU other than by HLT */
+typedef enum {
+    DDP24_FAULT_NONE = 0,
+    DDP24_FAULT_ILLEGAL,        /* Opcode the CPU does not have */
+    DDP24_FAULT_XEC_CHAIN,      /* XEC chain longer than xec_limit */
+    DDP24_FAULT_NOMEM,          /* A page could not be copied for a store or decode */
+} ddp24_fault_t;
+
+#define DDP24_FOREVER   UINT64_MAX  /* Deadline that is never reached */
+
+struct ddp24_jit;
+struct ddp24_profile;
+struct ddp24_trace;
+struct ddp24_calls;
+struct ddp24_hle;
+struct ddp24_io;
+struct ddp24_debug;
+struct ddp24_timing;
+
+/* Paged memory.
+ * Each CPU reaches memory through a page table, so many instances can
+ * share the pages of one read-only image and copy a page only when they
+ * first store into it.
+ */
+#define DDP24_PAGE_SHIFT    9
+#define DDP24_PAGE_SIZE     (1 << DDP24_PAGE_SHIFT)     /* Words per page */
+#define DDP24_PAGE_MASK     (DDP24_PAGE_SIZE - 1)
+#define DDP24_PAGES         (MEM_SIZE / DDP24_PAGE_SIZE)
+
+typedef struct {
+    word_t word[DDP24_PAGE_SIZE];
+    ddp24_decoded_t decoded[DDP24_PAGE_SIZE];
+    uint64_t hash;      /* XOR of the words' hashes, kept up to date by every store */
+} ddp24_page_t;
+
+/* Longest XEC chain (XEC of an XEC of ...) before the CPU gives up and
+ * halts; the real machine would hang on an XEC of itself */
+#define DDP24_XEC_LIMIT     64
+
+/* Shared, immutable, reference-counted memory image */
+typedef struct ddp24_image ddp24_image_t;
+
 /* CPU State */
 typedef struct {
     word_t A;           /* Accumulator A */
     word_t B;           /* Accumulator B */
     word_t X[4];        /* Index registers (X0 is always 0) */
     word_t PC;          /* Program Counter */
-    word_t memory[MEM_SIZE];
+    ddp24_page_t *page[DDP24_PAGES];
+    uint64_t page_private;  /* Bit n set: page[n] is this CPU's own copy */
+    ddp24_image_t *image;   /* Image the shared pages belong to, or NULL */
 
     /* Status flags */
     bool overflow;
     bool halted;
     bool interrupt_enabled;
 
+    /* Interrupt lines (ddp24_io.h) */
+    bool interrupt_enable_next; /* ITC enable: takes effect after the next instruction */
+    uint32_t irq_pending;       /* Raised, not yet delivered */
+    uint32_t irq_mask;          /* Bit n set: line n held off */
+    atomic_uint irq_posted;     /* Raised from other threads, not yet taken in */
+
     /* Cycle counter for timing */
     uint64_t cycles;
+
+    /* Run control: engines stop once cycles reaches run_limit.
+     * ddp24_request_stop zeroes it so the run ends after the current
+     * instruction, as ddp24_post_interrupt does from other threads. */
+    _Atomic uint64_t run_limit;
+    ddp24_stop_t stop;      /* Pending stop request */
+    uint64_t next_event;    /* Earliest queued device event, DDP24_FOREVER if none */
+    struct ddp24_io *io;    /* Devices and event queue (ddp24_io.h), NULL if unused */
+
+    const struct ddp24_timing *timing;  /* Cycle costs (ddp24_timing.h), fixed at init */
+    int xec_limit;          /* DDP24_XEC_LIMIT unless changed */
+    ddp24_fault_t fault;    /* Set when an engine halts the CPU itself */
+    word_t fault_pc;        /* Instruction it could not run */
+
+    /* Breakpoints and watchpoints (ddp24_debug.h): bit n set while page n has one */
+    uint64_t break_pages;
+    uint64_t watch_read_pages;
+    uint64_t watch_write_pages;
+    struct ddp24_debug *debug;  /* NULL until one is set */
+
+    ddp24_engine_t engine;  /* Used by ddp24_run */
+    struct ddp24_jit *jit;  /* Compiled blocks, DDP24_ENGINE_JIT only */
+    struct ddp24_profile *profile;  /* See ddp24_profile.h */
+    struct ddp24_trace *trace;      /* See ddp24_trace.h */
+    struct ddp24_calls *calls;      /* See ddp24_calls.h */
+    struct ddp24_hle *hle;          /* See ddp24_hle.h */
+    uint64_t hle_checked[4];        /* Bit n: hook n's code has matched on this CPU */
+    uint64_t hle_pages;             /* Bit n set: page n holds code of a matched hook */
 } ddp24_t;
 
 /* Function prototypes */
 void ddp24_init(ddp24_t *cpu);
 void ddp24_reset(ddp24_t *cpu);
+void ddp24_release(ddp24_t *cpu);
 int ddp24_step(ddp24_t *cpu);
 int ddp24_run(ddp24_t *cpu, int max_cycles);
+ddp24_stop_t ddp24_run_for(ddp24_t *cpu, uint64_t budget);
+ddp24_stop_t ddp24_run_until(ddp24_t *cpu, uint64_t deadline);
+void ddp24_request_stop(ddp24_t *cpu, ddp24_stop_t reason);
+const char *ddp24_stop_name(ddp24_stop_t reason);
+const char *ddp24_fault_name(ddp24_fault_t fault);
+bool ddp24_set_engine(ddp24_t *cpu, ddp24_engine_t engine);
+bool ddp24_engine_available(ddp24_engine_t engine);
+const char *ddp24_engine_name(ddp24_engine_t engine);
 void ddp24_dump(ddp24_t *cpu);
 
 /* Memory operations */
-word_t ddp24_read(ddp24_t *cpu, word_t addr);
+word_t ddp24_read(const ddp24_t *cpu, word_t addr);
 void ddp24_write(ddp24_t *cpu, word_t addr, word_t value);
+word_t ddp24_write_block(ddp24_t *cpu, word_t addr, const word_t *src, word_t count);
+void ddp24_fill_block(ddp24_t *cpu, word_t addr, word_t value, word_t count);
+void ddp24_copy_block(ddp24_t *cpu, word_t dst, word_t src, word_t count);
+
+/* Hash of registers, flags, interrupt state and memory, but not the
+ * cycle count. Memory is hashed a word at a time as it is stored, so
+ * this costs a look at each page's hash rather than a scan. */
+uint64_t ddp24_state_hash(const ddp24_t *cpu);
+
+/* Program images: 3 bytes per word, big-endian, the native format
+ * written by ddp24_cache_image (32-bit host-order words behind a header),
+ * or a symbolic image from the assembler (ddp24_asm.h), which also sets
+ * PC to its entry point.
+ * ddp24_load prints what it did; the others are silent and return the
+ * number of words loaded, or -1 with errno set. Loads stop at the top of
+ * memory. */
 int ddp24_load(ddp24_t *cpu, const char *filename);
+int ddp24_load_image(ddp24_t *cpu, const char *filename, word_t base);
+int ddp24_load_buffer(ddp24_t *cpu, const uint8_t *data, size_t size, word_t base);
+int ddp24_cache_image(const char *image, const char *cache);
+void ddp24_invalidate(ddp24_t *cpu, word_t addr, word_t count);
+void ddp24_predecode(word_t instr, ddp24_decoded_t *d);
+int ddp24_private_pages(const ddp24_t *cpu);
+
+/* Shared images: ddp24_init_image starts a CPU on the image's pages,
+ * which it then copies on write. The image lives until its last CPU is
+ * released and its creator calls ddp24_image_release. */
+ddp24_image_t *ddp24_image_create(const ddp24_t *cpu);
+ddp24_image_t *ddp24_image_load(const char *filename);
+ddp24_image_t *ddp24_image_retain(ddp24_image_t *image);
+void ddp24_image_release(ddp24_image_t *image);
+void ddp24_init_image(ddp24_t *cpu, ddp24_image_t *image);
 
 /* Instruction decode helpers */
 static inline uint8_t decode_opcode(word_t instr) {
@@ -141,4 +296,65 @@ static inline word_t decode_address(word_t instr) {
     return instr & ADDR_MASK;
 }
 
+/* Sign-magnitude arithmetic. Guidance data mixes signs, so these work
+ * the sign through masks rather than branching on it. Both zeros read
+ * as 0. A zero result is +0 except from from_signed, when a negative
+ * magnitude wraps to 0, and from sm_multiply, whose halves both carry
+ * the product's sign. */
+
+/* -1 if w is negative, else 0 */
+static inline uint32_t sign_mask(word_t w) {
+    return 0u - ((w >> 23) & 1);
+}
+
+static inline int32_t to_signed(word_t w) {
+    uint32_t s = sign_mask(w);
+    return (int32_t)(((w & MAGNITUDE_MASK) ^ s) - s);
+}
+
+/* Magnitude wraps at 23 bits, as the adder does */
+static inline word_t from_signed(int32_t v) {
+    uint32_t s = (uint32_t)(v >> 31);
+    return ((((uint32_t)v ^ s) - s) & MAGNITUDE_MASK) | (s & SIGN_BIT);
+}
+
+/* Does v, a sum of two words, overflow 23 bits of magnitude? */
+static inline bool sm_overflow(int32_t v) {
+    uint32_t s = (uint32_t)(v >> 31);
+    return ((uint32_t)v ^ s) - s > MAGNITUDE_MASK;
+}
+
+/* ADD's sum; subtract by flipping y's sign bit */
+static inline int32_t sm_sum(word_t a, word_t y) {
+    return to_signed(a) + to_signed(y);
+}
+
+/* SKG's test */
+static inline bool sm_greater(word_t a, word_t y) {
+    return to_signed(a) > to_signed(y);
+}
+
+/* MPY: the 46-bit product of b and y into hi:lo, both with its sign */
+static inline void sm_multiply(word_t b, word_t y, word_t *hi, word_t *lo) {
+    uint64_t product = (uint64_t)(b & MAGNITUDE_MASK) * (y & MAGNITUDE_MASK);
+    word_t sign = (word_t)(0u - (product != 0)) & (b ^ y) & SIGN_BIT;
+    *hi = sign | (word_t)((product >> 23) & MAGNITUDE_MASK);
+    *lo = sign | (word_t)(product & MAGNITUDE_MASK);
+}
+
+/* DIV: the 46-bit a:b by y, the quotient signed algebraically and the
+ * remainder like a. False, with nothing stored, if |a| >= |y|. */
+static inline bool sm_divide(word_t a, word_t b, word_t y, word_t *quotient, word_t *remainder) {
+    uint32_t divisor = y & MAGNITUDE_MASK;
+    if ((a & MAGNITUDE_MASK) >= divisor) {
+        return false;   /* Improper divide, rare enough to branch on */
+    }
+    uint64_t dividend = (uint64_t)(a & MAGNITUDE_MASK) << 23 | (b & MAGNITUDE_MASK);
+    word_t q = (word_t)(dividend / divisor);
+    word_t r = (word_t)(dividend % divisor);
+    *quotient = q | ((word_t)(0u - (q != 0)) & (a ^ y) & SIGN_BIT);
+    *remainder = r | ((word_t)(0u - (r != 0)) & a & SIGN_BIT);
+    return true;
+}
+
 #endif /* DDP24_H */
@@ -0,0 +1,95 @@
+/*
+ * DDP-24 Emulator - Assembler and Symbolic Images
+ * Viking Mars Lander Guidance Computer
+ *
+ * Source is one statement per line:
+ *     [label:] [op[*] [address][,index]] [; comment]
+ *     [label:] .directive [operands]
+ *     name = expression
+ * Mnemonics are those of opcode_t, in either case; a * after one sets
+ * the indirect bit, and every operand is optional. Numbers follow C:
+ * 0100 is octal, 0x40 hex, 64 decimal. Expressions add and subtract
+ * numbers, names and "." (the current address).
+ *
+ *     .org addr       continue assembling at addr
+ *     .code           what follows is instructions (the default)
+ *     .data           ... data
+ *     .const          ... data the program never stores to
+ *     .word v, ...    words; negative values in sign-magnitude
+ *     .space n        n zero words
+ *     .entry addr     where to start
+ *
+ * A program keeps the section map, the labels and the entry point next
+ * to its words, and saves them in a symbolic image, little-endian:
+ *     magic[8] version entry sections symbols:u32
+ *     sections: start count flags:u32, words:u32[count]
+ *     symbols: addr:u32 length:u8 name[length]
+ * ddp24_load_buffer and everything built on it take symbolic images as
+ * well as raw ones, loading the words at the addresses they were
+ * assembled for.
+ */
+
+#ifndef DDP24_ASM_H
+#define DDP24_ASM_H
+
+#include <stddef.h>
+#include "ddp24.h"
+
+#define DDP24_SECTION_CODE  0x1
+#define DDP24_SECTION_DATA  0x2
+#define DDP24_SECTION_CONST 0x4     /* With DATA: never stored to */
+
+#define DDP24_SYMBOL_MAX    31      /* Longest name */
+
+typedef struct {
+    word_t start;
+    word_t count;
+    uint32_t flags;         /* DDP24_SECTION_* */
+} ddp24_section_t;
+
+typedef struct {
+    char name[DDP24_SYMBOL_MAX + 1];
+    word_t addr;
+} ddp24_symbol_t;
+
+typedef struct ddp24_program {
+    word_t entry;
+    int nsections;
+    int nsymbols;
+    ddp24_section_t *section;   /* By address */
+    ddp24_symbol_t *symbol;     /* Labels, by address */
+    word_t word[MEM_SIZE];      /* Section contents, at their addresses */
+} ddp24_program_t;
+
+typedef struct {
+    int line;               /* 0 if the source could not be read */
+    char message[128];
+} ddp24_asm_error_t;
+
+/* NULL on error, described in *err (may be NULL) */
+ddp24_program_t *ddp24_assemble(const char *source, ddp24_asm_error_t *err);
+ddp24_program_t *ddp24_assemble_file(const char *filename, ddp24_asm_error_t *err);
+void ddp24_program_free(ddp24_program_t *program);
+
+/* Store the sections in cpu's memory and point PC at the entry; returns
+ * the words stored */
+int ddp24_program_install(ddp24_t *cpu, const ddp24_program_t *program);
+
+/* Shared image of the program, predecoding only its code sections */
+ddp24_image_t *ddp24_program_image(const ddp24_program_t *program);
+
+/* Symbolic images. Save returns 0, or -1 with errno set; the readers
+ * return NULL with errno set (EINVAL: not a symbolic image). */
+int ddp24_program_save(const ddp24_program_t *program, const char *filename);
+ddp24_program_t *ddp24_program_read(const uint8_t *data, size_t size);
+ddp24_program_t *ddp24_program_load(const char *filename);
+bool ddp24_is_program(const uint8_t *data, size_t size);
+
+/* Address of a label; false if there is none by that name */
+bool ddp24_program_lookup(const ddp24_program_t *program, const char *name, word_t *addr);
+
+/* "label" or "label+n" for the nearest label at or before addr in the
+ * same section, else the octal address; program may be NULL */
+const char *ddp24_program_name(const ddp24_program_t *program, word_t addr, char *buf, size_t size);
+
+#endif /* DDP24_ASM_H */
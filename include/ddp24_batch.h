@@ -0,0 +1,59 @@
+/*
+ * DDP-24 Emulator - Batch Runner
+ * Viking Mars Lander Guidance Computer
+ *
+ * Runs many independent simulations on a pool of threads. Each job gets
+ * its own ddp24_t on the shared image of its program; idle threads steal
+ * queued jobs from busy ones, so a few long jobs do not hold up the rest.
+ */
+
+#ifndef DDP24_BATCH_H
+#define DDP24_BATCH_H
+
+#include <stdio.h>
+#include "ddp24_embed.h"
+
+/* One memory word to patch before the job starts */
+typedef struct {
+    word_t addr;
+    word_t value;
+} ddp24_poke_t;
+
+typedef struct {
+    /* Input */
+    char *program;              /* Image file, or NULL for an image made in memory */
+    ddp24_image_t *image;       /* Shared by every job naming the same program */
+    word_t A, B, X[4], PC;      /* Initial registers (X[0] stays 0) */
+    ddp24_poke_t *pokes;
+    int npokes;
+    uint64_t budget;            /* Cycles to run for, 0 = until HLT */
+
+    /* Result */
+    struct {
+        word_t A, B, X[4], PC;
+        ddp24_stop_t stop;
+        bool overflow;
+        uint64_t cycles;
+        int pages;              /* Pages the job copied from the image */
+        int worker;             /* Thread that ran it */
+    } result;
+} ddp24_job_t;
+
+/* Read a job list. Each line is
+ *     program.bin budget [A=o] [B=o] [X1=o] [X2=o] [X3=o] [PC=o] [@addr=value]...
+ * with registers, addresses and values in octal and the budget in decimal
+ * cycles. Blank lines and lines starting with # are skipped.
+ * Returns the number of jobs, or -1 with *err set and *line the line it
+ * stopped on, 0 if the file could not be opened (either may be NULL).
+ * DDP24_ERR_IO leaves errno saying why. Prints nothing. */
+int ddp24_batch_parse(const char *filename, ddp24_job_t **jobs, ddp24_error_t *err, int *line);
+
+/* Run every job on threads workers (0 = one per online CPU) */
+void ddp24_batch_run(ddp24_job_t *jobs, int count, int threads, ddp24_engine_t engine);
+
+/* One result line per job, in job order */
+void ddp24_batch_print(FILE *out, const ddp24_job_t *jobs, int count);
+
+void ddp24_batch_free(ddp24_job_t *jobs, int count);
+
+#endif /* DDP24_BATCH_H */
@@ -0,0 +1,20 @@
+/*
+ * DDP-24 Emulator - Microbenchmarks
+ * Viking Mars Lander Guidance Computer
+ *
+ * Fixed synthetic kernels timed on one engine, for catching throughput
+ * regressions between versions.
+ */
+
+#ifndef DDP24_BENCH_H
+#define DDP24_BENCH_H
+
+#include <stdio.h>
+#include "ddp24.h"
+
+#define DDP24_ORIGINAL_IPS  100000.0  /* Instructions/second on the real machine */
+
+/* Run every kernel on engine and print a table to out */
+void ddp24_bench(ddp24_engine_t engine, FILE *out);
+
+#endif /* DDP24_BENCH_H */
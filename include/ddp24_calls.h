@@ -0,0 +1,61 @@
+/*
+ * DDP-24 Emulator - Subroutine Costs
+ * Viking Mars Lander Guidance Computer
+ *
+ * A shadow call stack of the guest's subroutines. JSL stores the
+ * return address in the routine's first word and enters the word after
+ * it; the routine returns with an indirect JMP through that link word.
+ * Each JSL pushes a frame and each JMP* through the link word of a
+ * frame on the stack pops it, along with any frames above it that
+ * never returned. Interrupt delivery counts as a call to the line's
+ * vector word, which the handler's JMP* returns through.
+ *
+ * Routines are keyed by their link word. Inclusive cycles run from the
+ * call to the return, counted once for recursive routines. Exclusive
+ * cycles leave out the callees' time. Works on every engine; the cost
+ * is a push or pop per call and a test per JSL and JMP*. Unlike the
+ * profiler's call tree (ddp24_profile.h) it needs no special build.
+ */
+
+#ifndef DDP24_CALLS_H
+#define DDP24_CALLS_H
+
+#include <stdio.h>
+#include "ddp24.h"
+
+#define DDP24_CALLS_DEPTH   256     /* Deeper calls, and their returns, go uncounted */
+
+typedef struct {
+    word_t entry;           /* Link word: the JSL target or an interrupt vector */
+    uint64_t calls;
+    uint64_t inclusive;     /* Callees included */
+    uint64_t exclusive;     /* Callees excluded */
+} ddp24_routine_t;
+
+typedef struct ddp24_calls ddp24_calls_t;
+struct ddp24_program;
+
+/* NULL if out of memory */
+ddp24_calls_t *ddp24_calls_create(void);
+void ddp24_calls_free(ddp24_calls_t *calls);
+
+/* Start following cpu's calls in calls. NULL detaches, closing the
+ * frames still open at cpu->cycles so the totals add up. */
+void ddp24_calls_attach(ddp24_t *cpu, ddp24_calls_t *calls);
+
+/* Totals for the routine with link word entry; false if never called */
+bool ddp24_calls_routine(const ddp24_calls_t *calls, word_t entry, ddp24_routine_t *out);
+
+/* Up to max routines, most inclusive cycles first; returns how many */
+int ddp24_calls_top(const ddp24_calls_t *calls, ddp24_routine_t *out, int max);
+
+/* Frames open now */
+int ddp24_calls_depth(const ddp24_calls_t *calls);
+
+/* Label the report's routines from program (NULL for none) */
+void ddp24_calls_names(ddp24_calls_t *calls, const struct ddp24_program *program);
+
+/* Table of the top routines */
+void ddp24_calls_report(const ddp24_calls_t *calls, FILE *out, int top);
+
+#endif /* DDP24_CALLS_H */
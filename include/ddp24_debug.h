@@ -0,0 +1,51 @@
+/*
+ * DDP-24 Emulator - Breakpoints and Watchpoints
+ * Viking Mars Lander Guidance Computer
+ *
+ * While any are set, ddp24_run_until runs the CPU a step at a time
+ * through a debug loop whatever the engine; with none set the engines
+ * never look at them. Each kind keeps a bit per page in ddp24_t, so a
+ * watched access costs ddp24_step one test of a page bit before the
+ * exact per-word lookup.
+ *
+ * A breakpoint stops a run before the instruction at its address; a run
+ * that starts there executes it first. A watchpoint stops the run after
+ * the instruction that reads or writes a watched word, the write having
+ * happened. Watchpoints see operand reads and writes and block moves,
+ * not instruction fetches or indirect address words. The fleet engine
+ * ignores both.
+ */
+
+#ifndef DDP24_DEBUG_H
+#define DDP24_DEBUG_H
+
+#include "ddp24.h"
+
+#define DDP24_WATCH_READ    01
+#define DDP24_WATCH_WRITE   02
+
+typedef struct {
+    word_t pc;          /* Instruction that made the access */
+    word_t addr;        /* First watched word it touched */
+    int kind;           /* DDP24_WATCH_READ or DDP24_WATCH_WRITE */
+    uint64_t count;     /* Hits so far, so a caller can tell a new one */
+} ddp24_watch_hit_t;
+
+/* False if out of memory */
+bool ddp24_set_breakpoint(ddp24_t *cpu, word_t addr);
+void ddp24_clear_breakpoint(ddp24_t *cpu, word_t addr);
+bool ddp24_breakpoint_at(const ddp24_t *cpu, word_t addr);
+
+/* Watch count words from first (wrapping at the top of memory) for
+ * kind, a mask of DDP24_WATCH_*. Clearing takes the same arguments.
+ * False if out of memory. */
+bool ddp24_set_watchpoint(ddp24_t *cpu, word_t first, word_t count, int kind);
+void ddp24_clear_watchpoint(ddp24_t *cpu, word_t first, word_t count, int kind);
+
+/* Drop every breakpoint and watchpoint */
+void ddp24_clear_debug(ddp24_t *cpu);
+
+/* Most recent watchpoint hit; false if there has been none */
+bool ddp24_last_watch_hit(const ddp24_t *cpu, ddp24_watch_hit_t *hit);
+
+#endif /* DDP24_DEBUG_H */
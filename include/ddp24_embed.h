@@ -0,0 +1,66 @@
+/*
+ * DDP-24 Emulator - Embedding
+ * Viking Mars Lander Guidance Computer
+ *
+ * libddp24.a and libddp24.so hold everything but the command line
+ * tool. This header is the part of their API meant for hosts that run
+ * many CPUs in one process: instances on the heap, error codes instead
+ * of messages, and a hook for where memory comes from. Devices, the
+ * host's I/O callbacks, are attached as in ddp24_io.h.
+ *
+ * Nothing here or in a run touches stdio. ddp24_load and ddp24_dump are
+ * the command line's conveniences and print; ddp24_load_file and
+ * ddp24_format_state are their silent forms. An engine that meets an
+ * instruction it cannot run, or a store or decode that needs a page the
+ * allocator will not give, halts and records why in cpu->fault.
+ */
+
+#ifndef DDP24_EMBED_H
+#define DDP24_EMBED_H
+
+#include <stddef.h>
+#include "ddp24.h"
+
+#define DDP24_API_VERSION   1   /* Bumped when this header changes incompatibly */
+
+typedef enum {
+    DDP24_OK = 0,
+    DDP24_ERR_NOMEM,            /* The allocator failed */
+    DDP24_ERR_IO,               /* A file could not be opened or read; errno says why */
+    DDP24_ERR_FORMAT,           /* Not a DDP-24 image */
+    DDP24_ERR_ENGINE,           /* Engine not built in */
+} ddp24_error_t;
+
+const char *ddp24_error_name(ddp24_error_t err);
+
+/* Version of this header the library was built from */
+int ddp24_api_version(void);
+
+/* realloc-like: ptr NULL allocates, size 0 frees and returns NULL */
+typedef void *(*ddp24_alloc_fn)(void *ctx, void *ptr, size_t size);
+
+/* Every CPU, page, image, snapshot, device table, recording, profile
+ * and trace comes from fn from now on; NULL puts back the C library's.
+ * Call before creating anything, as frees go to the allocator current
+ * at the time. Fleets, batch job lists and a loader's transient file
+ * buffers still use the C library. */
+void ddp24_set_allocator(ddp24_alloc_fn fn, void *ctx);
+
+/* New CPU, initialised, on engine. NULL with *err set on failure
+ * (err may be NULL). */
+ddp24_t *ddp24_create(ddp24_engine_t engine, ddp24_error_t *err);
+
+/* Same, sharing the pages of image */
+ddp24_t *ddp24_create_image(ddp24_image_t *image, ddp24_engine_t engine, ddp24_error_t *err);
+
+/* Release and free a created CPU; NULL is ignored */
+void ddp24_destroy(ddp24_t *cpu);
+
+/* ddp24_load_image with an error code; *words (may be NULL) gets the
+ * words loaded */
+ddp24_error_t ddp24_load_file(ddp24_t *cpu, const char *filename, word_t base, int *words);
+
+/* ddp24_dump into buf, truncated to size; returns the length it needed */
+int ddp24_format_state(const ddp24_t *cpu, char *buf, size_t size);
+
+#endif /* DDP24_EMBED_H */
@@ -0,0 +1,61 @@
+/*
+ * DDP-24 Emulator - CPU Fleet
+ * Viking Mars Lander Guidance Computer
+ *
+ * Many DDP-24s running the same program in lockstep, stored as
+ * structure-of-arrays so lanes that share a PC execute together with
+ * SIMD kernels. Lanes that branch apart are regrouped by PC and brought
+ * back together by always advancing the lowest PC first.
+ */
+
+#ifndef DDP24_FLEET_H
+#define DDP24_FLEET_H
+
+#include "ddp24.h"
+
+#define DDP24_FLEET_ALIGN   8   /* Lanes per SIMD group (256 bits of words) */
+
+typedef struct {
+    int lanes;              /* CPUs in the fleet */
+    int stride;             /* lanes rounded up to DDP24_FLEET_ALIGN */
+    const struct ddp24_timing *timing;  /* Cycle costs, the profile in force at creation */
+
+    /* Per-lane state, one entry per lane */
+    word_t *A;
+    word_t *B;
+    word_t *X[4];           /* X[0] is an all-zero row */
+    word_t *PC;
+    uint32_t *overflow;     /* 0 or 1 */
+    uint32_t *halted;       /* 0 or 1 */
+    uint64_t *cycles;
+
+    /* Memory, lane-interleaved: word addr of lane i is memory[addr * stride + i] */
+    word_t *memory;
+
+    /* Scratch for ddp24_fleet_run */
+    uint32_t *mask;
+    word_t *ea;
+    word_t *operand;
+    uint64_t *limit;
+    uint32_t *live;
+} ddp24_fleet_t;
+
+ddp24_fleet_t *ddp24_fleet_create(int lanes);
+void ddp24_fleet_destroy(ddp24_fleet_t *fleet);
+
+/* Copy registers and memory between a lane and an ordinary CPU */
+void ddp24_fleet_set(ddp24_fleet_t *fleet, int lane, const ddp24_t *cpu);
+void ddp24_fleet_get(const ddp24_fleet_t *fleet, int lane, ddp24_t *cpu);
+void ddp24_fleet_broadcast(ddp24_fleet_t *fleet, const ddp24_t *cpu);
+
+word_t ddp24_fleet_read(const ddp24_fleet_t *fleet, int lane, word_t addr);
+void ddp24_fleet_write(ddp24_fleet_t *fleet, int lane, word_t addr, word_t value);
+
+/* Run every lane until it halts or spends max_cycles (0 = no limit).
+ * Returns the number of lanes still running. */
+int ddp24_fleet_run(ddp24_fleet_t *fleet, uint64_t max_cycles);
+
+/* Name of the SIMD kernel set in use ("avx2", "neon" or "scalar") */
+const char *ddp24_fleet_kernels(void);
+
+#endif /* DDP24_FLEET_H */
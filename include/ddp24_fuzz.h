@@ -0,0 +1,83 @@
+/*
+ * DDP-24 Emulator - Differential Fuzzing
+ * Viking Mars Lander Guidance Computer
+ *
+ * Random programs from random starting states, run by ddp24_step one
+ * instruction at a time (the reference) and by each candidate: the run
+ * loop of every engine, idle-loop skipping included, and a fleet with
+ * the case in all the lanes of a SIMD group. A candidate must end with
+ * the reference's registers, flags, fault, cycles and state hash; the
+ * fleet has no devices or interrupts, so it is held to the registers,
+ * flags, cycles and memory.
+ *
+ * Cases are numbered from a seed, so any one can be generated again on
+ * its own. A failing case is cut down before it is reported: the fewest
+ * cycles and words that still show the difference, the other words
+ * turned into NOPs and the registers cleared where that changes nothing.
+ */
+
+#ifndef DDP24_FUZZ_H
+#define DDP24_FUZZ_H
+
+#include <stdio.h>
+#include "ddp24.h"
+
+#define DDP24_FUZZ_WORDS    256     /* Longest program */
+
+/* Candidates */
+#define DDP24_FUZZ_SWITCH   (1u << DDP24_ENGINE_SWITCH)
+#define DDP24_FUZZ_THREADED (1u << DDP24_ENGINE_THREADED)
+#define DDP24_FUZZ_JIT      (1u << DDP24_ENGINE_JIT)
+#define DDP24_FUZZ_FLEET    0x100u
+#define DDP24_FUZZ_ALL      (DDP24_FUZZ_SWITCH | DDP24_FUZZ_THREADED | DDP24_FUZZ_JIT | DDP24_FUZZ_FLEET)
+
+typedef struct {
+    uint64_t seed;
+    word_t A, B, X[4], PC;  /* X[0] is always 0 */
+    bool overflow;
+    word_t base;            /* The program's words go here, the rest of memory is 0 */
+    int length;
+    word_t word[DDP24_FUZZ_WORDS];
+    uint64_t budget;        /* Cycles to run for */
+} ddp24_fuzz_case_t;
+
+typedef struct {
+    uint64_t seed;          /* Of the first case; the others follow on */
+    uint64_t cases;
+    int threads;            /* 0 = one per online CPU */
+    int length;             /* Words per program, 0 = 64 */
+    uint64_t budget;        /* Cycles per case, 0 = 4000 */
+    unsigned candidates;    /* DDP24_FUZZ_*, 0 = all; those not built in are left out */
+    int max_failures;       /* Stop after this many, 0 = 1 */
+} ddp24_fuzz_config_t;
+
+typedef struct {
+    ddp24_fuzz_case_t c;
+    unsigned candidate;     /* The one DDP24_FUZZ_* that differed */
+    char field[16];         /* First difference: "PC", "cycles", "@01234" (memory)... */
+    uint64_t expected, got;
+} ddp24_fuzz_failure_t;
+
+/* Case number seed of the kind config asks for */
+void ddp24_fuzz_generate(const ddp24_fuzz_config_t *config, uint64_t seed, ddp24_fuzz_case_t *c);
+
+/* Run c on the reference and the candidates, in bit order. Returns the
+ * first candidate that differs, described in *failure (may be NULL), or
+ * 0 if they all agree. */
+unsigned ddp24_fuzz_check(const ddp24_fuzz_case_t *c, unsigned candidates, ddp24_fuzz_failure_t *failure);
+
+/* Cut failure->c down as far as it still fails the same candidate */
+void ddp24_fuzz_minimise(ddp24_fuzz_failure_t *failure);
+
+/* Run config->cases cases on config->threads threads. Fills failure[]
+ * (room for config->max_failures) with the minimised failures by seed
+ * and returns how many; *ran (may be NULL) gets the cases run. */
+int ddp24_fuzz_run(const ddp24_fuzz_config_t *config, ddp24_fuzz_failure_t *failure, uint64_t *ran);
+
+/* The failure as a comment and assembler source (ddp24_asm.h) */
+void ddp24_fuzz_print(FILE *out, const ddp24_fuzz_failure_t *failure);
+
+/* "threaded", "fleet"... */
+const char *ddp24_fuzz_candidate_name(unsigned candidate);
+
+#endif /* DDP24_FUZZ_H */
@@ -0,0 +1,55 @@
+/*
+ * DDP-24 Emulator - High-Level Emulation
+ * Viking Mars Lander Guidance Computer
+ *
+ * Native stand-ins for guest subroutines. A hook names a routine by its
+ * link word (the JSL target) and a checksum of its code, so it only
+ * fires for the exact routine it was written against: another image,
+ * or code patched since, runs as guest code. On a JSL to a hooked
+ * routine the hook computes the routine's results, bit for bit in
+ * sign-magnitude, and returns the cycles the guest code would have
+ * taken; the CPU then continues at the return address as if the
+ * routine's JMP* had just run.
+ *
+ * A hook may decline (return a negative count), for instance for an
+ * argument it does not handle, and the guest code runs instead. The
+ * checksum is taken on a CPU's first call, and again only after a store
+ * or ddp24_invalidate touches the routine on that CPU. Hooks
+ * fire from the switch and threaded engines, and from the JIT, which
+ * runs JSL in the interpreter; fleet lanes always run guest code.
+ */
+
+#ifndef DDP24_HLE_H
+#define DDP24_HLE_H
+
+#include "ddp24.h"
+
+#define DDP24_HLE_MAX   255     /* Hooks per table */
+
+/* Results into cpu's registers and memory; cycles spent from the JSL
+ * retiring to the return retiring, or negative to run the guest code.
+ * cpu->PC is the routine's first instruction, and the link word holds
+ * the return address. */
+typedef int (*ddp24_hle_fn)(ddp24_t *cpu, word_t link, void *ctx);
+
+typedef struct ddp24_hle ddp24_hle_t;
+
+/* NULL if out of memory */
+ddp24_hle_t *ddp24_hle_create(void);
+void ddp24_hle_free(ddp24_hle_t *hle);
+
+/* Hook the routine with link word link whose length words of code after
+ * the link word have the given checksum. False if the table is full. */
+bool ddp24_hle_add(ddp24_hle_t *hle, word_t link, int length, uint64_t checksum,
+                   ddp24_hle_fn fn, void *ctx);
+
+/* Checksum of the length words at first, as ddp24_hle_add expects */
+uint64_t ddp24_hle_checksum(const ddp24_t *cpu, word_t first, int length);
+
+/* Use hle's hooks on cpu; NULL stops. A table can serve many CPUs. */
+void ddp24_hle_attach(ddp24_t *cpu, ddp24_hle_t *hle);
+
+/* Calls a hook answered, across every CPU using the table */
+uint64_t ddp24_hle_hits(const ddp24_hle_t *hle);
+
+#endif /* DDP24_HLE_H */
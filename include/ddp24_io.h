@@ -0,0 +1,81 @@
+/*
+ * DDP-24 Emulator - Devices and Events
+ * Viking Mars Lander Guidance Computer
+ *
+ * I/O instructions name a channel in the low six bits of their
+ * effective address and a function code in the bits above it. Each
+ * channel can have one device; a device supplies the callbacks it needs
+ * and leaves the rest NULL.
+ *
+ * Device timing goes through a queue of events keyed on cpu->cycles.
+ * Runs stop at the earliest event, so nothing is polled per instruction
+ * and events fire exactly at the first instruction boundary at or after
+ * their time. A device's sense lines and input must only change in its
+ * callbacks, in events, or from the host between runs. Idle loops that
+ * poll them may otherwise be skipped past the change.
+ *
+ * Interrupts: line n (0 is most urgent) is delivered at the first
+ * instruction boundary where it is pending, unmasked and interrupts are
+ * enabled. Delivery stores PC in the line's vector word, continues at
+ * the word after it and disables interrupts; the handler returns with
+ * ITC enable then JMP* vector, and the enable takes effect after the
+ * JMP*. ITC's address bits select what it does (DDP24_ITC_*); MASK loads
+ * the mask from A, a set bit holding its line off. Lines are edge
+ * triggered and a halted CPU stays halted.
+ */
+
+#ifndef DDP24_IO_H
+#define DDP24_IO_H
+
+#include "ddp24.h"
+
+#define DDP24_CHANNELS      64
+#define DDP24_IO_CHANNEL(ea)    ((ea) & 077)
+#define DDP24_IO_FUNCTION(ea)   (((ea) >> 6) & 0777)
+
+#define DDP24_IRQ_LINES     16
+#define DDP24_IRQ_VECTOR(line)  (040 + 2 * (line))
+#define DDP24_IRQ_CYCLES    10      /* Delivery on the DDP-24; the profile in force */
+                                    /* has the cost charged (ddp24_timing.h) */
+
+#define DDP24_ITC_ENABLE    01
+#define DDP24_ITC_DISABLE   02
+#define DDP24_ITC_MASK      04
+
+/* Callbacks run during the instruction, with cpu->cycles at its start */
+typedef struct {
+    const char *name;
+    void *ctx;
+    void (*control)(ddp24_t *cpu, void *ctx, int function);                 /* OCP */
+    word_t (*input)(ddp24_t *cpu, void *ctx, int function);                 /* ITA */
+    void (*output)(ddp24_t *cpu, void *ctx, int function, word_t value);    /* OTA */
+    bool (*sense)(ddp24_t *cpu, void *ctx, int function);                   /* SKS */
+} ddp24_device_t;
+
+typedef void (*ddp24_event_fn)(ddp24_t *cpu, void *arg);
+
+/* Put dev (copied) on channel; NULL removes it. False on a bad channel
+ * or out of memory. Empty channels ignore OCP and OTA, read as zero and
+ * never sense. */
+bool ddp24_attach_device(ddp24_t *cpu, int channel, const ddp24_device_t *dev);
+
+/* Call fn at the first instruction boundary with cycles >= when. Events
+ * due at the same time run in the order they were scheduled. Events
+ * may schedule further events. False if out of memory. */
+bool ddp24_schedule(ddp24_t *cpu, uint64_t when, ddp24_event_fn fn, void *arg);
+
+/* Drop every pending fn(arg); returns how many there were */
+int ddp24_cancel(ddp24_t *cpu, ddp24_event_fn fn, void *arg);
+
+/* Time of the earliest pending event, DDP24_FOREVER if none */
+uint64_t ddp24_next_event(const ddp24_t *cpu);
+
+/* Make line pending. CPU thread only: from callbacks, events, or
+ * between runs. False on a bad line. */
+bool ddp24_raise_interrupt(ddp24_t *cpu, int line);
+
+/* Same, from any thread. Taken in at the next instruction boundary of a
+ * run in progress, or at the start of the next run. */
+bool ddp24_post_interrupt(ddp24_t *cpu, int line);
+
+#endif /* DDP24_IO_H */
@@ -0,0 +1,42 @@
+/*
+ * DDP-24 Emulator - Real-Time Pacing
+ * Viking Mars Lander Guidance Computer
+ *
+ * Holds emulated time to wall time, one cycle being 0.5 usec (MPY's
+ * 28 cycles are the manual's 14 usec). The CPU runs a burst of cycles
+ * at full speed, then waits for the wall clock to catch up. The
+ * schedule is anchored at the start of the call rather than at each
+ * burst, so a burst that overruns is made up by shorter waits later
+ * instead of adding up as drift.
+ */
+
+#ifndef DDP24_PACE_H
+#define DDP24_PACE_H
+
+#include <stdio.h>
+#include "ddp24.h"
+
+#define DDP24_NS_PER_CYCLE  500
+#define DDP24_PACE_BURST    500         /* Cycles per burst: 250 usec */
+#define DDP24_PACE_MAX_LAG  100000000   /* Nanoseconds behind before giving up catching up */
+
+typedef struct {
+    uint64_t bursts;
+    uint64_t misses;        /* Bursts that ended after their wall deadline */
+    uint64_t resyncs;       /* Times lag passed DDP24_PACE_MAX_LAG and the schedule restarted */
+    uint64_t worst_late_ns;
+    uint64_t total_late_ns;
+    uint64_t waited_ns;     /* Spent sleeping or spinning */
+} ddp24_pace_stats_t;
+
+/* Run until deadline (DDP24_FOREVER for no limit) at speed times real
+ * time. Stops the same way ddp24_run_until does; interrupts posted from
+ * other threads wait for the end of the burst. Adds to stats if not
+ * NULL. */
+ddp24_stop_t ddp24_run_paced(ddp24_t *cpu, uint64_t deadline, double speed,
+                             ddp24_pace_stats_t *stats);
+
+/* One-line summary of stats */
+void ddp24_pace_report(const ddp24_pace_stats_t *stats, FILE *out);
+
+#endif /* DDP24_PACE_H */
@@ -0,0 +1,72 @@
+/*
+ * DDP-24 Emulator - Execution Profiler
+ * Viking Mars Lander Guidance Computer
+ *
+ * Counts every instruction ddp24_step retires: per opcode, and hits and
+ * cycles per address. JSL calls and the indirect JMPs that return from
+ * them build a call tree, written out as folded stacks for flamegraph.pl.
+ *
+ * Needs a build with -DDDP24_PROFILE (make PROFILE=1); otherwise attach
+ * fails and ddp24_step carries no profiling code at all. A CPU with a
+ * profile attached always runs on the switch engine.
+ */
+
+#ifndef DDP24_PROFILE_H
+#define DDP24_PROFILE_H
+
+#include <stdio.h>
+#include "ddp24.h"
+
+#ifdef DDP24_PROFILE
+#define DDP24_PROFILE_AVAILABLE 1
+#else
+#define DDP24_PROFILE_AVAILABLE 0
+#endif
+
+#define DDP24_PROFILE_NODES 4096    /* Call tree size limit */
+#define DDP24_PROFILE_DEPTH 64      /* Deeper calls count against the caller */
+
+/* One call tree node: a subroutine entry reached through one path */
+typedef struct {
+    word_t entry;       /* JSL target (the link word) */
+    int parent;         /* -1 for the root */
+    int child;          /* First callee, -1 if none */
+    int sibling;        /* Next callee of the parent, -1 if none */
+    int depth;
+    uint64_t cycles;    /* Spent in this frame, callees excluded */
+} ddp24_profile_node_t;
+
+typedef struct ddp24_profile {
+    uint64_t instructions;
+    uint64_t cycles;
+    uint64_t op_count[64];
+    uint64_t op_cycles[64];
+    uint64_t hits[MEM_SIZE];        /* Instructions retired at each address */
+    uint64_t pc_cycles[MEM_SIZE];   /* Cycles spent at each address */
+
+    ddp24_profile_node_t *node;
+    int nodes;
+    int current;        /* Frame the CPU is executing in */
+    uint64_t dropped;   /* Calls not recorded (tree full or too deep) */
+    uint64_t overflow;  /* Of those, the ones not returned yet */
+    uint32_t deep[MEM_SIZE];        /* Calls not recorded, not returned, per link word */
+
+    const struct ddp24_program *names;  /* Labels for the reports, or NULL */
+} ddp24_profile_t;
+
+/* NULL if out of memory. Clearing keeps names. */
+ddp24_profile_t *ddp24_profile_create(void);
+void ddp24_profile_free(ddp24_profile_t *prof);
+void ddp24_profile_clear(ddp24_profile_t *prof);
+
+/* Start counting into prof (NULL detaches). False if not built in. */
+bool ddp24_profile_attach(ddp24_t *cpu, ddp24_profile_t *prof);
+
+/* Opcode table and the top addresses by cycles */
+void ddp24_profile_report(const ddp24_profile_t *prof, FILE *out, int top);
+
+/* "root;sub_01000;sub_02000 cycles" lines, with labels for the names
+ * where there are; 0 on success, -1 on error */
+int ddp24_profile_write_folded(const ddp24_profile_t *prof, FILE *out);
+
+#endif /* DDP24_PROFILE_H */
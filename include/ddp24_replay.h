@@ -0,0 +1,59 @@
+/*
+ * DDP-24 Emulator - Record and Replay
+ * Viking Mars Lander Guidance Computer
+ *
+ * A recording logs everything a run takes in that the program alone
+ * does not decide: device input and sense values, and the cycles at
+ * which interrupt lines become pending. It also checkpoints the CPU
+ * every so many cycles. Replay starts a CPU from any checkpoint with
+ * the log standing in for the devices, so each segment between two
+ * checkpoints can be re-run on its own thread and checked against the
+ * checkpoint that ends it.
+ *
+ * Values are logged when they change, keyed on cpu->cycles, and
+ * restated at each checkpoint so a segment needs nothing from before
+ * it. While recording, the host must change the CPU only through
+ * devices and interrupts. Replayed OCP and OTA go nowhere.
+ */
+
+#ifndef DDP24_REPLAY_H
+#define DDP24_REPLAY_H
+
+#include "ddp24.h"
+
+typedef struct ddp24_recording ddp24_recording_t;
+
+/* Start recording cpu with a checkpoint now and every interval cycles
+ * after (0 = only at the start and the end). NULL if out of memory. */
+ddp24_recording_t *ddp24_record_start(ddp24_t *cpu, uint64_t interval);
+
+/* Take the last checkpoint and stop recording; call before the CPU is
+ * released. False if memory ran out along the way, leaving the
+ * recording unusable. */
+bool ddp24_record_stop(ddp24_recording_t *rec);
+
+void ddp24_recording_free(ddp24_recording_t *rec);
+
+int ddp24_recording_checkpoints(const ddp24_recording_t *rec);
+uint64_t ddp24_checkpoint_cycles(const ddp24_recording_t *rec, int checkpoint);
+
+/* Put an initialised cpu in checkpoint's state, fed from the log from
+ * then on; runs then replay the recorded one. False on a bad checkpoint
+ * or out of memory. */
+bool ddp24_replay_start(ddp24_t *cpu, const ddp24_recording_t *rec, int checkpoint);
+
+/* Detach the log; the CPU keeps its state */
+void ddp24_replay_finish(ddp24_t *cpu);
+
+/* True if cpu is exactly as it was at checkpoint */
+bool ddp24_replay_matches(const ddp24_t *cpu, const ddp24_recording_t *rec, int checkpoint);
+
+/* Replay from checkpoint segment to segment + 1 on a fresh CPU and
+ * check that it arrives */
+bool ddp24_replay_segment(const ddp24_recording_t *rec, int segment, ddp24_engine_t engine);
+
+/* Check every segment on threads workers (0 = one per online CPU).
+ * Returns the first segment that fails, or -1 if none do. */
+int ddp24_replay_verify(const ddp24_recording_t *rec, int threads, ddp24_engine_t engine);
+
+#endif /* DDP24_REPLAY_H */
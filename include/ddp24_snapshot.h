@@ -0,0 +1,40 @@
+/*
+ * DDP-24 Emulator - Snapshots
+ * Viking Mars Lander Guidance Computer
+ *
+ * A snapshot holds registers, flags, interrupt state, the cycle count
+ * and memory, but not devices or queued events. Taking one moves the
+ * CPU onto the snapshot's pages, so from then on the pages the CPU
+ * copies on write are exactly the ones it has dirtied. A snapshot
+ * taken later keeps only those pages and shares the rest with the one
+ * before it, and restoring swaps back only the pages that differ.
+ */
+
+#ifndef DDP24_SNAPSHOT_H
+#define DDP24_SNAPSHOT_H
+
+#include <stdio.h>
+#include "ddp24.h"
+
+typedef struct ddp24_snapshot ddp24_snapshot_t;
+
+/* Capture the CPU. NULL if out of memory. */
+ddp24_snapshot_t *ddp24_snapshot(ddp24_t *cpu);
+
+/* Put the CPU back in the captured state; the engine is kept */
+void ddp24_restore(ddp24_t *cpu, const ddp24_snapshot_t *snap);
+
+void ddp24_snapshot_release(ddp24_snapshot_t *snap);
+
+/* Pages stored in this snapshot rather than shared with an earlier one */
+int ddp24_snapshot_pages(const ddp24_snapshot_t *snap);
+
+/* Binary form, always complete (earlier snapshots are folded in).
+ * Return 0 / a snapshot on success, -1 / NULL with errno set on error
+ * (EINVAL: not a snapshot, or cut short). Nothing is printed. */
+int ddp24_snapshot_write(const ddp24_snapshot_t *snap, FILE *f);
+ddp24_snapshot_t *ddp24_snapshot_read(FILE *f);
+int ddp24_snapshot_save(const ddp24_snapshot_t *snap, const char *filename);
+ddp24_snapshot_t *ddp24_snapshot_load(const char *filename);
+
+#endif /* DDP24_SNAPSHOT_H */
@@ -0,0 +1,84 @@
+/*
+ * DDP-24 Emulator - Telemetry
+ * Viking Mars Lander Guidance Computer
+ *
+ * Samples of chosen memory cells and the registers, taken every period
+ * cycles while the CPU runs. Sampling is a device event (ddp24_io.h),
+ * so it costs the run loop's existing test of the next event time per
+ * stretch and nothing per instruction, and a sample is taken at the
+ * first instruction boundary at or after its time.
+ *
+ * Samples go to a segment of two buffers that the CPU fills in turn;
+ * readers take the newer complete one without ever holding the CPU
+ * up. The segment is on the heap for readers in the same process, or
+ * POSIX shared memory for a dashboard in another. Each sample can also
+ * go out as a UDP datagram, dropped rather than waited for when the
+ * socket is busy:
+ *     magic:u32 seq:u64 cycles:u64 A B X1 X2 X3 PC flags count:u32
+ *     cells:u32[count]
+ * all little-endian.
+ */
+
+#ifndef DDP24_TELEMETRY_H
+#define DDP24_TELEMETRY_H
+
+#include "ddp24.h"
+
+#define DDP24_TELEMETRY_CELLS   4096        /* Words per sample, all ranges together */
+#define DDP24_TELEMETRY_RANGES  64
+#define DDP24_TELEMETRY_MAGIC   0x4D4C5444  /* "DTLM" */
+
+#define DDP24_SAMPLE_OVERFLOW   0x1
+#define DDP24_SAMPLE_HALTED     0x2
+#define DDP24_SAMPLE_INTERRUPTS 0x4         /* Interrupts enabled */
+
+typedef struct {
+    uint64_t seq;           /* Samples taken before this one */
+    uint64_t cycles;
+    word_t A, B, X[4], PC;  /* X[0] is always 0 */
+    uint32_t flags;         /* DDP24_SAMPLE_* */
+    uint32_t count;         /* Cells, in the order their ranges were added */
+} ddp24_sample_t;
+
+typedef struct ddp24_telemetry ddp24_telemetry_t;
+typedef struct ddp24_telemetry_segment ddp24_telemetry_segment_t;
+
+/* Sample every period cycles; NULL if period is 0 or out of memory */
+ddp24_telemetry_t *ddp24_telemetry_create(uint64_t period);
+
+/* Detach from every CPU first. Removes a shared segment's name. */
+void ddp24_telemetry_free(ddp24_telemetry_t *t);
+
+/* Add count cells from first, wrapping at the top of memory. False if
+ * that would pass DDP24_TELEMETRY_CELLS or DDP24_TELEMETRY_RANGES. */
+bool ddp24_telemetry_watch(ddp24_telemetry_t *t, word_t first, int count);
+
+/* Move the segment to shared memory under name ("/lander"); false with
+ * errno set on failure, the heap segment staying in use */
+bool ddp24_telemetry_share(ddp24_telemetry_t *t, const char *name);
+
+/* Also send each sample to host:port; false with errno set on failure */
+bool ddp24_telemetry_send(ddp24_telemetry_t *t, const char *host, int port);
+
+/* Start sampling cpu, the first sample a period from now; false if out
+ * of memory. One CPU at a time per telemetry. */
+bool ddp24_telemetry_attach(ddp24_t *cpu, ddp24_telemetry_t *t);
+void ddp24_telemetry_detach(ddp24_t *cpu, ddp24_telemetry_t *t);
+
+/* Samples taken so far */
+uint64_t ddp24_telemetry_samples(const ddp24_telemetry_t *t);
+
+/* Reader side. The segment of t, for this process, */
+const ddp24_telemetry_segment_t *ddp24_telemetry_segment(const ddp24_telemetry_t *t);
+
+/* ... or another process's by name; NULL with errno set on failure */
+const ddp24_telemetry_segment_t *ddp24_telemetry_open(const char *name);
+void ddp24_telemetry_close(const ddp24_telemetry_segment_t *seg);
+
+/* Newest complete sample, and up to max of its cells into cells (may be
+ * NULL if max is 0). False if nothing has been sampled yet. Safe from
+ * any thread or process while the CPU runs. */
+bool ddp24_telemetry_read(const ddp24_telemetry_segment_t *seg, ddp24_sample_t *sample,
+                          word_t *cells, int max);
+
+#endif /* DDP24_TELEMETRY_H */
@@ -0,0 +1,46 @@
+/*
+ * DDP-24 Emulator - Timing Profiles
+ * Viking Mars Lander Guidance Computer
+ *
+ * Every cycle an instruction costs comes from one of these tables.
+ * Costs that depend only on the instruction word, shift counts
+ * included, are worked out once when the word is predecoded; the rest
+ * (shifts through an index register or an indirect word, block moves,
+ * interrupt delivery) read the active profile as they run. The engines
+ * add the result in one go, and the JIT adds a whole block's worth at
+ * once.
+ *
+ * Every CPU, image and fleet keeps the profile in force when it was
+ * set up, as predecoded words keep the costs they were decoded with.
+ * A CPU on an image, or restored from a snapshot, takes the image's.
+ */
+
+#ifndef DDP24_TIMING_H
+#define DDP24_TIMING_H
+
+#include "ddp24.h"
+
+typedef struct ddp24_timing {
+    const char *name;
+    uint8_t op[64];         /* Base cost per opcode */
+    uint8_t per_shift;      /* Per place shifted: ARS/ALS, long shifts, SCR/SCL, NRM */
+    uint8_t per_fill;       /* Per word stored by FMB */
+    uint8_t per_copy;       /* Per word moved by DMB */
+    uint8_t interrupt;      /* Delivery, on top of the interrupted instruction */
+} ddp24_timing_t;
+
+/* The manual's figures, in 0.5 usec cycles; the default */
+extern const ddp24_timing_t ddp24_timing_ddp24;
+
+/* The DDP-124, approximated until measured figures are entered */
+extern const ddp24_timing_t ddp24_timing_ddp124;
+
+/* Profile for CPUs, images and fleets set up from now on; NULL puts
+ * back the DDP-24's. Those already set up keep theirs. */
+void ddp24_set_timing(const ddp24_timing_t *timing);
+const ddp24_timing_t *ddp24_get_timing(void);
+
+/* Profile by name ("ddp24", "ddp124"), NULL if unknown */
+const ddp24_timing_t *ddp24_find_timing(const char *name);
+
+#endif /* DDP24_TIMING_H */
@@ -0,0 +1,51 @@
+/*
+ * DDP-24 Emulator - Execution Trace
+ * Viking Mars Lander Guidance Computer
+ *
+ * ddp24_step hands every retired instruction to a lock-free ring; a
+ * writer thread drains the ring and compresses the records to a file.
+ * Each field is predicted (the next PC, or what the same address did
+ * last time) and only differences are stored, so a loop costs little
+ * more than a byte per instruction. A traced CPU always runs on the switch engine.
+ */
+
+#ifndef DDP24_TRACE_H
+#define DDP24_TRACE_H
+
+#include <stdio.h>
+#include "ddp24.h"
+
+/* One retired instruction; registers are the values after it */
+typedef struct {
+    word_t pc;
+    word_t instr;
+    word_t ea;
+    word_t A;
+    word_t B;
+    uint32_t cycles;
+} ddp24_trace_rec_t;
+
+typedef struct ddp24_trace ddp24_trace_t;
+typedef struct ddp24_trace_reader ddp24_trace_reader_t;
+
+/* Start a writer thread on f, which stays the caller's. NULL on error. */
+ddp24_trace_t *ddp24_trace_start(FILE *f);
+
+/* Start tracing cpu into trace (NULL stops) */
+void ddp24_trace_attach(ddp24_t *cpu, ddp24_trace_t *trace);
+
+/* Drain the ring and stop the writer. Detach first. 0, or -1 if a write
+ * failed. */
+int ddp24_trace_finish(ddp24_trace_t *trace);
+
+uint64_t ddp24_trace_records(const ddp24_trace_t *trace);
+
+/* Decoding */
+ddp24_trace_reader_t *ddp24_trace_reader(FILE *f);
+
+/* 1 and the next record, 0 at the end, -1 if the file is damaged */
+int ddp24_trace_next(ddp24_trace_reader_t *reader, ddp24_trace_rec_t *rec);
+
+void ddp24_trace_reader_free(ddp24_trace_reader_t *reader);
+
+#endif /* DDP24_TRACE_H */
@@ -0,0 +1,735 @@
+/*
+ * DDP-24 Emulator - Assembler and Symbolic Images
+ * Viking Mars Lander Guidance Computer
+ *
+ * Two passes over the source: the first places every label and builds
+ * the section map, the second evaluates operands and stores the words.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include "../include/ddp24_asm.h"
+#include "ddp24_internal.h"
+
+#define PROGRAM_MAGIC   "DDP24SYM"
+#define PROGRAM_VERSION 1
+#define PROGRAM_HEADER  24
+#define LINE_MAX_LEN    256
+
+#define NAME(name)  #name,
+static const char *const mnemonic[64] = { DDP24_SLOTS(NAME) };
+#undef NAME
+
+typedef struct {
+    char name[DDP24_SYMBOL_MAX + 1];
+    int32_t value;
+    bool label;
+} name_t;
+
+typedef struct {
+    ddp24_program_t *program;
+    ddp24_asm_error_t *err;
+    int pass;
+    int line;
+    bool failed;
+    word_t loc;
+    bool wrapped;           /* Assembled the last word of memory */
+    uint32_t kind;          /* DDP24_SECTION_* for what follows */
+    bool has_entry;
+    name_t *names;
+    int nnames, capacity;
+    int nsections_cap;
+    uint64_t used[MEM_SIZE / 64];
+} asm_t;
+
+static bool fail(asm_t *a, const char *fmt, ...) {
+    if (!a->failed && a->err) {
+        va_list ap;
+        va_start(ap, fmt);
+        a->err->line = a->line;
+        vsnprintf(a->err->message, sizeof(a->err->message), fmt, ap);
+        va_end(ap);
+    }
+    a->failed = true;
+    return false;
+}
+
+static const char *skip_space(const char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r') {
+        p++;
+    }
+    return p;
+}
+
+static bool ident_start(char c) {
+    return isalpha((unsigned char)c) || c == '_';
+}
+
+static bool ident_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+/* Copy the identifier at p into name; returns past it, NULL if too long */
+static const char *identifier(const char *p, char name[DDP24_SYMBOL_MAX + 1]) {
+    int n = 0;
+    while (ident_char(p[n])) {
+        if (n == DDP24_SYMBOL_MAX) {
+            return NULL;
+        }
+        name[n] = p[n];
+        n++;
+    }
+    name[n] = '\0';
+    return p + n;
+}
+
+static name_t *find(asm_t *a, const char *name) {
+    for (int i = 0; i < a->nnames; i++) {
+        if (strcmp(a->names[i].name, name) == 0) {
+            return &a->names[i];
+        }
+    }
+    return NULL;
+}
+
+static bool define(asm_t *a, const char *name, int32_t value, bool label) {
+    if (find(a, name)) {
+        return fail(a, "%s defined twice", name);
+    }
+    if (a->nnames == a->capacity) {
+        int capacity = a->capacity ? 2 * a->capacity : 64;
+        name_t *names = ddp24_realloc(a->names, capacity * sizeof(name_t));
+        if (!names) {
+            return fail(a, "out of memory");
+        }
+        a->names = names;
+        a->capacity = capacity;
+    }
+    name_t *n = &a->names[a->nnames++];
+    strcpy(n->name, name);
+    n->value = value;
+    n->label = label;
+    return true;
+}
+
+/* Sum of terms at *pp. Names not defined yet read as 0 in the first
+ * pass unless needed is set. */
+static bool expression(asm_t *a, const char **pp, int32_t *value, bool needed) {
+    const char *p = skip_space(*pp);
+    int64_t total = 0;
+    int sign = 1;
+    if (*p == '-' || *p == '+') {
+        sign = *p == '-' ? -1 : 1;
+        p = skip_space(p + 1);
+    }
+    for (;;) {
+        int64_t term;
+        if (isdigit((unsigned char)*p)) {
+            char *end;
+            errno = 0;
+            term = strtoll(p, &end, 0);
+            if (errno || ident_char(*end)) {
+                return fail(a, "bad number");
+            }
+            p = end;
+        } else if (*p == '.' && !ident_char(p[1])) {
+            term = a->loc;
+            p++;
+        } else if (ident_start(*p)) {
+            char name[DDP24_SYMBOL_MAX + 1];
+            if (!(p = identifier(p, name))) {
+                return fail(a, "name longer than %d characters", DDP24_SYMBOL_MAX);
+            }
+            const name_t *n = find(a, name);
+            if (!n && (needed || a->pass == 2)) {
+                return fail(a, "%s is not defined%s", name, a->pass == 1 ? " yet" : "");
+            }
+            term = n ? n->value : 0;
+        } else {
+            return fail(a, "expected a number or a name");
+        }
+        total += sign * term;
+        if (total > WORD_MASK || total < -(int64_t)WORD_MASK) {
+            return fail(a, "value out of range");
+        }
+        p = skip_space(p);
+        if (*p != '+' && *p != '-') {
+            break;
+        }
+        sign = *p == '-' ? -1 : 1;
+        p = skip_space(p + 1);
+    }
+    *value = (int32_t)total;
+    *pp = p;
+    return true;
+}
+
+/* Assemble value at the current address */
+static bool emit(asm_t *a, word_t value) {
+    if (a->wrapped) {
+        return fail(a, "past the top of memory");
+    }
+    word_t loc = a->loc;
+    if (a->pass == 1) {
+        if (a->used[loc / 64] >> (loc % 64) & 1) {
+            return fail(a, "%05o assembled twice", loc);
+        }
+        a->used[loc / 64] |= 1ull << (loc % 64);
+
+        ddp24_program_t *prog = a->program;
+        ddp24_section_t *last = prog->nsections ? &prog->section[prog->nsections - 1] : NULL;
+        if (last && last->flags == a->kind && last->start + last->count == loc) {
+            last->count++;
+        } else {
+            if (prog->nsections == a->nsections_cap) {
+                int capacity = a->nsections_cap ? 2 * a->nsections_cap : 8;
+                ddp24_section_t *s = ddp24_realloc(prog->section, capacity * sizeof(ddp24_section_t));
+                if (!s) {
+                    return fail(a, "out of memory");
+                }
+                prog->section = s;
+                a->nsections_cap = capacity;
+            }
+            prog->section[prog->nsections++] = (ddp24_section_t){ loc, 1, a->kind };
+        }
+    } else {
+        a->program->word[loc] = value & WORD_MASK;
+    }
+    a->wrapped = loc == ADDR_MASK;
+    a->loc = (loc + 1) & ADDR_MASK;
+    return true;
+}
+
+static bool at_end(const char *p) {
+    return *skip_space(p) == '\0';
+}
+
+static bool directive(asm_t *a, const char *name, const char *p) {
+    int32_t v;
+    if (strcmp(name, "org") == 0) {
+        if (!expression(a, &p, &v, true)) {
+            return false;
+        }
+        if (v < 0 || v > ADDR_MASK) {
+            return fail(a, "address out of range");
+        }
+        a->loc = (word_t)v;
+        a->wrapped = false;
+    } else if (strcmp(name, "code") == 0) {
+        a->kind = DDP24_SECTION_CODE;
+    } else if (strcmp(name, "data") == 0) {
+        a->kind = DDP24_SECTION_DATA;
+    } else if (strcmp(name, "const") == 0) {
+        a->kind = DDP24_SECTION_DATA | DDP24_SECTION_CONST;
+    } else if (strcmp(name, "word") == 0) {
+        do {
+            if (*p == ',') {
+                p++;
+            }
+            if (!expression(a, &p, &v, false)) {
+                return false;
+            }
+            if (v < -MAGNITUDE_MASK) {
+                return fail(a, "value out of range");
+            }
+            if (!emit(a, v < 0 ? SIGN_BIT | (word_t)-v : (word_t)v)) {
+                return false;
+            }
+        } while (*p == ',');
+    } else if (strcmp(name, "space") == 0) {
+        if (!expression(a, &p, &v, true)) {
+            return false;
+        }
+        if (v < 0 || v > MEM_SIZE) {
+            return fail(a, "bad size");
+        }
+        for (int32_t i = 0; i < v; i++) {
+            if (!emit(a, 0)) {
+                return false;
+            }
+        }
+    } else if (strcmp(name, "entry") == 0) {
+        if (!expression(a, &p, &v, false)) {
+            return false;
+        }
+        if (v < 0 || v > ADDR_MASK) {
+            return fail(a, "address out of range");
+        }
+        a->program->entry = (word_t)v;
+        a->has_entry = true;
+    } else {
+        return fail(a, "unknown directive .%s", name);
+    }
+    return at_end(p) || fail(a, "unexpected text after .%s", name);
+}
+
+static bool instruction(asm_t *a, const char *name, const char *p) {
+    char upper[DDP24_SYMBOL_MAX + 1];
+    int n = 0;
+    for (; name[n]; n++) {
+        upper[n] = (char)toupper((unsigned char)name[n]);
+    }
+    upper[n] = '\0';
+
+    int op = 0;
+    while (op < 64 && (strcmp(mnemonic[op], upper) != 0 || strcmp(upper, "ILLEGAL") == 0)) {
+        op++;
+    }
+    if (op == 64) {
+        return fail(a, "unknown instruction %s", name);
+    }
+    word_t word = (word_t)op << OP_SHIFT;
+    if (*p == '*') {
+        word |= INDIRECT_BIT;
+        p++;
+    }
+    if (!at_end(p)) {
+        int32_t addr, index = 0;
+        if (!expression(a, &p, &addr, false)) {
+            return false;
+        }
+        if (*p == ',') {
+            p++;
+            if (!expression(a, &p, &index, false)) {
+                return false;
+            }
+        }
+        if (addr < 0 || addr > ADDR_MASK) {
+            return fail(a, "address out of range");
+        }
+        if (index < 0 || index > INDEX_MASK) {
+            return fail(a, "no index register %d", index);
+        }
+        if (!at_end(p)) {
+            return fail(a, "unexpected text after the operand");
+        }
+        word |= (word_t)index << INDEX_SHIFT | (word_t)addr;
+    }
+    return emit(a, word);
+}
+
+static bool statement(asm_t *a, char *text) {
+    char *semi = strchr(text, ';');
+    if (semi) {
+        *semi = '\0';
+    }
+    const char *p = skip_space(text);
+    char name[DDP24_SYMBOL_MAX + 1];
+
+    if (ident_start(*p)) {
+        const char *after = identifier(p, name);
+        if (!after) {
+            return fail(a, "name longer than %d characters", DDP24_SYMBOL_MAX);
+        }
+        const char *q = skip_space(after);
+        if (*q == ':') {
+            if (a->pass == 1 && !define(a, name, a->loc, true)) {
+                return false;
+            }
+            p = skip_space(q + 1);
+        } else if (*q == '=') {
+            int32_t v;
+            q++;
+            if (a->pass == 2) {
+                return true;
+            }
+            return expression(a, &q, &v, true) && define(a, name, v, false) &&
+                   (at_end(q) || fail(a, "unexpected text after the value"));
+        }
+    }
+
+    if (*p == '\0') {
+        return true;
+    }
+    if (*p == '.') {
+        const char *after = identifier(p + 1, name);
+        if (!after || !name[0]) {
+            return fail(a, "bad directive");
+        }
+        return directive(a, name, skip_space(after));
+    }
+    const char *after = ident_start(*p) ? identifier(p, name) : NULL;
+    if (!after) {
+        return fail(a, "expected an instruction");
+    }
+    return instruction(a, name, after);
+}
+
+static bool run_pass(asm_t *a, const char *source, int pass) {
+    a->pass = pass;
+    a->line = 0;
+    a->loc = 0;
+    a->wrapped = false;
+    a->kind = DDP24_SECTION_CODE;
+    for (const char *p = source; *p && !a->failed; ) {
+        const char *end = strchr(p, '\n');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        char text[LINE_MAX_LEN];
+        a->line++;
+        if (len >= sizeof(text)) {
+            return fail(a, "line longer than %d characters", LINE_MAX_LEN - 1);
+        }
+        memcpy(text, p, len);
+        text[len] = '\0';
+        statement(a, text);
+        p += len + (end != NULL);
+    }
+    return !a->failed;
+}
+
+static int by_start(const void *x, const void *y) {
+    const ddp24_section_t *s = x, *t = y;
+    return (int)s->start - (int)t->start;
+}
+
+static int by_addr(const void *x, const void *y) {
+    const ddp24_symbol_t *s = x, *t = y;
+    if (s->addr != t->addr) {
+        return (int)s->addr - (int)t->addr;
+    }
+    return strcmp(s->name, t->name);
+}
+
+static ddp24_program_t *program_new(void) {
+    return ddp24_calloc(1, sizeof(ddp24_program_t));
+}
+
+void ddp24_program_free(ddp24_program_t *program) {
+    if (program) {
+        ddp24_free(program->section);
+        ddp24_free(program->symbol);
+        ddp24_free(program);
+    }
+}
+
+ddp24_program_t *ddp24_assemble(const char *source, ddp24_asm_error_t *err) {
+    asm_t *a = ddp24_calloc(1, sizeof(asm_t));
+    ddp24_program_t *prog = program_new();
+    if (!a || !prog) {
+        if (err) {
+            *err = (ddp24_asm_error_t){ 0, "out of memory" };
+        }
+        ddp24_free(a);
+        ddp24_free(prog);
+        return NULL;
+    }
+    a->program = prog;
+    a->err = err;
+
+    bool ok = run_pass(a, source, 1);
+    if (ok) {
+        qsort(prog->section, prog->nsections, sizeof(ddp24_section_t), by_start);
+        int labels = 0;
+        for (int i = 0; i < a->nnames; i++) {
+            labels += a->names[i].label;
+        }
+        prog->symbol = ddp24_calloc(labels ? labels : 1, sizeof(ddp24_symbol_t));
+        ok = prog->symbol != NULL || fail(a, "out of memory");
+        for (int i = 0; ok && i < a->nnames; i++) {
+            if (a->names[i].label) {
+                ddp24_symbol_t *s = &prog->symbol[prog->nsymbols++];
+                strcpy(s->name, a->names[i].name);
+                s->addr = (word_t)a->names[i].value;
+            }
+        }
+        if (ok) {
+            qsort(prog->symbol, prog->nsymbols, sizeof(ddp24_symbol_t), by_addr);
+        }
+    }
+    ok = ok && run_pass(a, source, 2);
+    if (ok && !a->has_entry) {
+        /* The first code, failing a .entry */
+        for (int i = 0; i < prog->nsections; i++) {
+            if (prog->section[i].flags & DDP24_SECTION_CODE) {
+                prog->entry = prog->section[i].start;
+                break;
+            }
+        }
+    }
+
+    ddp24_free(a->names);
+    ddp24_free(a);
+    if (!ok) {
+        ddp24_program_free(prog);
+        return NULL;
+    }
+    return prog;
+}
+
+ddp24_program_t *ddp24_assemble_file(const char *filename, ddp24_asm_error_t *err) {
+    FILE *f = fopen(filename, "rb");
+    char *source = NULL;
+    size_t len = 0, cap = 0, n;
+    char chunk[4096];
+    while (f && (n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        if (len + n + 1 > cap) {
+            size_t grown = cap ? 2 * cap : sizeof(chunk) + 1;
+            while (grown < len + n + 1) {
+                grown *= 2;
+            }
+            char *p = ddp24_realloc(source, grown);
+            if (!p) {
+                if (err) {
+                    *err = (ddp24_asm_error_t){ 0, "out of memory" };
+                }
+                fclose(f);
+                ddp24_free(source);
+                return NULL;
+            }
+            source = p;
+            cap = grown;
+        }
+        memcpy(source + len, chunk, n);
+        len += n;
+    }
+    if (!f || ferror(f) || (len == 0 && !source && !feof(f))) {
+        if (err) {
+            err->line = 0;
+            snprintf(err->message, sizeof(err->message), "%s: %s", filename, strerror(errno));
+        }
+        if (f) {
+            fclose(f);
+        }
+        ddp24_free(source);
+        return NULL;
+    }
+    fclose(f);
+    if (!source && !(source = ddp24_malloc(1))) {
+        if (err) {
+            *err = (ddp24_asm_error_t){ 0, "out of memory" };
+        }
+        return NULL;
+    }
+    source[len] = '\0';
+    ddp24_program_t *prog = ddp24_assemble(source, err);
+    ddp24_free(source);
+    return prog;
+}
+
+int ddp24_program_install(ddp24_t *cpu, const ddp24_program_t *program) {
+    int words = 0;
+    for (int i = 0; i < program->nsections; i++) {
+        const ddp24_section_t *s = &program->section[i];
+        words += (int)ddp24_write_block(cpu, s->start, &program->word[s->start], s->count);
+    }
+    cpu->PC = program->entry;
+    return words;
+}
+
+ddp24_image_t *ddp24_program_image(const ddp24_program_t *program) {
+    ddp24_t cpu;
+    uint64_t code[MEM_SIZE / 64] = { 0 };
+    for (int i = 0; i < program->nsections; i++) {
+        const ddp24_section_t *s = &program->section[i];
+        if (s->flags & DDP24_SECTION_CODE) {
+            for (word_t a = s->start; a < s->start + s->count; a++) {
+                code[a / 64] |= 1ull << (a % 64);
+            }
+        }
+    }
+    ddp24_init(&cpu);
+    ddp24_program_install(&cpu, program);
+    ddp24_image_t *image = ddp24_image_create_decoded(&cpu, code);
+    ddp24_release(&cpu);
+    return image;
+}
+
+/* Symbolic images */
+
+static void put32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+int ddp24_program_save(const ddp24_program_t *program, const char *filename) {
+    FILE *f = fopen(filename, "wb");
+    if (!f) {
+        return -1;
+    }
+    uint8_t buf[PROGRAM_HEADER];
+    memcpy(buf, PROGRAM_MAGIC, 8);
+    put32(buf + 8, PROGRAM_VERSION);
+    put32(buf + 12, program->entry);
+    put32(buf + 16, (uint32_t)program->nsections);
+    put32(buf + 20, (uint32_t)program->nsymbols);
+    bool ok = fwrite(buf, 1, PROGRAM_HEADER, f) == PROGRAM_HEADER;
+
+    for (int i = 0; ok && i < program->nsections; i++) {
+        const ddp24_section_t *s = &program->section[i];
+        put32(buf, s->start);
+        put32(buf + 4, s->count);
+        put32(buf + 8, s->flags);
+        ok = fwrite(buf, 1, 12, f) == 12;
+        for (word_t a = s->start; ok && a < s->start + s->count; a++) {
+            put32(buf, program->word[a]);
+            ok = fwrite(buf, 1, 4, f) == 4;
+        }
+    }
+    for (int i = 0; ok && i < program->nsymbols; i++) {
+        const ddp24_symbol_t *s = &program->symbol[i];
+        size_t len = strlen(s->name);
+        put32(buf, s->addr);
+        buf[4] = (uint8_t)len;
+        ok = fwrite(buf, 1, 5, f) == 5 && fwrite(s->name, 1, len, f) == len;
+    }
+    if (fclose(f) != 0 || !ok) {
+        if (errno == 0) {
+            errno = EIO;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+bool ddp24_is_program(const uint8_t *data, size_t size) {
+    return size >= PROGRAM_HEADER && memcmp(data, PROGRAM_MAGIC, 8) == 0;
+}
+
+ddp24_program_t *ddp24_program_read(const uint8_t *data, size_t size) {
+    if (!ddp24_is_program(data, size) || get32(data + 8) != PROGRAM_VERSION) {
+        errno = EINVAL;
+        return NULL;
+    }
+    uint32_t entry = get32(data + 12);
+    uint32_t nsections = get32(data + 16);
+    uint32_t nsymbols = get32(data + 20);
+    if (entry > ADDR_MASK || nsections > MEM_SIZE || nsymbols > MEM_SIZE) {
+        errno = EINVAL;
+        return NULL;
+    }
+    ddp24_program_t *prog = program_new();
+    if (prog) {
+        prog->section = ddp24_malloc((nsections ? nsections : 1) * sizeof(ddp24_section_t));
+        prog->symbol = ddp24_calloc(nsymbols ? nsymbols : 1, sizeof(ddp24_symbol_t));
+    }
+    if (!prog || !prog->section || !prog->symbol) {
+        ddp24_program_free(prog);
+        errno = ENOMEM;
+        return NULL;
+    }
+    prog->entry = (word_t)entry;
+
+    const uint8_t *p = data + PROGRAM_HEADER, *end = data + size;
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < nsections; i++) {
+        ok = end - p >= 12;
+        if (!ok) {
+            break;
+        }
+        ddp24_section_t s = { (word_t)get32(p), (word_t)get32(p + 4), get32(p + 8) };
+        p += 12;
+        ok = s.start < MEM_SIZE &&
+             s.count <= MEM_SIZE - s.start && (size_t)(end - p) / 4 >= s.count;
+        for (word_t a = 0; ok && a < s.count; a++, p += 4) {
+            prog->word[s.start + a] = get32(p) & WORD_MASK;
+        }
+        prog->section[prog->nsections++] = s;
+    }
+    for (uint32_t i = 0; ok && i < nsymbols; i++) {
+        ok = end - p >= 5 && p[4] > 0 && p[4] <= DDP24_SYMBOL_MAX && end - p - 5 >= p[4];
+        if (ok) {
+            ddp24_symbol_t *s = &prog->symbol[prog->nsymbols++];
+            s->addr = get32(p) & ADDR_MASK;
+            memcpy(s->name, p + 5, p[4]);
+            s->name[p[4]] = '\0';
+            p += 5 + p[4];
+        }
+    }
+    if (!ok) {
+        ddp24_program_free(prog);
+        errno = EINVAL;
+        return NULL;
+    }
+    return prog;
+}
+
+ddp24_program_t *ddp24_program_load(const char *filename) {
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        return NULL;
+    }
+    uint8_t *data = NULL;
+    size_t size = 0, cap = 0, n;
+    uint8_t chunk[4096];
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        if (size + n > cap) {
+            size_t grown = cap ? 2 * cap : 4 * sizeof(chunk);
+            uint8_t *p = ddp24_realloc(data, grown);
+            if (!p) {
+                ddp24_free(data);
+                fclose(f);
+                errno = ENOMEM;
+                return NULL;
+            }
+            data = p;
+            cap = grown;
+        }
+        memcpy(data + size, chunk, n);
+        size += n;
+    }
+    bool failed = ferror(f);
+    fclose(f);
+    ddp24_program_t *prog = NULL;
+    if (failed) {
+        errno = EIO;
+    } else {
+        prog = ddp24_program_read(data ? data : (const uint8_t *)"", size);
+    }
+    ddp24_free(data);
+    return prog;
+}
+
+bool ddp24_program_lookup(const ddp24_program_t *program, const char *name, word_t *addr) {
+    for (int i = 0; i < program->nsymbols; i++) {
+        if (strcmp(program->symbol[i].name, name) == 0) {
+            *addr = program->symbol[i].addr;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const ddp24_section_t *section_of(const ddp24_program_t *program, word_t addr) {
+    for (int i = 0; i < program->nsections; i++) {
+        const ddp24_section_t *s = &program->section[i];
+        if (addr >= s->start && addr - s->start < s->count) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+const char *ddp24_program_name(const ddp24_program_t *program, word_t addr, char *buf, size_t size) {
+    const ddp24_section_t *s = program ? section_of(program, addr) : NULL;
+    int lo = 0, hi = program ? program->nsymbols : 0;
+    while (lo < hi) {       /* First symbol past addr */
+        int mid = (lo + hi) / 2;
+        if (program->symbol[mid].addr <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (s && lo > 0 && program->symbol[lo - 1].addr >= s->start) {
+        const ddp24_symbol_t *sym = &program->symbol[lo - 1];
+        if (sym->addr == addr) {
+            snprintf(buf, size, "%s", sym->name);
+        } else {
+            snprintf(buf, size, "%s+%o", sym->name, addr - sym->addr);
+        }
+    } else {
+        snprintf(buf, size, "%05o", addr);
+    }
+    return buf;
+}
@@ -0,0 +1,324 @@
+/*
+ * DDP-24 Emulator - Batch Runner
+ * Viking Mars Lander Guidance Computer
+ *
+ * Jobs are dealt out in contiguous runs, one per worker. A worker takes
+ * from the front of its own run; once that is empty it steals from the
+ * back of someone else's. No jobs are created while the pool runs, so a
+ * worker that finds every run empty is done.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../include/ddp24_batch.h"
+#include "ddp24_internal.h"
+
+typedef struct {
+    pthread_mutex_t lock;
+    int head;                   /* Next job the owner takes */
+    int tail;                   /* One past the job a thief takes */
+} queue_t;
+
+typedef struct {
+    ddp24_job_t *jobs;
+    ddp24_engine_t engine;
+    queue_t *queue;
+    int workers;
+} pool_t;
+
+typedef struct {
+    pool_t *pool;
+    int id;
+} worker_t;
+
+/* Parsing */
+
+static bool parse_octal(const char *s, word_t *v) {
+    char *end;
+    unsigned long n = strtoul(s, &end, 8);
+    if (end == s || *end != '\0') {
+        return false;
+    }
+    *v = (word_t)n & WORD_MASK;
+    return true;
+}
+
+static bool parse_field(ddp24_job_t *job, const char *tok) {
+    const char *eq = strchr(tok, '=');
+    if (!eq) {
+        return false;
+    }
+    size_t len = (size_t)(eq - tok);
+    const char *val = eq + 1;
+    word_t v;
+
+    if (tok[0] == '@') {
+        char addr[16];
+        word_t a;
+        if (len < 2 || len - 1 >= sizeof(addr)) {
+            return false;
+        }
+        memcpy(addr, tok + 1, len - 1);
+        addr[len - 1] = '\0';
+        if (!parse_octal(addr, &a) || !parse_octal(val, &v)) {
+            return false;
+        }
+        ddp24_poke_t *p = realloc(job->pokes, (size_t)(job->npokes + 1) * sizeof(*p));
+        if (!p) {
+            return false;
+        }
+        job->pokes = p;
+        job->pokes[job->npokes].addr = a & ADDR_MASK;
+        job->pokes[job->npokes].value = v;
+        job->npokes++;
+        return true;
+    }
+
+    if (!parse_octal(val, &v)) {
+        return false;
+    }
+    if (len == 1 && tok[0] == 'A') {
+        job->A = v;
+    } else if (len == 1 && tok[0] == 'B') {
+        job->B = v;
+    } else if (len == 2 && tok[0] == 'X' && tok[1] >= '1' && tok[1] <= '3') {
+        job->X[tok[1] - '0'] = v & ADDR_MASK;
+    } else if (len == 2 && tok[0] == 'P' && tok[1] == 'C') {
+        job->PC = v & ADDR_MASK;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/* One image per distinct program; each job holds its own reference */
+static ddp24_image_t *find_image(ddp24_job_t *jobs, int count, const char *program) {
+    for (int i = 0; i < count; i++) {
+        if (jobs[i].program && strcmp(jobs[i].program, program) == 0) {
+            return ddp24_image_retain(jobs[i].image);
+        }
+    }
+    return ddp24_image_load(program);
+}
+
+int ddp24_batch_parse(const char *filename, ddp24_job_t **out, ddp24_error_t *err, int *line) {
+    ddp24_error_t why = DDP24_OK;
+    int lineno = 0;
+    FILE *f = fopen(filename, "r");
+    if (!f) {
+        why = DDP24_ERR_IO;
+        goto report;
+    }
+
+    ddp24_job_t *jobs = NULL;
+    int count = 0;
+    char text[1024];
+
+    while (fgets(text, sizeof(text), f)) {
+        lineno++;
+        char *save = NULL;
+        char *tok = strtok_r(text, " \t\r\n", &save);
+        if (!tok || tok[0] == '#') {
+            continue;
+        }
+
+        ddp24_job_t *grown = realloc(jobs, (size_t)(count + 1) * sizeof(*jobs));
+        if (!grown) {
+            why = DDP24_ERR_NOMEM;
+            goto fail;
+        }
+        jobs = grown;
+        ddp24_job_t *job = &jobs[count];
+        memset(job, 0, sizeof(*job));
+
+        job->image = find_image(jobs, count, tok);
+        if (!job->image) {
+            why = ddp24_errno_error();
+            goto fail;
+        }
+        job->program = strdup(tok);
+        count++;
+        if (!job->program) {
+            why = DDP24_ERR_NOMEM;
+            goto fail;
+        }
+
+        char *budget = strtok_r(NULL, " \t\r\n", &save);
+        char *end = NULL;
+        if (budget) {
+            job->budget = strtoull(budget, &end, 10);
+        }
+        if (!budget || *end != '\0') {
+            why = DDP24_ERR_FORMAT;     /* No cycle budget */
+            goto fail;
+        }
+
+        while ((tok = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+            if (!parse_field(job, tok)) {
+                why = DDP24_ERR_FORMAT;
+                goto fail;
+            }
+        }
+    }
+    if (ferror(f)) {
+        why = DDP24_ERR_IO;
+        goto fail;
+    }
+
+    fclose(f);
+    *out = jobs;
+    return count;
+
+fail:
+    fclose(f);
+    ddp24_batch_free(jobs, count);
+report:
+    if (err) {
+        *err = why;
+    }
+    if (line) {
+        *line = lineno;
+    }
+    return -1;
+}
+
+void ddp24_batch_free(ddp24_job_t *jobs, int count) {
+    for (int i = 0; i < count; i++) {
+        ddp24_image_release(jobs[i].image);
+        free(jobs[i].program);
+        free(jobs[i].pokes);
+    }
+    free(jobs);
+}
+
+/* Running */
+
+static void run_job(ddp24_job_t *job, ddp24_engine_t engine, int worker) {
+    ddp24_t cpu;
+
+    ddp24_init_image(&cpu, job->image);
+    ddp24_set_engine(&cpu, engine);
+    cpu.A = job->A;
+    cpu.B = job->B;
+    for (int i = 1; i < 4; i++) {
+        cpu.X[i] = job->X[i];
+    }
+    cpu.PC = job->PC;
+    for (int i = 0; i < job->npokes; i++) {
+        ddp24_write(&cpu, job->pokes[i].addr, job->pokes[i].value);
+    }
+
+    job->result.stop = ddp24_run_for(&cpu, job->budget);
+
+    job->result.A = cpu.A;
+    job->result.B = cpu.B;
+    for (int i = 0; i < 4; i++) {
+        job->result.X[i] = cpu.X[i];
+    }
+    job->result.PC = cpu.PC;
+    job->result.overflow = cpu.overflow;
+    job->result.cycles = cpu.cycles;
+    job->result.pages = ddp24_private_pages(&cpu);
+    job->result.worker = worker;
+    ddp24_release(&cpu);
+}
+
+/* Own queue first, front end; then the back end of the others' */
+static int take(pool_t *pool, int id) {
+    for (int k = 0; k < pool->workers; k++) {
+        queue_t *q = &pool->queue[(id + k) % pool->workers];
+        int job = -1;
+
+        pthread_mutex_lock(&q->lock);
+        if (q->head < q->tail) {
+            job = k == 0 ? q->head++ : --q->tail;
+        }
+        pthread_mutex_unlock(&q->lock);
+
+        if (job >= 0) {
+            return job;
+        }
+    }
+    return -1;
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    int job;
+    while ((job = take(w->pool, w->id)) >= 0) {
+        run_job(&w->pool->jobs[job], w->pool->engine, w->id);
+    }
+    return NULL;
+}
+
+void ddp24_batch_run(ddp24_job_t *jobs, int count, int threads, ddp24_engine_t engine) {
+    if (threads <= 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = n > 0 ? (int)n : 1;
+    }
+    if (threads > count) {
+        threads = count > 0 ? count : 1;
+    }
+
+    pool_t pool = { jobs, engine, NULL, threads };
+    queue_t *queue = calloc((size_t)threads, sizeof(queue_t));
+    worker_t *workers = calloc((size_t)threads, sizeof(worker_t));
+    pthread_t *tids = calloc((size_t)threads, sizeof(pthread_t));
+    bool *started = calloc((size_t)threads, sizeof(bool));
+
+    if (!queue || !workers || !tids || !started) {
+        /* Fall back to running everything here */
+        for (int j = 0; j < count; j++) {
+            run_job(&jobs[j], engine, 0);
+        }
+        goto out;
+    }
+
+    pool.queue = queue;
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_init(&queue[i].lock, NULL);
+        queue[i].head = (int)((long long)count * i / threads);
+        queue[i].tail = (int)((long long)count * (i + 1) / threads);
+        workers[i].pool = &pool;
+        workers[i].id = i;
+    }
+
+    /* Worker 0 is this thread; a worker that fails to start just leaves
+     * its queue to be stolen */
+    for (int i = 1; i < threads; i++) {
+        started[i] = pthread_create(&tids[i], NULL, worker_main, &workers[i]) == 0;
+    }
+    worker_main(&workers[0]);
+    for (int i = 1; i < threads; i++) {
+        if (started[i]) {
+            pthread_join(tids[i], NULL);
+        }
+    }
+
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_destroy(&queue[i].lock);
+    }
+
+out:
+    free(queue);
+    free(workers);
+    free(tids);
+    free(started);
+}
+
+void ddp24_batch_print(FILE *out, const ddp24_job_t *jobs, int count) {
+    for (int i = 0; i < count; i++) {
+        const ddp24_job_t *j = &jobs[i];
+        fprintf(out, "job %d %s %s PC=%05o A=%08o B=%08o X1=%05o X2=%05o X3=%05o%s cycles=%llu pages=%d\n",
+                i, j->program ? j->program : "-", ddp24_stop_name(j->result.stop),
+                j->result.PC, j->result.A, j->result.B,
+                j->result.X[1], j->result.X[2], j->result.X[3],
+                j->result.overflow ? " OVF" : "",
+                (unsigned long long)j->result.cycles, j->result.pages);
+    }
+}
@@ -0,0 +1,185 @@
+/*
+ * DDP-24 Emulator - Microbenchmarks
+ * Viking Mars Lander Guidance Computer
+ *
+ * Each kernel is a counted loop stressing one part of the hot path. The
+ * instruction count comes from stepping the kernel once on the switch
+ * engine; the timed run is a single ddp24_run_for on the engine under
+ * test, so per-call overhead does not show up in the numbers.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../include/ddp24_bench.h"
+
+#define BENCH_ITERATIONS    500000
+
+/* Fixed data addresses shared by the kernels */
+#define CNT     0x1000      /* Loop counter */
+#define ONE     0x1001
+#define SUM     0x1002
+#define VAL     0x1003
+#define DIVISOR 0x1004
+#define PTR     0x1005      /* Indirect pointers */
+#define PTR2    0x1006
+#define TABLE   0x2000      /* Indexed data */
+#define NEXT    0x3000      /* NEXT[i] = i + 1, wrapping */
+#define TABLE_SIZE  256
+
+typedef struct {
+    const char *name;
+    void (*build)(ddp24_t *cpu);
+} kernel_t;
+
+static void put(ddp24_t *cpu, word_t addr, int op, word_t ea) {
+    ddp24_write(cpu, addr, ((word_t)op << OP_SHIFT) | (ea & ADDR_MASK));
+}
+
+static void put_x(ddp24_t *cpu, word_t addr, int op, word_t ea, int index) {
+    ddp24_write(cpu, addr, ((word_t)op << OP_SHIFT) | ((word_t)index << INDEX_SHIFT) | (ea & ADDR_MASK));
+}
+
+static void put_i(ddp24_t *cpu, word_t addr, int op, word_t ea) {
+    ddp24_write(cpu, addr, ((word_t)op << OP_SHIFT) | INDIRECT_BIT | (ea & ADDR_MASK));
+}
+
+/* Counter decrement and loop back to 0x10, starting at addr */
+static void loop_tail(ddp24_t *cpu, word_t addr) {
+    put(cpu, addr, OP_LDA, CNT);
+    put(cpu, addr + 1, OP_SUB, ONE);
+    put(cpu, addr + 2, OP_STA, CNT);
+    put(cpu, addr + 3, OP_JNZ, 0x10);
+    put(cpu, addr + 4, OP_HLT, 0);
+}
+
+static void build_arith(ddp24_t *cpu) {
+    put(cpu, 0x10, OP_LDA, SUM);
+    put(cpu, 0x11, OP_ADD, VAL);
+    put(cpu, 0x12, OP_SUB, ONE);
+    put(cpu, 0x13, OP_ANA, VAL);
+    put(cpu, 0x14, OP_ORA, ONE);
+    put(cpu, 0x15, OP_ERA, SUM);
+    put(cpu, 0x16, OP_STA, SUM);
+    loop_tail(cpu, 0x17);
+    ddp24_write(cpu, VAL, 0x0F0F0F);
+}
+
+static void build_muldiv(ddp24_t *cpu) {
+    put(cpu, 0x10, OP_LDB, VAL);
+    put(cpu, 0x11, OP_MPY, VAL);
+    put(cpu, 0x12, OP_DIV, DIVISOR);
+    put(cpu, 0x13, OP_LDB, CNT);
+    put(cpu, 0x14, OP_MPY, DIVISOR);
+    loop_tail(cpu, 0x15);
+    ddp24_write(cpu, VAL, 1234);
+    ddp24_write(cpu, DIVISOR, 777);
+}
+
+/* X1 walks the table through NEXT, since LDX indexes by its own register */
+static void build_indexed(ddp24_t *cpu) {
+    put_x(cpu, 0x10, OP_LDA, TABLE, 1);
+    put(cpu, 0x11, OP_ERA, SUM);
+    put(cpu, 0x12, OP_STA, SUM);
+    put_x(cpu, 0x13, OP_LDX, NEXT, 1);
+    loop_tail(cpu, 0x14);
+    for (word_t i = 0; i < TABLE_SIZE; i++) {
+        ddp24_write(cpu, TABLE + i, i * 0x010101);
+        ddp24_write(cpu, NEXT + i, (i + 1) % TABLE_SIZE);
+    }
+}
+
+static void build_indirect(ddp24_t *cpu) {
+    put_i(cpu, 0x10, OP_LDA, PTR);
+    put_i(cpu, 0x11, OP_ERA, PTR2);
+    put_i(cpu, 0x12, OP_STA, PTR);
+    put_i(cpu, 0x13, OP_LDB, PTR2);
+    loop_tail(cpu, 0x14);
+    ddp24_write(cpu, PTR, TABLE);
+    ddp24_write(cpu, PTR2, TABLE + 1);
+    ddp24_write(cpu, TABLE + 1, 0x5A5A5A);
+}
+
+/* Alternating taken and not-taken branches on the counter's low bits */
+static void build_branchy(ddp24_t *cpu) {
+    put(cpu, 0x10, OP_LDA, CNT);
+    put(cpu, 0x11, OP_ANA, ONE);
+    put(cpu, 0x12, OP_JZE, 0x16);
+    put(cpu, 0x13, OP_SKN, ONE);    /* A == 1 here: no skip */
+    put(cpu, 0x14, OP_JMP, 0x17);
+    put(cpu, 0x15, OP_HLT, 0);
+    put(cpu, 0x16, OP_JMI, 0x15);   /* Never taken */
+    put(cpu, 0x17, OP_JPL, 0x18);
+    put(cpu, 0x18, OP_SKG, ONE);
+    put(cpu, 0x19, OP_NOP, 0);
+    loop_tail(cpu, 0x1A);
+}
+
+/* XEC into XEC into NOP, twice a pass */
+static void build_xec(ddp24_t *cpu) {
+    put(cpu, 0x10, OP_XEC, 0x200);
+    put(cpu, 0x11, OP_XEC, 0x200);
+    loop_tail(cpu, 0x12);
+    put(cpu, 0x200, OP_XEC, 0x210);
+    put(cpu, 0x210, OP_NOP, 0);
+}
+
+static const kernel_t kernels[] = {
+    { "arith",    build_arith },
+    { "muldiv",   build_muldiv },
+    { "indexed",  build_indexed },
+    { "indirect", build_indirect },
+    { "branchy",  build_branchy },
+    { "xec",      build_xec },
+};
+
+static void setup(ddp24_t *cpu, const kernel_t *k) {
+    ddp24_init(cpu);
+    k->build(cpu);
+    ddp24_write(cpu, CNT, BENCH_ITERATIONS);
+    ddp24_write(cpu, ONE, 1);
+    cpu->PC = 0x10;
+}
+
+static double now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void ddp24_bench(ddp24_engine_t engine, FILE *out) {
+    ddp24_t cpu;
+
+    fprintf(out, "=== DDP-24 Benchmarks (%s) ===\n\n", ddp24_engine_name(engine));
+    fprintf(out, "%-10s %12s %10s %12s %12s\n",
+            "kernel", "instructions", "ns/instr", "Mcycles/s", "x original");
+
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        const kernel_t *k = &kernels[i];
+
+        /* Count instructions by stepping the reference engine */
+        uint64_t instructions = 0;
+        setup(&cpu, k);
+        while (!cpu.halted) {
+            ddp24_step(&cpu);
+            instructions++;
+        }
+        ddp24_release(&cpu);
+
+        setup(&cpu, k);
+        ddp24_set_engine(&cpu, engine);
+        double t0 = now();
+        ddp24_run_for(&cpu, 0);
+        double elapsed = now() - t0;
+        uint64_t cycles = cpu.cycles;
+        ddp24_release(&cpu);
+
+        if (elapsed <= 0) {
+            elapsed = 1e-9;
+        }
+        double ips = instructions / elapsed;
+        fprintf(out, "%-10s %12llu %10.2f %12.1f %12.0f\n",
+                k->name, (unsigned long long)instructions, elapsed * 1e9 / instructions,
+                cycles / elapsed / 1e6, ips / DDP24_ORIGINAL_IPS);
+    }
+}
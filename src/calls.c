@@ -0,0 +1,186 @@
+/*
+ * DDP-24 Emulator - Subroutine Costs
+ * Viking Mars Lander Guidance Computer
+ *
+ * Totals are indexed by link word, so a call or return touches its own
+ * frame and its routine's counters and nothing else.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "../include/ddp24_calls.h"
+#include "../include/ddp24_asm.h"
+#include "ddp24_internal.h"
+
+typedef struct {
+    word_t entry;
+    uint64_t start;         /* Cycles at the call */
+    uint64_t callees;       /* Inclusive cycles of the calls it made */
+} frame_t;
+
+struct ddp24_calls {
+    int depth;
+    uint64_t dropped;       /* Calls past DDP24_CALLS_DEPTH */
+    uint64_t overflow;      /* Of those, the ones not returned yet */
+    uint64_t start, end;    /* Span followed, for percentages */
+    const struct ddp24_program *names;
+    frame_t stack[DDP24_CALLS_DEPTH];
+    uint32_t open[MEM_SIZE];            /* Frames on the stack per routine */
+    uint32_t deep[MEM_SIZE];            /* Calls past the stack per routine */
+    ddp24_routine_t routine[MEM_SIZE];
+};
+
+ddp24_calls_t *ddp24_calls_create(void) {
+    return ddp24_calloc(1, sizeof(ddp24_calls_t));
+}
+
+void ddp24_calls_free(ddp24_calls_t *calls) {
+    ddp24_free(calls);
+}
+
+/* From the JSL handler and interrupt delivery, with the call retired */
+void ddp24_calls_enter(ddp24_calls_t *calls, word_t entry, uint64_t now) {
+    calls->end = now;
+    if (calls->depth == DDP24_CALLS_DEPTH) {
+        calls->dropped++;
+        calls->overflow++;
+        calls->deep[entry]++;
+        return;
+    }
+    calls->stack[calls->depth++] = (frame_t){ entry, now, 0 };
+    calls->open[entry]++;
+    calls->routine[entry].calls++;
+}
+
+/* Close frames down to depth, and any calls past the stack above them */
+static void unwind(ddp24_calls_t *calls, int depth, uint64_t now) {
+    if (calls->overflow) {
+        memset(calls->deep, 0, sizeof(calls->deep));
+        calls->overflow = 0;
+    }
+    while (calls->depth > depth) {
+        const frame_t *f = &calls->stack[--calls->depth];
+        ddp24_routine_t *r = &calls->routine[f->entry];
+        uint64_t spent = now - f->start;
+        r->exclusive += spent - f->callees;
+        if (--calls->open[f->entry] == 0) {
+            r->inclusive += spent;      /* Outermost frame of a recursion */
+        }
+        if (calls->depth > 0) {
+            calls->stack[calls->depth - 1].callees += spent;
+        }
+    }
+}
+
+/* From JMP*, with the jump retired: a return if link is on the stack */
+void ddp24_calls_return(ddp24_calls_t *calls, word_t link, uint64_t now) {
+    if (calls->deep[link]) {
+        /* The innermost call through link was one past the stack */
+        calls->deep[link]--;
+        calls->overflow--;
+        calls->end = now;
+        return;
+    }
+    if (!calls->open[link]) {
+        return;
+    }
+    int n = calls->depth - 1;
+    while (calls->stack[n].entry != link) {
+        n--;
+    }
+    unwind(calls, n, now);
+    calls->end = now;
+}
+
+void ddp24_calls_attach(ddp24_t *cpu, ddp24_calls_t *calls) {
+    if (cpu->calls && cpu->calls != calls) {
+        unwind(cpu->calls, 0, cpu->cycles);
+        cpu->calls->end = cpu->cycles;
+    }
+    if (calls && calls != cpu->calls) {
+        calls->start = calls->end = cpu->cycles;
+    }
+    cpu->calls = calls;
+}
+
+bool ddp24_calls_routine(const ddp24_calls_t *calls, word_t entry, ddp24_routine_t *out) {
+    const ddp24_routine_t *r = &calls->routine[entry & ADDR_MASK];
+    if (!r->calls) {
+        return false;
+    }
+    *out = *r;
+    out->entry = entry & ADDR_MASK;
+    return true;
+}
+
+static int by_inclusive(const void *a, const void *b) {
+    const ddp24_routine_t *x = a, *y = b;
+    if (x->inclusive != y->inclusive) {
+        return x->inclusive < y->inclusive ? 1 : -1;
+    }
+    return (int)x->entry - (int)y->entry;
+}
+
+int ddp24_calls_top(const ddp24_calls_t *calls, ddp24_routine_t *out, int max) {
+    ddp24_routine_t *all = ddp24_malloc(MEM_SIZE * sizeof(ddp24_routine_t));
+    if (!all) {
+        return 0;
+    }
+    int n = 0;
+    for (word_t a = 0; a < MEM_SIZE; a++) {
+        if (ddp24_calls_routine(calls, a, &all[n])) {
+            n++;
+        }
+    }
+    qsort(all, n, sizeof(ddp24_routine_t), by_inclusive);
+    if (n > max) {
+        n = max;
+    }
+    memcpy(out, all, n * sizeof(ddp24_routine_t));
+    ddp24_free(all);
+    return n;
+}
+
+int ddp24_calls_depth(const ddp24_calls_t *calls) {
+    return calls->depth;
+}
+
+void ddp24_calls_names(ddp24_calls_t *calls, const struct ddp24_program *program) {
+    calls->names = program;
+}
+
+static double percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * part / total : 0.0;
+}
+
+void ddp24_calls_report(const ddp24_calls_t *calls, FILE *out, int top) {
+    uint64_t span = calls->end - calls->start;
+    ddp24_routine_t *rows = ddp24_malloc(MEM_SIZE * sizeof(ddp24_routine_t));
+    if (!rows) {
+        return;
+    }
+    int n = ddp24_calls_top(calls, rows, top > 0 ? top : MEM_SIZE);
+
+    fprintf(out, "=== Subroutines: %llu cycles followed ===\n\n", (unsigned long long)span);
+    fprintf(out, "%-6s %12s %16s %7s %16s %7s%s\n", "entry", "calls", "inclusive", "%", "exclusive", "%",
+            calls->names ? "  name" : "");
+    for (int i = 0; i < n; i++) {
+        char name[DDP24_SYMBOL_MAX + 16] = "";
+        if (calls->names) {
+            name[0] = name[1] = ' ';
+            ddp24_program_name(calls->names, rows[i].entry, name + 2, sizeof(name) - 2);
+        }
+        fprintf(out, "%05o  %12llu %16llu %6.2f%% %16llu %6.2f%%%s\n", rows[i].entry,
+                (unsigned long long)rows[i].calls,
+                (unsigned long long)rows[i].inclusive, percent(rows[i].inclusive, span),
+                (unsigned long long)rows[i].exclusive, percent(rows[i].exclusive, span), name);
+    }
+    if (calls->depth) {
+        fprintf(out, "\n%d frames still open\n", calls->depth);
+    }
+    if (calls->dropped) {
+        fprintf(out, "\n%llu calls deeper than %d frames not counted\n",
+                (unsigned long long)calls->dropped, DDP24_CALLS_DEPTH);
+    }
+    ddp24_free(rows);
+}
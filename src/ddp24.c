@@ -9,35 +9,90 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "../include/ddp24.h"
+#include "../include/ddp24_debug.h"
+#include "../include/ddp24_embed.h"
+#include "ddp24_internal.h"
 
-/* Sign-magnitude arithmetic helpers */
-static inline int32_t to_signed(word_t w) {
-    w &= WORD_MASK;
-    if (w & SIGN_BIT) {
-        return -(int32_t)(w & MAGNITUDE_MASK);
-    }
-    return (int32_t)(w & MAGNITUDE_MASK);
+/* Backs every page nobody has stored into. Never written: decode misses
+ * and stores copy a page before touching it. */
+ddp24_page_t ddp24_zero_page;
+
+/* Decode one word into its predecoded form */
+void ddp24_predecode(word_t instr, ddp24_decoded_t *d) {
+    ddp24_predecode_with(ddp24_active_timing, instr, d);
 }
 
-static inline word_t from_signed(int32_t v) {
-    if (v < 0) {
-        return SIGN_BIT | ((-v) & MAGNITUDE_MASK);
+void ddp24_predecode_with(const ddp24_timing_t *t, word_t instr, ddp24_decoded_t *d) {
+    uint8_t op = decode_opcode(instr);
+    bool implemented = ddp24_timing_ddp24.op[op] != 0;
+
+    d->op = op;
+    d->handler = implemented ? op : DDP24_H_ILLEGAL;
+    d->index = decode_index(instr);
+    d->flags = DDP24_DEC_VALID | (decode_indirect(instr) ? DDP24_DEC_INDIRECT : 0);
+    d->addr = decode_address(instr);
+    d->cycles = implemented ? t->op[op] : 5;
+
+    /* Shift count is static unless it comes through X or an indirect word */
+    if (d->index == 0 && !(d->flags & DDP24_DEC_INDIRECT)) {
+        if (op == OP_ARS || op == OP_ALS) {
+            d->cycles += t->per_shift * (d->addr & 0x1F);
+        } else if (op >= OP_LRR && op <= OP_LLS) {
+            d->cycles += t->per_shift * (d->addr & 0x3F);
+        }
     }
-    return v & MAGNITUDE_MASK;
 }
 
 /* Initialize CPU */
 void ddp24_init(ddp24_t *cpu) {
     memset(cpu, 0, sizeof(ddp24_t));
+    for (int n = 0; n < DDP24_PAGES; n++) {
+        cpu->page[n] = &ddp24_zero_page;
+    }
     cpu->halted = false;
     cpu->overflow = false;
     cpu->interrupt_enabled = false;
     cpu->cycles = 0;
+    cpu->next_event = DDP24_FOREVER;
+    cpu->timing = ddp24_active_timing;
+    cpu->xec_limit = DDP24_XEC_LIMIT;
+    atomic_init(&cpu->irq_posted, 0);
     /* X[0] is hardwired to 0 */
     cpu->X[0] = 0;
 }
 
+/* Initialize CPU on the pages of a shared image */
+void ddp24_init_image(ddp24_t *cpu, ddp24_image_t *image) {
+    ddp24_init(cpu);
+    cpu->image = ddp24_image_retain(image);
+    cpu->timing = image->timing;
+    memcpy(cpu->page, image->page, sizeof(cpu->page));
+}
+
+/* Free engine state and private pages; call before re-initialising or
+ * discarding a CPU. Memory reads as zero afterwards. */
+void ddp24_release(ddp24_t *cpu) {
+    ddp24_jit_detach(cpu);
+    cpu->profile = NULL;
+    cpu->trace = NULL;
+    cpu->calls = NULL;
+    cpu->hle = NULL;
+    cpu->hle_pages = 0;
+    ddp24_io_release(cpu);
+    ddp24_debug_release(cpu);
+    for (int n = 0; n < DDP24_PAGES; n++) {
+        if (cpu->page_private & (1ull << n)) {
+            ddp24_free(cpu->page[n]);
+        }
+        cpu->page[n] = &ddp24_zero_page;
+    }
+    cpu->page_private = 0;
+    if (cpu->image) {
+        ddp24_image_release(cpu->image);
+        cpu->image = NULL;
+    }
+}
+
 /* Reset CPU (preserves memory) */
 void ddp24_reset(ddp24_t *cpu) {
     cpu->A = 0;
@@ -50,342 +105,639 @@ void ddp24_reset(ddp24_t *cpu) {
     cpu->halted = false;
     cpu->overflow = false;
     cpu->interrupt_enabled = false;
+    cpu->interrupt_enable_next = false;
+    cpu->irq_pending = 0;
+    cpu->irq_mask = 0;
+    atomic_store(&cpu->irq_posted, 0);
+    cpu->fault = DDP24_FAULT_NONE;
     cpu->cycles = 0;
 }
 
+/* A page could not be copied: halt the CPU, not the host, and drop the
+ * store or decode that needed it */
+static void out_of_memory(ddp24_t *cpu, word_t pc) {
+    cpu->fault = DDP24_FAULT_NOMEM;
+    cpu->fault_pc = pc;
+    cpu->halted = true;
+    set_run_limit(cpu, 0);  /* The threaded engine tests only the limit */
+}
+
+/* Copy page n for the CPU on its first store there; NULL if out of memory */
+static ddp24_page_t *copy_page(ddp24_t *cpu, int n) {
+    ddp24_page_t *p = ddp24_malloc(sizeof(ddp24_page_t));
+    if (!p) {
+        return NULL;
+    }
+    memcpy(p, cpu->page[n], sizeof(ddp24_page_t));
+    cpu->page[n] = p;
+    cpu->page_private |= 1ull << n;
+    return p;
+}
+
+/* Give the CPU its own copy of page n */
+static inline ddp24_page_t *private_page(ddp24_t *cpu, int n) {
+    if (!(cpu->page_private & (1ull << n))) {
+        return copy_page(cpu, n);
+    }
+    return cpu->page[n];
+}
+
+/* Number of pages this CPU has copied */
+int ddp24_private_pages(const ddp24_t *cpu) {
+    int count = 0;
+    for (uint64_t m = cpu->page_private; m; m &= m - 1) {
+        count++;
+    }
+    return count;
+}
+
+/* Runs in place of a word that could not be decoded, halting on it */
+static const ddp24_decoded_t nomem_halt = { .op = OP_HLT, .handler = OP_HLT, .flags = DDP24_DEC_VALID };
+
+/* Decode into a private page; shared pages come predecoded */
+const ddp24_decoded_t *ddp24_decode_miss(ddp24_t *cpu, word_t addr) {
+    ddp24_page_t *p = private_page(cpu, addr >> DDP24_PAGE_SHIFT);
+    if (!p) {
+        out_of_memory(cpu, addr);
+        return &nomem_halt;
+    }
+    ddp24_decoded_t *d = &p->decoded[addr & DDP24_PAGE_MASK];
+    ddp24_predecode_with(cpu->timing, p->word[addr & DDP24_PAGE_MASK], d);
+    return d;
+}
+
 /* Memory read */
-word_t ddp24_read(ddp24_t *cpu, word_t addr) {
-    addr &= (MEM_SIZE - 1);
-    return cpu->memory[addr] & WORD_MASK;
+word_t ddp24_read(const ddp24_t *cpu, word_t addr) {
+    return mem_read(cpu, addr);
 }
 
-/* Memory write */
+/* Memory write (drops any predecoded copy of the word).
+ * Storing the value a shared page already holds does not copy it. */
 void ddp24_write(ddp24_t *cpu, word_t addr, word_t value) {
     addr &= (MEM_SIZE - 1);
-    cpu->memory[addr] = value & WORD_MASK;
+    value &= WORD_MASK;
+
+    int n = addr >> DDP24_PAGE_SHIFT;
+    word_t off = addr & DDP24_PAGE_MASK;
+    if (!(cpu->page_private & (1ull << n)) && cpu->page[n]->word[off] == value) {
+        return;
+    }
+
+    ddp24_page_t *p = private_page(cpu, n);
+    if (!p) {
+        out_of_memory(cpu, (cpu->PC - 1) & ADDR_MASK);
+        return;
+    }
+    p->hash ^= word_hash(addr, p->word[off]) ^ word_hash(addr, value);
+    p->word[off] = value;
+    p->decoded[off].flags = 0;
+    hle_store(cpu, addr, 1);
+    if (cpu->jit) {
+        ddp24_jit_invalidate(cpu, addr);
+    }
 }
 
-/* Calculate effective address */
-static word_t effective_address(ddp24_t *cpu, word_t instr) {
-    word_t addr = decode_address(instr);
-    uint8_t idx = decode_index(instr);
+/* Store count words starting at addr, a page at a time; stops at the
+ * top of memory. Returns the number of words stored. */
+word_t ddp24_write_block(ddp24_t *cpu, word_t addr, const word_t *src, word_t count) {
+    addr &= (MEM_SIZE - 1);
+    if (count > MEM_SIZE - addr) {
+        count = MEM_SIZE - addr;
+    }
 
-    /* Add index register (X[0] is always 0) */
-    if (idx > 0) {
-        addr = (addr + cpu->X[idx]) & ADDR_MASK;
+    for (word_t done = 0; done < count; ) {
+        word_t a = addr + done;
+        int n = a >> DDP24_PAGE_SHIFT;
+        word_t off = a & DDP24_PAGE_MASK;
+        word_t len = DDP24_PAGE_SIZE - off;
+        if (len > count - done) {
+            len = count - done;
+        }
+
+        /* Like ddp24_write, leave shared pages alone if nothing changes */
+        if ((cpu->page_private & (1ull << n)) ||
+            memcmp(&cpu->page[n]->word[off], src + done, len * sizeof(word_t)) != 0) {
+            ddp24_page_t *p = private_page(cpu, n);
+            if (!p) {
+                out_of_memory(cpu, (cpu->PC - 1) & ADDR_MASK);
+                return done;
+            }
+            for (word_t i = 0; i < len; i++) {
+                word_t v = src[done + i] & WORD_MASK;
+                p->hash ^= word_hash(a + i, p->word[off + i]) ^ word_hash(a + i, v);
+                p->word[off + i] = v;
+            }
+            memset(&p->decoded[off], 0, len * sizeof(ddp24_decoded_t));
+            hle_store(cpu, a, len);
+            if (cpu->jit) {
+                for (word_t i = 0; i < len; i++) {
+                    ddp24_jit_invalidate(cpu, a + i);
+                }
+            }
+        }
+        done += len;
+    }
+    return count;
+}
+
+/* Store value in count words from addr, wrapping at the top of memory */
+void ddp24_fill_block(ddp24_t *cpu, word_t addr, word_t value, word_t count) {
+    value &= WORD_MASK;
+    if (count > MEM_SIZE) {
+        count = MEM_SIZE;
+    }
+
+    for (word_t done = 0; done < count; ) {
+        word_t a = (addr + done) & (MEM_SIZE - 1);
+        int n = a >> DDP24_PAGE_SHIFT;
+        word_t off = a & DDP24_PAGE_MASK;
+        word_t len = DDP24_PAGE_SIZE - off;
+        if (len > count - done) {
+            len = count - done;
+        }
+
+        bool same = !(cpu->page_private & (1ull << n));
+        for (word_t i = 0; same && i < len; i++) {
+            same = cpu->page[n]->word[off + i] == value;
+        }
+        if (!same) {
+            ddp24_page_t *p = private_page(cpu, n);
+            if (!p) {
+                out_of_memory(cpu, (cpu->PC - 1) & ADDR_MASK);
+                return;
+            }
+            for (word_t i = 0; i < len; i++) {
+                p->hash ^= word_hash(a + i, p->word[off + i]) ^ word_hash(a + i, value);
+                p->word[off + i] = value;
+            }
+            memset(&p->decoded[off], 0, len * sizeof(ddp24_decoded_t));
+            hle_store(cpu, a, len);
+            if (cpu->jit) {
+                for (word_t i = 0; i < len; i++) {
+                    ddp24_jit_invalidate(cpu, a + i);
+                }
+            }
+        }
+        done += len;
+    }
+}
+
+/* ddp24_write_block, carrying on at 0 past the top of memory; false if
+ * it ran out of memory */
+static bool write_wrapped(ddp24_t *cpu, word_t addr, const word_t *src, word_t count) {
+    word_t first = ddp24_write_block(cpu, addr, src, count);
+    if (first < count && addr + first < MEM_SIZE) {
+        return false;
     }
+    return first == count || ddp24_write_block(cpu, 0, src + first, count - first) == count - first;
+}
+
+/* Copy count words from src to dst, wrapping at the top of memory, with
+ * the result of copying one word at a time upwards: a destination just
+ * above its source repeats the words in between. */
+void ddp24_copy_block(ddp24_t *cpu, word_t dst, word_t src, word_t count) {
+    word_t buf[DDP24_PAGE_SIZE];
+    word_t lead = (dst - src) & (MEM_SIZE - 1);
+    if (lead == 0) {
+        return;
+    }
+    if (count > MEM_SIZE) {
+        count = MEM_SIZE;
+    }
+
+    if (lead < count && lead <= DDP24_PAGE_SIZE) {
+        /* Repeat the first lead words, in whole periods per write */
+        word_t span = DDP24_PAGE_SIZE / lead * lead;
+        for (word_t i = 0; i < lead; i++) {
+            buf[i] = mem_read(cpu, src + i);
+        }
+        for (word_t i = lead; i < span; i++) {
+            buf[i] = buf[i - lead];
+        }
+        for (word_t done = 0; done < count; done += span) {
+            if (!write_wrapped(cpu, (dst + done) & (MEM_SIZE - 1), buf,
+                               count - done < span ? count - done : span)) {
+                return;
+            }
+        }
+        return;
+    }
+
+    /* Chunks no longer than the lead never read what they write */
+    for (word_t done = 0; done < count; ) {
+        word_t s = (src + done) & (MEM_SIZE - 1);
+        word_t len = DDP24_PAGE_SIZE - (s & DDP24_PAGE_MASK);
+        if (len > count - done) {
+            len = count - done;
+        }
+        if (len > lead) {
+            len = lead;
+        }
+        memcpy(buf, &cpu->page[s >> DDP24_PAGE_SHIFT]->word[s & DDP24_PAGE_MASK], len * sizeof(word_t));
+        if (!write_wrapped(cpu, (dst + done) & (MEM_SIZE - 1), buf, len)) {
+            return;
+        }
+        done += len;
+    }
+}
+
+/* Drop predecoded words after the host writes a private page directly,
+ * and rehash the pages touched */
+void ddp24_invalidate(ddp24_t *cpu, word_t addr, word_t count) {
+    uint64_t touched = 0;
+    if (count >= MEM_SIZE) {
+        count = MEM_SIZE;
+    }
+    if (cpu->hle_pages) {
+        ddp24_hle_forget(cpu, addr, count);
+    }
+    for (word_t i = 0; i < count; i++) {
+        word_t a = (addr + i) & (MEM_SIZE - 1);
+        int n = a >> DDP24_PAGE_SHIFT;
+        if (cpu->page_private & (1ull << n)) {
+            cpu->page[n]->decoded[a & DDP24_PAGE_MASK].flags = 0;
+            touched |= 1ull << n;
+        }
+        if (cpu->jit) {
+            ddp24_jit_invalidate(cpu, a);
+        }
+    }
+    for (int n = 0; touched; n++, touched >>= 1) {
+        if (touched & 1) {
+            cpu->page[n]->hash = ddp24_page_hash(cpu->page[n], n);
+        }
+    }
+}
 
-    /* Handle indirect addressing */
-    if (decode_indirect(instr)) {
-        addr = ddp24_read(cpu, addr) & ADDR_MASK;
+uint64_t ddp24_page_hash(const ddp24_page_t *p, int n) {
+    uint64_t h = 0;
+    for (word_t i = 0; i < DDP24_PAGE_SIZE; i++) {
+        h ^= word_hash(((word_t)n << DDP24_PAGE_SHIFT) + i, p->word[i]);
     }
+    return h;
+}
 
-    return addr;
+uint64_t ddp24_state_hash(const ddp24_t *cpu) {
+    uint64_t h = 0;
+    for (int n = 0; n < DDP24_PAGES; n++) {
+        h ^= cpu->page[n]->hash;
+    }
+    const uint64_t regs[] = {
+        cpu->A, cpu->B, cpu->X[1], cpu->X[2], cpu->X[3], cpu->PC,
+        (uint64_t)cpu->overflow | (uint64_t)cpu->halted << 1 | (uint64_t)cpu->interrupt_enabled << 2 |
+            (uint64_t)cpu->interrupt_enable_next << 3,
+        cpu->irq_pending, cpu->irq_mask,
+    };
+    for (size_t i = 0; i < sizeof(regs) / sizeof(regs[0]); i++) {
+        h = (h ^ regs[i]) * 0x100000001b3ull;
+        h ^= h >> 29;
+    }
+    return h;
 }
 
+/* Handler glue for the switch in ddp24_step */
+#define OP(name)    case OP_##name:
+#define OP_DEFAULT  default:
+#define NEXT        break
+#define STOP        break
+#define R_A         cpu->A
+#define R_B         cpu->B
+#define R_PC        cpu->PC
+#define R_X(i)      cpu->X[i]
+#define F_OVF       cpu->overflow
+#define F_HLT       cpu->halted
+#define RD(addr)    (WATCH(watch_read_pages & PAGE_BIT(addr), addr, 1, DDP24_WATCH_READ), mem_read(cpu, addr))
+#define WR(addr, v) (WATCH(watch_write_pages & PAGE_BIT(addr), addr, 1, DDP24_WATCH_WRITE), ddp24_write(cpu, addr, v))
+#define FETCH(addr) fetch(cpu, addr)
+#define EA(d)       effective_address(cpu, d)
+#define CHARGE(n)   (cpu->cycles += (n))
+#define TIMING      cpu->timing
+#define XEC_LIMIT   cpu->xec_limit
+#define EXECUTE()   goto execute
+#define IDLE(head)  ddp24_idle_skip(cpu, head, cycles)
+#define IO_CONTROL(ea)      ddp24_io_control(cpu, ea)
+#define IO_INPUT(ea)        ddp24_io_input(cpu, ea)
+#define IO_OUTPUT(ea, v)    ddp24_io_output(cpu, ea, v)
+#define IO_SENSE(ea)        ddp24_io_sense(cpu, ea)
+#define IO_ITC(ea)          ddp24_itc(cpu, ea)
+#define FAULT(kind, pc)     (cpu->fault = (kind), cpu->fault_pc = (pc))
+#define CALL(entry)     (cpu->calls ? ddp24_calls_enter(cpu->calls, entry, cpu->cycles + cycles) : (void)0)
+#define RETURN(link)    (cpu->calls ? ddp24_calls_return(cpu->calls, link, cpu->cycles + cycles) : (void)0)
+#define HLE(link)       (cpu->hle && ddp24_hle_enter(cpu, link, &cycles))
+#define FILL(addr, v, n)    (WATCH(watch_write_pages, addr, n, DDP24_WATCH_WRITE), \
+                             ddp24_fill_block(cpu, addr, v, n))
+#define COPY(dst, src, n)   (WATCH(watch_read_pages, src, n, DDP24_WATCH_READ), \
+                             WATCH(watch_write_pages, dst, n, DDP24_WATCH_WRITE), \
+                             ddp24_copy_block(cpu, dst, src, n))
+
+/* With nothing watched, one test of a page mask per access */
+#define WATCH(pages, addr, n, kind) \
+    ((cpu->pages) ? ddp24_watch_access(cpu, pc, addr, n, kind) : (void)0)
+
 /* Execute one instruction, return cycles used */
 int ddp24_step(ddp24_t *cpu) {
     if (cpu->halted) {
         return 0;
     }
 
-    word_t instr = ddp24_read(cpu, cpu->PC);
+    word_t pc = cpu->PC;
+    const ddp24_decoded_t *d = fetch(cpu, pc);
+    word_t instr = cpu->trace ? mem_read(cpu, pc) : 0;  /* Before it can store over itself */
     cpu->PC = (cpu->PC + 1) & ADDR_MASK;
 
-    uint8_t op = decode_opcode(instr);
-    word_t ea = effective_address(cpu, instr);
+    word_t ea = effective_address(cpu, d);
     word_t operand;
-    int32_t sa, sb, result;
-    int cycles = 5;  /* Default cycle count */
-
-    switch (op) {
-        case OP_HLT:  /* Halt */
-            cpu->halted = true;
-            cpu->PC = (cpu->PC - 1) & ADDR_MASK;  /* Stay at HLT */
-            cycles = 5;
-            break;
-
-        case OP_NOP:  /* No Operation */
-            cycles = 5;
-            break;
-
-        case OP_LDA:  /* Load A */
-            cpu->A = ddp24_read(cpu, ea);
-            cycles = 10;
-            break;
-
-        case OP_LDB:  /* Load B */
-            cpu->B = ddp24_read(cpu, ea);
-            cycles = 10;
-            break;
-
-        case OP_STA:  /* Store A */
-            ddp24_write(cpu, ea, cpu->A);
-            cycles = 10;
-            break;
-
-        case OP_STB:  /* Store B */
-            ddp24_write(cpu, ea, cpu->B);
-            cycles = 10;
-            break;
-
-        case OP_ADD:  /* Add */
-            operand = ddp24_read(cpu, ea);
-            sa = to_signed(cpu->A);
-            sb = to_signed(operand);
-            result = sa + sb;
-            /* Check overflow */
-            if (result > 0x7FFFFF || result < -0x7FFFFF) {
-                cpu->overflow = true;
-            }
-            cpu->A = from_signed(result);
-            cycles = 10;
-            break;
-
-        case OP_SUB:  /* Subtract */
-            operand = ddp24_read(cpu, ea);
-            sa = to_signed(cpu->A);
-            sb = to_signed(operand);
-            result = sa - sb;
-            if (result > 0x7FFFFF || result < -0x7FFFFF) {
-                cpu->overflow = true;
-            }
-            cpu->A = from_signed(result);
-            cycles = 10;
-            break;
-
-        case OP_MPY:  /* Multiply */
-            {
-                operand = ddp24_read(cpu, ea);
-                /* Get magnitudes and signs */
-                uint32_t b_mag = cpu->B & MAGNITUDE_MASK;
-                uint32_t y_mag = operand & MAGNITUDE_MASK;
-                bool b_neg = (cpu->B & SIGN_BIT) != 0;
-                bool y_neg = (operand & SIGN_BIT) != 0;
-                bool result_neg = b_neg ^ y_neg;
-
-                /* 46-bit product (23-bit * 23-bit = 46-bit) */
-                uint64_t product = (uint64_t)b_mag * (uint64_t)y_mag;
-
-                /* Most significant 23 bits to A, least significant 23 to B */
-                uint32_t a_mag = (product >> 23) & MAGNITUDE_MASK;
-                uint32_t new_b_mag = product & MAGNITUDE_MASK;
-
-                /* Set signs to algebraic sign of product */
-                cpu->A = (result_neg && (a_mag || new_b_mag)) ? (SIGN_BIT | a_mag) : a_mag;
-                cpu->B = (result_neg && (a_mag || new_b_mag)) ? (SIGN_BIT | new_b_mag) : new_b_mag;
-            }
-            cycles = 28;  /* 14 usec average */
-            break;
-
-        case OP_DIV:  /* Divide */
-            {
-                operand = ddp24_read(cpu, ea);
-                uint32_t divisor_mag = operand & MAGNITUDE_MASK;
-                uint32_t a_mag = cpu->A & MAGNITUDE_MASK;
-                bool dividend_neg = (cpu->A & SIGN_BIT) != 0;
-                bool divisor_neg = (operand & SIGN_BIT) != 0;
-
-                /* Check for improper divide (A >= divisor) */
-                if (a_mag >= divisor_mag) {
-                    /* Set improper divide indicator and skip */
-                    cpu->overflow = true;
-                    cycles = 44;
-                    break;
-                }
+    int32_t result;
+    int cycles = d->cycles;
+    uint64_t start = cpu->cycles;
 
-                /* Form 46-bit dividend from A:B */
-                uint64_t dividend = ((uint64_t)(cpu->A & MAGNITUDE_MASK) << 23) |
-                                    (cpu->B & MAGNITUDE_MASK);
+execute:
+    switch (d->handler) {
+#include "ddp24_ops.inc"
+    }
 
-                /* Divide */
-                uint32_t quotient = dividend / divisor_mag;
-                uint32_t remainder = dividend % divisor_mag;
+    cpu->cycles += cycles;
+    cycles = (int)(cpu->cycles - start);    /* With any XEC chain in front */
+    if (cpu->trace) {
+        ddp24_trace_rec_t rec = { pc, instr, ea, cpu->A, cpu->B, (uint32_t)cycles };
+        ddp24_trace_record(cpu->trace, &rec);
+    }
+#ifdef DDP24_PROFILE
+    if (cpu->profile) {
+        ddp24_profile_record(cpu, pc, d, ea, cycles);
+    }
+#endif
+    return cycles;
+}
 
-                /* Quotient sign is algebraic, remainder sign is dividend sign */
-                bool quotient_neg = dividend_neg ^ divisor_neg;
+#undef OP
+#undef OP_DEFAULT
+#undef NEXT
+#undef STOP
+#undef R_A
+#undef R_B
+#undef R_PC
+#undef R_X
+#undef F_OVF
+#undef F_HLT
+#undef RD
+#undef WR
+#undef FETCH
+#undef EA
+#undef CHARGE
+#undef XEC_LIMIT
+#undef EXECUTE
+#undef IDLE
+#undef IO_CONTROL
+#undef IO_INPUT
+#undef IO_OUTPUT
+#undef IO_SENSE
+#undef IO_ITC
+#undef FAULT
+#undef CALL
+#undef RETURN
+#undef HLE
+#undef FILL
+#undef COPY
+#undef WATCH
+
+/* Switch engine: the reference, one ddp24_step per instruction */
+void ddp24_run_switch(ddp24_t *cpu) {
+    while (!cpu->halted && cpu->cycles < RUN_LIMIT(cpu)) {
+        ddp24_step(cpu);
+    }
+}
 
-                cpu->B = (quotient_neg && quotient) ? (SIGN_BIT | quotient) : quotient;
-                cpu->A = (dividend_neg && remainder) ? (SIGN_BIT | remainder) : remainder;
+/* Select execution engine */
+bool ddp24_set_engine(ddp24_t *cpu, ddp24_engine_t engine) {
+    switch (engine) {
+        case DDP24_ENGINE_SWITCH:
+        case DDP24_ENGINE_THREADED:
+            ddp24_jit_detach(cpu);
+            cpu->engine = engine;
+            return true;
+        case DDP24_ENGINE_JIT:
+            if (!ddp24_jit_attach(cpu)) {
+                return false;
             }
-            cycles = 44;  /* 22 usec */
-            break;
-
-        case OP_ANA:  /* AND to A */
-            operand = ddp24_read(cpu, ea);
-            cpu->A = (cpu->A & operand) & WORD_MASK;
-            cycles = 10;
-            break;
-
-        case OP_ORA:  /* OR to A */
-            operand = ddp24_read(cpu, ea);
-            cpu->A = (cpu->A | operand) & WORD_MASK;
-            cycles = 10;
-            break;
-
-        case OP_ERA:  /* Exclusive OR to A */
-            operand = ddp24_read(cpu, ea);
-            cpu->A = (cpu->A ^ operand) & WORD_MASK;
-            cycles = 10;
-            break;
-
-        case OP_JMP:  /* Unconditional Jump */
-            cpu->PC = ea;
-            cycles = 5;
-            break;
-
-        case OP_JPL:  /* Jump if A Plus */
-            if (!(cpu->A & SIGN_BIT) && (cpu->A & MAGNITUDE_MASK) != 0) {
-                cpu->PC = ea;
-            }
-            cycles = 6;
-            break;
+            cpu->engine = engine;
+            return true;
+    }
+    return false;
+}
 
-        case OP_JMI:  /* Jump if A Minus */
-            if (cpu->A & SIGN_BIT) {
-                cpu->PC = ea;
-            }
-            cycles = 6;
-            break;
+bool ddp24_engine_available(ddp24_engine_t engine) {
+    switch (engine) {
+        case DDP24_ENGINE_SWITCH:
+        case DDP24_ENGINE_THREADED: return true;
+        case DDP24_ENGINE_JIT:      return DDP24_JIT_AVAILABLE;
+    }
+    return false;
+}
 
-        case OP_JZE:  /* Jump if A Zero */
-            if ((cpu->A & MAGNITUDE_MASK) == 0) {
-                cpu->PC = ea;
-            }
-            cycles = 6;
-            break;
+const char *ddp24_engine_name(ddp24_engine_t engine) {
+    switch (engine) {
+        case DDP24_ENGINE_SWITCH:   return "switch";
+        case DDP24_ENGINE_THREADED: return "threaded";
+        case DDP24_ENGINE_JIT:      return "jit";
+    }
+    return "unknown";
+}
 
-        case OP_JNZ:  /* Jump if A Not Zero */
-            if ((cpu->A & MAGNITUDE_MASK) != 0) {
-                cpu->PC = ea;
-            }
-            cycles = 6;
-            break;
-
-        case OP_JSL:  /* Jump and Store Location */
-            ddp24_write(cpu, ea, cpu->PC);
-            cpu->PC = (ea + 1) & ADDR_MASK;
-            cycles = 10;
-            break;
-
-        case OP_SKG:  /* Skip if A Greater */
-            operand = ddp24_read(cpu, ea);
-            if (to_signed(cpu->A) > to_signed(operand)) {
-                cpu->PC = (cpu->PC + 1) & ADDR_MASK;
+/* Run until halt, a stop request, or cycles reaches deadline.
+ * The instruction that crosses the deadline completes, so a host slicing
+ * time with absolute deadlines never drifts. Engines run in stretches
+ * that end at the next device event or deliverable interrupt, which are
+ * handled in between. */
+ddp24_stop_t ddp24_run_until(ddp24_t *cpu, uint64_t deadline) {
+    uint64_t start = cpu->cycles;
+    while (cpu->stop == DDP24_STOP_NONE && !cpu->halted && cpu->cycles < deadline) {
+        if (cpu->cycles >= cpu->next_event) {
+            ddp24_io_fire(cpu);
+            continue;
+        }
+        if (ddp24_irq_service(cpu)) {
+            continue;
+        }
+        /* Seq-cst against ddp24_post_interrupt: either it sees this
+         * limit and lowers it, or the interrupt is seen here */
+        atomic_store(&cpu->run_limit, deadline < cpu->next_event ? deadline : cpu->next_event);
+        if (atomic_load(&cpu->irq_posted)) {
+            continue;
+        }
+        /* Only ddp24_step feeds the trace and the profiler */
+        ddp24_engine_t engine = cpu->engine;
+        if (cpu->trace) {
+            engine = DDP24_ENGINE_SWITCH;
+        }
+#ifdef DDP24_PROFILE
+        if (cpu->profile) {
+            engine = DDP24_ENGINE_SWITCH;
+        }
+#endif
+        if (debug_active(cpu)) {
+            ddp24_run_debug(cpu, start);    /* Steps, checking breakpoints */
+        } else {
+            switch (engine) {
+                case DDP24_ENGINE_THREADED: ddp24_run_threaded(cpu); break;
+                case DDP24_ENGINE_JIT:      ddp24_run_jit(cpu); break;
+                default:                    ddp24_run_switch(cpu); break;
             }
-            cycles = 10;
-            break;
+        }
+        set_run_limit(cpu, 0);  /* Lone ddp24_step calls never skip idle loops */
+    }
 
-        case OP_SKN:  /* Skip if A Not Equal */
-            operand = ddp24_read(cpu, ea);
-            if (cpu->A != operand) {
-                cpu->PC = (cpu->PC + 1) & ADDR_MASK;
-            }
-            cycles = 10;
-            break;
-
-        case OP_TAB:  /* Transfer A to B */
-            cpu->B = cpu->A;
-            cycles = 5;
-            break;
-
-        case OP_IAB:  /* Interchange A and B */
-            operand = cpu->A;
-            cpu->A = cpu->B;
-            cpu->B = operand;
-            cycles = 10;
-            break;
-
-        case OP_LDX:  /* Load Index */
-            {
-                uint8_t idx = decode_index(instr);
-                if (idx > 0) {
-                    cpu->X[idx] = ddp24_read(cpu, ea) & ADDR_MASK;
-                }
-            }
-            cycles = 5;
-            break;
+    ddp24_stop_t reason = cpu->stop;
+    cpu->stop = DDP24_STOP_NONE;
+    if (reason != DDP24_STOP_NONE) {
+        return reason;
+    }
+    return cpu->halted ? DDP24_STOP_HALTED : DDP24_STOP_BUDGET;
+}
 
-        case OP_SIX:  /* Store Index */
-            {
-                uint8_t idx = decode_index(instr);
-                ddp24_write(cpu, ea, cpu->X[idx]);
-            }
-            cycles = 10;
-            break;
-
-        case OP_ARS:  /* A Right Shift */
-            {
-                word_t count = ea & 0x1F;  /* 5-bit shift count */
-                word_t sign = cpu->A & SIGN_BIT;
-                cpu->A = sign | ((cpu->A & MAGNITUDE_MASK) >> count);
-            }
-            cycles = 5 + (ea & 0x1F);
-            break;
-
-        case OP_ALS:  /* A Left Shift */
-            {
-                word_t count = ea & 0x1F;
-                word_t sign = cpu->A & SIGN_BIT;
-                cpu->A = sign | (((cpu->A & MAGNITUDE_MASK) << count) & MAGNITUDE_MASK);
-            }
-            cycles = 5 + (ea & 0x1F);
-            break;
+/* Run for budget more cycles (0 = no limit) */
+ddp24_stop_t ddp24_run_for(ddp24_t *cpu, uint64_t budget) {
+    if (budget == 0 || budget > DDP24_FOREVER - cpu->cycles) {
+        return ddp24_run_until(cpu, DDP24_FOREVER);
+    }
+    return ddp24_run_until(cpu, cpu->cycles + budget);
+}
 
-        case OP_XEC:  /* Execute */
-            /* Execute instruction at EA without changing PC */
-            cpu->PC = (ea + 1) & ADDR_MASK;
-            cycles = 5 + ddp24_step(cpu);
-            /* Note: PC changes from executed instruction are kept */
-            break;
+/* Run until halt or max_cycles, return cycles used */
+int ddp24_run(ddp24_t *cpu, int max_cycles) {
+    uint64_t start = cpu->cycles;
+    ddp24_run_for(cpu, max_cycles > 0 ? (uint64_t)max_cycles : 0);
+    return (int)(cpu->cycles - start);
+}
 
-        default:
-            fprintf(stderr, "Unimplemented opcode: %02o at PC=%05o\n", op, cpu->PC - 1);
-            cpu->halted = true;
-            break;
-    }
+/* End the current run after the instruction in progress, or the next
+ * run before it starts. Not safe to call from another thread. */
+void ddp24_request_stop(ddp24_t *cpu, ddp24_stop_t reason) {
+    cpu->stop = reason;
+    set_run_limit(cpu, 0);
+}
 
-    cpu->cycles += cycles;
-    return cycles;
+const char *ddp24_stop_name(ddp24_stop_t reason) {
+    switch (reason) {
+        case DDP24_STOP_NONE:       return "none";
+        case DDP24_STOP_HALTED:     return "halted";
+        case DDP24_STOP_BUDGET:     return "budget";
+        case DDP24_STOP_BREAKPOINT: return "breakpoint";
+        case DDP24_STOP_WATCHPOINT: return "watchpoint";
+        case DDP24_STOP_IO_WAIT:    return "io-wait";
+    }
+    return "unknown";
 }
 
-/* Run until halt or max_cycles */
-int ddp24_run(ddp24_t *cpu, int max_cycles) {
-    int total = 0;
-    while (!cpu->halted && (max_cycles <= 0 || total < max_cycles)) {
-        total += ddp24_step(cpu);
+const char *ddp24_fault_name(ddp24_fault_t fault) {
+    switch (fault) {
+        case DDP24_FAULT_NONE:      return "none";
+        case DDP24_FAULT_ILLEGAL:   return "unimplemented opcode";
+        case DDP24_FAULT_XEC_CHAIN: return "XEC chain too long";
+        case DDP24_FAULT_NOMEM:     return "out of memory";
     }
-    return total;
+    return "unknown";
+}
+
+/* CPU state as ddp24_dump prints it */
+int ddp24_format_state(const ddp24_t *cpu, char *buf, size_t size) {
+    return snprintf(buf, size,
+                    "=== DDP-24 CPU State ===\n"
+                    "PC: %05o  A: %08o  B: %08o\n"
+                    "X1: %05o  X2: %05o  X3: %05o\n"
+                    "Flags: %s%s%s\n"
+                    "Cycles: %llu\n",
+                    cpu->PC, cpu->A, cpu->B, cpu->X[1], cpu->X[2], cpu->X[3],
+                    cpu->overflow ? "OVF " : "",
+                    cpu->halted ? "HLT " : "",
+                    cpu->interrupt_enabled ? "INT " : "",
+                    (unsigned long long)cpu->cycles);
 }
 
 /* Dump CPU state */
 void ddp24_dump(ddp24_t *cpu) {
-    printf("=== DDP-24 CPU State ===\n");
-    printf("PC: %05o  A: %08o  B: %08o\n", cpu->PC, cpu->A, cpu->B);
-    printf("X1: %05o  X2: %05o  X3: %05o\n", cpu->X[1], cpu->X[2], cpu->X[3]);
-    printf("Flags: %s%s%s\n",
-           cpu->overflow ? "OVF " : "",
-           cpu->halted ? "HLT " : "",
-           cpu->interrupt_enabled ? "INT " : "");
-    printf("Cycles: %llu\n", (unsigned long long)cpu->cycles);
-}
-
-/* Load binary file into memory */
-int ddp24_load(ddp24_t *cpu, const char *filename) {
-    FILE *f = fopen(filename, "rb");
-    if (!f) {
-        perror(filename);
-        return -1;
-    }
-
-    /* Simple format: 3 bytes per word, big-endian */
-    word_t addr = 0;
-    uint8_t buf[3];
-    while (fread(buf, 1, 3, f) == 3 && addr < MEM_SIZE) {
-        cpu->memory[addr++] = (buf[0] << 16) | (buf[1] << 8) | buf[2];
-    }
-
-    fclose(f);
-    printf("Loaded %d words from %s\n", addr, filename);
-    return addr;
+    char buf[256];
+    ddp24_format_state(cpu, buf, sizeof(buf));
+    fputs(buf, stdout);
+}
+
+
+/* Freeze a CPU's memory into a shared image, predecoding every word */
+ddp24_image_t *ddp24_image_create(const ddp24_t *cpu) {
+    return ddp24_image_create_decoded(cpu, NULL);
+}
+
+/* Same, predecoding only the words set in decode (one bit per address,
+ * NULL for all); the other words decode on a CPU's first fetch */
+ddp24_image_t *ddp24_image_create_decoded(const ddp24_t *cpu, const uint64_t *decode) {
+    ddp24_image_t *image = ddp24_calloc(1, sizeof(ddp24_image_t));
+    if (!image) {
+        return NULL;
+    }
+    atomic_init(&image->refs, 1);
+    image->parent = NULL;
+    image->timing = cpu->timing;
+
+    for (int n = 0; n < DDP24_PAGES; n++) {
+        const word_t *src = cpu->page[n]->word;
+        bool zero = true;
+        for (int i = 0; i < DDP24_PAGE_SIZE && zero; i++) {
+            zero = src[i] == 0;
+        }
+        if (zero) {
+            image->page[n] = &ddp24_zero_page;
+            continue;
+        }
+
+        ddp24_page_t *p = ddp24_malloc(sizeof(ddp24_page_t));
+        if (!p) {
+            ddp24_image_release(image);
+            return NULL;
+        }
+        memcpy(p->word, src, sizeof(p->word));
+        for (int i = 0; i < DDP24_PAGE_SIZE; i++) {
+            word_t addr = (word_t)(n * DDP24_PAGE_SIZE + i);
+            if (!decode || (decode[addr / 64] >> (addr % 64) & 1)) {
+                ddp24_predecode_with(image->timing, p->word[i], &p->decoded[i]);
+            } else {
+                p->decoded[i].flags = 0;
+            }
+        }
+        p->hash = cpu->page[n]->hash;
+        image->page[n] = p;
+        image->owned |= 1ull << n;
+    }
+    return image;
+}
+
+/* Load a binary file straight into a new shared image */
+ddp24_image_t *ddp24_image_load(const char *filename) {
+    ddp24_t cpu;
+    ddp24_init(&cpu);
+    ddp24_image_t *image = NULL;
+    if (ddp24_load_image(&cpu, filename, 0) >= 0) {
+        image = ddp24_image_create(&cpu);
+    }
+    ddp24_release(&cpu);
+    return image;
+}
+
+/* Take another reference */
+ddp24_image_t *ddp24_image_retain(ddp24_image_t *image) {
+    atomic_fetch_add(&image->refs, 1);
+    return image;
+}
+
+/* Drop one reference; the last one frees the pages */
+void ddp24_image_release(ddp24_image_t *image) {
+    if (!image || atomic_fetch_sub(&image->refs, 1) != 1) {
+        return;
+    }
+    for (int n = 0; n < DDP24_PAGES; n++) {
+        if (image->owned & (1ull << n)) {
+            ddp24_free(image->page[n]);
+        }
+    }
+    ddp24_image_release(image->parent);
+    ddp24_free(image);
 }
@@ -0,0 +1,227 @@
+/*
+ * DDP-24 Emulator - Internal Helpers
+ * Viking Mars Lander Guidance Computer
+ *
+ * Shared by the execution engines; not part of the public interface.
+ */
+
+#ifndef DDP24_INTERNAL_H
+#define DDP24_INTERNAL_H
+
+#include <stdatomic.h>
+#include "../include/ddp24.h"
+#include "../include/ddp24_trace.h"
+#include "../include/ddp24_timing.h"
+#include "../include/ddp24_embed.h"
+
+/* Labels-as-values is a GNU extension; other compilers use the switch */
+#if defined(__GNUC__) || defined(__clang__)
+#define DDP24_HAVE_COMPUTED_GOTO 1
+#else
+#define DDP24_HAVE_COMPUTED_GOTO 0
+#endif
+
+/* The JIT tier needs -DDDP24_JIT (make JIT=1) and an x86-64 host */
+#if defined(DDP24_JIT) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DDP24_JIT_AVAILABLE 1
+#else
+#define DDP24_JIT_AVAILABLE 0
+#endif
+
+/* Handler name for every opcode slot, in numeric order */
+#define DDP24_SLOTS(X) \
+    X(HLT)     X(ILLEGAL) X(XEC)     X(STB)     X(STC)     X(STA)     X(SAA)     X(INA)     \
+    X(ADD)     X(SUB)     X(SKG)     X(SKN)     X(ILLEGAL) X(ANA)     X(ORA)     X(ERA)     \
+    X(ADM)     X(SBM)     X(ILLEGAL) X(LDB)     X(LDA)     X(EAB)     X(ILLEGAL) X(JSL)     \
+    X(SMP)     X(ILLEGAL) X(FMB)     X(DMB)     X(MPY)     X(DIV)     X(BCD)     X(DCB)     \
+    X(ARS)     X(ALS)     X(LRR)     X(LLR)     X(LRS)     X(LLS)     X(NRM)     X(ILLEGAL) \
+    X(OCP)     X(ITC)     X(ITA)     X(OTA)     X(SMX)     X(TAB)     X(LDX)     X(IAB)     \
+    X(ILLEGAL) X(SKS)     X(RND)     X(TAX)     X(SCR)     X(SCL)     X(SIX)     X(RIX)     \
+    X(JPL)     X(JZE)     X(JMI)     X(JNZ)     X(JMP)     X(JXI)     X(ILLEGAL) X(NOP)
+
+/* Shared memory image. Pages are immutable and predecoded, but for
+ * the data words of a program's image; the ones not owned belong to
+ * the parent (or are the zero page). */
+struct ddp24_image {
+    atomic_int refs;                    /* Creator plus every CPU using it */
+    ddp24_page_t *page[DDP24_PAGES];
+    uint64_t owned;                     /* Bit n set: this image frees page[n] */
+    ddp24_image_t *parent;              /* Holds the pages not owned, or NULL */
+    const ddp24_timing_t *timing;       /* Costs its pages were decoded with */
+};
+
+extern ddp24_page_t ddp24_zero_page;
+
+/* A:B as one 46-bit magnitude, A's half on top. Long results carry
+ * A's sign in both words, as MPY leaves them. */
+#define LONG_BITS   46
+#define LONG_MASK   ((1ull << LONG_BITS) - 1)
+
+static inline uint64_t long_magnitude(word_t a, word_t b) {
+    return (uint64_t)(a & MAGNITUDE_MASK) << 23 | (b & MAGNITUDE_MASK);
+}
+
+static inline void long_split(uint64_t mag, word_t sign, word_t *a, word_t *b) {
+    *a = sign | (word_t)((mag >> 23) & MAGNITUDE_MASK);
+    *b = sign | (word_t)(mag & MAGNITUDE_MASK);
+}
+
+/* Read a word through the page table (ddp24_read for the engines) */
+static inline word_t mem_read(const ddp24_t *cpu, word_t addr) {
+    addr &= (MEM_SIZE - 1);
+    return cpu->page[addr >> DDP24_PAGE_SHIFT]->word[addr & DDP24_PAGE_MASK];
+}
+
+/* Profile new CPUs, images and fleets get (src/timing.c) */
+extern const ddp24_timing_t *ddp24_active_timing;
+
+/* ddp24_predecode with the costs of t */
+void ddp24_predecode_with(const ddp24_timing_t *t, word_t instr, ddp24_decoded_t *d);
+
+/* Shift of count places, for counts known only as it runs */
+static inline int shift_cycles(const ddp24_timing_t *t, int handler, word_t count) {
+    return t->op[handler] + t->per_shift * (int)count;
+}
+
+/* A word's share of its page hash: zero for zero words, so the zero
+ * page needs no hash of its own */
+static inline uint64_t word_hash(word_t addr, word_t value) {
+    uint64_t h = ((uint64_t)addr << 24 | value) * 0x9e3779b97f4a7c15ull;
+    return value ? h ^ h >> 32 : 0;
+}
+
+/* Hash page n from scratch, for pages filled other than by stores */
+uint64_t ddp24_page_hash(const ddp24_page_t *p, int n);
+
+/* ddp24_image_create, predecoding only the addresses set in decode */
+ddp24_image_t *ddp24_image_create_decoded(const ddp24_t *cpu, const uint64_t *decode);
+
+/* Decode a word whose entry is not valid yet (src/ddp24.c) */
+const ddp24_decoded_t *ddp24_decode_miss(ddp24_t *cpu, word_t addr);
+
+/* Fetch the predecoded form of the word at addr, decoding on a miss */
+static inline const ddp24_decoded_t *fetch(ddp24_t *cpu, word_t addr) {
+    const ddp24_decoded_t *d = &cpu->page[addr >> DDP24_PAGE_SHIFT]->decoded[addr & DDP24_PAGE_MASK];
+    if (!(d->flags & DDP24_DEC_VALID)) {
+        d = ddp24_decode_miss(cpu, addr);
+    }
+    return d;
+}
+
+/* Calculate effective address */
+static inline word_t effective_address(ddp24_t *cpu, const ddp24_decoded_t *d) {
+    word_t addr = d->addr;
+
+    /* Add index register (X[0] is always 0) */
+    if (d->index > 0) {
+        addr = (addr + cpu->X[d->index]) & ADDR_MASK;
+    }
+
+    /* Handle indirect addressing */
+    if (d->flags & DDP24_DEC_INDIRECT) {
+        addr = mem_read(cpu, addr) & ADDR_MASK;
+    }
+
+    return addr;
+}
+
+/* Engines: run until halted or cpu->cycles reaches RUN_LIMIT(cpu) */
+void ddp24_run_switch(ddp24_t *cpu);
+void ddp24_run_threaded(ddp24_t *cpu);
+void ddp24_run_jit(ddp24_t *cpu);
+
+/* I/O instructions and the event queue (src/io.c) */
+void ddp24_io_control(ddp24_t *cpu, word_t ea);
+word_t ddp24_io_input(ddp24_t *cpu, word_t ea);
+void ddp24_io_output(ddp24_t *cpu, word_t ea, word_t value);
+bool ddp24_io_sense(ddp24_t *cpu, word_t ea);
+void ddp24_io_fire(ddp24_t *cpu);
+void ddp24_io_release(ddp24_t *cpu);
+void ddp24_itc(ddp24_t *cpu, word_t ea);
+bool ddp24_irq_service(ddp24_t *cpu);
+
+/* Record and replay hooks (src/replay.c); I/O goes through the replay,
+ * when one is attached, instead of the devices */
+#define DDP24_LOG_INPUT     0
+#define DDP24_LOG_SENSE     1
+#define DDP24_LOG_IRQ       2
+struct ddp24_recording;
+struct ddp24_replay;
+bool ddp24_io_hook(ddp24_t *cpu, struct ddp24_recording *record, struct ddp24_replay *replay);
+struct ddp24_replay *ddp24_io_replay(const ddp24_t *cpu);
+void ddp24_record_value(struct ddp24_recording *rec, uint64_t cycles, int kind, word_t ea, word_t value);
+void ddp24_record_irq(struct ddp24_recording *rec, const ddp24_t *cpu);
+word_t ddp24_replay_value(ddp24_t *cpu, struct ddp24_replay *replay, int kind, word_t ea);
+
+/* The engines' one exit test reads this; ddp24_post_interrupt drops
+ * it to 0 from other threads, so it is the CPU's own stores that can
+ * stay relaxed */
+#define RUN_LIMIT(cpu)  atomic_load_explicit(&(cpu)->run_limit, memory_order_relaxed)
+
+static inline void set_run_limit(ddp24_t *cpu, uint64_t limit) {
+    atomic_store_explicit(&cpu->run_limit, limit, memory_order_relaxed);
+}
+
+/* Bring the limit down to limit, unless a post got it lower first */
+static inline void lower_run_limit(ddp24_t *cpu, uint64_t limit) {
+    uint64_t old = RUN_LIMIT(cpu);
+    while (limit < old &&
+           !atomic_compare_exchange_weak_explicit(&cpu->run_limit, &old, limit,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+/* Breakpoints and watchpoints (src/debug.c) */
+#define PAGE_BIT(addr)  (1ull << ((addr) >> DDP24_PAGE_SHIFT))
+
+/* Clear the checked bits of hooks whose code overlaps count words from
+ * addr (src/hle.c) */
+void ddp24_hle_forget(ddp24_t *cpu, word_t addr, word_t count);
+
+/* Stores of count words from addr, all on one page */
+static inline void hle_store(ddp24_t *cpu, word_t addr, word_t count) {
+    if (cpu->hle_pages & PAGE_BIT(addr)) {
+        ddp24_hle_forget(cpu, addr, count);
+    }
+}
+static inline bool debug_active(const ddp24_t *cpu) {
+    return (cpu->break_pages | cpu->watch_read_pages | cpu->watch_write_pages) != 0;
+}
+void ddp24_run_debug(ddp24_t *cpu, uint64_t resume);
+void ddp24_watch_access(ddp24_t *cpu, word_t pc, word_t addr, word_t count, int kind);
+void ddp24_debug_release(ddp24_t *cpu);
+
+/* Library allocations, through ddp24_set_allocator (src/embed.c).
+ * NULL with errno ENOMEM on failure, like the C library's. */
+void *ddp24_malloc(size_t size);
+void *ddp24_calloc(size_t count, size_t size);
+void *ddp24_realloc(void *ptr, size_t size);
+void ddp24_free(void *ptr);
+
+/* The error code for errno after a failed load (src/embed.c) */
+ddp24_error_t ddp24_errno_error(void);
+
+/* Idle loop fast-forward (src/idle.c) */
+void ddp24_idle_skip(ddp24_t *cpu, word_t head, int pending);
+
+/* JIT state (src/jit.c) */
+bool ddp24_jit_attach(ddp24_t *cpu);
+void ddp24_jit_detach(ddp24_t *cpu);
+void ddp24_jit_invalidate(ddp24_t *cpu, word_t addr);
+
+/* Trace hook (src/trace.c) */
+void ddp24_trace_record(struct ddp24_trace *trace, const ddp24_trace_rec_t *rec);
+
+/* Shadow call stack hooks (src/calls.c) */
+void ddp24_calls_enter(struct ddp24_calls *calls, word_t entry, uint64_t now);
+void ddp24_calls_return(struct ddp24_calls *calls, word_t link, uint64_t now);
+
+/* Native routine hook (src/hle.c) */
+bool ddp24_hle_enter(ddp24_t *cpu, word_t link, int *cycles);
+
+/* Profiler hook (src/profile.c) */
+#ifdef DDP24_PROFILE
+void ddp24_profile_record(ddp24_t *cpu, word_t pc, const ddp24_decoded_t *d, word_t ea, int cycles);
+#endif
+
+#endif /* DDP24_INTERNAL_H */
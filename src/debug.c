@@ -0,0 +1,172 @@
+/*
+ * DDP-24 Emulator - Breakpoints and Watchpoints
+ * Viking Mars Lander Guidance Computer
+ *
+ * Exact sets are bitmaps with one bit per word; the page masks in
+ * ddp24_t are kept equal to "this page's bitmap is not empty", so the
+ * checks in ddp24_step and the debug loop only reach this file for
+ * pages with something set.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "../include/ddp24_debug.h"
+#include "ddp24_internal.h"
+
+#define BITMAP_WORDS    (MEM_SIZE / 64)
+#define PAGE_WORDS      (DDP24_PAGE_SIZE / 64)  /* Bitmap words per page */
+
+struct ddp24_debug {
+    uint64_t breaks[BITMAP_WORDS];
+    uint64_t reads[BITMAP_WORDS];
+    uint64_t writes[BITMAP_WORDS];
+    bool running;               /* Inside ddp24_run_debug: hits stop the run */
+    ddp24_watch_hit_t hit;
+};
+
+static struct ddp24_debug *debug_state(ddp24_t *cpu) {
+    if (!cpu->debug) {
+        cpu->debug = ddp24_calloc(1, sizeof(struct ddp24_debug));
+    }
+    return cpu->debug;
+}
+
+void ddp24_debug_release(ddp24_t *cpu) {
+    ddp24_free(cpu->debug);
+    cpu->debug = NULL;
+    cpu->break_pages = 0;
+    cpu->watch_read_pages = 0;
+    cpu->watch_write_pages = 0;
+}
+
+static bool test_bit(const uint64_t *map, word_t addr) {
+    return (map[addr >> 6] >> (addr & 63)) & 1;
+}
+
+/* Set or clear count bits from first, then bring the page mask up to date */
+static void update(uint64_t *map, uint64_t *pages, word_t first, word_t count, bool set) {
+    if (count > MEM_SIZE) {
+        count = MEM_SIZE;
+    }
+    for (word_t i = 0; i < count; i++) {
+        word_t a = (first + i) & ADDR_MASK;
+        if (set) {
+            map[a >> 6] |= 1ull << (a & 63);
+        } else {
+            map[a >> 6] &= ~(1ull << (a & 63));
+        }
+    }
+    *pages = 0;
+    for (int n = 0; n < DDP24_PAGES; n++) {
+        for (int w = 0; w < PAGE_WORDS; w++) {
+            if (map[n * PAGE_WORDS + w]) {
+                *pages |= 1ull << n;
+                break;
+            }
+        }
+    }
+}
+
+bool ddp24_set_breakpoint(ddp24_t *cpu, word_t addr) {
+    struct ddp24_debug *dbg = debug_state(cpu);
+    if (!dbg) {
+        return false;
+    }
+    update(dbg->breaks, &cpu->break_pages, addr & ADDR_MASK, 1, true);
+    return true;
+}
+
+void ddp24_clear_breakpoint(ddp24_t *cpu, word_t addr) {
+    if (cpu->debug) {
+        update(cpu->debug->breaks, &cpu->break_pages, addr & ADDR_MASK, 1, false);
+    }
+}
+
+bool ddp24_breakpoint_at(const ddp24_t *cpu, word_t addr) {
+    return cpu->debug && test_bit(cpu->debug->breaks, addr & ADDR_MASK);
+}
+
+bool ddp24_set_watchpoint(ddp24_t *cpu, word_t first, word_t count, int kind) {
+    struct ddp24_debug *dbg = debug_state(cpu);
+    if (!dbg) {
+        return false;
+    }
+    if (kind & DDP24_WATCH_READ) {
+        update(dbg->reads, &cpu->watch_read_pages, first, count, true);
+    }
+    if (kind & DDP24_WATCH_WRITE) {
+        update(dbg->writes, &cpu->watch_write_pages, first, count, true);
+    }
+    return true;
+}
+
+void ddp24_clear_watchpoint(ddp24_t *cpu, word_t first, word_t count, int kind) {
+    struct ddp24_debug *dbg = cpu->debug;
+    if (!dbg) {
+        return;
+    }
+    if (kind & DDP24_WATCH_READ) {
+        update(dbg->reads, &cpu->watch_read_pages, first, count, false);
+    }
+    if (kind & DDP24_WATCH_WRITE) {
+        update(dbg->writes, &cpu->watch_write_pages, first, count, false);
+    }
+}
+
+void ddp24_clear_debug(ddp24_t *cpu) {
+    struct ddp24_debug *dbg = cpu->debug;
+    if (dbg) {
+        memset(dbg->breaks, 0, sizeof(dbg->breaks));
+        memset(dbg->reads, 0, sizeof(dbg->reads));
+        memset(dbg->writes, 0, sizeof(dbg->writes));
+    }
+    cpu->break_pages = 0;
+    cpu->watch_read_pages = 0;
+    cpu->watch_write_pages = 0;
+}
+
+bool ddp24_last_watch_hit(const ddp24_t *cpu, ddp24_watch_hit_t *hit) {
+    if (!cpu->debug || cpu->debug->hit.count == 0) {
+        return false;
+    }
+    *hit = cpu->debug->hit;
+    return true;
+}
+
+/* From ddp24_step, for accesses on a page whose mask bit is set */
+void ddp24_watch_access(ddp24_t *cpu, word_t pc, word_t addr, word_t count, int kind) {
+    struct ddp24_debug *dbg = cpu->debug;
+    const uint64_t *map = kind == DDP24_WATCH_READ ? dbg->reads : dbg->writes;
+    uint64_t pages = kind == DDP24_WATCH_READ ? cpu->watch_read_pages : cpu->watch_write_pages;
+
+    for (word_t i = 0; i < count; i++) {
+        word_t a = (addr + i) & ADDR_MASK;
+        if (!(pages & PAGE_BIT(a))) {
+            i += DDP24_PAGE_SIZE - 1 - (a & DDP24_PAGE_MASK);   /* Next page */
+            continue;
+        }
+        if (test_bit(map, a)) {
+            dbg->hit = (ddp24_watch_hit_t){ pc, a, kind, dbg->hit.count + 1 };
+            if (dbg->running) {
+                ddp24_request_stop(cpu, DDP24_STOP_WATCHPOINT);
+            }
+            return;
+        }
+    }
+}
+
+/* The engine while any are set. resume is cpu->cycles at the start of
+ * the run, when a breakpoint at PC is stepped over. */
+void ddp24_run_debug(ddp24_t *cpu, uint64_t resume) {
+    struct ddp24_debug *dbg = cpu->debug;
+    dbg->running = true;
+    while (!cpu->halted && cpu->cycles < RUN_LIMIT(cpu)) {
+        word_t pc = cpu->PC;
+        if ((cpu->break_pages & PAGE_BIT(pc)) && test_bit(dbg->breaks, pc) && cpu->cycles != resume) {
+            ddp24_request_stop(cpu, DDP24_STOP_BREAKPOINT);
+            break;
+        }
+        ddp24_step(cpu);
+    }
+    dbg->running = false;
+}
@@ -0,0 +1,131 @@
+/*
+ * DDP-24 Emulator - Embedding
+ * Viking Mars Lander Guidance Computer
+ *
+ * Heap instances, error codes and the allocator every library
+ * allocation goes through.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/ddp24_embed.h"
+#include "ddp24_internal.h"
+
+static void *libc_alloc(void *ctx, void *ptr, size_t size) {
+    (void)ctx;
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    return realloc(ptr, size);
+}
+
+static ddp24_alloc_fn alloc_fn = libc_alloc;
+static void *alloc_ctx;
+
+void ddp24_set_allocator(ddp24_alloc_fn fn, void *ctx) {
+    alloc_fn = fn ? fn : libc_alloc;
+    alloc_ctx = fn ? ctx : NULL;
+}
+
+void *ddp24_realloc(void *ptr, size_t size) {
+    void *p = alloc_fn(alloc_ctx, ptr, size ? size : 1);
+    if (!p) {
+        errno = ENOMEM;
+    }
+    return p;
+}
+
+void *ddp24_malloc(size_t size) {
+    return ddp24_realloc(NULL, size);
+}
+
+void *ddp24_calloc(size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    void *p = ddp24_malloc(count * size);
+    if (p) {
+        memset(p, 0, count * size);
+    }
+    return p;
+}
+
+void ddp24_free(void *ptr) {
+    if (ptr) {
+        alloc_fn(alloc_ctx, ptr, 0);
+    }
+}
+
+const char *ddp24_error_name(ddp24_error_t err) {
+    switch (err) {
+        case DDP24_OK:          return "ok";
+        case DDP24_ERR_NOMEM:   return "out of memory";
+        case DDP24_ERR_IO:      return "I/O error";
+        case DDP24_ERR_FORMAT:  return "bad format";
+        case DDP24_ERR_ENGINE:  return "engine not built in";
+    }
+    return "unknown";
+}
+
+int ddp24_api_version(void) {
+    return DDP24_API_VERSION;
+}
+
+static ddp24_t *create(ddp24_image_t *image, ddp24_engine_t engine, ddp24_error_t *err) {
+    ddp24_error_t e = DDP24_OK;
+    ddp24_t *cpu = NULL;
+    if (!ddp24_engine_available(engine)) {
+        e = DDP24_ERR_ENGINE;
+    } else if (!(cpu = ddp24_malloc(sizeof(*cpu)))) {
+        e = DDP24_ERR_NOMEM;
+    } else {
+        if (image) {
+            ddp24_init_image(cpu, image);
+        } else {
+            ddp24_init(cpu);
+        }
+        if (!ddp24_set_engine(cpu, engine)) {
+            ddp24_destroy(cpu);
+            cpu = NULL;
+            e = DDP24_ERR_NOMEM;
+        }
+    }
+    if (err) {
+        *err = e;
+    }
+    return cpu;
+}
+
+ddp24_t *ddp24_create(ddp24_engine_t engine, ddp24_error_t *err) {
+    return create(NULL, engine, err);
+}
+
+ddp24_t *ddp24_create_image(ddp24_image_t *image, ddp24_engine_t engine, ddp24_error_t *err) {
+    return create(image, engine, err);
+}
+
+void ddp24_destroy(ddp24_t *cpu) {
+    if (cpu) {
+        ddp24_release(cpu);
+        ddp24_free(cpu);
+    }
+}
+
+ddp24_error_t ddp24_load_file(ddp24_t *cpu, const char *filename, word_t base, int *words) {
+    int n = ddp24_load_image(cpu, filename, base);
+    if (words) {
+        *words = n < 0 ? 0 : n;
+    }
+    if (n >= 0) {
+        return DDP24_OK;
+    }
+    return ddp24_errno_error();
+}
+
+ddp24_error_t ddp24_errno_error(void) {
+    return errno == ENOMEM ? DDP24_ERR_NOMEM : errno == EINVAL ? DDP24_ERR_FORMAT : DDP24_ERR_IO;
+}
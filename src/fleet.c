@@ -0,0 +1,724 @@
+/*
+ * DDP-24 Emulator - CPU Fleet
+ * Viking Mars Lander Guidance Computer
+ *
+ * Lockstep execution of many CPUs. Each step picks the lowest PC among
+ * running lanes and executes that instruction for every lane sitting on
+ * it with the same instruction word. Common opcodes run through masked
+ * SIMD kernels (AVX2 on x86-64 when the host has it, NEON on AArch64,
+ * plain loops elsewhere); the rest, and groups too small to be worth
+ * it, go lane by lane through the shared handler bodies.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/ddp24_fleet.h"
+#include "ddp24_internal.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FLEET_AVX2 1
+#include <immintrin.h>
+#else
+#define FLEET_AVX2 0
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define FLEET_NEON 1
+#include <arm_neon.h>
+#else
+#define FLEET_NEON 0
+#endif
+
+#define FLEET_MIN_SIMD  4   /* Smaller groups are stepped lane by lane */
+
+/* Masked kernels over a whole row of stride lanes.
+ * mask[i] is all-ones for lanes taking part and zero otherwise. */
+typedef struct {
+    const char *name;
+    void (*blend)(word_t *dst, const word_t *src, const uint32_t *mask, int n);
+    void (*addsub)(word_t *a, const word_t *y, word_t flip, const uint32_t *mask,
+                   uint32_t *ovf, int n);
+    void (*mpy)(word_t *a, word_t *b, const word_t *y, const uint32_t *mask, int n);
+    void (*logic)(word_t *a, const word_t *y, uint8_t op, const uint32_t *mask, int n);
+} kernels_t;
+
+/* Portable kernels, also the reference for the vector versions */
+
+static void blend_scalar(word_t *dst, const word_t *src, const uint32_t *mask, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = (src[i] & mask[i]) | (dst[i] & ~mask[i]);
+    }
+}
+
+/* flip = SIGN_BIT turns the add into a subtract */
+static void addsub_scalar(word_t *a, const word_t *y, word_t flip, const uint32_t *mask,
+                          uint32_t *ovf, int n) {
+    for (int i = 0; i < n; i++) {
+        if (!mask[i]) {
+            continue;
+        }
+        int32_t result = sm_sum(a[i], y[i] ^ flip);
+        ovf[i] |= sm_overflow(result);
+        a[i] = from_signed(result);
+    }
+}
+
+static void mpy_scalar(word_t *a, word_t *b, const word_t *y, const uint32_t *mask, int n) {
+    for (int i = 0; i < n; i++) {
+        if (!mask[i]) {
+            continue;
+        }
+        sm_multiply(b[i], y[i], &a[i], &b[i]);
+    }
+}
+
+static void logic_scalar(word_t *a, const word_t *y, uint8_t op, const uint32_t *mask, int n) {
+    for (int i = 0; i < n; i++) {
+        word_t r = op == OP_ANA ? (a[i] & y[i]) : op == OP_ORA ? (a[i] | y[i]) : (a[i] ^ y[i]);
+        a[i] = (r & mask[i]) | (a[i] & ~mask[i]);
+    }
+}
+
+static const kernels_t kernels_scalar = {
+    "scalar", blend_scalar, addsub_scalar, mpy_scalar, logic_scalar
+};
+
+#if FLEET_AVX2
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i v_load(const word_t *p) { return _mm256_load_si256((const __m256i *)p); }
+AVX2 static inline void v_store(word_t *p, __m256i v) { _mm256_store_si256((__m256i *)p, v); }
+
+/* Sign-magnitude to two's complement: (mag ^ -s) + s */
+AVX2 static inline __m256i v_to_signed(__m256i w) {
+    __m256i m = _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_srli_epi32(w, 23));
+    __m256i mag = _mm256_and_si256(w, _mm256_set1_epi32(MAGNITUDE_MASK));
+    return _mm256_sub_epi32(_mm256_xor_si256(mag, m), m);
+}
+
+AVX2 static void blend_avx2(word_t *dst, const word_t *src, const uint32_t *mask, int n) {
+    for (int i = 0; i < n; i += 8) {
+        v_store(dst + i, _mm256_blendv_epi8(v_load(dst + i), v_load(src + i), v_load(mask + i)));
+    }
+}
+
+AVX2 static void addsub_avx2(word_t *a, const word_t *y, word_t flip, const uint32_t *mask,
+                             uint32_t *ovf, int n) {
+    const __m256i vflip = _mm256_set1_epi32((int)flip);
+    const __m256i vmag = _mm256_set1_epi32(MAGNITUDE_MASK);
+    const __m256i vsign = _mm256_set1_epi32(SIGN_BIT);
+    const __m256i one = _mm256_set1_epi32(1);
+
+    for (int i = 0; i < n; i += 8) {
+        __m256i m = v_load(mask + i);
+        __m256i va = v_load(a + i);
+        __m256i r = _mm256_add_epi32(v_to_signed(va),
+                                     v_to_signed(_mm256_xor_si256(v_load(y + i), vflip)));
+        __m256i s = _mm256_srai_epi32(r, 31);
+        __m256i mag = _mm256_sub_epi32(_mm256_xor_si256(r, s), s);
+        __m256i big = _mm256_cmpgt_epi32(mag, vmag);
+        __m256i res = _mm256_or_si256(_mm256_and_si256(mag, vmag), _mm256_and_si256(s, vsign));
+        v_store(a + i, _mm256_blendv_epi8(va, res, m));
+        v_store(ovf + i, _mm256_or_si256(v_load(ovf + i),
+                                         _mm256_and_si256(_mm256_and_si256(m, big), one)));
+    }
+}
+
+AVX2 static void mpy_avx2(word_t *a, word_t *b, const word_t *y, const uint32_t *mask, int n) {
+    const __m256i vmag = _mm256_set1_epi32(MAGNITUDE_MASK);
+    const __m256i vmag64 = _mm256_set1_epi64x(MAGNITUDE_MASK);
+    const __m256i vsign = _mm256_set1_epi32(SIGN_BIT);
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (int i = 0; i < n; i += 8) {
+        __m256i m = v_load(mask + i);
+        __m256i va = v_load(a + i);
+        __m256i vb = v_load(b + i);
+        __m256i vy = v_load(y + i);
+        __m256i bm = _mm256_and_si256(vb, vmag);
+        __m256i ym = _mm256_and_si256(vy, vmag);
+
+        /* 23 x 23 bit products, even and odd lanes separately */
+        __m256i pe = _mm256_mul_epu32(bm, ym);
+        __m256i po = _mm256_mul_epu32(_mm256_srli_epi64(bm, 32), _mm256_srli_epi64(ym, 32));
+        __m256i lo = _mm256_blend_epi32(_mm256_and_si256(pe, vmag64),
+                                        _mm256_slli_epi64(_mm256_and_si256(po, vmag64), 32), 0xAA);
+        __m256i hi = _mm256_blend_epi32(_mm256_and_si256(_mm256_srli_epi64(pe, 23), vmag64),
+                                        _mm256_slli_epi64(_mm256_and_si256(_mm256_srli_epi64(po, 23), vmag64), 32),
+                                        0xAA);
+
+        /* Product takes the algebraic sign unless it is zero */
+        __m256i z = _mm256_or_si256(_mm256_cmpeq_epi32(bm, zero), _mm256_cmpeq_epi32(ym, zero));
+        __m256i sign = _mm256_andnot_si256(z, _mm256_and_si256(_mm256_xor_si256(vb, vy), vsign));
+
+        v_store(a + i, _mm256_blendv_epi8(va, _mm256_or_si256(hi, sign), m));
+        v_store(b + i, _mm256_blendv_epi8(vb, _mm256_or_si256(lo, sign), m));
+    }
+}
+
+AVX2 static void logic_avx2(word_t *a, const word_t *y, uint8_t op, const uint32_t *mask, int n) {
+    for (int i = 0; i < n; i += 8) {
+        __m256i va = v_load(a + i);
+        __m256i vy = v_load(y + i);
+        __m256i r = op == OP_ANA ? _mm256_and_si256(va, vy) :
+                    op == OP_ORA ? _mm256_or_si256(va, vy) : _mm256_xor_si256(va, vy);
+        v_store(a + i, _mm256_blendv_epi8(va, r, v_load(mask + i)));
+    }
+}
+
+static const kernels_t kernels_avx2 = {
+    "avx2", blend_avx2, addsub_avx2, mpy_avx2, logic_avx2
+};
+
+#endif /* FLEET_AVX2 */
+
+#if FLEET_NEON
+
+static inline int32x4_t n_to_signed(uint32x4_t w) {
+    int32x4_t m = vnegq_s32(vreinterpretq_s32_u32(vshrq_n_u32(w, 23)));
+    int32x4_t mag = vreinterpretq_s32_u32(vandq_u32(w, vdupq_n_u32(MAGNITUDE_MASK)));
+    return vsubq_s32(veorq_s32(mag, m), m);
+}
+
+static void blend_neon(word_t *dst, const word_t *src, const uint32_t *mask, int n) {
+    for (int i = 0; i < n; i += 4) {
+        vst1q_u32(dst + i, vbslq_u32(vld1q_u32(mask + i), vld1q_u32(src + i), vld1q_u32(dst + i)));
+    }
+}
+
+static void addsub_neon(word_t *a, const word_t *y, word_t flip, const uint32_t *mask,
+                        uint32_t *ovf, int n) {
+    const uint32x4_t vflip = vdupq_n_u32(flip);
+    const uint32x4_t vmag = vdupq_n_u32(MAGNITUDE_MASK);
+    const uint32x4_t vsign = vdupq_n_u32(SIGN_BIT);
+    const uint32x4_t one = vdupq_n_u32(1);
+
+    for (int i = 0; i < n; i += 4) {
+        uint32x4_t m = vld1q_u32(mask + i);
+        uint32x4_t va = vld1q_u32(a + i);
+        int32x4_t r = vaddq_s32(n_to_signed(va), n_to_signed(veorq_u32(vld1q_u32(y + i), vflip)));
+        int32x4_t s = vshrq_n_s32(r, 31);
+        uint32x4_t mag = vreinterpretq_u32_s32(vsubq_s32(veorq_s32(r, s), s));
+        uint32x4_t big = vcgtq_u32(mag, vmag);
+        uint32x4_t res = vorrq_u32(vandq_u32(mag, vmag), vandq_u32(vreinterpretq_u32_s32(s), vsign));
+        vst1q_u32(a + i, vbslq_u32(m, res, va));
+        vst1q_u32(ovf + i, vorrq_u32(vld1q_u32(ovf + i), vandq_u32(vandq_u32(m, big), one)));
+    }
+}
+
+static void mpy_neon(word_t *a, word_t *b, const word_t *y, const uint32_t *mask, int n) {
+    const uint32x4_t vmag = vdupq_n_u32(MAGNITUDE_MASK);
+    const uint64x2_t vmag64 = vdupq_n_u64(MAGNITUDE_MASK);
+    const uint32x4_t vsign = vdupq_n_u32(SIGN_BIT);
+    const uint32x4_t zero = vdupq_n_u32(0);
+
+    for (int i = 0; i < n; i += 4) {
+        uint32x4_t m = vld1q_u32(mask + i);
+        uint32x4_t va = vld1q_u32(a + i);
+        uint32x4_t vb = vld1q_u32(b + i);
+        uint32x4_t vy = vld1q_u32(y + i);
+        uint32x4_t bm = vandq_u32(vb, vmag);
+        uint32x4_t ym = vandq_u32(vy, vmag);
+
+        uint64x2_t pl = vmull_u32(vget_low_u32(bm), vget_low_u32(ym));
+        uint64x2_t ph = vmull_u32(vget_high_u32(bm), vget_high_u32(ym));
+        uint32x4_t lo = vcombine_u32(vmovn_u64(vandq_u64(pl, vmag64)), vmovn_u64(vandq_u64(ph, vmag64)));
+        uint32x4_t hi = vcombine_u32(vmovn_u64(vandq_u64(vshrq_n_u64(pl, 23), vmag64)),
+                                     vmovn_u64(vandq_u64(vshrq_n_u64(ph, 23), vmag64)));
+
+        uint32x4_t z = vorrq_u32(vceqq_u32(bm, zero), vceqq_u32(ym, zero));
+        uint32x4_t sign = vbicq_u32(vandq_u32(veorq_u32(vb, vy), vsign), z);
+
+        vst1q_u32(a + i, vbslq_u32(m, vorrq_u32(hi, sign), va));
+        vst1q_u32(b + i, vbslq_u32(m, vorrq_u32(lo, sign), vb));
+    }
+}
+
+static void logic_neon(word_t *a, const word_t *y, uint8_t op, const uint32_t *mask, int n) {
+    for (int i = 0; i < n; i += 4) {
+        uint32x4_t va = vld1q_u32(a + i);
+        uint32x4_t vy = vld1q_u32(y + i);
+        uint32x4_t r = op == OP_ANA ? vandq_u32(va, vy) :
+                       op == OP_ORA ? vorrq_u32(va, vy) : veorq_u32(va, vy);
+        vst1q_u32(a + i, vbslq_u32(vld1q_u32(mask + i), r, va));
+    }
+}
+
+static const kernels_t kernels_neon = {
+    "neon", blend_neon, addsub_neon, mpy_neon, logic_neon
+};
+
+#endif /* FLEET_NEON */
+
+static const kernels_t *kernels(void) {
+#if FLEET_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return &kernels_avx2;
+    }
+#endif
+#if FLEET_NEON
+    return &kernels_neon;
+#else
+    return &kernels_scalar;
+#endif
+}
+
+const char *ddp24_fleet_kernels(void) {
+    return kernels()->name;
+}
+
+/* Fleet allocation */
+
+static void *alloc_row(size_t count, size_t size) {
+    size_t bytes = count * size;
+    bytes = (bytes + 31) & ~(size_t)31;
+    void *p = aligned_alloc(32, bytes);
+    if (p) {
+        memset(p, 0, bytes);
+    }
+    return p;
+}
+
+ddp24_fleet_t *ddp24_fleet_create(int lanes) {
+    if (lanes <= 0) {
+        return NULL;
+    }
+
+    ddp24_fleet_t *f = calloc(1, sizeof(*f));
+    if (!f) {
+        return NULL;
+    }
+    f->lanes = lanes;
+    f->stride = (lanes + DDP24_FLEET_ALIGN - 1) & ~(DDP24_FLEET_ALIGN - 1);
+    f->timing = ddp24_active_timing;
+
+    size_t s = (size_t)f->stride;
+    f->A = alloc_row(s, sizeof(word_t));
+    f->B = alloc_row(s, sizeof(word_t));
+    for (int i = 0; i < 4; i++) {
+        f->X[i] = alloc_row(s, sizeof(word_t));
+    }
+    f->PC = alloc_row(s, sizeof(word_t));
+    f->overflow = alloc_row(s, sizeof(uint32_t));
+    f->halted = alloc_row(s, sizeof(uint32_t));
+    f->cycles = alloc_row(s, sizeof(uint64_t));
+    f->memory = alloc_row(s * MEM_SIZE, sizeof(word_t));
+    f->mask = alloc_row(s, sizeof(uint32_t));
+    f->ea = alloc_row(s, sizeof(word_t));
+    f->operand = alloc_row(s, sizeof(word_t));
+    f->limit = alloc_row(s, sizeof(uint64_t));
+    f->live = alloc_row(s, sizeof(uint32_t));
+
+    if (!f->A || !f->B || !f->X[0] || !f->X[1] || !f->X[2] || !f->X[3] || !f->PC ||
+        !f->overflow || !f->halted || !f->cycles || !f->memory || !f->mask ||
+        !f->ea || !f->operand || !f->limit || !f->live) {
+        ddp24_fleet_destroy(f);
+        return NULL;
+    }
+
+    /* Padding lanes never run */
+    for (int i = lanes; i < f->stride; i++) {
+        f->halted[i] = 1;
+    }
+    return f;
+}
+
+void ddp24_fleet_destroy(ddp24_fleet_t *f) {
+    if (!f) {
+        return;
+    }
+    free(f->A);
+    free(f->B);
+    for (int i = 0; i < 4; i++) {
+        free(f->X[i]);
+    }
+    free(f->PC);
+    free(f->overflow);
+    free(f->halted);
+    free(f->cycles);
+    free(f->memory);
+    free(f->mask);
+    free(f->ea);
+    free(f->operand);
+    free(f->limit);
+    free(f->live);
+    free(f);
+}
+
+/* Lane access */
+
+static inline word_t *cell(const ddp24_fleet_t *f, int lane, word_t addr) {
+    return &f->memory[(size_t)(addr & (MEM_SIZE - 1)) * f->stride + lane];
+}
+
+word_t ddp24_fleet_read(const ddp24_fleet_t *f, int lane, word_t addr) {
+    return *cell(f, lane, addr);
+}
+
+void ddp24_fleet_write(ddp24_fleet_t *f, int lane, word_t addr, word_t value) {
+    *cell(f, lane, addr) = value & WORD_MASK;
+}
+
+void ddp24_fleet_set(ddp24_fleet_t *f, int lane, const ddp24_t *cpu) {
+    f->A[lane] = cpu->A;
+    f->B[lane] = cpu->B;
+    for (int i = 1; i < 4; i++) {
+        f->X[i][lane] = cpu->X[i];
+    }
+    f->PC[lane] = cpu->PC;
+    f->overflow[lane] = cpu->overflow;
+    f->halted[lane] = cpu->halted;
+    f->cycles[lane] = cpu->cycles;
+    for (word_t a = 0; a < MEM_SIZE; a++) {
+        *cell(f, lane, a) = ddp24_read(cpu, a);
+    }
+}
+
+void ddp24_fleet_get(const ddp24_fleet_t *f, int lane, ddp24_t *cpu) {
+    cpu->A = f->A[lane];
+    cpu->B = f->B[lane];
+    for (int i = 1; i < 4; i++) {
+        cpu->X[i] = f->X[i][lane];
+    }
+    cpu->PC = f->PC[lane];
+    cpu->overflow = f->overflow[lane] != 0;
+    cpu->halted = f->halted[lane] != 0;
+    cpu->cycles = f->cycles[lane];
+    for (word_t a = 0; a < MEM_SIZE; a++) {
+        ddp24_write(cpu, a, *cell(f, lane, a));
+    }
+}
+
+void ddp24_fleet_broadcast(ddp24_fleet_t *f, const ddp24_t *cpu) {
+    for (int lane = 0; lane < f->lanes; lane++) {
+        f->A[lane] = cpu->A;
+        f->B[lane] = cpu->B;
+        for (int i = 1; i < 4; i++) {
+            f->X[i][lane] = cpu->X[i];
+        }
+        f->PC[lane] = cpu->PC;
+        f->overflow[lane] = cpu->overflow;
+        f->halted[lane] = cpu->halted;
+        f->cycles[lane] = cpu->cycles;
+    }
+    for (word_t a = 0; a < MEM_SIZE; a++) {
+        word_t *row = &f->memory[(size_t)a * f->stride];
+        word_t w = ddp24_read(cpu, a);
+        for (int lane = 0; lane < f->lanes; lane++) {
+            row[lane] = w;
+        }
+    }
+}
+
+/* One lane through the shared handler bodies */
+
+static word_t lane_ea(const ddp24_fleet_t *f, int lane, const ddp24_decoded_t *d) {
+    word_t ea = d->addr;
+    if (d->index > 0) {
+        ea = (ea + f->X[d->index][lane]) & ADDR_MASK;
+    }
+    if (d->flags & DDP24_DEC_INDIRECT) {
+        ea = *cell(f, lane, ea) & ADDR_MASK;
+    }
+    return ea;
+}
+
+static void fill_lane(ddp24_fleet_t *f, int lane, word_t addr, word_t value, word_t count) {
+    for (word_t i = 0; i < count; i++) {
+        *cell(f, lane, addr + i) = value & WORD_MASK;
+    }
+}
+
+static void copy_lane(ddp24_fleet_t *f, int lane, word_t dst, word_t src, word_t count) {
+    for (word_t i = 0; i < count; i++) {
+        *cell(f, lane, dst + i) = *cell(f, lane, src + i);
+    }
+}
+
+#define OP(name)    case OP_##name:
+#define OP_DEFAULT  default:
+#define NEXT        break
+#define STOP        break
+#define R_A         f->A[lane]
+#define R_B         f->B[lane]
+#define R_PC        f->PC[lane]
+#define R_X(i)      f->X[i][lane]
+#define F_OVF       f->overflow[lane]
+#define F_HLT       f->halted[lane]
+#define RD(addr)    (*cell(f, lane, addr))
+#define WR(addr, v) (*cell(f, lane, addr) = (v) & WORD_MASK)
+#define FETCH(addr) (ddp24_predecode_with(f->timing, *cell(f, lane, addr), &dec), &dec)
+#define EA(d)       lane_ea(f, lane, d)
+#define CHARGE(n)   (f->cycles[lane] += (n))
+#define TIMING      f->timing
+#define XEC_LIMIT   DDP24_XEC_LIMIT
+#define EXECUTE()   goto execute
+#define IDLE(head)  ((void)0)   /* Lanes run every pass in lockstep */
+#define IO_CONTROL(ea)      ((void)(ea))    /* Lanes have no devices */
+#define IO_INPUT(ea)        ((void)(ea), (word_t)0)
+#define IO_OUTPUT(ea, v)    ((void)(ea), (void)(v))
+#define IO_SENSE(ea)        ((void)(ea), false)
+#define IO_ITC(ea)          ((void)(ea))    /* ... nor interrupts */
+#define FAULT(kind, pc)     ((void)(kind), (void)(pc))   /* Lanes just halt */
+#define CALL(entry)         ((void)(entry))
+#define RETURN(link)        ((void)(link))
+#define HLE(link)           ((void)(link), false)   /* Guest code, always */
+#define FILL(addr, v, n)    fill_lane(f, lane, addr, v, n)
+#define COPY(dst, src, n)   copy_lane(f, lane, dst, src, n)
+
+static void step_lane(ddp24_fleet_t *f, int lane) {
+    if (f->halted[lane]) {
+        return;
+    }
+
+    ddp24_decoded_t dec;
+    const ddp24_decoded_t *d = &dec;
+    ddp24_predecode_with(f->timing, *cell(f, lane, f->PC[lane]), &dec);
+    f->PC[lane] = (f->PC[lane] + 1) & ADDR_MASK;
+
+    word_t ea = lane_ea(f, lane, d);
+    word_t operand;
+    int32_t result;
+    int cycles = d->cycles;
+
+execute:
+    switch (d->handler) {
+#include "ddp24_ops.inc"
+    }
+
+    f->cycles[lane] += cycles;
+}
+
+#undef OP
+#undef OP_DEFAULT
+#undef NEXT
+#undef STOP
+#undef R_A
+#undef R_B
+#undef R_PC
+#undef R_X
+#undef F_OVF
+#undef F_HLT
+#undef RD
+#undef WR
+#undef FETCH
+#undef EA
+#undef CHARGE
+#undef XEC_LIMIT
+#undef EXECUTE
+#undef IDLE
+#undef IO_CONTROL
+#undef IO_INPUT
+#undef IO_OUTPUT
+#undef IO_SENSE
+#undef IO_ITC
+#undef FAULT
+#undef CALL
+#undef RETURN
+#undef HLE
+#undef FILL
+#undef COPY
+
+/* Whole-group execution */
+
+static bool vectorizable(const ddp24_decoded_t *d, bool uniform) {
+    switch (d->handler) {
+        case OP_LDA: case OP_LDB: case OP_STA: case OP_STB:
+        case OP_ADD: case OP_SUB: case OP_MPY:
+        case OP_ANA: case OP_ORA: case OP_ERA:
+        case OP_TAB: case OP_IAB: case OP_NOP:
+        case OP_JMP: case OP_JPL: case OP_JZE: case OP_JMI: case OP_JNZ:
+            return true;
+        case OP_ARS: case OP_ALS:
+            return uniform;  /* Cost depends on the count */
+    }
+    return false;
+}
+
+static bool branch_taken(uint8_t handler, word_t a) {
+    switch (handler) {
+        case OP_JMP: return true;
+        case OP_JPL: return !(a & SIGN_BIT) && (a & MAGNITUDE_MASK) != 0;
+        case OP_JZE: return (a & MAGNITUDE_MASK) == 0;
+        case OP_JMI: return (a & SIGN_BIT) != 0;
+        case OP_JNZ: return (a & MAGNITUDE_MASK) != 0;
+    }
+    return false;
+}
+
+static void exec_group(ddp24_fleet_t *f, const kernels_t *k, const ddp24_decoded_t *d,
+                       word_t pc, int count) {
+    const int n = f->stride;
+    const uint32_t *mask = f->mask;
+    const bool uniform = d->index == 0 && !(d->flags & DDP24_DEC_INDIRECT);
+    const word_t next = (pc + 1) & ADDR_MASK;
+
+    if (count < FLEET_MIN_SIMD || !vectorizable(d, uniform)) {
+        for (int i = 0; i < f->lanes; i++) {
+            if (mask[i]) {
+                step_lane(f, i);
+            }
+        }
+        return;
+    }
+
+    /* Operand row: straight out of memory, or gathered per lane */
+    const word_t *y;
+    if (uniform) {
+        y = &f->memory[(size_t)d->addr * n];
+    } else {
+        for (int i = 0; i < f->lanes; i++) {
+            if (!mask[i]) {
+                continue;
+            }
+            word_t ea = d->addr;
+            if (d->index > 0) {
+                ea = (ea + f->X[d->index][i]) & ADDR_MASK;
+            }
+            if (d->flags & DDP24_DEC_INDIRECT) {
+                ea = *cell(f, i, ea) & ADDR_MASK;
+            }
+            f->ea[i] = ea;
+            f->operand[i] = *cell(f, i, ea);
+        }
+        y = f->operand;
+    }
+
+    switch (d->handler) {
+        case OP_NOP:
+            break;
+        case OP_LDA:
+            k->blend(f->A, y, mask, n);
+            break;
+        case OP_LDB:
+            k->blend(f->B, y, mask, n);
+            break;
+        case OP_STA:
+        case OP_STB: {
+            const word_t *src = d->handler == OP_STA ? f->A : f->B;
+            if (uniform) {
+                k->blend(&f->memory[(size_t)d->addr * n], src, mask, n);
+            } else {
+                for (int i = 0; i < f->lanes; i++) {
+                    if (mask[i]) {
+                        *cell(f, i, f->ea[i]) = src[i];
+                    }
+                }
+            }
+            break;
+        }
+        case OP_ADD:
+            k->addsub(f->A, y, 0, mask, f->overflow, n);
+            break;
+        case OP_SUB:
+            k->addsub(f->A, y, SIGN_BIT, mask, f->overflow, n);
+            break;
+        case OP_MPY:
+            k->mpy(f->A, f->B, y, mask, n);
+            break;
+        case OP_ANA:
+        case OP_ORA:
+        case OP_ERA:
+            k->logic(f->A, y, d->handler, mask, n);
+            break;
+        case OP_TAB:
+            k->blend(f->B, f->A, mask, n);
+            break;
+        case OP_IAB:
+            for (int i = 0; i < n; i++) {
+                word_t t = (f->A[i] ^ f->B[i]) & mask[i];
+                f->A[i] ^= t;
+                f->B[i] ^= t;
+            }
+            break;
+        case OP_ARS:
+        case OP_ALS: {
+            word_t count = d->addr & 0x1F;
+            for (int i = 0; i < n; i++) {
+                word_t a = f->A[i];
+                word_t mag = d->handler == OP_ARS ? (a & MAGNITUDE_MASK) >> count :
+                                                    ((a & MAGNITUDE_MASK) << count) & MAGNITUDE_MASK;
+                f->A[i] = (((a & SIGN_BIT) | mag) & mask[i]) | (a & ~mask[i]);
+            }
+            break;
+        }
+        default: {
+            /* Branches: every lane picks its own next PC */
+            for (int i = 0; i < f->lanes; i++) {
+                if (mask[i]) {
+                    word_t target = uniform ? d->addr : f->ea[i];
+                    f->PC[i] = branch_taken(d->handler, f->A[i]) ? target : next;
+                    f->cycles[i] += d->cycles;
+                }
+            }
+            return;
+        }
+    }
+
+    /* Everyone in the group falls through to the next word */
+    for (int i = 0; i < n; i++) {
+        f->PC[i] = (next & mask[i]) | (f->PC[i] & ~mask[i]);
+        f->cycles[i] += d->cycles & (uint64_t)(int64_t)(int32_t)mask[i];
+    }
+}
+
+static inline uint32_t lane_live(const ddp24_fleet_t *f, int i) {
+    return -(uint32_t)(!f->halted[i] & (f->cycles[i] < f->limit[i]));
+}
+
+int ddp24_fleet_run(ddp24_fleet_t *f, uint64_t max_cycles) {
+    const kernels_t *k = kernels();
+    uint32_t *live = f->live;
+    int running = 0;
+
+    for (int i = 0; i < f->lanes; i++) {
+        f->limit[i] = max_cycles ? f->cycles[i] + max_cycles : UINT64_MAX;
+        live[i] = lane_live(f, i);
+    }
+
+    /* Lowest PC first lets lanes that fell behind catch up.
+     * Dead lanes read as 0xFFFFFFFF, above any real PC. */
+    word_t leader = 0xFFFFFFFFu;
+    for (int i = 0; i < f->lanes; i++) {
+        word_t pc = f->PC[i] | ~live[i];
+        leader = pc < leader ? pc : leader;
+    }
+
+    while (leader != 0xFFFFFFFFu) {
+        /* Group: live lanes at the leader PC holding the same word */
+        const word_t *row = &f->memory[(size_t)leader * f->stride];
+        int first = 0;
+        while (!live[first] || f->PC[first] != leader) {
+            first++;
+        }
+        word_t instr = row[first];
+        int count = 0;
+        for (int i = first; i < f->lanes; i++) {
+            uint32_t m = live[i] & -(uint32_t)(f->PC[i] == leader) & -(uint32_t)(row[i] == instr);
+            f->mask[i] = m;
+            count += (int)(m & 1);
+        }
+        for (int i = 0; i < first; i++) {
+            f->mask[i] = 0;
+        }
+
+        ddp24_decoded_t d;
+        ddp24_predecode_with(f->timing, instr, &d);
+        exec_group(f, k, &d, leader, count);
+
+        /* Retire lanes that stopped and find the next leader in one pass */
+        leader = 0xFFFFFFFFu;
+        for (int i = 0; i < f->lanes; i++) {
+            live[i] &= ~f->mask[i] | lane_live(f, i);
+            word_t pc = f->PC[i] | ~live[i];
+            leader = pc < leader ? pc : leader;
+        }
+    }
+
+    for (int i = 0; i < f->lanes; i++) {
+        running += !f->halted[i];
+    }
+    return running;
+}
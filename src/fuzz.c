@@ -0,0 +1,480 @@
+/*
+ * DDP-24 Emulator - Differential Fuzzing
+ * Viking Mars Lander Guidance Computer
+ *
+ * Workers take case numbers off a shared counter; each has its own
+ * fleet, so nothing but the failure list is shared while they run.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../include/ddp24_fuzz.h"
+#include "../include/ddp24_fleet.h"
+#include "ddp24_internal.h"
+
+#define FUZZ_LENGTH     64
+#define FUZZ_BUDGET     4000
+#define NOP_WORD        ((word_t)OP_NOP << OP_SHIFT)
+
+#define NAME(name)  #name,
+static const char *const slot_name[64] = { DDP24_SLOTS(NAME) };
+#undef NAME
+
+/* Generation */
+
+static uint64_t splitmix(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/* Mostly anything, sometimes the sign-magnitude corners */
+static word_t random_value(uint64_t *state) {
+    static const word_t edge[] = {
+        0, SIGN_BIT, 1, SIGN_BIT | 1, MAGNITUDE_MASK, SIGN_BIT | MAGNITUDE_MASK,
+        MAGNITUDE_MASK - 1, 1u << 22,
+    };
+    uint64_t r = splitmix(state);
+    return r % 4 == 0 ? edge[(r >> 2) % 8] : (word_t)(r >> 8) & WORD_MASK;
+}
+
+/* Neither HLT nor an unimplemented slot */
+static bool runs_on(int op) {
+    return op != OP_HLT && strcmp(slot_name[op], "ILLEGAL") != 0;
+}
+
+static word_t random_word(uint64_t *state, const ddp24_fuzz_case_t *c) {
+    uint64_t r = splitmix(state);
+    if (r % 8 == 0) {
+        return random_value(state);     /* Data among the code */
+    }
+    int op = (int)(r >> 3) & OP_MASK;
+    if (!runs_on(op) && (r >> 9) % 8) {
+        op = (int)(r >> 48) & OP_MASK;  /* Keep most runs going */
+        op = runs_on(op) ? op : OP_NOP;
+    }
+    word_t addr;
+    switch ((r >> 12) % 8) {
+        case 0:  addr = (word_t)(r >> 16) & ADDR_MASK; break;
+        case 1:  addr = (word_t)(r >> 16) % 32; break;  /* Shift counts, device codes */
+        default: addr = (c->base + (word_t)((r >> 16) % (uint64_t)c->length)) & ADDR_MASK; break;
+    }
+    word_t index = (r >> 40) % 4 == 0 ? (word_t)(r >> 42) % 4 : 0;
+    word_t indirect = (r >> 44) % 8 == 0 ? INDIRECT_BIT : 0;
+    return (word_t)op << OP_SHIFT | indirect | index << INDEX_SHIFT | addr;
+}
+
+void ddp24_fuzz_generate(const ddp24_fuzz_config_t *config, uint64_t seed, ddp24_fuzz_case_t *c) {
+    uint64_t state = seed;
+    int length = config->length > 0 ? config->length : FUZZ_LENGTH;
+    if (length > DDP24_FUZZ_WORDS) {
+        length = DDP24_FUZZ_WORDS;
+    }
+    memset(c, 0, sizeof(*c));
+    c->seed = seed;
+    c->length = length;
+    c->budget = config->budget ? config->budget : FUZZ_BUDGET;
+    c->base = (word_t)(splitmix(&state) % (MEM_SIZE - (uint64_t)length));
+    c->PC = c->base;
+    c->A = random_value(&state);
+    c->B = random_value(&state);
+    for (int i = 1; i < 4; i++) {
+        uint64_t r = splitmix(&state);
+        c->X[i] = (word_t)(r % 2 ? r >> 8 : (r >> 8) % 8) & ADDR_MASK;
+    }
+    c->overflow = splitmix(&state) % 2;
+    for (int i = 0; i < length; i++) {
+        c->word[i] = random_word(&state, c);
+    }
+}
+
+/* Running */
+
+static void setup(ddp24_t *cpu, const ddp24_fuzz_case_t *c) {
+    ddp24_init(cpu);
+    ddp24_write_block(cpu, c->base, c->word, (word_t)c->length);
+    cpu->A = c->A;
+    cpu->B = c->B;
+    for (int i = 1; i < 4; i++) {
+        cpu->X[i] = c->X[i];
+    }
+    cpu->PC = c->PC;
+    cpu->overflow = c->overflow;
+}
+
+/* ddp24_run_until without the devices or the engines */
+static void run_reference(ddp24_t *cpu, uint64_t budget) {
+    while (!cpu->halted && cpu->cycles < budget) {
+        if (!ddp24_irq_service(cpu)) {
+            ddp24_step(cpu);
+        }
+    }
+}
+
+static bool differs(ddp24_fuzz_failure_t *f, const char *field, uint64_t expected, uint64_t got) {
+    if (expected == got) {
+        return false;
+    }
+    snprintf(f->field, sizeof(f->field), "%s", field);
+    f->expected = expected;
+    f->got = got;
+    return true;
+}
+
+static bool differs_at(ddp24_fuzz_failure_t *f, word_t addr, word_t expected, word_t got) {
+    if (expected == got) {
+        return false;
+    }
+    char field[16];
+    snprintf(field, sizeof(field), "@%05o", addr);
+    return differs(f, field, expected, got);
+}
+
+/* First difference between got and the reference, into *f */
+static bool compare(const ddp24_t *ref, const ddp24_t *got, ddp24_fuzz_failure_t *f) {
+    if (differs(f, "halted", ref->halted, got->halted) ||
+        differs(f, "fault", ref->fault, got->fault) ||
+        differs(f, "PC", ref->PC, got->PC) ||
+        differs(f, "A", ref->A, got->A) ||
+        differs(f, "B", ref->B, got->B) ||
+        differs(f, "X1", ref->X[1], got->X[1]) ||
+        differs(f, "X2", ref->X[2], got->X[2]) ||
+        differs(f, "X3", ref->X[3], got->X[3]) ||
+        differs(f, "overflow", ref->overflow, got->overflow) ||
+        differs(f, "cycles", ref->cycles, got->cycles)) {
+        return true;
+    }
+    uint64_t hash = ddp24_state_hash(ref);
+    if (hash == ddp24_state_hash(got)) {
+        return false;
+    }
+    for (word_t a = 0; a < MEM_SIZE; a++) {
+        if (differs_at(f, a, mem_read(ref, a), mem_read(got, a))) {
+            return true;
+        }
+    }
+    return differs(f, "state hash", hash, ddp24_state_hash(got));   /* Interrupt state */
+}
+
+static bool run_engine(const ddp24_fuzz_case_t *c, ddp24_engine_t engine, const ddp24_t *ref,
+                       ddp24_fuzz_failure_t *f) {
+    ddp24_t cpu;
+    setup(&cpu, c);
+    ddp24_set_engine(&cpu, engine);
+    ddp24_run_for(&cpu, c->budget);
+    bool bad = compare(ref, &cpu, f);
+    ddp24_release(&cpu);
+    return bad;
+}
+
+/* The same for the lanes, which have no fault or interrupt state */
+static bool compare_lanes(const ddp24_t *ref, const ddp24_fleet_t *fleet, ddp24_fuzz_failure_t *f) {
+    for (int lane = 0; lane < fleet->lanes; lane++) {
+        if (differs(f, "halted", ref->halted, fleet->halted[lane]) ||
+            differs(f, "PC", ref->PC, fleet->PC[lane]) ||
+            differs(f, "A", ref->A, fleet->A[lane]) ||
+            differs(f, "B", ref->B, fleet->B[lane]) ||
+            differs(f, "X1", ref->X[1], fleet->X[1][lane]) ||
+            differs(f, "X2", ref->X[2], fleet->X[2][lane]) ||
+            differs(f, "X3", ref->X[3], fleet->X[3][lane]) ||
+            differs(f, "overflow", ref->overflow, fleet->overflow[lane]) ||
+            differs(f, "cycles", ref->cycles, fleet->cycles[lane])) {
+            return true;
+        }
+    }
+    for (word_t a = 0; a < MEM_SIZE; a++) {
+        const word_t *row = &fleet->memory[(size_t)a * fleet->stride];
+        word_t w = mem_read(ref, a);
+        for (int lane = 0; lane < fleet->lanes; lane++) {
+            if (differs_at(f, a, w, row[lane])) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool run_fleet(const ddp24_fuzz_case_t *c, ddp24_fleet_t *fleet, const ddp24_t *ref,
+                      ddp24_fuzz_failure_t *f) {
+    ddp24_t cpu;
+    setup(&cpu, c);
+    ddp24_fleet_broadcast(fleet, &cpu);
+    ddp24_release(&cpu);
+    ddp24_fleet_run(fleet, c->budget);
+
+    return compare_lanes(ref, fleet, f);
+}
+
+static unsigned available(unsigned candidates) {
+    if (!candidates) {
+        candidates = DDP24_FUZZ_ALL;
+    }
+    for (int e = DDP24_ENGINE_SWITCH; e <= DDP24_ENGINE_JIT; e++) {
+        if (!ddp24_engine_available((ddp24_engine_t)e)) {
+            candidates &= ~(1u << e);
+        }
+    }
+    return candidates & DDP24_FUZZ_ALL;
+}
+
+/* ddp24_fuzz_check on a fleet the caller keeps */
+static unsigned check(const ddp24_fuzz_case_t *c, unsigned candidates, ddp24_fleet_t *fleet,
+                      ddp24_fuzz_failure_t *failure) {
+    ddp24_fuzz_failure_t scratch;
+    ddp24_fuzz_failure_t *f = failure ? failure : &scratch;
+    ddp24_t ref;
+    setup(&ref, c);
+    run_reference(&ref, c->budget);
+
+    unsigned bad = 0;
+    for (int e = DDP24_ENGINE_SWITCH; e <= DDP24_ENGINE_JIT && !bad; e++) {
+        if ((candidates & (1u << e)) && run_engine(c, (ddp24_engine_t)e, &ref, f)) {
+            bad = 1u << e;
+        }
+    }
+    if (!bad && (candidates & DDP24_FUZZ_FLEET) && fleet && run_fleet(c, fleet, &ref, f)) {
+        bad = DDP24_FUZZ_FLEET;
+    }
+    ddp24_release(&ref);
+    if (bad) {
+        f->c = *c;
+        f->candidate = bad;
+    }
+    return bad;
+}
+
+unsigned ddp24_fuzz_check(const ddp24_fuzz_case_t *c, unsigned candidates, ddp24_fuzz_failure_t *failure) {
+    candidates = available(candidates);
+    ddp24_fleet_t *fleet = candidates & DDP24_FUZZ_FLEET ? ddp24_fleet_create(DDP24_FLEET_ALIGN) : NULL;
+    unsigned bad = check(c, candidates, fleet, failure);
+    ddp24_fleet_destroy(fleet);
+    return bad;
+}
+
+/* Minimising */
+
+static bool still_fails(const ddp24_fuzz_case_t *c, unsigned candidate, ddp24_fleet_t *fleet) {
+    return check(c, candidate, fleet, NULL) != 0;
+}
+
+static void minimise(ddp24_fuzz_failure_t *f, ddp24_fleet_t *fleet) {
+    ddp24_fuzz_case_t c = f->c;
+    unsigned candidate = f->candidate;
+
+    /* The fewest cycles: the failing budget stays in hi */
+    uint64_t lo = 0, hi = c.budget;
+    while (hi - lo > 1) {
+        c.budget = lo + (hi - lo) / 2;
+        if (still_fails(&c, candidate, fleet)) {
+            hi = c.budget;
+        } else {
+            lo = c.budget;
+        }
+    }
+    c.budget = hi;
+
+    /* Until nothing more goes: drop words off the end (leaving HLTs),
+     * NOP out the others, clear registers */
+    for (bool changed = true; changed; ) {
+        changed = false;
+        while (c.length > 1) {
+            c.length--;
+            if (!still_fails(&c, candidate, fleet)) {
+                c.length++;
+                break;
+            }
+            changed = true;
+        }
+        for (int i = 0; i < c.length; i++) {
+            word_t w = c.word[i];
+            if (w != NOP_WORD) {
+                c.word[i] = NOP_WORD;
+                if (still_fails(&c, candidate, fleet)) {
+                    changed = true;
+                } else {
+                    c.word[i] = w;
+                }
+            }
+        }
+        word_t *reg[] = { &c.A, &c.B, &c.X[1], &c.X[2], &c.X[3] };
+        for (size_t i = 0; i < sizeof(reg) / sizeof(reg[0]); i++) {
+            word_t v = *reg[i];
+            if (v) {
+                *reg[i] = 0;
+                if (still_fails(&c, candidate, fleet)) {
+                    changed = true;
+                } else {
+                    *reg[i] = v;
+                }
+            }
+        }
+        if (c.overflow) {
+            c.overflow = false;
+            if (still_fails(&c, candidate, fleet)) {
+                changed = true;
+            } else {
+                c.overflow = true;
+            }
+        }
+    }
+
+    /* Describe what is left */
+    check(&c, candidate, fleet, f);
+}
+
+void ddp24_fuzz_minimise(ddp24_fuzz_failure_t *failure) {
+    ddp24_fleet_t *fleet = NULL;
+    if (failure->candidate == DDP24_FUZZ_FLEET && !(fleet = ddp24_fleet_create(DDP24_FLEET_ALIGN))) {
+        return;
+    }
+    if (check(&failure->c, failure->candidate, fleet, NULL)) {
+        minimise(failure, fleet);
+    }
+    ddp24_fleet_destroy(fleet);
+}
+
+/* Parallel runs */
+
+typedef struct {
+    const ddp24_fuzz_config_t *config;
+    unsigned candidates;
+    int max;
+    atomic_uint_least64_t next;
+    atomic_uint_least64_t ran;
+    atomic_bool done;
+    pthread_mutex_t lock;
+    ddp24_fuzz_failure_t *failure;      /* By seed */
+    int failures;
+} fuzz_t;
+
+/* Keep the lowest seeds if workers still running find more */
+static void add_failure(fuzz_t *z, const ddp24_fuzz_failure_t *f) {
+    pthread_mutex_lock(&z->lock);
+    int i = z->failures;
+    if (i == z->max) {
+        i = z->failure[i - 1].c.seed > f->c.seed ? i - 1 : -1;
+    } else {
+        z->failures++;
+    }
+    if (i >= 0) {
+        while (i > 0 && z->failure[i - 1].c.seed > f->c.seed) {
+            z->failure[i] = z->failure[i - 1];
+            i--;
+        }
+        z->failure[i] = *f;
+    }
+    if (z->failures == z->max) {
+        atomic_store(&z->done, true);
+    }
+    pthread_mutex_unlock(&z->lock);
+}
+
+static void *fuzz_main(void *arg) {
+    fuzz_t *z = arg;
+    ddp24_fleet_t *fleet = NULL;
+    if ((z->candidates & DDP24_FUZZ_FLEET) && !(fleet = ddp24_fleet_create(DDP24_FLEET_ALIGN))) {
+        return NULL;
+    }
+    uint64_t k;
+    while (!atomic_load_explicit(&z->done, memory_order_relaxed) &&
+           (k = atomic_fetch_add(&z->next, 1)) < z->config->cases) {
+        ddp24_fuzz_case_t c;
+        ddp24_fuzz_failure_t f;
+        ddp24_fuzz_generate(z->config, z->config->seed + k, &c);
+        if (check(&c, z->candidates, fleet, &f)) {
+            minimise(&f, fleet);
+            add_failure(z, &f);
+        }
+        atomic_fetch_add_explicit(&z->ran, 1, memory_order_relaxed);
+    }
+    ddp24_fleet_destroy(fleet);
+    return NULL;
+}
+
+int ddp24_fuzz_run(const ddp24_fuzz_config_t *config, ddp24_fuzz_failure_t *failure, uint64_t *ran) {
+    int threads = config->threads;
+    if (threads <= 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = n > 0 ? (int)n : 1;
+    }
+    if ((uint64_t)threads > config->cases) {
+        threads = config->cases ? (int)config->cases : 1;
+    }
+
+    fuzz_t z = { .config = config, .candidates = available(config->candidates),
+                 .max = config->max_failures > 0 ? config->max_failures : 1, .failure = failure };
+    atomic_init(&z.next, 0);
+    atomic_init(&z.ran, 0);
+    atomic_init(&z.done, false);
+    pthread_mutex_init(&z.lock, NULL);
+
+    /* This thread is one of the workers */
+    pthread_t *tids = ddp24_calloc((size_t)threads, sizeof(pthread_t));
+    bool *started = ddp24_calloc((size_t)threads, sizeof(bool));
+    for (int i = 1; tids && started && i < threads; i++) {
+        started[i] = pthread_create(&tids[i], NULL, fuzz_main, &z) == 0;
+    }
+    fuzz_main(&z);
+    for (int i = 1; tids && started && i < threads; i++) {
+        if (started[i]) {
+            pthread_join(tids[i], NULL);
+        }
+    }
+    ddp24_free(tids);
+    ddp24_free(started);
+    pthread_mutex_destroy(&z.lock);
+
+    if (ran) {
+        *ran = atomic_load(&z.ran);
+    }
+    return z.failures;
+}
+
+/* Reports */
+
+const char *ddp24_fuzz_candidate_name(unsigned candidate) {
+    switch (candidate) {
+        case DDP24_FUZZ_SWITCH:     return "switch";
+        case DDP24_FUZZ_THREADED:   return "threaded";
+        case DDP24_FUZZ_JIT:        return "jit";
+        case DDP24_FUZZ_FLEET:      return "fleet";
+    }
+    return "unknown";
+}
+
+void ddp24_fuzz_print(FILE *out, const ddp24_fuzz_failure_t *f) {
+    const ddp24_fuzz_case_t *c = &f->c;
+    fprintf(out, "; Case %llu: %s differs in %s (expected %llo, got %llo)\n",
+            (unsigned long long)c->seed, ddp24_fuzz_candidate_name(f->candidate), f->field,
+            (unsigned long long)f->expected, (unsigned long long)f->got);
+    fprintf(out, "; A=%08o B=%08o X1=%05o X2=%05o X3=%05o%s, %llu cycles\n",
+            c->A, c->B, c->X[1], c->X[2], c->X[3], c->overflow ? " overflow" : "",
+            (unsigned long long)c->budget);
+    fprintf(out, "        .org 0%o\n        .entry 0%o\n", c->base, c->PC);
+    for (int i = 0; i < c->length; i++) {
+        word_t w = c->word[i];
+        const char *name = slot_name[decode_opcode(w)];
+        if (strcmp(name, "ILLEGAL") == 0) {
+            fprintf(out, "        .word 0%o\n", w);
+            continue;
+        }
+        char op[8];
+        int n = 0;
+        for (; name[n]; n++) {
+            op[n] = (char)(name[n] - 'A' + 'a');
+        }
+        op[n] = '\0';
+        fprintf(out, "        %s%s 0%o", op, decode_indirect(w) ? "*" : "", decode_address(w));
+        if (decode_index(w)) {
+            fprintf(out, ",%d", decode_index(w));
+        }
+        fprintf(out, "\n");
+    }
+}
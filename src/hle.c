@@ -0,0 +1,141 @@
+/*
+ * DDP-24 Emulator - High-Level Emulation
+ * Viking Mars Lander Guidance Computer
+ *
+ * The engines test cpu->hle once per JSL; a byte per address then says
+ * whether anything hooks the target. Each CPU keeps a bit per hook for
+ * code that has matched, and a page mask the stores test before
+ * ddp24_hle_forget clears the bits they hit.
+ */
+
+#include <stdatomic.h>
+#include <string.h>
+#include "../include/ddp24_hle.h"
+#include "ddp24_internal.h"
+
+typedef struct {
+    word_t link;
+    int length;
+    uint64_t checksum;
+    ddp24_hle_fn fn;
+    void *ctx;
+    uint8_t next;           /* Another hook on the same link word, 1-based */
+} hook_t;
+
+struct ddp24_hle {
+    int count;
+    atomic_uint_least64_t hits;
+    uint8_t first[MEM_SIZE];    /* First hook per link word, 1-based */
+    hook_t hook[DDP24_HLE_MAX];
+};
+
+ddp24_hle_t *ddp24_hle_create(void) {
+    ddp24_hle_t *hle = ddp24_calloc(1, sizeof(ddp24_hle_t));
+    if (hle) {
+        atomic_init(&hle->hits, 0);
+    }
+    return hle;
+}
+
+void ddp24_hle_free(ddp24_hle_t *hle) {
+    ddp24_free(hle);
+}
+
+bool ddp24_hle_add(ddp24_hle_t *hle, word_t link, int length, uint64_t checksum,
+                   ddp24_hle_fn fn, void *ctx) {
+    if (hle->count == DDP24_HLE_MAX || length < 0 || length >= MEM_SIZE) {
+        return false;
+    }
+    link &= ADDR_MASK;
+    hle->hook[hle->count] = (hook_t){ link, length, checksum, fn, ctx, hle->first[link] };
+    hle->first[link] = (uint8_t)++hle->count;
+    return true;
+}
+
+/* Position-sensitive, so moved code does not match */
+uint64_t ddp24_hle_checksum(const ddp24_t *cpu, word_t first, int length) {
+    uint64_t h = 0;
+    for (int i = 0; i < length; i++) {
+        word_t addr = (first + i) & ADDR_MASK;
+        h ^= word_hash(addr, mem_read(cpu, addr));
+    }
+    return h;
+}
+
+#define CHECKED_WORDS   ((int)(sizeof(((ddp24_t *)0)->hle_checked) / sizeof(uint64_t)))
+_Static_assert(DDP24_HLE_MAX <= 64 * CHECKED_WORDS, "a checked bit per hook");
+
+void ddp24_hle_attach(ddp24_t *cpu, ddp24_hle_t *hle) {
+    cpu->hle = hle;
+    memset(cpu->hle_checked, 0, sizeof(cpu->hle_checked));
+    cpu->hle_pages = 0;
+}
+
+/* Pages holding the length words from first */
+static uint64_t code_pages(word_t first, int length) {
+    if (length == 0) {
+        return 0;
+    }
+    if (length > MEM_SIZE - DDP24_PAGE_SIZE) {
+        return ~0ull;
+    }
+    uint64_t pages = 0;
+    int last = ((first + (word_t)length - 1) & (MEM_SIZE - 1)) >> DDP24_PAGE_SHIFT;
+    for (int n = first >> DDP24_PAGE_SHIFT; ; n = (n + 1) % DDP24_PAGES) {
+        pages |= 1ull << n;
+        if (n == last) {
+            return pages;
+        }
+    }
+}
+
+void ddp24_hle_forget(ddp24_t *cpu, word_t addr, word_t count) {
+    uint64_t pages = 0;
+    for (int w = 0; w < CHECKED_WORDS; w++) {
+        for (uint64_t m = cpu->hle_checked[w]; m; m &= m - 1) {
+            int bit = __builtin_ctzll(m);
+            const hook_t *h = &cpu->hle->hook[w * 64 + bit];
+            word_t first = (h->link + 1) & (MEM_SIZE - 1);
+            if (count >= MEM_SIZE || ((addr - first) & (MEM_SIZE - 1)) < (word_t)h->length ||
+                ((first - addr) & (MEM_SIZE - 1)) < count) {
+                cpu->hle_checked[w] &= ~(1ull << bit);
+            } else {
+                pages |= code_pages(first, h->length);
+            }
+        }
+    }
+    cpu->hle_pages = pages;
+}
+
+uint64_t ddp24_hle_hits(const ddp24_hle_t *hle) {
+    return atomic_load_explicit(&hle->hits, memory_order_relaxed);
+}
+
+/* From the JSL handler, with the link word stored and cpu->PC on the
+ * routine; true if a hook ran it, *cycles then including its time */
+bool ddp24_hle_enter(ddp24_t *cpu, word_t link, int *cycles) {
+    ddp24_hle_t *hle = cpu->hle;
+    for (int n = hle->first[link]; n; n = hle->hook[n - 1].next) {
+        const hook_t *h = &hle->hook[n - 1];
+        uint64_t *checked = &cpu->hle_checked[(n - 1) / 64];
+        uint64_t bit = 1ull << ((n - 1) % 64);
+        if (!(*checked & bit)) {
+            word_t first = (link + 1) & ADDR_MASK;
+            if (ddp24_hle_checksum(cpu, first, h->length) != h->checksum) {
+                continue;
+            }
+            *checked |= bit;
+            cpu->hle_pages |= code_pages(first, h->length);
+        }
+        int spent = h->fn(cpu, link, h->ctx);
+        if (spent < 0) {
+            cpu->PC = (link + 1) & ADDR_MASK;   /* Declined: run the guest code */
+            return false;
+        }
+        cpu->PC = mem_read(cpu, link) & ADDR_MASK;
+        *cycles += spent;
+        atomic_fetch_add_explicit(&hle->hits, 1, memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
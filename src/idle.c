@@ -0,0 +1,100 @@
+/*
+ * DDP-24 Emulator - Idle Loop Fast-Forward
+ * Viking Mars Lander Guidance Computer
+ *
+ * Wait loops that store nothing and change registers by a fixed step
+ * each time round can be skipped in one go. Engines call in when
+ * a branch is taken back to itself. Runs end at the next device event,
+ * so nothing outside the CPU can change what the loop does before
+ * run_limit, and the skip goes up to the last whole iteration that ends
+ * short of it. The engine then runs the
+ * remaining iterations normally and stops exactly where stepping would.
+ *
+ * Recognised shapes, all with direct, unindexed operands:
+ *     L: JMP L                       spin
+ *     L: SKS dev, L+1: JMP L         wait for a sense line
+ *     L: SUB m / ADD m, L+1: JNZ L   countdown to zero by a constant
+ *     L: JXI L                       count an index register up to zero
+ */
+
+#include "ddp24_internal.h"
+
+static bool direct(const ddp24_decoded_t *d) {
+    return d->index == 0 && !(d->flags & DDP24_DEC_INDIRECT);
+}
+
+/* About to retire the branch back to head, which costs pending cycles */
+void ddp24_idle_skip(ddp24_t *cpu, word_t head, int pending) {
+    uint64_t now = cpu->cycles + (uint64_t)pending;
+    uint64_t limit = RUN_LIMIT(cpu);
+    if (now >= limit || cpu->trace || debug_active(cpu)) {
+        return;     /* A trace, breakpoint or watchpoint must see every pass */
+    }
+#ifdef DDP24_PROFILE
+    if (cpu->profile) {
+        return;
+    }
+#endif
+
+    const ddp24_decoded_t *d = fetch(cpu, head);
+    uint64_t per_pass;
+    uint64_t passes;
+    int32_t a = 0, step = 0;
+    int counter = 0;
+
+    if (d->handler == OP_JMP && direct(d) && d->addr == head) {
+        /* Nothing to count down: with no deadline it spins forever */
+        if (limit == DDP24_FOREVER) {
+            return;
+        }
+        per_pass = d->cycles;
+        passes = UINT64_MAX;
+    } else if (d->handler == OP_SKS) {
+        /* The sense line only changes at events, which end the run */
+        const ddp24_decoded_t *j = fetch(cpu, (head + 1) & ADDR_MASK);
+        if (j->handler != OP_JMP || !direct(j) || j->addr != head || limit == DDP24_FOREVER) {
+            return;
+        }
+        per_pass = (uint64_t)d->cycles + j->cycles;
+        passes = UINT64_MAX;
+    } else if (d->handler == OP_JXI && d->index > 0 && !(d->flags & DDP24_DEC_INDIRECT) &&
+               d->addr == head) {
+        /* X has just been stepped to nonzero; the pass that wraps it falls through */
+        counter = d->index;
+        per_pass = d->cycles;
+        passes = MEM_SIZE - 1 - cpu->X[counter];
+    } else if ((d->handler == OP_SUB || d->handler == OP_ADD) && direct(d)) {
+        const ddp24_decoded_t *j = fetch(cpu, (head + 1) & ADDR_MASK);
+        if (j->handler != OP_JNZ || !direct(j) || j->addr != head) {
+            return;
+        }
+        int32_t v = to_signed(mem_read(cpu, d->addr));
+        step = d->handler == OP_SUB ? -v : v;
+        a = to_signed(cpu->A);
+
+        /* Must land on zero exactly, moving towards it */
+        if (a == 0 || step == 0 || (a > 0) == (step > 0) || a % step != 0) {
+            return;
+        }
+        per_pass = (uint64_t)d->cycles + j->cycles;
+        passes = (uint64_t)(a / -step) - 1;     /* The last pass falls through */
+    } else {
+        return;
+    }
+
+    uint64_t fit = (limit - now - 1) / per_pass;
+    if (passes > fit) {
+        passes = fit;
+    }
+    if (passes == 0) {
+        return;
+    }
+
+    cpu->cycles += passes * per_pass;
+    if (step != 0) {
+        cpu->A = from_signed(a + (int32_t)passes * step);
+    }
+    if (counter) {
+        cpu->X[counter] = (cpu->X[counter] + (word_t)passes) & ADDR_MASK;
+    }
+}
@@ -0,0 +1,314 @@
+/*
+ * DDP-24 Emulator - Devices and Events
+ * Viking Mars Lander Guidance Computer
+ *
+ * The event queue is a binary min-heap ordered on (when, seq), so ties
+ * come out first in, first out. cpu->next_event mirrors the root so
+ * the run loop never has to look at the heap.
+ */
+
+#include <stdlib.h>
+#include "../include/ddp24_io.h"
+#include "ddp24_internal.h"
+
+typedef struct {
+    uint64_t when;
+    uint64_t seq;
+    ddp24_event_fn fn;
+    void *arg;
+} event_t;
+
+struct ddp24_io {
+    ddp24_device_t device[DDP24_CHANNELS];
+    bool attached[DDP24_CHANNELS];
+    event_t *heap;
+    int count;
+    int cap;
+    uint64_t seq;
+    struct ddp24_recording *record;     /* Logging what comes in (ddp24_replay.h) */
+    struct ddp24_replay *replay;        /* Feeding it back in place of the devices */
+};
+
+static struct ddp24_io *io_state(ddp24_t *cpu) {
+    if (!cpu->io) {
+        cpu->io = ddp24_calloc(1, sizeof(struct ddp24_io));
+    }
+    return cpu->io;
+}
+
+void ddp24_io_release(ddp24_t *cpu) {
+    if (cpu->io) {
+        ddp24_free(cpu->io->heap);
+        ddp24_free(cpu->io->replay);
+        ddp24_free(cpu->io);
+        cpu->io = NULL;
+    }
+    cpu->next_event = DDP24_FOREVER;
+}
+
+bool ddp24_attach_device(ddp24_t *cpu, int channel, const ddp24_device_t *dev) {
+    if (channel < 0 || channel >= DDP24_CHANNELS) {
+        return false;
+    }
+    if (!dev) {
+        if (cpu->io) {
+            cpu->io->attached[channel] = false;
+        }
+        return true;
+    }
+    struct ddp24_io *io = io_state(cpu);
+    if (!io) {
+        return false;
+    }
+    io->device[channel] = *dev;
+    io->attached[channel] = true;
+    return true;
+}
+
+/* I/O instructions */
+
+static const ddp24_device_t *device(const ddp24_t *cpu, word_t ea) {
+    int ch = DDP24_IO_CHANNEL(ea);
+    return cpu->io && cpu->io->attached[ch] ? &cpu->io->device[ch] : NULL;
+}
+
+void ddp24_io_control(ddp24_t *cpu, word_t ea) {
+    const ddp24_device_t *dev = device(cpu, ea);
+    if (dev && dev->control) {
+        dev->control(cpu, dev->ctx, DDP24_IO_FUNCTION(ea));
+    }
+}
+
+word_t ddp24_io_input(ddp24_t *cpu, word_t ea) {
+    struct ddp24_io *io = cpu->io;
+    if (io && io->replay) {
+        return ddp24_replay_value(cpu, io->replay, DDP24_LOG_INPUT, ea);
+    }
+    const ddp24_device_t *dev = device(cpu, ea);
+    word_t value = dev && dev->input ? dev->input(cpu, dev->ctx, DDP24_IO_FUNCTION(ea)) & WORD_MASK : 0;
+    if (io && io->record) {
+        ddp24_record_value(io->record, cpu->cycles, DDP24_LOG_INPUT, ea, value);
+    }
+    return value;
+}
+
+void ddp24_io_output(ddp24_t *cpu, word_t ea, word_t value) {
+    const ddp24_device_t *dev = device(cpu, ea);
+    if (dev && dev->output) {
+        dev->output(cpu, dev->ctx, DDP24_IO_FUNCTION(ea), value);
+    }
+}
+
+bool ddp24_io_sense(ddp24_t *cpu, word_t ea) {
+    struct ddp24_io *io = cpu->io;
+    if (io && io->replay) {
+        return ddp24_replay_value(cpu, io->replay, DDP24_LOG_SENSE, ea) != 0;
+    }
+    const ddp24_device_t *dev = device(cpu, ea);
+    bool set = dev && dev->sense && dev->sense(cpu, dev->ctx, DDP24_IO_FUNCTION(ea));
+    if (io && io->record) {
+        ddp24_record_value(io->record, cpu->cycles, DDP24_LOG_SENSE, ea, set);
+    }
+    return set;
+}
+
+bool ddp24_io_hook(ddp24_t *cpu, struct ddp24_recording *record, struct ddp24_replay *replay) {
+    struct ddp24_io *io = record || replay ? io_state(cpu) : cpu->io;
+    if (!io) {
+        return !record && !replay;
+    }
+    io->record = record;
+    io->replay = replay;
+    return true;
+}
+
+struct ddp24_replay *ddp24_io_replay(const ddp24_t *cpu) {
+    return cpu->io ? cpu->io->replay : NULL;
+}
+
+/* Event heap */
+
+static bool before(const event_t *a, const event_t *b) {
+    return a->when != b->when ? a->when < b->when : a->seq < b->seq;
+}
+
+static void sift_up(event_t *h, int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!before(&h[i], &h[parent])) {
+            break;
+        }
+        event_t t = h[i];
+        h[i] = h[parent];
+        h[parent] = t;
+        i = parent;
+    }
+}
+
+static void sift_down(event_t *h, int count, int i) {
+    for (;;) {
+        int least = i;
+        int l = 2 * i + 1, r = l + 1;
+        if (l < count && before(&h[l], &h[least])) {
+            least = l;
+        }
+        if (r < count && before(&h[r], &h[least])) {
+            least = r;
+        }
+        if (least == i) {
+            break;
+        }
+        event_t t = h[i];
+        h[i] = h[least];
+        h[least] = t;
+        i = least;
+    }
+}
+
+static void update_next(ddp24_t *cpu) {
+    struct ddp24_io *io = cpu->io;
+    cpu->next_event = io && io->count ? io->heap[0].when : DDP24_FOREVER;
+}
+
+bool ddp24_schedule(ddp24_t *cpu, uint64_t when, ddp24_event_fn fn, void *arg) {
+    struct ddp24_io *io = io_state(cpu);
+    if (!io) {
+        return false;
+    }
+    if (io->count == io->cap) {
+        int cap = io->cap ? io->cap * 2 : 16;
+        event_t *heap = ddp24_realloc(io->heap, (size_t)cap * sizeof(event_t));
+        if (!heap) {
+            return false;
+        }
+        io->heap = heap;
+        io->cap = cap;
+    }
+    io->heap[io->count] = (event_t){ when, io->seq++, fn, arg };
+    sift_up(io->heap, io->count++);
+    update_next(cpu);
+
+    /* Scheduled from a callback mid-run: end the run in time for it */
+    lower_run_limit(cpu, when);
+    return true;
+}
+
+int ddp24_cancel(ddp24_t *cpu, ddp24_event_fn fn, void *arg) {
+    struct ddp24_io *io = cpu->io;
+    int removed = 0;
+    if (!io) {
+        return 0;
+    }
+    for (int i = 0; i < io->count; ) {
+        if (io->heap[i].fn == fn && io->heap[i].arg == arg) {
+            io->heap[i] = io->heap[--io->count];
+            removed++;
+        } else {
+            i++;
+        }
+    }
+    /* Rare enough that rebuilding beats fixing up in place */
+    for (int i = io->count / 2 - 1; i >= 0; i--) {
+        sift_down(io->heap, io->count, i);
+    }
+    update_next(cpu);
+    return removed;
+}
+
+uint64_t ddp24_next_event(const ddp24_t *cpu) {
+    return cpu->next_event;
+}
+
+/* Run every event due by now, including ones they schedule for now */
+void ddp24_io_fire(ddp24_t *cpu) {
+    struct ddp24_io *io = cpu->io;
+    while (io && io->count && io->heap[0].when <= cpu->cycles) {
+        event_t e = io->heap[0];
+        io->heap[0] = io->heap[--io->count];
+        sift_down(io->heap, io->count, 0);
+        update_next(cpu);
+        e.fn(cpu, e.arg);
+    }
+    update_next(cpu);
+}
+
+/* Interrupts */
+
+static bool irq_deliverable(const ddp24_t *cpu) {
+    return cpu->interrupt_enabled && (cpu->irq_pending & ~cpu->irq_mask);
+}
+
+/* End the current stretch so the run loop delivers at the next boundary */
+static void irq_check(ddp24_t *cpu) {
+    if (irq_deliverable(cpu) || cpu->interrupt_enable_next) {
+        set_run_limit(cpu, 0);
+    }
+}
+
+bool ddp24_raise_interrupt(ddp24_t *cpu, int line) {
+    if (line < 0 || line >= DDP24_IRQ_LINES) {
+        return false;
+    }
+    cpu->irq_pending |= 1u << line;
+    irq_check(cpu);
+    return true;
+}
+
+bool ddp24_post_interrupt(ddp24_t *cpu, int line) {
+    if (line < 0 || line >= DDP24_IRQ_LINES) {
+        return false;
+    }
+    atomic_fetch_or(&cpu->irq_posted, 1u << line);
+    atomic_store(&cpu->run_limit, 0);   /* Ends the stretch on the CPU's thread */
+    return true;
+}
+
+void ddp24_itc(ddp24_t *cpu, word_t ea) {
+    if (ea & DDP24_ITC_MASK) {
+        cpu->irq_mask = cpu->A & ((1u << DDP24_IRQ_LINES) - 1);
+    }
+    if (ea & DDP24_ITC_DISABLE) {
+        cpu->interrupt_enabled = false;
+        cpu->interrupt_enable_next = false;
+    } else if ((ea & DDP24_ITC_ENABLE) && !cpu->interrupt_enabled) {
+        cpu->interrupt_enable_next = true;
+    }
+    irq_check(cpu);
+}
+
+/* Called between stretches; true if it moved the CPU on */
+bool ddp24_irq_service(ddp24_t *cpu) {
+    struct ddp24_recording *record = cpu->io ? cpu->io->record : NULL;
+    if (atomic_load_explicit(&cpu->irq_posted, memory_order_relaxed)) {
+        cpu->irq_pending |= atomic_exchange_explicit(&cpu->irq_posted, 0, memory_order_acquire);
+    }
+    if (record) {
+        ddp24_record_irq(record, cpu);
+    }
+    if (cpu->interrupt_enable_next) {
+        /* The instruction after ITC runs first, typically the JMP* return */
+        cpu->interrupt_enable_next = false;
+        ddp24_step(cpu);
+        cpu->interrupt_enabled = true;
+        return true;
+    }
+    uint32_t ready = cpu->irq_pending & ~cpu->irq_mask;
+    if (!cpu->interrupt_enabled || !ready) {
+        return false;
+    }
+
+    int line = __builtin_ctz(ready);    /* Lowest line wins */
+    word_t vector = DDP24_IRQ_VECTOR(line);
+    cpu->irq_pending &= ~(1u << line);
+    if (record) {
+        ddp24_record_irq(record, cpu);  /* So a fresh raise of the line is logged */
+    }
+    cpu->interrupt_enabled = false;
+    ddp24_write(cpu, vector, cpu->PC);
+    cpu->PC = (vector + 1) & ADDR_MASK;
+    cpu->cycles += cpu->timing->interrupt;
+    if (cpu->calls) {
+        ddp24_calls_enter(cpu->calls, vector, cpu->cycles);
+    }
+    return true;
+}
@@ -0,0 +1,566 @@
+/*
+ * DDP-24 Emulator - Basic-Block JIT
+ * Viking Mars Lander Guidance Computer
+ *
+ * Optional tier (make JIT=1) on top of the reference interpreter.
+ * Branch targets of JMP/JNZ/JXI are counted as they are taken; once a
+ * target gets hot, the straight-line block starting there is compiled
+ * to host code and entered directly from then on. A and B live in host
+ * registers inside a block and every exit writes back PC, A, B and the
+ * exact cycle count for the path taken.
+ *
+ * Only direct (unindexed, non-indirect) operands are compiled. Anything
+ * else ends the block and is left to the interpreter. The backend is
+ * x86-64 only; on other hosts the engine is reported as unavailable.
+ */
+
+#define _DEFAULT_SOURCE
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ddp24_internal.h"
+
+#if DDP24_JIT_AVAILABLE
+
+#include <sys/mman.h>
+
+#define JIT_THRESHOLD   16          /* Taken branches before compiling */
+#define JIT_NEVER       0xFFFF      /* Counter value for uncompilable targets */
+#define JIT_MAX_BLOCK   64          /* Instructions per block */
+#define JIT_MAX_BLOCKS  4096
+#define JIT_CODE_SIZE   (1 << 20)   /* Bytes of executable memory */
+#define JIT_BLOCK_SLACK 512         /* Worst-case code bytes per instruction */
+
+typedef uint32_t (*jit_code_t)(ddp24_t *cpu);
+
+typedef struct {
+    jit_code_t code;
+    word_t start;
+    word_t len;                     /* Words covered, terminator included */
+    uint32_t cycles;                /* Cost when run to the end */
+} jit_block_t;
+
+struct ddp24_jit {
+    jit_block_t *entry[MEM_SIZE];   /* Live block starting at each address */
+    uint16_t hits[MEM_SIZE];        /* Taken-branch counts per target */
+    uint8_t cover[MEM_SIZE];        /* Live blocks covering each word */
+    jit_block_t blocks[JIT_MAX_BLOCKS];
+    int nblocks;
+    uint8_t *code;
+    size_t code_used;
+    bool killed;                    /* A store threw away compiled code */
+};
+
+/* x86-64 registers */
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSI = 6, RDI = 7, R12 = 12, R13 = 13 };
+
+/* ALU opcodes, "op r/m32, r32" form, and their /digit for immediates */
+enum { ALU_ADD = 0x01, ALU_OR = 0x09, ALU_AND = 0x21, ALU_SUB = 0x29, ALU_XOR = 0x31 };
+enum { IMM_ADD = 0, IMM_OR = 1, IMM_AND = 4, IMM_SUB = 5, IMM_XOR = 6, IMM_CMP = 7 };
+enum { SH_SHL = 4, SH_SHR = 5, SH_SAR = 7 };
+
+#define REG_A   R12
+#define REG_B   R13
+
+#define OFF_A       ((int32_t)offsetof(ddp24_t, A))
+#define OFF_B       ((int32_t)offsetof(ddp24_t, B))
+#define OFF_PC      ((int32_t)offsetof(ddp24_t, PC))
+#define OFF_OVF     ((int32_t)offsetof(ddp24_t, overflow))
+#define OFF_CYCLES  ((int32_t)offsetof(ddp24_t, cycles))
+#define OFF_PAGE(a) ((int32_t)(offsetof(ddp24_t, page) + ((a) >> DDP24_PAGE_SHIFT) * sizeof(ddp24_page_t *)))
+#define OFF_WORD(a) ((int32_t)(offsetof(ddp24_page_t, word) + ((a) & DDP24_PAGE_MASK) * sizeof(word_t)))
+
+typedef struct {
+    uint8_t *p;
+    int page;                       /* Guest page whose pointer is in rsi, or -1 */
+} emit_t;
+
+static void emit8(emit_t *e, uint8_t b) { *e->p++ = b; }
+
+static void emit32(emit_t *e, uint32_t v) {
+    memcpy(e->p, &v, 4);
+    e->p += 4;
+}
+
+static void emit64(emit_t *e, uint64_t v) {
+    memcpy(e->p, &v, 8);
+    e->p += 8;
+}
+
+static void rex(emit_t *e, bool w, int reg, int rm) {
+    uint8_t r = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+    if (r != 0x40) {
+        emit8(e, r);
+    }
+}
+
+/* opc reg, rm (register-direct) */
+static void op_rr(emit_t *e, bool w, uint8_t opc, int reg, int rm) {
+    rex(e, w, reg, rm);
+    emit8(e, opc);
+    emit8(e, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* opc reg, [base + disp32] (base must not need a SIB byte) */
+static void op_mb(emit_t *e, bool w, uint8_t opc, int reg, int base, int32_t disp) {
+    rex(e, w, reg, base);
+    emit8(e, opc);
+    emit8(e, 0x80 | ((reg & 7) << 3) | (base & 7));
+    emit32(e, (uint32_t)disp);
+}
+
+/* opc reg, [rbx + disp32] */
+static void op_rm(emit_t *e, bool w, uint8_t opc, int reg, int32_t disp) {
+    op_mb(e, w, opc, reg, RBX, disp);
+}
+
+/* 0F-prefixed opc reg, rm (register-direct) */
+static void op2_rr(emit_t *e, bool w, uint8_t opc, int reg, int rm) {
+    rex(e, w, reg, rm);
+    emit8(e, 0x0F);
+    emit8(e, opc);
+    emit8(e, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void mov_rr(emit_t *e, int dst, int src) { op_rr(e, false, 0x89, src, dst); }
+static void alu_rr(emit_t *e, uint8_t opc, int dst, int src) { op_rr(e, false, opc, src, dst); }
+static void load(emit_t *e, int dst, int32_t disp) { op_rm(e, false, 0x8B, dst, disp); }
+static void store(emit_t *e, int32_t disp, int src) { op_rm(e, false, 0x89, src, disp); }
+
+/* opc reg, guest word a. The page pointer is loaded at run time, so a
+ * page copied on write after compiling is still seen; rsi caches it until
+ * the next store, which may do the copying. */
+static void op_word(emit_t *e, uint8_t opc, int reg, word_t a) {
+    if (e->page != (int)(a >> DDP24_PAGE_SHIFT)) {
+        op_rm(e, true, 0x8B, RSI, OFF_PAGE(a)); /* mov rsi, [rbx + page] */
+        e->page = a >> DDP24_PAGE_SHIFT;
+    }
+    op_mb(e, false, opc, reg, RSI, OFF_WORD(a));
+}
+
+static void load_word(emit_t *e, int dst, word_t a) { op_word(e, 0x8B, dst, a); }
+
+/* ALU with guest word source: opc is the "op r32, r/m32" form (+2) */
+static void alu_word(emit_t *e, uint8_t opc, int dst, word_t a) { op_word(e, opc + 2, dst, a); }
+
+static void alu_ri(emit_t *e, int ext, int dst, uint32_t imm) {
+    rex(e, false, 0, dst);
+    emit8(e, 0x81);
+    emit8(e, 0xC0 | (ext << 3) | (dst & 7));
+    emit32(e, imm);
+}
+
+static void shift_ri(emit_t *e, int ext, int dst, uint8_t count) {
+    rex(e, false, 0, dst);
+    emit8(e, 0xC1);
+    emit8(e, 0xC0 | (ext << 3) | (dst & 7));
+    emit8(e, count);
+}
+
+static void shift_ri64(emit_t *e, int ext, int dst, uint8_t count) {
+    rex(e, true, 0, dst);
+    emit8(e, 0xC1);
+    emit8(e, 0xC0 | (ext << 3) | (dst & 7));
+    emit8(e, count);
+}
+
+static void neg(emit_t *e, int r) {
+    rex(e, false, 0, r);
+    emit8(e, 0xF7);
+    emit8(e, 0xC0 | (3 << 3) | (r & 7));
+}
+
+/* jcc rel32 with the displacement patched later; returns patch site */
+static uint8_t *jcc(emit_t *e, uint8_t cc) {
+    emit8(e, 0x0F);
+    emit8(e, 0x80 | cc);
+    uint8_t *site = e->p;
+    emit32(e, 0);
+    return site;
+}
+
+static void patch(uint8_t *site, uint8_t *target) {
+    int32_t rel = (int32_t)(target - (site + 4));
+    memcpy(site, &rel, 4);
+}
+
+#define CC_Z    0x4
+#define CC_NZ   0x5
+
+/* r = to_signed(r), using tmp: (mag ^ -s) + s */
+static void emit_to_signed(emit_t *e, int r, int tmp) {
+    mov_rr(e, tmp, r);
+    shift_ri(e, SH_SHR, tmp, 23);
+    neg(e, tmp);
+    alu_ri(e, IMM_AND, r, MAGNITUDE_MASK);
+    alu_rr(e, ALU_XOR, r, tmp);
+    alu_rr(e, ALU_SUB, r, tmp);
+}
+
+/* A = from_signed(eax), setting overflow if |eax| exceeds 23 bits */
+static void emit_from_signed_ovf(emit_t *e) {
+    mov_rr(e, RDX, RAX);
+    shift_ri(e, SH_SAR, RDX, 31);           /* edx = sign mask */
+    mov_rr(e, RDI, RAX);
+    alu_rr(e, ALU_XOR, RDI, RDX);
+    alu_rr(e, ALU_SUB, RDI, RDX);           /* edi = |result| */
+    alu_ri(e, IMM_CMP, RDI, MAGNITUDE_MASK);
+    op2_rr(e, false, 0x97, 0, RCX);         /* seta cl */
+    op_rm(e, false, 0x08, RCX, OFF_OVF);    /* or [overflow], cl */
+    alu_ri(e, IMM_AND, RDI, MAGNITUDE_MASK);
+    alu_ri(e, IMM_AND, RDX, SIGN_BIT);
+    alu_rr(e, ALU_OR, RDI, RDX);
+    mov_rr(e, REG_A, RDI);
+}
+
+/* Leave the block at guest pc having spent the given cycles */
+static void emit_exit(emit_t *e, word_t pc, uint32_t cycles) {
+    store(e, OFF_A, REG_A);
+    store(e, OFF_B, REG_B);
+    rex(e, false, 0, RBX);
+    emit8(e, 0xC7);                         /* mov dword [rbx+PC], imm32 */
+    emit8(e, 0x80 | RBX);
+    emit32(e, (uint32_t)OFF_PC);
+    emit32(e, pc);
+    rex(e, true, 0, RBX);
+    emit8(e, 0x81);                         /* add qword [rbx+cycles], imm32 */
+    emit8(e, 0x80 | RBX);
+    emit32(e, (uint32_t)OFF_CYCLES);
+    emit32(e, cycles);
+    emit8(e, 0xB8);                         /* mov eax, imm32 */
+    emit32(e, cycles);
+    emit8(e, 0x41); emit8(e, 0x5D);         /* pop r13 */
+    emit8(e, 0x41); emit8(e, 0x5C);         /* pop r12 */
+    emit8(e, 0x5B);                         /* pop rbx */
+    emit8(e, 0xC3);                         /* ret */
+}
+
+/* Store helper called from compiled code; nonzero means bail out */
+static uint32_t jit_store(ddp24_t *cpu, uint32_t addr, uint32_t value, uint32_t next_pc) {
+    cpu->jit->killed = false;
+    ddp24_write(cpu, addr, value);
+    if (cpu->halted) {
+        cpu->fault_pc = (next_pc - 1) & ADDR_MASK;  /* Out of memory; cpu->PC is behind */
+        return 1;
+    }
+    return cpu->jit->killed;
+}
+
+static void emit_store(emit_t *e, word_t addr, int src, word_t next_pc, uint32_t cycles) {
+    op_rr(e, true, 0x89, RBX, RDI);         /* mov rdi, rbx */
+    emit8(e, 0xBE);                         /* mov esi, imm32 */
+    emit32(e, addr);
+    mov_rr(e, RDX, src);
+    emit8(e, 0xB9);                         /* mov ecx, imm32 */
+    emit32(e, next_pc);
+    emit8(e, 0x48); emit8(e, 0xB8);         /* mov rax, imm64 */
+    emit64(e, (uint64_t)(uintptr_t)jit_store);
+    emit8(e, 0xFF); emit8(e, 0xD0);         /* call rax */
+    op_rr(e, false, 0x85, RAX, RAX);        /* test eax, eax */
+    uint8_t *cont = jcc(e, CC_Z);
+    emit_exit(e, next_pc, cycles);
+    patch(cont, e->p);
+    e->page = -1;
+}
+
+/* Can the interpreter's semantics for this word be compiled? */
+static bool compilable(const ddp24_decoded_t *d) {
+    if (d->index != 0 || (d->flags & DDP24_DEC_INDIRECT)) {
+        return false;
+    }
+    switch (d->handler) {
+        case OP_LDA: case OP_LDB: case OP_STA: case OP_STB:
+        case OP_ADD: case OP_SUB: case OP_MPY:
+        case OP_ANA: case OP_ORA: case OP_ERA:
+        case OP_TAB: case OP_IAB: case OP_NOP:
+        case OP_ARS: case OP_ALS:
+        case OP_JMP: case OP_JNZ: case OP_JZE: case OP_JPL: case OP_JMI:
+            return true;
+    }
+    return false;
+}
+
+static bool is_terminator(uint8_t handler) {
+    return handler == OP_JMP || handler == OP_JNZ || handler == OP_JZE ||
+           handler == OP_JPL || handler == OP_JMI;
+}
+
+static void flush(struct ddp24_jit *jit) {
+    memset(jit->entry, 0, sizeof(jit->entry));
+    memset(jit->cover, 0, sizeof(jit->cover));
+    jit->nblocks = 0;
+    jit->code_used = 0;
+}
+
+/* Compile the block starting at start; false if nothing compilable */
+static bool compile(ddp24_t *cpu, word_t start) {
+    struct ddp24_jit *jit = cpu->jit;
+
+    if (jit->nblocks == JIT_MAX_BLOCKS ||
+        jit->code_used + JIT_MAX_BLOCK * JIT_BLOCK_SLACK > JIT_CODE_SIZE) {
+        flush(jit);
+    }
+
+    emit_t e = { jit->code + jit->code_used, -1 };
+    uint8_t *begin = e.p;
+    uint32_t cycles = 0;
+    word_t pc = start;
+    word_t len = 0;
+
+    emit8(&e, 0x53);                        /* push rbx */
+    emit8(&e, 0x41); emit8(&e, 0x54);       /* push r12 */
+    emit8(&e, 0x41); emit8(&e, 0x55);       /* push r13 */
+    op_rr(&e, true, 0x89, RDI, RBX);        /* mov rbx, rdi */
+    load(&e, REG_A, OFF_A);
+    load(&e, REG_B, OFF_B);
+
+    while (len < JIT_MAX_BLOCK && pc < MEM_SIZE) {
+        ddp24_decoded_t d;
+        ddp24_predecode_with(cpu->timing, ddp24_read(cpu, pc), &d);
+        if (!compilable(&d)) {
+            break;
+        }
+
+        word_t a = d.addr;
+        word_t next = (pc + 1) & ADDR_MASK;
+        cycles += d.cycles;
+        len++;
+
+        switch (d.handler) {
+            case OP_NOP:
+                break;
+            case OP_LDA:
+                load_word(&e, REG_A, a);
+                break;
+            case OP_LDB:
+                load_word(&e, REG_B, a);
+                break;
+            case OP_STA:
+                emit_store(&e, a, REG_A, next, cycles);
+                break;
+            case OP_STB:
+                emit_store(&e, a, REG_B, next, cycles);
+                break;
+            case OP_ADD:
+            case OP_SUB:
+                mov_rr(&e, RAX, REG_A);
+                emit_to_signed(&e, RAX, RDX);
+                load_word(&e, RCX, a);
+                emit_to_signed(&e, RCX, RDX);
+                alu_rr(&e, d.handler == OP_ADD ? ALU_ADD : ALU_SUB, RAX, RCX);
+                emit_from_signed_ovf(&e);
+                break;
+            case OP_MPY:
+                mov_rr(&e, RAX, REG_B);
+                alu_ri(&e, IMM_AND, RAX, MAGNITUDE_MASK);
+                load_word(&e, RCX, a);
+                mov_rr(&e, RDX, RCX);
+                alu_rr(&e, ALU_XOR, RDX, REG_B);
+                alu_ri(&e, IMM_AND, RDX, SIGN_BIT);     /* edx = product sign */
+                alu_ri(&e, IMM_AND, RCX, MAGNITUDE_MASK);
+                op2_rr(&e, true, 0xAF, RAX, RCX);       /* imul rax, rcx */
+                alu_rr(&e, ALU_XOR, RDI, RDI);
+                op_rr(&e, true, 0x85, RAX, RAX);        /* test rax, rax */
+                op2_rr(&e, false, 0x44, RDX, RDI);      /* cmovz edx, edi */
+                mov_rr(&e, REG_B, RAX);
+                alu_ri(&e, IMM_AND, REG_B, MAGNITUDE_MASK);
+                alu_rr(&e, ALU_OR, REG_B, RDX);
+                shift_ri64(&e, SH_SHR, RAX, 23);
+                alu_ri(&e, IMM_AND, RAX, MAGNITUDE_MASK);
+                alu_rr(&e, ALU_OR, RAX, RDX);
+                mov_rr(&e, REG_A, RAX);
+                break;
+            case OP_ANA:
+                alu_word(&e, ALU_AND, REG_A, a);
+                break;
+            case OP_ORA:
+                alu_word(&e, ALU_OR, REG_A, a);
+                break;
+            case OP_ERA:
+                alu_word(&e, ALU_XOR, REG_A, a);
+                break;
+            case OP_TAB:
+                mov_rr(&e, REG_B, REG_A);
+                break;
+            case OP_IAB:
+                mov_rr(&e, RAX, REG_A);
+                mov_rr(&e, REG_A, REG_B);
+                mov_rr(&e, REG_B, RAX);
+                break;
+            case OP_ARS:
+            case OP_ALS:
+                mov_rr(&e, RAX, REG_A);
+                alu_ri(&e, IMM_AND, RAX, MAGNITUDE_MASK);
+                shift_ri(&e, d.handler == OP_ARS ? SH_SHR : SH_SHL, RAX, a & 0x1F);
+                alu_ri(&e, IMM_AND, RAX, MAGNITUDE_MASK);
+                alu_ri(&e, IMM_AND, REG_A, SIGN_BIT);
+                alu_rr(&e, ALU_OR, REG_A, RAX);
+                break;
+            case OP_JMP:
+                emit_exit(&e, a, cycles);
+                break;
+            case OP_JNZ:
+            case OP_JZE:
+            case OP_JPL:
+            case OP_JMI: {
+                uint8_t *taken;
+                if (d.handler == OP_JMI) {
+                    rex(&e, false, 0, REG_A);           /* test r12d, SIGN_BIT */
+                    emit8(&e, 0xF7);
+                    emit8(&e, 0xC0 | (REG_A & 7));
+                    emit32(&e, SIGN_BIT);
+                    taken = jcc(&e, CC_NZ);
+                } else if (d.handler == OP_JPL) {
+                    /* Plus means sign clear and magnitude nonzero */
+                    mov_rr(&e, RAX, REG_A);
+                    alu_ri(&e, IMM_SUB, RAX, 1);
+                    alu_ri(&e, IMM_CMP, RAX, MAGNITUDE_MASK - 1);
+                    taken = jcc(&e, 0x6);               /* jbe */
+                } else {
+                    rex(&e, false, 0, REG_A);           /* test r12d, MAGNITUDE_MASK */
+                    emit8(&e, 0xF7);
+                    emit8(&e, 0xC0 | (REG_A & 7));
+                    emit32(&e, MAGNITUDE_MASK);
+                    taken = jcc(&e, d.handler == OP_JNZ ? CC_NZ : CC_Z);
+                }
+                emit_exit(&e, next, cycles);
+                patch(taken, e.p);
+                emit_exit(&e, a, cycles);
+                break;
+            }
+        }
+
+        if (is_terminator(d.handler)) {
+            pc = next;
+            goto done;
+        }
+        pc = next;
+        if (pc == 0) {
+            break;  /* Do not run off the top of memory */
+        }
+    }
+
+    if (len == 0) {
+        return false;
+    }
+    emit_exit(&e, pc, cycles);
+
+done:
+    {
+        jit_block_t *b = &jit->blocks[jit->nblocks++];
+        b->code = (jit_code_t)(void *)begin;
+        b->start = start;
+        b->len = len;
+        b->cycles = cycles;
+        jit->code_used += (size_t)(e.p - begin);
+        jit->entry[start] = b;
+        for (word_t i = 0; i < len; i++) {
+            jit->cover[start + i]++;
+        }
+    }
+    return true;
+}
+
+/* A store at addr hit compiled code: drop every block covering it */
+void ddp24_jit_invalidate(ddp24_t *cpu, word_t addr) {
+    struct ddp24_jit *jit = cpu->jit;
+
+    if (!jit->cover[addr]) {
+        return;
+    }
+    for (int i = 0; i < jit->nblocks; i++) {
+        jit_block_t *b = &jit->blocks[i];
+        if (b->code && addr >= b->start && addr < b->start + b->len) {
+            for (word_t w = 0; w < b->len; w++) {
+                jit->cover[b->start + w]--;
+            }
+            jit->entry[b->start] = NULL;
+            jit->hits[b->start] = 0;
+            b->code = NULL;
+        }
+    }
+    jit->killed = true;
+}
+
+bool ddp24_jit_attach(ddp24_t *cpu) {
+    if (cpu->jit) {
+        return true;
+    }
+    struct ddp24_jit *jit = ddp24_calloc(1, sizeof(*jit));
+    if (!jit) {
+        return false;
+    }
+    jit->code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->code == MAP_FAILED) {
+        ddp24_free(jit);
+        return false;
+    }
+    cpu->jit = jit;
+    return true;
+}
+
+void ddp24_jit_detach(ddp24_t *cpu) {
+    if (!cpu->jit) {
+        return;
+    }
+    munmap(cpu->jit->code, JIT_CODE_SIZE);
+    ddp24_free(cpu->jit);
+    cpu->jit = NULL;
+}
+
+/* JIT engine: interpret, count hot targets, enter compiled blocks */
+void ddp24_run_jit(ddp24_t *cpu) {
+    struct ddp24_jit *jit = cpu->jit;
+
+    while (!cpu->halted && cpu->cycles < RUN_LIMIT(cpu)) {
+        word_t pc = cpu->PC;
+        jit_block_t *b = jit->entry[pc];
+
+        /* Only enter when the whole block fits, so stops stay exact */
+        if (b && b->cycles <= RUN_LIMIT(cpu) - cpu->cycles) {
+            b->code(cpu);
+            if (b->len <= 2 && cpu->PC == b->start) {
+                ddp24_idle_skip(cpu, b->start, 0);
+            }
+            continue;
+        }
+
+        uint8_t handler = fetch(cpu, pc)->handler;
+        ddp24_step(cpu);
+
+        if ((handler == OP_JMP || handler == OP_JNZ || handler == OP_JXI) &&
+            cpu->PC != ((pc + 1) & ADDR_MASK)) {
+            word_t target = cpu->PC;
+            if (jit->hits[target] != JIT_NEVER && ++jit->hits[target] >= JIT_THRESHOLD &&
+                !jit->entry[target]) {
+                if (!compile(cpu, target)) {
+                    jit->hits[target] = JIT_NEVER;
+                }
+            }
+        }
+    }
+}
+
+#else /* !DDP24_JIT_AVAILABLE */
+
+bool ddp24_jit_attach(ddp24_t *cpu) {
+    (void)cpu;
+    return false;
+}
+
+void ddp24_jit_detach(ddp24_t *cpu) {
+    (void)cpu;
+}
+
+void ddp24_jit_invalidate(ddp24_t *cpu, word_t addr) {
+    (void)cpu;
+    (void)addr;
+}
+
+void ddp24_run_jit(ddp24_t *cpu) {
+    ddp24_run_switch(cpu);
+}
+
+#endif
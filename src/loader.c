@@ -0,0 +1,284 @@
+/*
+ * DDP-24 Emulator - Program Loader
+ * Viking Mars Lander Guidance Computer
+ *
+ * Images are mapped rather than read, then unpacked a page at a time
+ * straight into CPU memory. The 24-bit big-endian words unpack four at
+ * a time with one SSSE3 byte shuffle where the host has it; the native
+ * format skips unpacking altogether.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "../include/ddp24_asm.h"
+#include "ddp24_internal.h"
+
+#if defined(_WIN32)
+#define LOADER_MMAP 0
+#else
+#define LOADER_MMAP 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define LOADER_SSSE3 1
+#include <immintrin.h>
+#else
+#define LOADER_SSSE3 0
+#endif
+
+/* Native format: magic, byte-order tag, word count, then the words */
+#define NATIVE_MAGIC    "DDP24NAT"
+#define NATIVE_ORDER    0x01020304u
+#define NATIVE_HEADER   16
+
+/* Unpacking */
+
+static void unpack_scalar(word_t *dst, const uint8_t *src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = (word_t)src[3 * i] << 16 | (word_t)src[3 * i + 1] << 8 | src[3 * i + 2];
+    }
+}
+
+#if LOADER_SSSE3
+
+/* Each 16-byte load holds four words in its first 12 bytes; the last
+ * group goes through the scalar loop so we never read past the end */
+__attribute__((target("ssse3")))
+static void unpack_ssse3(word_t *dst, const uint8_t *src, size_t n) {
+    const __m128i order = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    size_t i = 0;
+
+    for (; i + 6 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + 3 * i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(v, order));
+    }
+    unpack_scalar(dst + i, src + 3 * i, n - i);
+}
+
+#endif
+
+static void unpack(word_t *dst, const uint8_t *src, size_t n) {
+#if LOADER_SSSE3
+    if (__builtin_cpu_supports("ssse3")) {
+        unpack_ssse3(dst, src, n);
+        return;
+    }
+#endif
+    unpack_scalar(dst, src, n);
+}
+
+/* Loading */
+
+static bool is_native(const uint8_t *data, size_t size) {
+    return size >= NATIVE_HEADER && memcmp(data, NATIVE_MAGIC, 8) == 0;
+}
+
+int ddp24_load_buffer(ddp24_t *cpu, const uint8_t *data, size_t size, word_t base) {
+    base &= ADDR_MASK;
+    size_t room = MEM_SIZE - base;
+
+    if (ddp24_is_program(data, size)) {
+        /* Assembled for fixed addresses, so base does not apply */
+        ddp24_program_t *program = ddp24_program_read(data, size);
+        if (!program) {
+            return -1;
+        }
+        int words = ddp24_program_install(cpu, program);
+        ddp24_program_free(program);
+        return words;
+    }
+
+    if (is_native(data, size)) {
+        uint32_t order, count;
+        memcpy(&order, data + 8, 4);
+        memcpy(&count, data + 12, 4);
+        if (order != NATIVE_ORDER || count > (size - NATIVE_HEADER) / sizeof(word_t)) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (count > room) {
+            count = (uint32_t)room;
+        }
+
+        /* The caller's buffer need not keep the words aligned */
+        word_t page[DDP24_PAGE_SIZE];
+        for (uint32_t done = 0; done < count; ) {
+            uint32_t len = count - done < DDP24_PAGE_SIZE ? count - done : DDP24_PAGE_SIZE;
+            memcpy(page, data + NATIVE_HEADER + sizeof(word_t) * done, sizeof(word_t) * len);
+            ddp24_write_block(cpu, base + (word_t)done, page, (word_t)len);
+            done += len;
+        }
+        return (int)count;
+    }
+
+    size_t count = size / 3;
+    if (count > room) {
+        count = room;
+    }
+    word_t page[DDP24_PAGE_SIZE];
+    for (size_t done = 0; done < count; ) {
+        size_t len = count - done < DDP24_PAGE_SIZE ? count - done : DDP24_PAGE_SIZE;
+        unpack(page, data + 3 * done, len);
+        ddp24_write_block(cpu, base + (word_t)done, page, (word_t)len);
+        done += len;
+    }
+    return (int)count;
+}
+
+/* Whole file in memory: mapped where we can, read otherwise */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    bool mapped;
+} file_map_t;
+
+static bool map_file(const char *filename, file_map_t *m) {
+    m->data = NULL;
+    m->size = 0;
+    m->mapped = false;
+
+#if LOADER_MMAP
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+    m->size = (size_t)st.st_size;
+    if (m->size > 0) {
+        void *p = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            m->data = p;
+            m->mapped = true;
+        }
+    }
+    close(fd);
+    if (m->mapped || m->size == 0) {
+        return true;
+    }
+#endif
+
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        return false;
+    }
+    size_t cap = 0;
+    for (;;) {
+        if (m->size == cap) {
+            cap = cap ? cap * 2 : 3 * MEM_SIZE + NATIVE_HEADER;
+            uint8_t *grown = realloc(m->data, cap);
+            if (!grown) {
+                free(m->data);
+                fclose(f);
+                errno = ENOMEM;
+                return false;
+            }
+            m->data = grown;
+        }
+        size_t got = fread(m->data + m->size, 1, cap - m->size, f);
+        m->size += got;
+        if (got == 0) {
+            break;
+        }
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    if (!ok) {
+        free(m->data);
+        errno = EIO;
+    }
+    return ok;
+}
+
+static void unmap_file(file_map_t *m) {
+#if LOADER_MMAP
+    if (m->mapped) {
+        munmap(m->data, m->size);
+        return;
+    }
+#endif
+    free(m->data);
+}
+
+int ddp24_load_image(ddp24_t *cpu, const char *filename, word_t base) {
+    file_map_t m;
+    if (!map_file(filename, &m)) {
+        return -1;
+    }
+    int words = ddp24_load_buffer(cpu, m.data ? m.data : (const uint8_t *)"", m.size, base);
+    int saved = errno;
+    unmap_file(&m);
+    errno = saved;
+    return words;
+}
+
+/* Load binary file into memory */
+int ddp24_load(ddp24_t *cpu, const char *filename) {
+    int words = ddp24_load_image(cpu, filename, 0);
+    if (words < 0) {
+        perror(filename);
+        return -1;
+    }
+    printf("Loaded %d words from %s\n", words, filename);
+    return words;
+}
+
+/* Write the native form of an image file */
+int ddp24_cache_image(const char *image, const char *cache) {
+    file_map_t m;
+    if (!map_file(image, &m)) {
+        return -1;
+    }
+
+    int rc = -1;
+    uint32_t count = 0;
+    word_t *words = NULL;
+
+    if (is_native(m.data, m.size)) {
+        errno = EINVAL;  /* Already native */
+        goto out;
+    }
+    count = (uint32_t)(m.size / 3 < MEM_SIZE ? m.size / 3 : MEM_SIZE);
+    words = malloc((count ? count : 1) * sizeof(word_t));
+    if (!words) {
+        errno = ENOMEM;
+        goto out;
+    }
+    unpack(words, m.data, count);
+
+    FILE *f = fopen(cache, "wb");
+    if (!f) {
+        goto out;
+    }
+    uint8_t hdr[NATIVE_HEADER];
+    uint32_t order = NATIVE_ORDER;
+    memcpy(hdr, NATIVE_MAGIC, 8);
+    memcpy(hdr + 8, &order, 4);
+    memcpy(hdr + 12, &count, 4);
+    bool ok = fwrite(hdr, 1, sizeof(hdr), f) == sizeof(hdr) &&
+              fwrite(words, sizeof(word_t), count, f) == count;
+    if (fclose(f) != 0) {
+        ok = false;
+    }
+    if (ok) {
+        rc = (int)count;
+    } else {
+        errno = EIO;
+    }
+
+out:
+    free(words);
+    unmap_file(&m);
+    return rc;
+}
@@ -3,24 +3,81 @@
  * Viking Mars Lander Guidance Computer
  */
 
+#define _POSIX_C_SOURCE 200809L     /* Sockets, for the telemetry test */
+
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
 #include "../include/ddp24.h"
+#include "../include/ddp24_fleet.h"
+#include "../include/ddp24_batch.h"
+#include "../include/ddp24_snapshot.h"
+#include "../include/ddp24_bench.h"
+#include "../include/ddp24_profile.h"
+#include "../include/ddp24_calls.h"
+#include "../include/ddp24_hle.h"
+#include "../include/ddp24_trace.h"
+#include "../include/ddp24_io.h"
+#include "../include/ddp24_pace.h"
+#include "../include/ddp24_debug.h"
+#include "../include/ddp24_replay.h"
+#include "../include/ddp24_embed.h"
+#include "../include/ddp24_timing.h"
+#include "../include/ddp24_telemetry.h"
+#include "../include/ddp24_asm.h"
+#include "../include/ddp24_fuzz.h"
 
 static void print_usage(const char *prog) {
     printf("DDP-24 Emulator - Viking Mars Lander Guidance Computer\n\n");
-    printf("Usage: %s [options] [program.bin]\n\n", prog);
+    printf("Usage: %s [options] [program.bin]\n", prog);
+    printf("       %s --batch jobs.txt [-j threads] [-o results.txt] [-e engine]\n", prog);
+    printf("       %s --fuzz cases [--seed n] [-j threads] [-e engine]\n\n", prog);
     printf("Options:\n");
     printf("  -i        Interactive mode\n");
     printf("  -t        Run built-in tests\n");
+    printf("  -b        Run benchmarks (every engine, or the one given by -e)\n");
     printf("  -d        Dump state after execution\n");
+    printf("  -e <name> Execution engine: switch (default), threaded or jit\n");
+    printf("  -l <addr> Load the program at this octal address (default: 0)\n");
+    printf("  -c <file> Write the program in native format to file, then exit\n");
+    printf("  -a <file> Assemble the program (source) into a symbolic image, then exit\n");
+    printf("  -p <file> Profile the run: report to stdout, folded stacks to file\n");
+    printf("            (needs make PROFILE=1)\n");
+    printf("  -s        Report cycles per subroutine after the run\n");
+    printf("  -T <file> Write a binary trace of the run (decode with ddp24-trace)\n");
+    printf("  -r <x>    Pace the run at x times real time (1 = the original's speed)\n");
+    printf("  -m <name> Timing profile: ddp24 (default) or ddp124\n");
+    printf("  --watch <addr>:<n>   Sample n cells from octal addr while running\n");
+    printf("  --every <cycles>     Sampling period (default: 20000, 10 ms)\n");
+    printf("  --shm <name>         Publish samples in shared memory (\"/lander\")\n");
+    printf("  --udp <host>:<port>  Send each sample as a datagram\n");
+    printf("  --fuzz <n>           Check n random programs on every engine and the fleet\n");
+    printf("                       against ddp24_step (-e: that engine only)\n");
+    printf("  --seed <n>           First fuzz case (default: 1)\n");
+    printf("  -j <n>    Batch and fuzz worker threads (default: one per CPU)\n");
+    printf("  -o <file> Batch results file (default: stdout)\n");
     printf("  -h        Show this help\n");
 }
 
+/* The messages the engines leave to the host */
+static void report_fault(const ddp24_t *cpu) {
+    if (cpu->fault != DDP24_FAULT_NONE) {
+        fprintf(stderr, "Halted: %s at PC=%05o\n", ddp24_fault_name(cpu->fault), cpu->fault_pc);
+    }
+}
+
 static void interactive_mode(ddp24_t *cpu) {
     char line[256];
     printf("DDP-24 Interactive Mode. Commands: s(tep), r(un), d(ump), m(emory), q(uit)\n");
+    printf("  b <addr> toggles a breakpoint, w/a <addr> [count] watch writes/any access,\n");
+    printf("  c clears them all\n");
 
     while (!cpu->halted) {
         printf("ddp24> ");
@@ -37,8 +94,51 @@ static void interactive_mode(ddp24_t *cpu) {
                 break;
 
             case 'r':  /* Run */
-                ddp24_run(cpu, 0);
-                printf("Halted after %llu cycles\n", (unsigned long long)cpu->cycles);
+                {
+                    ddp24_stop_t why = ddp24_run_for(cpu, 0);
+                    ddp24_watch_hit_t hit;
+                    if (why == DDP24_STOP_BREAKPOINT) {
+                        printf("Breakpoint at %05o\n", cpu->PC);
+                    } else if (why == DDP24_STOP_WATCHPOINT && ddp24_last_watch_hit(cpu, &hit)) {
+                        printf("Watchpoint: %05o %s [%05o] = %08o, now at %05o\n", hit.pc,
+                               hit.kind == DDP24_WATCH_READ ? "read" : "wrote", hit.addr,
+                               ddp24_read(cpu, hit.addr), cpu->PC);
+                    } else {
+                        printf("Halted after %llu cycles\n", (unsigned long long)cpu->cycles);
+                    }
+                }
+                break;
+
+            case 'b':  /* Breakpoint on/off */
+                {
+                    unsigned int addr;
+                    if (sscanf(line + 1, "%o", &addr) != 1) {
+                        printf("Usage: b <octal_addr>\n");
+                    } else if (ddp24_breakpoint_at(cpu, addr)) {
+                        ddp24_clear_breakpoint(cpu, addr);
+                        printf("Breakpoint at %05o cleared\n", addr & ADDR_MASK);
+                    } else if (ddp24_set_breakpoint(cpu, addr)) {
+                        printf("Breakpoint at %05o\n", addr & ADDR_MASK);
+                    }
+                }
+                break;
+
+            case 'w':  /* Watch writes */
+            case 'a':  /* Watch any access */
+                {
+                    unsigned int addr, count = 1;
+                    int kind = line[0] == 'w' ? DDP24_WATCH_WRITE
+                                              : DDP24_WATCH_READ | DDP24_WATCH_WRITE;
+                    if (sscanf(line + 1, "%o %o", &addr, &count) < 1) {
+                        printf("Usage: %c <octal_addr> [octal_count]\n", line[0]);
+                    } else if (ddp24_set_watchpoint(cpu, addr, count, kind)) {
+                        printf("Watching %o words from %05o\n", count, addr & ADDR_MASK);
+                    }
+                }
+                break;
+
+            case 'c':  /* Clear breakpoints and watchpoints */
+                ddp24_clear_debug(cpu);
                 break;
 
             case 'd':  /* Dump */
@@ -63,7 +163,7 @@ static void interactive_mode(ddp24_t *cpu) {
                 break;
 
             default:
-                printf("Unknown command. Use s, r, d, m <addr>, or q\n");
+                printf("Unknown command. Use s, r, d, m <addr>, b <addr>, w/a <addr> [count], c, or q\n");
         }
     }
 
@@ -73,82 +173,408 @@ static void interactive_mode(ddp24_t *cpu) {
     }
 }
 
-static int run_tests(void) {
+static bool parse_engine(const char *name, ddp24_engine_t *engine) {
+    if (strcmp(name, "switch") == 0) {
+        *engine = DDP24_ENGINE_SWITCH;
+    } else if (strcmp(name, "threaded") == 0) {
+        *engine = DDP24_ENGINE_THREADED;
+    } else if (strcmp(name, "jit") == 0) {
+        *engine = DDP24_ENGINE_JIT;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static void init_cpu(ddp24_t *cpu, ddp24_engine_t engine) {
+    ddp24_release(cpu);
+    ddp24_init(cpu);
+    ddp24_set_engine(cpu, engine);
+}
+
+/* Test devices: an ADC on channel 5 that takes 1000 cycles per
+ * conversion, and a recorder on channel 6 */
+typedef struct {
+    bool ready;
+    word_t value;
+    uint64_t read_at;
+    word_t written;
+    uint64_t written_at;
+} test_io_t;
+
+static void adc_done(ddp24_t *cpu, void *arg) {
+    test_io_t *io = arg;
+    (void)cpu;
+    io->ready = true;
+    io->value = 01234567;
+}
+
+static void adc_control(ddp24_t *cpu, void *ctx, int function) {
+    (void)function;
+    ((test_io_t *)ctx)->ready = false;
+    ddp24_schedule(cpu, cpu->cycles + 1000, adc_done, ctx);
+}
+
+static bool adc_sense(ddp24_t *cpu, void *ctx, int function) {
+    (void)cpu;
+    (void)function;
+    return ((test_io_t *)ctx)->ready;
+}
+
+static word_t adc_input(ddp24_t *cpu, void *ctx, int function) {
+    test_io_t *io = ctx;
+    (void)function;
+    io->read_at = cpu->cycles;
+    return io->value;
+}
+
+static void recorder_output(ddp24_t *cpu, void *ctx, int function, word_t value) {
+    test_io_t *io = ctx;
+    (void)function;
+    io->written = value;
+    io->written_at = cpu->cycles;
+}
+
+/* Events log the order they fire in */
+typedef struct {
+    uint64_t when[64];
+    int order[64];
+    int fired;
+} test_events_t;
+
+static test_events_t *test_events;
+
+static void log_event(ddp24_t *cpu, void *arg) {
+    test_events_t *ev = test_events;
+    ev->when[ev->fired] = cpu->cycles;
+    ev->order[ev->fired++] = (int)(intptr_t)arg;
+}
+
+/* Interrupt handlers OTA their line here */
+static void irq_log_output(ddp24_t *cpu, void *ctx, int function, word_t value) {
+    test_events_t *ev = ctx;
+    (void)function;
+    if (ev->fired < 64) {
+        ev->when[ev->fired] = cpu->cycles;
+        ev->order[ev->fired++] = (int)value;
+    }
+}
+
+static void raise_lines(ddp24_t *cpu, void *arg) {
+    (void)arg;
+    ddp24_raise_interrupt(cpu, 3);
+    ddp24_raise_interrupt(cpu, 1);
+}
+
+static void post_line(ddp24_t *cpu, void *arg) {
+    ddp24_post_interrupt(cpu, (int)(intptr_t)arg);
+}
+
+/* Another thread's post, while the CPU spins with no deadline */
+static void *post_later(void *cpu) {
+    struct timespec pause = { 0, 1000000 };
+    nanosleep(&pause, NULL);
+    ddp24_post_interrupt(cpu, 1);
+    return NULL;
+}
+
+/* Spin with the mask from 0210; lines 1 and 3 log themselves, and line
+ * 3's handler clears the mask before returning */
+static void load_irq_program(ddp24_t *cpu, ddp24_engine_t engine, word_t mask, test_events_t *ev) {
+    ddp24_device_t log = { "log", ev, NULL, NULL, irq_log_output, NULL };
+    static const word_t program[][2] = {
+        { 0000, (OP_LDA << OP_SHIFT) | 0210 },
+        { 0001, (OP_ITC << OP_SHIFT) | DDP24_ITC_MASK | DDP24_ITC_ENABLE },
+        { 0002, (OP_JMP << OP_SHIFT) | 0002 },
+        { 0043, (OP_JMP << OP_SHIFT) | 0100 },          /* Line 1 */
+        { 0047, (OP_JMP << OP_SHIFT) | 0110 },          /* Line 3 */
+        { 0100, (OP_LDA << OP_SHIFT) | 0201 },
+        { 0101, (OP_OTA << OP_SHIFT) | 7 },
+        { 0102, (OP_ITC << OP_SHIFT) | DDP24_ITC_ENABLE },
+        { 0103, (OP_JMP << OP_SHIFT) | INDIRECT_BIT | 0042 },
+        { 0110, (OP_LDA << OP_SHIFT) | 0203 },
+        { 0111, (OP_OTA << OP_SHIFT) | 7 },
+        { 0112, (OP_LDA << OP_SHIFT) | 0211 },
+        { 0113, (OP_ITC << OP_SHIFT) | DDP24_ITC_MASK | DDP24_ITC_ENABLE },
+        { 0114, (OP_JMP << OP_SHIFT) | INDIRECT_BIT | 0046 },
+        { 0201, 1 },
+        { 0203, 3 },
+    };
+
+    init_cpu(cpu, engine);
+    memset(ev, 0, sizeof(*ev));
+    ddp24_attach_device(cpu, 7, &log);
+    for (size_t i = 0; i < sizeof(program) / sizeof(program[0]); i++) {
+        ddp24_write(cpu, program[i][0], program[i][1]);
+    }
+    ddp24_write(cpu, 0210, mask);
+}
+
+/* One instruction at 0 (then HLT) from a preset A, B, X1 and the words
+ * at 0100 and 0101 */
+typedef struct {
+    const char *name;
+    word_t instr;
+    word_t a, b, x1, m0, m1;
+    word_t want_a, want_b, want_x1, want_m0;
+    bool want_ovf;
+    int cycles;
+} op_case_t;
+
+#define INSN(op, x, addr)  (((word_t)(op) << OP_SHIFT) | ((word_t)(x) << INDEX_SHIFT) | (addr))
+
+static const op_case_t op_cases[] = {
+    { "STC", INSN(OP_STC, 0, 0100), 0xABCDEF, 0, 0, 0x123456, 0,   0xABCDEF, 0, 0, 0xABB456, false, 10 },
+    { "SAA", INSN(OP_SAA, 0, 0100), 0xABCDEF, 0, 0, 0x123456, 0,   0xABCDEF, 0, 0, 0x124DEF, false, 10 },
+    { "ADM", INSN(OP_ADM, 0, 0100), 0x800005, 0, 0, 0x800003, 0,   0x800002, 0, 0, 0x800003, false, 10 },
+    { "SBM", INSN(OP_SBM, 0, 0100), 0x000005, 0, 0, 0x800007, 0,   0x800002, 0, 0, 0x800007, false, 10 },
+    { "SBM overflow", INSN(OP_SBM, 0, 0100), 0xFFFFFF, 0, 0, 1, 0,  0x800000, 0, 0, 1, true, 10 },
+    { "EAB", INSN(OP_EAB, 0, 0), 0xABCDEF, 0x123456, 0, 0, 0,      0xABB456, 0x124DEF, 0, 0, false, 5 },
+    { "SMP carry", INSN(OP_SMP, 0, 0100), 0, 0x7FFFFF, 0, 0, 1,    1, 0, 0, 0, false, 20 },
+    { "SMP sign", INSN(OP_SMP, 0, 0100), 0, 1, 0, 0x800000, 2,     0x800000, 0x800001, 0, 0x800000, false, 20 },
+    { "BCD", INSN(OP_BCD, 0, 0), 0x800000 | 1234567, 0, 0, 0, 0,   0x800001, 0x234567, 0, 0, false, 30 },
+    { "DCB", INSN(OP_DCB, 0, 0), 1, 0x234567, 0, 0, 0,             1234567, 0x234567, 0, 0, false, 30 },
+    { "DCB bad digit", INSN(OP_DCB, 0, 0), 0, 0x00000A, 0, 0, 0,   0, 0x00000A, 0, 0, true, 30 },
+    { "LRS", INSN(OP_LRS, 0, 3), 0x800001, 0, 0, 0, 0,             0x800000, 0x900000, 0, 0, false, 8 },
+    { "LLS", INSN(OP_LLS, 0, 23), 0, 012345, 0, 0, 0,              012345, 0, 0, 0, false, 28 },
+    { "LRR", INSN(OP_LRR, 0, 24), 0x123456, 0xABCDEF, 0, 0, 0,     0xABCDEF, 0x123456, 0, 0, false, 29 },
+    { "LLR", INSN(OP_LLR, 0, 1), 0x800000, 0, 0, 0, 0,             0, 1, 0, 0, false, 6 },
+    { "NRM", INSN(OP_NRM, 0, 0100), 0x800000, 5, 0, 0, 0,          0xD00000, 0x800000, 0, 43, false, 48 },
+    { "SCL", INSN(OP_SCL, 0, 0100), 0, 0x700001, 0, 4, 0,          0xE, 0x10, 0, 4, false, 14 },
+    { "SCR", INSN(OP_SCR, 0, 0100), 5, 0, 0, 23, 0,                0, 5, 0, 23, false, 33 },
+    { "RND", INSN(OP_RND, 0, 0), 5, 0x400000, 0, 0, 0,             6, 0x400000, 0, 0, false, 5 },
+    { "TAX", INSN(OP_TAX, 1, 0), 0x801234, 0, 0, 0, 0,             0x801234, 0, 0x1234, 0, false, 5 },
+    { "SMX", INSN(OP_SMX, 1, 075), 0, 0, 3, 0, 0,                  0, 0, 4, 3, false, 10 },
+    { "RIX", INSN(OP_RIX, 1, 0100), 0, 0, 0, 0xAB7FFF, 0,          0, 0, 0x7FFF, 0xAB0000, false, 10 },
+};
+
+static int run_op_cases(ddp24_t *cpu, ddp24_engine_t engine) {
+    int bad = 0;
+    for (size_t i = 0; i < sizeof(op_cases) / sizeof(op_cases[0]); i++) {
+        const op_case_t *c = &op_cases[i];
+        init_cpu(cpu, engine);
+        ddp24_write(cpu, 0, c->instr);
+        ddp24_write(cpu, 1, (OP_HLT << OP_SHIFT));
+        ddp24_write(cpu, 0100, c->m0);
+        ddp24_write(cpu, 0101, c->m1);
+        cpu->A = c->a;
+        cpu->B = c->b;
+        cpu->X[1] = c->x1;
+        ddp24_run(cpu, 1000);
+        if (cpu->A != c->want_a || cpu->B != c->want_b || cpu->X[1] != c->want_x1 ||
+            ddp24_read(cpu, 0100) != c->want_m0 || cpu->overflow != c->want_ovf ||
+            cpu->cycles != (uint64_t)c->cycles + 5) {
+            printf("  %s: A=%08o B=%08o X1=%05o M=%08o OVF=%d cycles %llu\n", c->name,
+                   cpu->A, cpu->B, cpu->X[1], ddp24_read(cpu, 0100), cpu->overflow,
+                   (unsigned long long)cpu->cycles - 5);
+            bad++;
+        }
+    }
+    return bad;
+}
+
+/* Integer square root of A by subtracting odd numbers, and its native
+ * twin for the HLE test */
+#define ISQRT_LINK  0300
+#define ISQRT_N     0330
+#define ISQRT_ODD   0331
+#define ISQRT_R     0332
+
+static const word_t isqrt_code[] = {
+    INSN(OP_STA, 0, ISQRT_N),       /* 0301 */
+    INSN(OP_LDA, 0, 0333),
+    INSN(OP_STA, 0, ISQRT_ODD),
+    INSN(OP_LDA, 0, 0335),
+    INSN(OP_STA, 0, ISQRT_R),
+    INSN(OP_LDA, 0, ISQRT_N),       /* 0306: loop */
+    INSN(OP_SUB, 0, ISQRT_ODD),
+    INSN(OP_JMI, 0, 0321),
+    INSN(OP_STA, 0, ISQRT_N),
+    INSN(OP_LDA, 0, ISQRT_ODD),
+    INSN(OP_ADD, 0, 0334),
+    INSN(OP_STA, 0, ISQRT_ODD),
+    INSN(OP_LDA, 0, ISQRT_R),
+    INSN(OP_ADD, 0, 0333),
+    INSN(OP_STA, 0, ISQRT_R),
+    INSN(OP_JMP, 0, 0306),
+    INSN(OP_LDA, 0, ISQRT_R),       /* 0321: done */
+    INSN(OP_JMP, 0, ISQRT_LINK) | INDIRECT_BIT,
+};
+#define ISQRT_LENGTH    ((int)(sizeof(isqrt_code) / sizeof(isqrt_code[0])))
+
+static void load_isqrt(ddp24_t *cpu) {
+    ddp24_write_block(cpu, ISQRT_LINK + 1, isqrt_code, ISQRT_LENGTH);
+    ddp24_write(cpu, 0333, 1);
+    ddp24_write(cpu, 0334, 2);
+}
+
+/* JSL 0100 from 0, which calls itself n more times through the same
+ * link word and returns as often, the last time to the HLT at 1 */
+static void load_recursion(ddp24_t *cpu, word_t n) {
+    static const word_t code[] = {
+        INSN(OP_LDA, 0, 0150),          /* 0101: recurse n more times */
+        INSN(OP_JZE, 0, 0110),
+        INSN(OP_SUB, 0, 0151),
+        INSN(OP_STA, 0, 0150),
+        INSN(OP_JSL, 0, 0100),
+        INSN(OP_JMP, 0, 0110),          /* 0106: returned */
+        INSN(OP_NOP, 0, 0),
+        INSN(OP_LDA, 0, 0152),          /* 0110: return, the last one to 1 */
+        INSN(OP_JZE, 0, 0116),
+        INSN(OP_SUB, 0, 0151),
+        INSN(OP_STA, 0, 0152),
+        INSN(OP_JMP, 0, 0100) | INDIRECT_BIT,
+        INSN(OP_NOP, 0, 0),
+        INSN(OP_LDA, 0, 0153),          /* 0116 */
+        INSN(OP_STA, 0, 0100),
+        INSN(OP_JMP, 0, 0100) | INDIRECT_BIT,
+    };
+    ddp24_write(cpu, 0, INSN(OP_JSL, 0, 0100));
+    ddp24_write(cpu, 1, (OP_HLT << OP_SHIFT));
+    ddp24_write_block(cpu, 0101, code, (int)(sizeof(code) / sizeof(code[0])));
+    ddp24_write(cpu, 0150, n);
+    ddp24_write(cpu, 0151, 1);
+    ddp24_write(cpu, 0152, n);
+    ddp24_write(cpu, 0153, 1);
+}
+
+static int native_isqrt(ddp24_t *cpu, word_t link, void *ctx) {
+    (void)link;
+    (void)ctx;
+    if (cpu->A & SIGN_BIT) {
+        return -1;
+    }
+    word_t n = cpu->A, r = 0;
+    while ((r + 1) * (r + 1) <= n) {
+        r++;
+    }
+    ddp24_write(cpu, ISQRT_N, n - r * r);
+    ddp24_write(cpu, ISQRT_ODD, 2 * r + 1);
+    ddp24_write(cpu, ISQRT_R, r);
+    cpu->A = r;
+
+    const uint8_t *op = cpu->timing->op;
+    int setup = 3 * op[OP_STA] + 2 * op[OP_LDA];
+    int pass = 3 * op[OP_LDA] + op[OP_SUB] + op[OP_JMI] + 3 * op[OP_STA] + 2 * op[OP_ADD] + op[OP_JMP];
+    int done = 2 * op[OP_LDA] + op[OP_SUB] + op[OP_JMI] + op[OP_JMP];
+    return setup + (int)r * pass + done;
+}
+
+/* Sign-magnitude by the book, branching on signs, to hold the kernels
+ * in ddp24.h to. A and B in, A, B and flags out. */
+typedef struct {
+    word_t a, b;
+    bool ovf, skip;
+} sm_ref_t;
+
+static word_t sm_ref_word(int64_t v) {
+    return v < 0 ? SIGN_BIT | ((word_t)-v & MAGNITUDE_MASK) : (word_t)v & MAGNITUDE_MASK;
+}
+
+static sm_ref_t sm_ref(uint8_t op, word_t a, word_t b, word_t y) {
+    int64_t sa = (a & SIGN_BIT) ? -(int64_t)(a & MAGNITUDE_MASK) : (a & MAGNITUDE_MASK);
+    int64_t sy = (y & SIGN_BIT) ? -(int64_t)(y & MAGNITUDE_MASK) : (y & MAGNITUDE_MASK);
+    bool neg = ((a ^ y) & SIGN_BIT) != 0;
+    sm_ref_t r = { a, b, false, false };
+    if (op == OP_ADD || op == OP_SUB) {
+        int64_t v = op == OP_ADD ? sa + sy : sa - sy;
+        r.ovf = v > MAGNITUDE_MASK || v < -(int64_t)MAGNITUDE_MASK;
+        r.a = sm_ref_word(v);
+    } else if (op == OP_SKG) {
+        r.skip = sa > sy;
+    } else if (op == OP_MPY) {
+        uint64_t p = (uint64_t)(b & MAGNITUDE_MASK) * (y & MAGNITUDE_MASK);
+        word_t sign = (p && ((b ^ y) & SIGN_BIT)) ? SIGN_BIT : 0;
+        r.a = sign | (word_t)(p >> 23);
+        r.b = sign | (word_t)(p & MAGNITUDE_MASK);
+    } else if ((a & MAGNITUDE_MASK) >= (y & MAGNITUDE_MASK)) {
+        r.ovf = true;
+    } else {
+        uint64_t n = (uint64_t)(a & MAGNITUDE_MASK) << 23 | (b & MAGNITUDE_MASK);
+        uint64_t q = n / (y & MAGNITUDE_MASK), m = n % (y & MAGNITUDE_MASK);
+        r.b = (word_t)q | (neg && q ? SIGN_BIT : 0);
+        r.a = (word_t)m | ((a & SIGN_BIT) && m ? SIGN_BIT : 0);
+    }
+    return r;
+}
+
+static int run_tests(ddp24_engine_t engine) {
     ddp24_t cpu;
     int passed = 0;
     int failed = 0;
 
-    printf("=== DDP-24 Instruction Tests ===\n\n");
+    printf("=== DDP-24 Instruction Tests (%s engine) ===\n\n", ddp24_engine_name(engine));
+    ddp24_init(&cpu);
 
     /* Test 1: LDA/STA */
     {
-        ddp24_init(&cpu);
-        cpu.memory[0] = (OP_LDA << OP_SHIFT) | 0x100;  /* LDA 100 */
-        cpu.memory[1] = (OP_STA << OP_SHIFT) | 0x101;  /* STA 101 */
-        cpu.memory[2] = (OP_HLT << OP_SHIFT);          /* HLT */
-        cpu.memory[0x100] = 0x123456;
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, (OP_LDA << OP_SHIFT) | 0x100);  /* LDA 100 */
+        ddp24_write(&cpu, 1, (OP_STA << OP_SHIFT) | 0x101);  /* STA 101 */
+        ddp24_write(&cpu, 2, (OP_HLT << OP_SHIFT));          /* HLT */
+        ddp24_write(&cpu, 0x100, 0x123456);
 
         ddp24_run(&cpu, 100);
 
-        if (cpu.memory[0x101] == 0x123456) {
+        if (ddp24_read(&cpu, 0x101) == 0x123456) {
             printf("PASS: LDA/STA\n");
             passed++;
         } else {
-            printf("FAIL: LDA/STA (got %06x, expected 123456)\n", cpu.memory[0x101]);
+            printf("FAIL: LDA/STA (got %06x, expected 123456)\n", ddp24_read(&cpu, 0x101));
             failed++;
         }
     }
 
     /* Test 2: ADD */
     {
-        ddp24_init(&cpu);
-        cpu.memory[0] = (OP_LDA << OP_SHIFT) | 0x100;  /* LDA 100 */
-        cpu.memory[1] = (OP_ADD << OP_SHIFT) | 0x101;  /* ADD 101 */
-        cpu.memory[2] = (OP_STA << OP_SHIFT) | 0x102;  /* STA 102 */
-        cpu.memory[3] = (OP_HLT << OP_SHIFT);          /* HLT */
-        cpu.memory[0x100] = 0x000005;  /* 5 */
-        cpu.memory[0x101] = 0x000003;  /* 3 */
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, (OP_LDA << OP_SHIFT) | 0x100);  /* LDA 100 */
+        ddp24_write(&cpu, 1, (OP_ADD << OP_SHIFT) | 0x101);  /* ADD 101 */
+        ddp24_write(&cpu, 2, (OP_STA << OP_SHIFT) | 0x102);  /* STA 102 */
+        ddp24_write(&cpu, 3, (OP_HLT << OP_SHIFT));          /* HLT */
+        ddp24_write(&cpu, 0x100, 0x000005);                  /* 5 */
+        ddp24_write(&cpu, 0x101, 0x000003);                  /* 3 */
 
         ddp24_run(&cpu, 100);
 
-        if (cpu.memory[0x102] == 0x000008) {
+        if (ddp24_read(&cpu, 0x102) == 0x000008) {
             printf("PASS: ADD\n");
             passed++;
         } else {
-            printf("FAIL: ADD (got %06x, expected 000008)\n", cpu.memory[0x102]);
+            printf("FAIL: ADD (got %06x, expected 000008)\n", ddp24_read(&cpu, 0x102));
             failed++;
         }
     }
 
     /* Test 3: SUB */
     {
-        ddp24_init(&cpu);
-        cpu.memory[0] = (OP_LDA << OP_SHIFT) | 0x100;  /* LDA 100 */
-        cpu.memory[1] = (OP_SUB << OP_SHIFT) | 0x101;  /* SUB 101 */
-        cpu.memory[2] = (OP_STA << OP_SHIFT) | 0x102;  /* STA 102 */
-        cpu.memory[3] = (OP_HLT << OP_SHIFT);          /* HLT */
-        cpu.memory[0x100] = 0x000008;  /* 8 */
-        cpu.memory[0x101] = 0x000003;  /* 3 */
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, (OP_LDA << OP_SHIFT) | 0x100);  /* LDA 100 */
+        ddp24_write(&cpu, 1, (OP_SUB << OP_SHIFT) | 0x101);  /* SUB 101 */
+        ddp24_write(&cpu, 2, (OP_STA << OP_SHIFT) | 0x102);  /* STA 102 */
+        ddp24_write(&cpu, 3, (OP_HLT << OP_SHIFT));          /* HLT */
+        ddp24_write(&cpu, 0x100, 0x000008);                  /* 8 */
+        ddp24_write(&cpu, 0x101, 0x000003);                  /* 3 */
 
         ddp24_run(&cpu, 100);
 
-        if (cpu.memory[0x102] == 0x000005) {
+        if (ddp24_read(&cpu, 0x102) == 0x000005) {
             printf("PASS: SUB\n");
             passed++;
         } else {
-            printf("FAIL: SUB (got %06x, expected 000005)\n", cpu.memory[0x102]);
+            printf("FAIL: SUB (got %06x, expected 000005)\n", ddp24_read(&cpu, 0x102));
             failed++;
         }
     }
 
     /* Test 4: JMP */
     {
-        ddp24_init(&cpu);
-        cpu.memory[0] = (OP_JMP << OP_SHIFT) | 0x010;  /* JMP 010 */
-        cpu.memory[1] = (OP_HLT << OP_SHIFT);          /* HLT (skipped) */
-        cpu.memory[0x10] = (OP_LDA << OP_SHIFT) | 0x100;  /* LDA 100 */
-        cpu.memory[0x11] = (OP_HLT << OP_SHIFT);          /* HLT */
-        cpu.memory[0x100] = 0x424242;
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, (OP_JMP << OP_SHIFT) | 0x010);     /* JMP 010 */
+        ddp24_write(&cpu, 1, (OP_HLT << OP_SHIFT));             /* HLT (skipped) */
+        ddp24_write(&cpu, 0x10, (OP_LDA << OP_SHIFT) | 0x100);  /* LDA 100 */
+        ddp24_write(&cpu, 0x11, (OP_HLT << OP_SHIFT));          /* HLT */
+        ddp24_write(&cpu, 0x100, 0x424242);
 
         ddp24_run(&cpu, 100);
 
@@ -163,16 +589,16 @@ static int run_tests(void) {
 
     /* Test 5: Conditional Jump (JZE) */
     {
-        ddp24_init(&cpu);
-        cpu.memory[0] = (OP_LDA << OP_SHIFT) | 0x100;  /* LDA 100 (load 0) */
-        cpu.memory[1] = (OP_JZE << OP_SHIFT) | 0x010;  /* JZE 010 */
-        cpu.memory[2] = (OP_LDA << OP_SHIFT) | 0x101;  /* LDA 101 (wrong path) */
-        cpu.memory[3] = (OP_HLT << OP_SHIFT);
-        cpu.memory[0x10] = (OP_LDA << OP_SHIFT) | 0x102;  /* LDA 102 (right path) */
-        cpu.memory[0x11] = (OP_HLT << OP_SHIFT);
-        cpu.memory[0x100] = 0x000000;  /* Zero */
-        cpu.memory[0x101] = 0xBAD;
-        cpu.memory[0x102] = 0x600D;
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, (OP_LDA << OP_SHIFT) | 0x100);     /* LDA 100 (load 0) */
+        ddp24_write(&cpu, 1, (OP_JZE << OP_SHIFT) | 0x010);     /* JZE 010 */
+        ddp24_write(&cpu, 2, (OP_LDA << OP_SHIFT) | 0x101);     /* LDA 101 (wrong path) */
+        ddp24_write(&cpu, 3, (OP_HLT << OP_SHIFT));
+        ddp24_write(&cpu, 0x10, (OP_LDA << OP_SHIFT) | 0x102);  /* LDA 102 (right path) */
+        ddp24_write(&cpu, 0x11, (OP_HLT << OP_SHIFT));
+        ddp24_write(&cpu, 0x100, 0x000000);                     /* Zero */
+        ddp24_write(&cpu, 0x101, 0xBAD);
+        ddp24_write(&cpu, 0x102, 0x600D);
 
         ddp24_run(&cpu, 100);
 
@@ -187,12 +613,12 @@ static int run_tests(void) {
 
     /* Test 6: ANA (AND) */
     {
-        ddp24_init(&cpu);
-        cpu.memory[0] = (OP_LDA << OP_SHIFT) | 0x100;
-        cpu.memory[1] = (OP_ANA << OP_SHIFT) | 0x101;
-        cpu.memory[2] = (OP_HLT << OP_SHIFT);
-        cpu.memory[0x100] = 0xFF00FF;
-        cpu.memory[0x101] = 0x0F0F0F;
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, (OP_LDA << OP_SHIFT) | 0x100);
+        ddp24_write(&cpu, 1, (OP_ANA << OP_SHIFT) | 0x101);
+        ddp24_write(&cpu, 2, (OP_HLT << OP_SHIFT));
+        ddp24_write(&cpu, 0x100, 0xFF00FF);
+        ddp24_write(&cpu, 0x101, 0x0F0F0F);
 
         ddp24_run(&cpu, 100);
 
@@ -207,12 +633,12 @@ static int run_tests(void) {
 
     /* Test 7: MPY (Multiply) - 100 * 50 = 5000 */
     {
-        ddp24_init(&cpu);
-        cpu.memory[0] = (OP_LDB << OP_SHIFT) | 0x100;  /* Load B with 100 */
-        cpu.memory[1] = (OP_MPY << OP_SHIFT) | 0x101;  /* Multiply by 50 */
-        cpu.memory[2] = (OP_HLT << OP_SHIFT);
-        cpu.memory[0x100] = 100;  /* B = 100 */
-        cpu.memory[0x101] = 50;   /* Multiplier = 50 */
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, (OP_LDB << OP_SHIFT) | 0x100);  /* Load B with 100 */
+        ddp24_write(&cpu, 1, (OP_MPY << OP_SHIFT) | 0x101);  /* Multiply by 50 */
+        ddp24_write(&cpu, 2, (OP_HLT << OP_SHIFT));
+        ddp24_write(&cpu, 0x100, 100);                       /* B = 100 */
+        ddp24_write(&cpu, 0x101, 50);                        /* Multiplier = 50 */
 
         ddp24_run(&cpu, 100);
 
@@ -228,12 +654,12 @@ static int run_tests(void) {
 
     /* Test 8: MPY with sign - (-5) * 3 = -15 */
     {
-        ddp24_init(&cpu);
-        cpu.memory[0] = (OP_LDB << OP_SHIFT) | 0x100;  /* Load B with -5 */
-        cpu.memory[1] = (OP_MPY << OP_SHIFT) | 0x101;  /* Multiply by 3 */
-        cpu.memory[2] = (OP_HLT << OP_SHIFT);
-        cpu.memory[0x100] = SIGN_BIT | 5;  /* B = -5 */
-        cpu.memory[0x101] = 3;              /* Multiplier = 3 */
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, (OP_LDB << OP_SHIFT) | 0x100);  /* Load B with -5 */
+        ddp24_write(&cpu, 1, (OP_MPY << OP_SHIFT) | 0x101);  /* Multiply by 3 */
+        ddp24_write(&cpu, 2, (OP_HLT << OP_SHIFT));
+        ddp24_write(&cpu, 0x100, SIGN_BIT | 5);              /* B = -5 */
+        ddp24_write(&cpu, 0x101, 3);                         /* Multiplier = 3 */
 
         ddp24_run(&cpu, 100);
 
@@ -250,12 +676,12 @@ static int run_tests(void) {
 
     /* Test 9: DIV - 5000 / 50 = 100 */
     {
-        ddp24_init(&cpu);
+        init_cpu(&cpu, engine);
         cpu.A = 0;       /* High part of dividend */
         cpu.B = 5000;    /* Low part of dividend */
-        cpu.memory[0] = (OP_DIV << OP_SHIFT) | 0x100;  /* Divide by 50 */
-        cpu.memory[1] = (OP_HLT << OP_SHIFT);
-        cpu.memory[0x100] = 50;  /* Divisor */
+        ddp24_write(&cpu, 0, (OP_DIV << OP_SHIFT) | 0x100);  /* Divide by 50 */
+        ddp24_write(&cpu, 1, (OP_HLT << OP_SHIFT));
+        ddp24_write(&cpu, 0x100, 50);                        /* Divisor */
 
         ddp24_run(&cpu, 100);
 
@@ -269,55 +695,2394 @@ static int run_tests(void) {
         }
     }
 
-    printf("\n=== Results: %d passed, %d failed ===\n", passed, failed);
-    return failed;
-}
+    /* Test 10: Store over an already-decoded instruction */
+    {
+        init_cpu(&cpu, engine);
+        cpu.PC = 3;
+        ddp24_write(&cpu, 0, (OP_LDA << OP_SHIFT) | 0x100);  /* LDA 100 (HLT word) */
+        ddp24_write(&cpu, 1, (OP_STA << OP_SHIFT) | 0x003);  /* STA 3 */
+        ddp24_write(&cpu, 2, (OP_JMP << OP_SHIFT) | 0x003);  /* JMP 3 */
+        ddp24_write(&cpu, 3, (OP_NOP << OP_SHIFT));          /* NOP, later HLT */
+        ddp24_write(&cpu, 4, (OP_JMP << OP_SHIFT));          /* JMP 0 */
+        ddp24_write(&cpu, 0x100, (OP_HLT << OP_SHIFT));
 
-int main(int argc, char *argv[]) {
-    ddp24_t cpu;
-    int interactive = 0;
-    int dump = 0;
-    int test = 0;
-    const char *program = NULL;
+        ddp24_run(&cpu, 100);
 
-    for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "-i") == 0) {
-            interactive = 1;
-        } else if (strcmp(argv[i], "-d") == 0) {
-            dump = 1;
-        } else if (strcmp(argv[i], "-t") == 0) {
-            test = 1;
-        } else if (strcmp(argv[i], "-h") == 0) {
-            print_usage(argv[0]);
-            return 0;
-        } else if (argv[i][0] != '-') {
-            program = argv[i];
+        if (cpu.halted && cpu.PC == 3) {
+            printf("PASS: Self-modifying store\n");
+            passed++;
+        } else {
+            printf("FAIL: Self-modifying store (PC=%05o, expected 00003 halted)\n", cpu.PC);
+            failed++;
         }
     }
 
-    if (test) {
-        return run_tests();
+    /* Test 11: Hot LDA/MPY/SUB/STA/JNZ loop, long enough to get compiled */
+    {
+        init_cpu(&cpu, engine);
+        cpu.PC = 0x10;
+        ddp24_write(&cpu, 0x10, (OP_LDB << OP_SHIFT) | 0x102);  /* LDB 102 */
+        ddp24_write(&cpu, 0x11, (OP_MPY << OP_SHIFT) | 0x100);  /* MPY 100 */
+        ddp24_write(&cpu, 0x12, (OP_LDA << OP_SHIFT) | 0x100);  /* LDA 100 */
+        ddp24_write(&cpu, 0x13, (OP_SUB << OP_SHIFT) | 0x101);  /* SUB 101 */
+        ddp24_write(&cpu, 0x14, (OP_STA << OP_SHIFT) | 0x100);  /* STA 100 */
+        ddp24_write(&cpu, 0x15, (OP_JNZ << OP_SHIFT) | 0x010);  /* JNZ 10 */
+        ddp24_write(&cpu, 0x16, (OP_HLT << OP_SHIFT));
+        ddp24_write(&cpu, 0x100, 1000);                         /* Counter */
+        ddp24_write(&cpu, 0x101, 1);
+        ddp24_write(&cpu, 0x102, SIGN_BIT | 3);                 /* -3 */
+
+        ddp24_run(&cpu, 0);
+
+        /* 1000 * (10 + 28 + 10 + 10 + 10 + 6) + HLT */
+        if (cpu.A == 0 && cpu.B == (SIGN_BIT | 3) && cpu.cycles == 74005 &&
+            ddp24_read(&cpu, 0x100) == 0 && !cpu.overflow) {
+            printf("PASS: Hot loop\n");
+            passed++;
+        } else {
+            printf("FAIL: Hot loop (A=%06x B=%06x cycles=%llu, expected A=0 B=%06x cycles=74005)\n",
+                   cpu.A, cpu.B, (unsigned long long)cpu.cycles, SIGN_BIT | 3);
+            failed++;
+        }
     }
 
-    ddp24_init(&cpu);
+    /* Test 12: Instances share an image and copy only the page they store to */
+    {
+        ddp24_t other;
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, (OP_LDA << OP_SHIFT) | 0x1100);  /* LDA 1100 */
+        ddp24_write(&cpu, 1, (OP_ADD << OP_SHIFT) | 0x1101);  /* ADD 1101 */
+        ddp24_write(&cpu, 2, (OP_STA << OP_SHIFT) | 0x1100);  /* STA 1100 */
+        ddp24_write(&cpu, 3, (OP_HLT << OP_SHIFT));
+        ddp24_write(&cpu, 0x1100, 40);
+        ddp24_write(&cpu, 0x1101, 2);
+        ddp24_image_t *image = ddp24_image_create(&cpu);
 
-    if (program) {
-        if (ddp24_load(&cpu, program) < 0) {
-            return 1;
+        ddp24_release(&cpu);
+        ddp24_init_image(&cpu, image);
+        ddp24_set_engine(&cpu, engine);
+        ddp24_init_image(&other, image);
+        ddp24_set_engine(&other, engine);
+        ddp24_image_release(image);     /* The CPUs keep it alive */
+
+        ddp24_write(&other, 0x1101, 5);
+        ddp24_run(&cpu, 0);
+        ddp24_run(&other, 0);
+
+        if (ddp24_read(&cpu, 0x1100) == 42 && ddp24_read(&other, 0x1100) == 45 &&
+            ddp24_private_pages(&cpu) == 1 && ddp24_private_pages(&other) == 1) {
+            printf("PASS: Shared image\n");
+            passed++;
+        } else {
+            printf("FAIL: Shared image (got %d and %d, expected 42 and 45)\n",
+                   ddp24_read(&cpu, 0x1100), ddp24_read(&other, 0x1100));
+            failed++;
         }
+        ddp24_release(&other);
     }
 
-    if (interactive) {
-        interactive_mode(&cpu);
-    } else if (program) {
+    /* Test 13: Resumable timeslices past 2^32 cycles */
+    {
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, (OP_LDA << OP_SHIFT) | 0x100);  /* LDA 100 */
+        ddp24_write(&cpu, 1, (OP_SUB << OP_SHIFT) | 0x101);  /* SUB 101 */
+        ddp24_write(&cpu, 2, (OP_STA << OP_SHIFT) | 0x100);  /* STA 100 */
+        ddp24_write(&cpu, 3, (OP_JNZ << OP_SHIFT));          /* JNZ 0 */
+        ddp24_write(&cpu, 4, (OP_HLT << OP_SHIFT));
+        ddp24_write(&cpu, 0x100, 50);
+        ddp24_write(&cpu, 0x101, 1);
+        uint64_t start = (1ull << 32) - 1000;
+        cpu.cycles = start;
+
+        /* A pending request stops the next run before it starts */
+        ddp24_request_stop(&cpu, DDP24_STOP_IO_WAIT);
+        ddp24_stop_t first = ddp24_run_for(&cpu, 100);
+        bool untouched = cpu.cycles == start;
+
+        /* 7-cycle slices with absolute deadlines, so nothing drifts */
+        int slices = 0;
+        ddp24_stop_t reason;
+        uint64_t deadline = start;
+        do {
+            deadline += 7;
+            reason = ddp24_run_until(&cpu, deadline);
+            slices++;
+        } while (reason == DDP24_STOP_BUDGET);
+
+        /* 50 * (10 + 10 + 10 + 6) + HLT */
+        if (first == DDP24_STOP_IO_WAIT && untouched && reason == DDP24_STOP_HALTED &&
+            cpu.cycles == start + 1805 && slices == 258) {
+            printf("PASS: Timeslices\n");
+            passed++;
+        } else {
+            printf("FAIL: Timeslices (stop=%s cycles=%llu slices=%d, expected halted %llu 258)\n",
+                   ddp24_stop_name(reason), (unsigned long long)cpu.cycles, slices,
+                   (unsigned long long)(start + 1805));
+            failed++;
+        }
+    }
+
+    /* Test 14: Snapshot, delta snapshot and restore */
+    {
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, (OP_LDA << OP_SHIFT) | 0x1100);  /* LDA 1100 */
+        ddp24_write(&cpu, 1, (OP_ADD << OP_SHIFT) | 0x1101);  /* ADD 1101 */
+        ddp24_write(&cpu, 2, (OP_STA << OP_SHIFT) | 0x1100);  /* STA 1100 */
+        ddp24_write(&cpu, 3, (OP_JMP << OP_SHIFT));           /* JMP 0 */
+        ddp24_write(&cpu, 0x1101, 3);
+        ddp24_run(&cpu, 350);                   /* Ten times round */
+        ddp24_snapshot_t *base = ddp24_snapshot(&cpu);
+
+        ddp24_run(&cpu, 350);
+        ddp24_snapshot_t *delta = ddp24_snapshot(&cpu);
+        int dirty = ddp24_snapshot_pages(delta);    /* Only page 1100 changed */
+
+        ddp24_run(&cpu, 350);
+        ddp24_write(&cpu, 0x3000, 1);
+        ddp24_restore(&cpu, base);
+        bool at_base = ddp24_read(&cpu, 0x1100) == 30 && ddp24_read(&cpu, 0x3000) == 0 &&
+                       cpu.cycles == 350 && ddp24_private_pages(&cpu) == 0;
+        ddp24_run(&cpu, 350);
+        bool rerun = ddp24_read(&cpu, 0x1100) == 60;
+
+        /* The file form folds the base into the delta */
+        FILE *f = tmpfile();
+        bool saved = f && ddp24_snapshot_write(delta, f) == 0;
+        ddp24_snapshot_t *loaded = NULL;
+        if (saved) {
+            rewind(f);
+            loaded = ddp24_snapshot_read(f);
+        }
+        if (f) {
+            fclose(f);
+        }
+        bool reloaded = false;
+        if (loaded) {
+            ddp24_restore(&cpu, loaded);
+            ddp24_run(&cpu, 350);
+            reloaded = ddp24_read(&cpu, 0x1100) == 90 && ddp24_read(&cpu, 0x1101) == 3 &&
+                       cpu.A == 90;
+        }
+
+        if (dirty == 1 && at_base && rerun && reloaded) {
+            printf("PASS: Snapshot and restore\n");
+            passed++;
+        } else {
+            printf("FAIL: Snapshot and restore (dirty=%d base=%d rerun=%d reload=%d)\n",
+                   dirty, at_base, rerun, reloaded);
+            failed++;
+        }
+        ddp24_snapshot_release(loaded);
+        ddp24_snapshot_release(delta);
+        ddp24_snapshot_release(base);
+    }
+
+    /* Test 15: Bulk image unpack, base address and native format */
+    {
+        enum { WORDS = 1030 };
+        static uint8_t raw[3 * WORDS];
+        static uint8_t native[16 + 4 * WORDS];
+        static uint8_t odd[1 + sizeof(native)];
+        word_t expect[WORDS];
+        uint32_t order = 0x01020304, count = WORDS;
+
+        for (int i = 0; i < WORDS; i++) {
+            expect[i] = ((word_t)i * 2654435761u) & WORD_MASK;
+            raw[3 * i] = (uint8_t)(expect[i] >> 16);
+            raw[3 * i + 1] = (uint8_t)(expect[i] >> 8);
+            raw[3 * i + 2] = (uint8_t)expect[i];
+        }
+        memcpy(native, "DDP24NAT", 8);
+        memcpy(native + 8, &order, 4);
+        memcpy(native + 12, &count, 4);
+        memcpy(native + 16, expect, sizeof(expect));
+
+        init_cpu(&cpu, engine);
+        int got_raw = ddp24_load_buffer(&cpu, raw, sizeof(raw), 0x7C01);   /* Only 1023 fit */
+        bool raw_ok = got_raw == 1023;
+        for (int i = 0; i < 1023 && raw_ok; i++) {
+            raw_ok = ddp24_read(&cpu, 0x7C01 + i) == expect[i];
+        }
+
+        int got_native = ddp24_load_buffer(&cpu, native, sizeof(native), 0x10);
+        bool native_ok = got_native == WORDS;
+        for (int i = 0; i < WORDS && native_ok; i++) {
+            native_ok = ddp24_read(&cpu, 0x10 + i) == expect[i];
+        }
+
+        /* Words off their alignment in the caller's buffer */
+        memcpy(odd + 1, native, sizeof(native));
+        init_cpu(&cpu, engine);
+        native_ok = native_ok && ddp24_load_buffer(&cpu, odd + 1, sizeof(native), 0x10) == WORDS;
+        for (int i = 0; i < WORDS && native_ok; i++) {
+            native_ok = ddp24_read(&cpu, 0x10 + i) == expect[i];
+        }
+
+        native[11] ^= 0xFF;     /* Other byte order */
+        bool rejected = ddp24_load_buffer(&cpu, native, sizeof(native), 0) < 0;
+
+        if (raw_ok && native_ok && rejected) {
+            printf("PASS: Image loader\n");
+            passed++;
+        } else {
+            printf("FAIL: Image loader (raw=%d native=%d rejected=%d)\n", got_raw, got_native, rejected);
+            failed++;
+        }
+    }
+
+    /* Test 16: Idle loops skipped in bulk, stopping where stepping would */
+    {
+        static const word_t program[] = {
+            (OP_LDA << OP_SHIFT) | 0x100,   /* LDA 100 */
+            (OP_SUB << OP_SHIFT) | 0x101,   /* SUB 101 */
+            (OP_JNZ << OP_SHIFT) | 1,       /* JNZ 1 */
+            (OP_JMP << OP_SHIFT) | 3,       /* JMP 3 */
+        };
+        ddp24_t ref;
+        init_cpu(&cpu, engine);
+        ddp24_init(&ref);
+        ddp24_write_block(&cpu, 0, program, 4);
+        ddp24_write_block(&ref, 0, program, 4);
+        ddp24_write(&cpu, 0x100, 3000);
+        ddp24_write(&ref, 0x100, 3000);
+        ddp24_write(&cpu, 0x101, 3);
+        ddp24_write(&ref, 0x101, 3);
+
+        /* Uneven slices through the countdown and into the spin */
+        int mismatches = 0;
+        uint64_t deadline = 0;
+        for (int i = 0; i < 40; i++) {
+            deadline += 1 + (uint64_t)i * 97;
+            ddp24_run_until(&cpu, deadline);
+            while (!ref.halted && ref.cycles < deadline) {
+                ddp24_step(&ref);
+            }
+            if (cpu.A != ref.A || cpu.PC != ref.PC || cpu.cycles != ref.cycles) {
+                mismatches++;
+            }
+        }
+
+        /* A day of spinning in one call */
+        uint64_t far = cpu.cycles + 172800000000ull;
+        ddp24_stop_t reason = ddp24_run_until(&cpu, far);
+        bool spun = reason == DDP24_STOP_BUDGET && cpu.PC == 3 && cpu.A == 0 &&
+                    cpu.cycles >= far && cpu.cycles < far + 5;
+
+        if (mismatches == 0 && spun) {
+            printf("PASS: Idle loop fast-forward\n");
+            passed++;
+        } else {
+            printf("FAIL: Idle loop fast-forward (%d slices differ, spin stop=%s cycles=%llu)\n",
+                   mismatches, ddp24_stop_name(reason), (unsigned long long)cpu.cycles);
+            failed++;
+        }
+        ddp24_release(&ref);
+    }
+
+    /* Test 17: Devices and the event queue */
+    {
+        test_io_t io = { 0 };
+        ddp24_device_t adc = { "adc", &io, adc_control, adc_input, NULL, adc_sense };
+        ddp24_device_t recorder = { "recorder", &io, NULL, NULL, recorder_output, NULL };
+
+        init_cpu(&cpu, engine);
+        ddp24_attach_device(&cpu, 5, &adc);
+        ddp24_attach_device(&cpu, 6, &recorder);
+        ddp24_write(&cpu, 0, (OP_OCP << OP_SHIFT) | 5);      /* OCP 5: start */
+        ddp24_write(&cpu, 1, (OP_SKS << OP_SHIFT) | 5);      /* SKS 5 */
+        ddp24_write(&cpu, 2, (OP_JMP << OP_SHIFT) | 1);      /* JMP 1 */
+        ddp24_write(&cpu, 3, (OP_ITA << OP_SHIFT) | 5);      /* ITA 5 */
+        ddp24_write(&cpu, 4, (OP_OTA << OP_SHIFT) | 6);      /* OTA 6 */
+        ddp24_write(&cpu, 5, (OP_HLT << OP_SHIFT));
+        ddp24_stop_t reason = ddp24_run_for(&cpu, 0);
+
+        /* Done at 1000 and seen at the next boundary, 1005 (after an SKS) */
+        bool io_ok = reason == DDP24_STOP_HALTED && io.read_at == 1020 &&
+                     io.written == 01234567 && io.written_at == 1030 && cpu.cycles == 1045;
+
+        /* Out-of-order times with ties, one cancelled */
+        static test_events_t ev;
+        memset(&ev, 0, sizeof(ev));
+        test_events = &ev;
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, (OP_JMP << OP_SHIFT));          /* JMP 0 */
+        for (int i = 0; i < 40; i++) {
+            ddp24_schedule(&cpu, 100 + (uint64_t)((i * 37) % 20) * 50, log_event, (void *)(intptr_t)i);
+        }
+        int cancelled = ddp24_cancel(&cpu, log_event, (void *)(intptr_t)7);
+        ddp24_run_until(&cpu, 5000);
+        bool ordered = ev.fired == 39 && cancelled == 1 && ddp24_next_event(&cpu) == DDP24_FOREVER;
+        for (int i = 1; i < ev.fired && ordered; i++) {
+            uint64_t a = 100 + (uint64_t)((ev.order[i - 1] * 37) % 20) * 50;
+            uint64_t b = 100 + (uint64_t)((ev.order[i] * 37) % 20) * 50;
+            ordered = a < b || (a == b && ev.order[i - 1] < ev.order[i]);
+            ordered = ordered && ev.when[i] >= b && ev.when[i] < b + 5;
+        }
+
+        if (io_ok && ordered) {
+            printf("PASS: Devices and events\n");
+            passed++;
+        } else {
+            printf("FAIL: Devices and events (read at %llu, wrote %08o at %llu, cycles %llu, %d events fired)\n",
+                   (unsigned long long)io.read_at, io.written, (unsigned long long)io.written_at,
+                   (unsigned long long)cpu.cycles, ev.fired);
+            failed++;
+        }
+    }
+
+    /* Test 18: Interrupts */
+    {
+        /* Spinning from 20 on; OTA logs 25 cycles after delivery starts */
+        static test_events_t ev[3];
+
+        /* Both at 1000: line 1 first, line 3 once the JMP* has re-enabled */
+        load_irq_program(&cpu, engine, 0, &ev[0]);
+        ddp24_schedule(&cpu, 1000, raise_lines, NULL);
+        ddp24_run_until(&cpu, 3000);
+        bool priority = ev[0].fired == 2 && ev[0].order[0] == 1 && ev[0].when[0] == 1025 &&
+                        ev[0].order[1] == 3 && ev[0].when[1] == 1070 &&
+                        cpu.PC == 2 && ddp24_read(&cpu, 042) == 2;
+
+        /* Line 1 masked until line 3's handler clears the mask */
+        load_irq_program(&cpu, engine, 1u << 1, &ev[1]);
+        ddp24_schedule(&cpu, 1000, raise_lines, NULL);
+        ddp24_run_until(&cpu, 3000);
+        bool masked = ev[1].fired == 2 && ev[1].order[0] == 3 && ev[1].when[0] == 1025 &&
+                      ev[1].order[1] == 1 && ev[1].when[1] == 1080;
+
+        /* Posted before enabling, and from mid-run */
+        load_irq_program(&cpu, engine, 0, &ev[2]);
+        ddp24_post_interrupt(&cpu, 1);
+        ddp24_schedule(&cpu, 2000, post_line, (void *)(intptr_t)3);
+        ddp24_run_until(&cpu, 3000);
+        bool posted = ev[2].fired == 2 && ev[2].order[0] == 1 && ev[2].when[0] == 45 &&
+                      ev[2].order[1] == 3 && ev[2].when[1] == 2025 &&
+                      cpu.cycles == 3000 && cpu.interrupt_enabled;
+
+        /* Line 1's vector halts; only the post can end the run */
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, INSN(OP_ITC, 0, DDP24_ITC_ENABLE));
+        ddp24_write(&cpu, 1, INSN(OP_JMP, 0, 1));
+        ddp24_write(&cpu, 043, (OP_HLT << OP_SHIFT));
+        pthread_t poster;
+        bool remote = pthread_create(&poster, NULL, post_later, &cpu) == 0;
+        if (remote) {
+            ddp24_run_until(&cpu, DDP24_FOREVER);
+            pthread_join(poster, NULL);
+            remote = cpu.halted && cpu.PC == 043 && ddp24_read(&cpu, 042) == 1;
+        }
+        posted = posted && remote;
+
+        if (priority && masked && posted) {
+            printf("PASS: Interrupts\n");
+            passed++;
+        } else {
+            printf("FAIL: Interrupts (priority %d, masked %d, posted %d)\n", priority, masked, posted);
+            for (int t = 0; t < 3; t++) {
+                for (int i = 0; i < ev[t].fired; i++) {
+                    printf("  %d: line %d at %llu\n", t, ev[t].order[i], (unsigned long long)ev[t].when[i]);
+                }
+            }
+            failed++;
+        }
+    }
+
+    /* Test 19: The rest of the instruction set, one at a time */
+    {
+        int bad = run_op_cases(&cpu, engine);
+        if (bad == 0) {
+            printf("PASS: Remaining instructions\n");
+            passed++;
+        } else {
+            printf("FAIL: Remaining instructions (%d wrong)\n", bad);
+            failed++;
+        }
+    }
+
+    /* Test 20: FMB and DMB against word-at-a-time stores */
+    {
+        static const struct { word_t dst, src, count; } moves[] = {
+            { 0x1000, 0x2000, 1500 },   /* Apart, several pages */
+            { 0x2001, 0x2000, 1000 },   /* Overlapping upwards by one */
+            { 0x2203, 0x2200, 700 },    /* ... by three */
+            { 0x2300, 0x2000, 2000 },   /* ... by more than a page */
+            { 0x1FF0, 0x2000, 900 },    /* Overlapping downwards */
+            { 0x7F00, 0x0100, 600 },    /* Destination wraps */
+            { 0x0200, 0x7E80, 900 },    /* Source wraps */
+            { 0x3000, 0x3000, 10 },     /* Onto itself */
+        };
+        static word_t ref[MEM_SIZE];
+        int bad = 0;
+
+        for (size_t t = 0; t < sizeof(moves) / sizeof(moves[0]); t++) {
+            init_cpu(&cpu, engine);
+            for (word_t a = 0; a < MEM_SIZE; a++) {
+                ref[a] = (a * 2654435761u) & WORD_MASK;
+            }
+            ddp24_write_block(&cpu, 0, ref, MEM_SIZE);
+            cpu.PC = 0x6000;
+            ddp24_write(&cpu, 0x6000, (OP_FMB << OP_SHIFT) | 0x4000);  /* FMB 4000 */
+            ddp24_write(&cpu, 0x6001, (OP_LDA << OP_SHIFT) | 0x6010);  /* LDA 6010 */
+            ddp24_write(&cpu, 0x6002, (OP_DMB << OP_SHIFT) | moves[t].src);
+            ddp24_write(&cpu, 0x6003, (OP_HLT << OP_SHIFT));
+            ddp24_write(&cpu, 0x6010, moves[t].dst);
+            cpu.A = 0x5A5A5A;
+            cpu.B = moves[t].count;
+            for (word_t a = 0x6000; a < 0x6011; a++) {
+                ref[a] = ddp24_read(&cpu, a);
+            }
+            for (word_t i = 0; i < moves[t].count; i++) {
+                ref[0x4000 + i] = 0x5A5A5A;
+            }
+            for (word_t i = 0; i < moves[t].count; i++) {
+                ref[(moves[t].dst + i) & ADDR_MASK] = ref[(moves[t].src + i) & ADDR_MASK];
+            }
+
+            ddp24_run(&cpu, 0);
+            for (word_t a = 0; a < MEM_SIZE; a++) {
+                bad += ddp24_read(&cpu, a) != ref[a];
+            }
+            bad += cpu.cycles != 10 + 10 + 10 + 6 * (uint64_t)moves[t].count + 5;
+        }
+
+        if (bad == 0) {
+            printf("PASS: FMB/DMB\n");
+            passed++;
+        } else {
+            printf("FAIL: FMB/DMB (%d mismatches)\n", bad);
+            failed++;
+        }
+    }
+
+    /* Test 21: JXI loops, and INA */
+    {
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, INSN(OP_JXI, 1, 0));      /* JXI 0,1 */
+        ddp24_write(&cpu, 1, INSN(OP_JXI, 2, 1));      /* JXI 1,2: idle-skipped */
+        ddp24_write(&cpu, 2, INSN(OP_INA, 0, 0100));   /* INA 100 */
+        ddp24_write(&cpu, 3, (OP_HLT << OP_SHIFT));
+        cpu.X[1] = MEM_SIZE - 5;
+        cpu.X[2] = 1;
+        cpu.B = 5;                                  /* From the ADC */
+
+        test_io_t io = { .value = 0x654321 };
+        ddp24_device_t adc = { "adc", &io, NULL, adc_input, NULL, NULL };
+        ddp24_attach_device(&cpu, 5, &adc);
         ddp24_run(&cpu, 0);
-        if (dump) {
-            ddp24_dump(&cpu);
+
+        if (cpu.X[1] == 0 && cpu.X[2] == 0 && cpu.cycles == 6 * 5 + 6 * 32767 + 10 + 5 &&
+            ddp24_read(&cpu, 0100) == 0x654321 && io.read_at == 6 * 5 + 6 * 32767) {
+            printf("PASS: JXI/INA\n");
+            passed++;
+        } else {
+            printf("FAIL: JXI/INA (X1=%05o X2=%05o cycles %llu)\n", cpu.X[1], cpu.X[2],
+                   (unsigned long long)cpu.cycles);
+            failed++;
         }
-    } else {
-        print_usage(argv[0]);
-        return 1;
     }
 
-    return 0;
+    /* Test 22: XEC runs its target in place */
+    {
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, INSN(OP_XEC, 0, 0100));    /* XEC 100: LDA 200 */
+        ddp24_write(&cpu, 1, INSN(OP_XEC, 0, 0101));    /* XEC 101: XEC 102: XEC 103: SKG 201 */
+        ddp24_write(&cpu, 2, (OP_HLT << OP_SHIFT));     /* Skipped */
+        ddp24_write(&cpu, 3, INSN(OP_XEC, 0, 0104));    /* XEC 104: JSL 110 */
+        ddp24_write(&cpu, 0100, INSN(OP_LDA, 0, 0200));
+        ddp24_write(&cpu, 0101, INSN(OP_XEC, 0, 0102));
+        ddp24_write(&cpu, 0102, INSN(OP_XEC, 0, 0103));
+        ddp24_write(&cpu, 0103, INSN(OP_SKG, 0, 0201));
+        ddp24_write(&cpu, 0104, INSN(OP_JSL, 0, 0110));
+        ddp24_write(&cpu, 0111, (OP_HLT << OP_SHIFT));
+        ddp24_write(&cpu, 0200, 7);
+        ddp24_write(&cpu, 0201, 3);
+        int first = ddp24_step(&cpu);
+        int second = ddp24_step(&cpu);
+        ddp24_run(&cpu, 0);
+        bool in_place = first == 15 && second == 25 && cpu.A == 7 && cpu.PC == 0111 &&
+                        ddp24_read(&cpu, 0110) == 4 && cpu.cycles == 15 + 25 + 15 + 5;
+
+        /* An XEC of itself gives up after xec_limit links */
+        init_cpu(&cpu, engine);
+        cpu.xec_limit = 8;
+        ddp24_write(&cpu, 0, INSN(OP_XEC, 0, 0));
+        ddp24_run(&cpu, 0);
+        bool limited = cpu.halted && cpu.PC == 0 && cpu.cycles == 8 * 5 &&
+                       cpu.fault == DDP24_FAULT_XEC_CHAIN && cpu.fault_pc == 0;
+
+        if (in_place && limited) {
+            printf("PASS: XEC\n");
+            passed++;
+        } else {
+            printf("FAIL: XEC (in place %d, limited %d, PC=%05o cycles %llu)\n", in_place, limited,
+                   cpu.PC, (unsigned long long)cpu.cycles);
+            failed++;
+        }
+    }
+
+    /* Test 23: breakpoints and watchpoints stop the run where they should */
+    {
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, INSN(OP_LDA, 0, 0200));
+        ddp24_write(&cpu, 1, INSN(OP_STA, 0, 0202));
+        ddp24_write(&cpu, 2, INSN(OP_LDB, 0, 0203));
+        ddp24_write(&cpu, 3, INSN(OP_FMB, 0, 0300));    /* 300..302 */
+        ddp24_write(&cpu, 4, INSN(OP_NOP, 0, 0));
+        ddp24_write(&cpu, 5, (OP_HLT << OP_SHIFT));
+        ddp24_write(&cpu, 0200, 5);
+        ddp24_write(&cpu, 0203, 3);
+        ddp24_set_watchpoint(&cpu, 0202, 1, DDP24_WATCH_WRITE);
+        ddp24_set_watchpoint(&cpu, 0302, 4, DDP24_WATCH_WRITE);
+        ddp24_set_breakpoint(&cpu, 5);
+        ddp24_watch_hit_t hit = { 0 };
+
+        bool store = ddp24_run_for(&cpu, 0) == DDP24_STOP_WATCHPOINT && cpu.PC == 2 &&
+                     ddp24_read(&cpu, 0202) == 5 && ddp24_last_watch_hit(&cpu, &hit) &&
+                     hit.pc == 1 && hit.addr == 0202 && hit.kind == DDP24_WATCH_WRITE;
+        bool block = ddp24_run_for(&cpu, 0) == DDP24_STOP_WATCHPOINT && cpu.PC == 4 &&
+                     ddp24_last_watch_hit(&cpu, &hit) && hit.pc == 3 && hit.addr == 0302;
+        bool brk = ddp24_run_for(&cpu, 0) == DDP24_STOP_BREAKPOINT && cpu.PC == 5 &&
+                   !cpu.halted && cpu.cycles == 10 + 10 + 10 + 16 + 5;
+        bool resumed = ddp24_run_for(&cpu, 0) == DDP24_STOP_HALTED && hit.count == 2;
+
+        /* Reads, and none left once cleared */
+        ddp24_clear_debug(&cpu);
+        ddp24_set_watchpoint(&cpu, 0200, 1, DDP24_WATCH_READ);
+        cpu.PC = 0;
+        cpu.halted = false;
+        bool read = ddp24_run_for(&cpu, 0) == DDP24_STOP_WATCHPOINT && cpu.PC == 1 &&
+                    ddp24_last_watch_hit(&cpu, &hit) && hit.kind == DDP24_WATCH_READ;
+        ddp24_clear_watchpoint(&cpu, 0200, 1, DDP24_WATCH_READ);
+        bool cleared = ddp24_run_for(&cpu, 0) == DDP24_STOP_HALTED && cpu.watch_read_pages == 0;
+
+        if (store && block && brk && resumed && read && cleared) {
+            printf("PASS: Breakpoints and watchpoints\n");
+            passed++;
+        } else {
+            printf("FAIL: Breakpoints and watchpoints (store %d, block %d, break %d, resumed %d, "
+                   "read %d, cleared %d)\n", store, block, brk, resumed, read, cleared);
+            failed++;
+        }
+    }
+
+    /* Test 24: the state hash follows stores, block moves and restores */
+    {
+        ddp24_t copy;
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, INSN(OP_LDA, 0, 0200));
+        ddp24_write(&cpu, 1, INSN(OP_STA, 0, 0202));
+        ddp24_write(&cpu, 2, INSN(OP_LDB, 0, 0203));
+        ddp24_write(&cpu, 3, INSN(OP_FMB, 0, 0300));    /* 5 into 300..302 */
+        ddp24_write(&cpu, 4, INSN(OP_LDA, 0, 0204));
+        ddp24_write(&cpu, 5, INSN(OP_DMB, 0, 0300));    /* 300..302 to 400..402 */
+        ddp24_write(&cpu, 6, (OP_HLT << OP_SHIFT));
+        ddp24_write(&cpu, 0200, 5);
+        ddp24_write(&cpu, 0203, 3);
+        ddp24_write(&cpu, 0204, 0400);
+        ddp24_run(&cpu, 0);
+
+        /* The same state built in another order hashes the same */
+        ddp24_init(&copy);
+        for (word_t a = MEM_SIZE; a-- > 0; ) {
+            ddp24_write(&copy, a, ddp24_read(&cpu, a));
+        }
+        copy.A = cpu.A;
+        copy.B = cpu.B;
+        copy.PC = cpu.PC;
+        copy.halted = cpu.halted;
+        bool rebuilt = ddp24_read(&cpu, 0402) == 5 && ddp24_state_hash(&copy) == ddp24_state_hash(&cpu);
+
+        uint64_t before = ddp24_state_hash(&cpu);
+        ddp24_write(&cpu, 0202, 6);
+        bool changed = ddp24_state_hash(&cpu) != before;
+        ddp24_write(&cpu, 0202, 5);
+        bool undone = ddp24_state_hash(&cpu) == before;
+        cpu.B ^= 1;
+        bool regs = ddp24_state_hash(&cpu) != before;
+        cpu.B ^= 1;
+
+        ddp24_snapshot_t *snap = ddp24_snapshot(&cpu);
+        ddp24_fill_block(&cpu, 0300, 7, 0200);
+        ddp24_restore(&cpu, snap);
+        bool restored = ddp24_state_hash(&cpu) == before;
+        ddp24_snapshot_release(snap);
+
+        /* Direct stores need ddp24_invalidate to rehash */
+        ddp24_write(&cpu, 0500, 1);
+        cpu.page[0500 >> DDP24_PAGE_SHIFT]->word[0500 & DDP24_PAGE_MASK] = 0;
+        ddp24_invalidate(&cpu, 0500, 1);
+        bool direct = ddp24_state_hash(&cpu) == before;
+        ddp24_release(&copy);
+
+        if (rebuilt && changed && undone && regs && restored && direct) {
+            printf("PASS: State hash\n");
+            passed++;
+        } else {
+            printf("FAIL: State hash (rebuilt %d, changed %d, undone %d, regs %d, restored %d, "
+                   "direct %d)\n", rebuilt, changed, undone, regs, restored, direct);
+            failed++;
+        }
+    }
+
+    /* Test 25: the timing profile prices fixed and run-time costs alike,
+     * and CPUs and images keep the one they were set up with */
+    {
+        uint64_t spent[3];
+        ddp24_t cpus[3] = { 0 };
+        const ddp24_timing_t *profiles[2] = { &ddp24_timing_ddp24, ddp24_find_timing("ddp124") };
+        for (int t = 0; t < 2; t++) {
+            ddp24_set_timing(profiles[t]);
+            init_cpu(&cpus[t], engine);
+            ddp24_write(&cpus[t], 0, INSN(OP_LDA, 0, 0200));
+            ddp24_write(&cpus[t], 1, INSN(OP_ARS, 0, 3));   /* Count known at decode */
+            ddp24_write(&cpus[t], 2, INSN(OP_ARS, 1, 0));   /* Count from X1 */
+            ddp24_write(&cpus[t], 3, INSN(OP_MPY, 0, 0201));
+            ddp24_write(&cpus[t], 4, (OP_HLT << OP_SHIFT));
+            ddp24_write(&cpus[t], 0200, 0100);
+            ddp24_write(&cpus[t], 0201, 3);
+        }
+        ddp24_set_timing(NULL);
+
+        ddp24_image_t *image = ddp24_image_create(&cpus[1]);
+        ddp24_init_image(&cpus[2], image);
+        ddp24_set_engine(&cpus[2], engine);
+        ddp24_image_release(image);
+        for (int t = 0; t < 3; t++) {
+            cpus[t].X[1] = 2;
+            ddp24_run(&cpus[t], 0);
+            spent[t] = cpus[t].cycles;
+            ddp24_release(&cpus[t]);
+        }
+
+        if (spent[0] == 10 + 8 + 7 + 28 + 5 && spent[1] == 7 + 7 + 6 + 20 + 4 &&
+            spent[2] == spent[1] && ddp24_get_timing() == &ddp24_timing_ddp24) {
+            printf("PASS: Timing profiles\n");
+            passed++;
+        } else {
+            printf("FAIL: Timing profiles (%llu, %llu and %llu cycles)\n",
+                   (unsigned long long)spent[0], (unsigned long long)spent[1],
+                   (unsigned long long)spent[2]);
+            failed++;
+        }
+    }
+
+    /* Test 26: the shadow call stack splits a nested call's cycles */
+    {
+        ddp24_calls_t *calls = ddp24_calls_create();
+        init_cpu(&cpu, engine);
+        ddp24_write(&cpu, 0, INSN(OP_JSL, 0, 0100));
+        ddp24_write(&cpu, 1, (OP_HLT << OP_SHIFT));
+        ddp24_write(&cpu, 0101, INSN(OP_NOP, 0, 0));
+        ddp24_write(&cpu, 0102, INSN(OP_JSL, 0, 0200));
+        ddp24_write(&cpu, 0103, INSN(OP_JSL, 0, 0200));
+        ddp24_write(&cpu, 0104, INSN(OP_JMP, 0, 0100) | INDIRECT_BIT);
+        ddp24_write(&cpu, 0201, INSN(OP_JMP, 0, 0210) | INDIRECT_BIT);  /* Not a return */
+        ddp24_write(&cpu, 0202, INSN(OP_JMP, 0, 0200) | INDIRECT_BIT);
+        ddp24_write(&cpu, 0210, 0202);
+        ddp24_calls_attach(&cpu, calls);
+        ddp24_run(&cpu, 0);
+        int depth = ddp24_calls_depth(calls);
+        ddp24_calls_attach(&cpu, NULL);
+
+        ddp24_routine_t outer = { 0 }, inner = { 0 }, top[4];
+        bool found = ddp24_calls_routine(calls, 0100, &outer) && ddp24_calls_routine(calls, 0200, &inner);
+        int n = ddp24_calls_top(calls, top, 4);
+        uint64_t around = ddp24_timing_ddp24.op[OP_JSL] + ddp24_timing_ddp24.op[OP_HLT];
+        if (found && depth == 0 && n == 2 && top[0].entry == 0100 &&
+            outer.calls == 1 && inner.calls == 2 &&
+            outer.inclusive == cpu.cycles - around &&
+            outer.exclusive == outer.inclusive - inner.inclusive &&
+            inner.exclusive == inner.inclusive) {
+            printf("PASS: Call stack\n");
+            passed++;
+        } else {
+            printf("FAIL: Call stack (depth %d, %d routines, %llu/%llu and %llu/%llu cycles)\n", depth, n,
+                   (unsigned long long)outer.inclusive, (unsigned long long)outer.exclusive,
+                   (unsigned long long)inner.inclusive, (unsigned long long)inner.exclusive);
+            failed++;
+        }
+        ddp24_calls_free(calls);
+    }
+
+    /* Test 27: a native hook matches the guest routine word and cycle */
+    {
+        static const word_t inputs[] = { 0, 1, 2, 3, 4, 15, 16, 17, 1000, 123456, SIGN_BIT | 9 };
+        ddp24_hle_t *hle = ddp24_hle_create();
+        int mismatches = 0;
+
+        init_cpu(&cpu, engine);
+        load_isqrt(&cpu);
+        ddp24_hle_add(hle, ISQRT_LINK, ISQRT_LENGTH,
+                      ddp24_hle_checksum(&cpu, ISQRT_LINK + 1, ISQRT_LENGTH), native_isqrt, NULL);
+        for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+            word_t want[4], got[4];
+            uint64_t cycles[2];
+            for (int hooked = 0; hooked < 2; hooked++) {
+                init_cpu(&cpu, engine);
+                load_isqrt(&cpu);
+                ddp24_hle_attach(&cpu, hooked ? hle : NULL);
+                ddp24_write(&cpu, 0, INSN(OP_JSL, 0, ISQRT_LINK));
+                ddp24_write(&cpu, 1, (OP_HLT << OP_SHIFT));
+                cpu.A = inputs[i];
+                ddp24_run(&cpu, 0);
+                word_t *out = hooked ? got : want;
+                out[0] = cpu.A;
+                for (int w = 0; w < 3; w++) {
+                    out[w + 1] = ddp24_read(&cpu, ISQRT_N + w);
+                }
+                cycles[hooked] = cpu.cycles;
+            }
+            mismatches += memcmp(want, got, sizeof(want)) != 0 || cycles[0] != cycles[1];
+        }
+        uint64_t hits = ddp24_hle_hits(hle);
+
+        /* Patched code is not the routine the hook was written for */
+        init_cpu(&cpu, engine);
+        load_isqrt(&cpu);
+        ddp24_write(&cpu, 0314, INSN(OP_STA, 0, 0336));
+        ddp24_hle_attach(&cpu, hle);
+        ddp24_write(&cpu, 0, INSN(OP_JSL, 0, ISQRT_LINK));
+        ddp24_write(&cpu, 1, (OP_HLT << OP_SHIFT));
+        cpu.A = 0;
+        ddp24_run(&cpu, 0);
+        bool patched = ddp24_hle_hits(hle) == hits && cpu.halted && cpu.PC == 1;
+
+        /* A match holds until a store or an invalidate reaches the code */
+        init_cpu(&cpu, engine);
+        load_isqrt(&cpu);
+        ddp24_hle_attach(&cpu, hle);
+        ddp24_write(&cpu, 0, INSN(OP_JSL, 0, ISQRT_LINK));
+        ddp24_write(&cpu, 1, (OP_HLT << OP_SHIFT));
+        word_t original = ddp24_read(&cpu, 0314);
+        uint64_t seen[4];
+        for (int pass = 0; pass < 4; pass++) {
+            if (pass == 1) {
+                ddp24_write(&cpu, 0314, INSN(OP_STA, 0, 0336));
+            } else if (pass == 2) {
+                ddp24_write(&cpu, 0314, original);
+            } else if (pass == 3) {
+                cpu.page[0314 >> DDP24_PAGE_SHIFT]->word[0314 & DDP24_PAGE_MASK] = INSN(OP_STA, 0, 0336);
+                ddp24_invalidate(&cpu, 0314, 1);
+            }
+            cpu.PC = 0;
+            cpu.halted = false;
+            cpu.A = 4;
+            ddp24_run(&cpu, 0);
+            seen[pass] = ddp24_hle_hits(hle) - hits;
+        }
+        patched = patched && seen[0] == 1 && seen[1] == 1 && seen[2] == 2 && seen[3] == 2;
+
+        if (mismatches == 0 && hits == 10 && patched) {
+            printf("PASS: Native routines\n");
+            passed++;
+        } else {
+            printf("FAIL: Native routines (%d mismatched, %llu hits, patched %d)\n",
+                   mismatches, (unsigned long long)hits, patched);
+            failed++;
+        }
+        ddp24_hle_free(hle);
+    }
+
+    /* Test 28: arithmetic on every pair of edge values, both zeros included */
+    {
+        static const word_t edges[] = {
+            0, SIGN_BIT, 1, SIGN_BIT | 1, 2, SIGN_BIT | 3, 0x3FFFFF, SIGN_BIT | 0x400000,
+            0x400001, SIGN_BIT | 0x2AAAAA, 0x555555, MAGNITUDE_MASK - 1,
+            MAGNITUDE_MASK, SIGN_BIT | MAGNITUDE_MASK,
+        };
+        static const uint8_t ops[] = { OP_ADD, OP_SUB, OP_SKG, OP_MPY, OP_DIV };
+        enum { EDGES = sizeof(edges) / sizeof(edges[0]) };
+        int kernel_bad = 0, engine_bad = 0;
+
+        for (size_t o = 0; o < sizeof(ops); o++) {
+            init_cpu(&cpu, engine);
+            ddp24_write(&cpu, 0, INSN(ops[o], 0, 0100));
+            ddp24_write(&cpu, 1, (OP_HLT << OP_SHIFT));
+            ddp24_write(&cpu, 2, (OP_HLT << OP_SHIFT));
+            for (int i = 0; i < EDGES; i++) {
+                for (int j = 0; j < EDGES; j++) {
+                    word_t a = edges[i], y = edges[j], b = edges[(i + j) % EDGES];
+                    sm_ref_t want = sm_ref(ops[o], a, b, y);
+
+                    /* The kernels on their own */
+                    sm_ref_t got = { a, b, false, false };
+                    word_t q, r;
+                    switch (ops[o]) {
+                        case OP_ADD: got.a = from_signed(sm_sum(a, y)); got.ovf = sm_overflow(sm_sum(a, y)); break;
+                        case OP_SUB: got.a = from_signed(sm_sum(a, y ^ SIGN_BIT)); got.ovf = sm_overflow(sm_sum(a, y ^ SIGN_BIT)); break;
+                        case OP_SKG: got.skip = sm_greater(a, y); break;
+                        case OP_MPY: sm_multiply(b, y, &got.a, &got.b); break;
+                        default:
+                            if (sm_divide(a, b, y, &q, &r)) {
+                                got.a = r;
+                                got.b = q;
+                            } else {
+                                got.ovf = true;
+                            }
+                    }
+                    kernel_bad += got.a != want.a || got.b != want.b || got.ovf != want.ovf || got.skip != want.skip;
+
+                    /* ... and as the engine runs them */
+                    cpu.A = a;
+                    cpu.B = b;
+                    cpu.overflow = false;
+                    cpu.halted = false;
+                    cpu.PC = 0;
+                    ddp24_write(&cpu, 0100, y);
+                    ddp24_run(&cpu, 0);
+                    engine_bad += cpu.A != want.a || cpu.B != want.b || cpu.overflow != want.ovf ||
+                                  cpu.PC != (want.skip ? 2u : 1u);
+                }
+            }
+        }
+
+        if (kernel_bad == 0 && engine_bad == 0) {
+            printf("PASS: Sign-magnitude edges\n");
+            passed++;
+        } else {
+            printf("FAIL: Sign-magnitude edges (%d kernel, %d engine mismatches)\n", kernel_bad, engine_bad);
+            failed++;
+        }
+    }
+
+    /* Test 29: recursion past the shadow stack returns in the right frames */
+    {
+        enum { EXTRA = 10, N = DDP24_CALLS_DEPTH + EXTRA - 1 };
+        ddp24_calls_t *calls = ddp24_calls_create();
+        init_cpu(&cpu, engine);
+        load_recursion(&cpu, N);
+        ddp24_calls_attach(&cpu, calls);
+        ddp24_run(&cpu, 0);
+        int depth = ddp24_calls_depth(calls);
+        ddp24_calls_attach(&cpu, NULL);
+
+        ddp24_routine_t r = { 0 };
+        uint64_t around = ddp24_timing_ddp24.op[OP_JSL] + ddp24_timing_ddp24.op[OP_HLT];
+        if (ddp24_calls_routine(calls, 0100, &r) && cpu.halted && cpu.PC == 1 && depth == 0 &&
+            r.calls == DDP24_CALLS_DEPTH && r.inclusive == cpu.cycles - around) {
+            printf("PASS: Deep recursion\n");
+            passed++;
+        } else {
+            printf("FAIL: Deep recursion (PC %o, depth %d, %llu calls, %llu of %llu cycles)\n", cpu.PC, depth,
+                   (unsigned long long)r.calls, (unsigned long long)r.inclusive,
+                   (unsigned long long)(cpu.cycles - around));
+            failed++;
+        }
+        ddp24_calls_free(calls);
+    }
+
+    ddp24_release(&cpu);
+    printf("\n=== Results: %d passed, %d failed ===\n", passed, failed);
+    return failed;
+}
+
+/* Fleet lanes must match the same program run on its own */
+static int run_fleet_tests(void) {
+    static ddp24_t cpu, lane;
+    int passed = 0;
+    int failed = 0;
+    const int lanes = 37;   /* Not a multiple of the SIMD width */
+    const uint64_t budgets[2] = { 0, 700 };
+
+    printf("=== DDP-24 Fleet Tests (%s kernels) ===\n\n", ddp24_fleet_kernels());
+
+    for (int t = 0; t < 2; t++) {
+        ddp24_fleet_t *fleet = ddp24_fleet_create(lanes);
+        int mismatches = 0;
+
+        ddp24_init(&cpu);
+        cpu.PC = 0x10;
+        ddp24_write(&cpu, 0x10, (OP_LDB << OP_SHIFT) | 0x102);  /* LDB 102 */
+        ddp24_write(&cpu, 0x11, (OP_MPY << OP_SHIFT) | 0x100);  /* MPY 100 */
+        ddp24_write(&cpu, 0x12, (OP_IAB << OP_SHIFT));          /* IAB */
+        ddp24_write(&cpu, 0x13, (OP_ADD << OP_SHIFT) | 0x103);  /* ADD 103 */
+        ddp24_write(&cpu, 0x14, (OP_STA << OP_SHIFT) | 0x103);  /* STA 103 */
+        ddp24_write(&cpu, 0x15, (OP_LDA << OP_SHIFT) | 0x100);  /* LDA 100 */
+        ddp24_write(&cpu, 0x16, (OP_SUB << OP_SHIFT) | 0x101);  /* SUB 101 */
+        ddp24_write(&cpu, 0x17, (OP_STA << OP_SHIFT) | 0x100);  /* STA 100 */
+        ddp24_write(&cpu, 0x18, (OP_JNZ << OP_SHIFT) | 0x010);  /* JNZ 10 */
+        ddp24_write(&cpu, 0x19, (OP_HLT << OP_SHIFT));
+        ddp24_write(&cpu, 0x101, 1);
+        ddp24_fleet_broadcast(fleet, &cpu);
+        ddp24_image_t *image = ddp24_image_create(&cpu);
+
+        /* Different inputs per lane, so lanes leave the loop at different times */
+        for (int i = 0; i < lanes; i++) {
+            ddp24_fleet_write(fleet, i, 0x100, 5 + i * 3);
+            ddp24_fleet_write(fleet, i, 0x102, (i & 1) ? (SIGN_BIT | (word_t)i) : (word_t)i);
+        }
+
+        ddp24_fleet_run(fleet, budgets[t]);
+
+        for (int i = 0; i < lanes; i++) {
+            ddp24_init_image(&lane, image);
+            lane.PC = cpu.PC;
+            ddp24_write(&lane, 0x100, 5 + i * 3);
+            ddp24_write(&lane, 0x102, (i & 1) ? (SIGN_BIT | (word_t)i) : (word_t)i);
+            ddp24_run(&lane, (int)budgets[t]);
+
+            if (fleet->A[i] != lane.A || fleet->B[i] != lane.B || fleet->PC[i] != lane.PC ||
+                fleet->cycles[i] != lane.cycles || (fleet->overflow[i] != 0) != lane.overflow ||
+                ddp24_fleet_read(fleet, i, 0x103) != ddp24_read(&lane, 0x103)) {
+                mismatches++;
+            }
+            ddp24_release(&lane);
+        }
+        ddp24_image_release(image);
+        ddp24_release(&cpu);
+        ddp24_fleet_destroy(fleet);
+
+        if (mismatches == 0) {
+            printf("PASS: Fleet lockstep (%s)\n", budgets[t] ? "cycle budget" : "to halt");
+            passed++;
+        } else {
+            printf("FAIL: Fleet lockstep (%d of %d lanes differ)\n", mismatches, lanes);
+            failed++;
+        }
+    }
+
+    printf("\n=== Results: %d passed, %d failed ===\n", passed, failed);
+    return failed;
+}
+
+/* Batch jobs must match the same job run on its own */
+static int run_batch_tests(void) {
+    ddp24_t cpu;
+    int passed = 0;
+    int failed = 0;
+    enum { JOBS = 40 };
+    ddp24_job_t jobs[JOBS];
+
+    printf("=== DDP-24 Batch Tests ===\n\n");
+
+    ddp24_init(&cpu);
+    ddp24_write(&cpu, 0, (OP_LDA << OP_SHIFT) | 0x100);  /* LDA 100 */
+    ddp24_write(&cpu, 1, (OP_SUB << OP_SHIFT) | 0x101);  /* SUB 101 */
+    ddp24_write(&cpu, 2, (OP_STA << OP_SHIFT) | 0x100);  /* STA 100 */
+    ddp24_write(&cpu, 3, (OP_JNZ << OP_SHIFT));          /* JNZ 0 */
+    ddp24_write(&cpu, 4, (OP_HLT << OP_SHIFT));
+    ddp24_write(&cpu, 0x101, 1);
+    ddp24_image_t *image = ddp24_image_create(&cpu);
+    ddp24_release(&cpu);
+
+    /* Counters spread over two orders of magnitude; every third job
+     * runs out of budget first */
+    ddp24_poke_t pokes[JOBS];
+    memset(jobs, 0, sizeof(jobs));
+    for (int i = 0; i < JOBS; i++) {
+        pokes[i].addr = 0x100;
+        pokes[i].value = (i % 7 == 0) ? 2000 + i : 10 + i;
+        jobs[i].image = ddp24_image_retain(image);
+        jobs[i].pokes = &pokes[i];
+        jobs[i].npokes = 1;
+        jobs[i].budget = (i % 3 == 0) ? 1000 : 0;
+    }
+
+    ddp24_batch_run(jobs, JOBS, 4, DDP24_ENGINE_SWITCH);
+
+    int mismatches = 0;
+    for (int i = 0; i < JOBS; i++) {
+        ddp24_init_image(&cpu, image);
+        ddp24_write(&cpu, 0x100, pokes[i].value);
+        ddp24_run(&cpu, (int)jobs[i].budget);
+        if (jobs[i].result.A != cpu.A || jobs[i].result.PC != cpu.PC ||
+            jobs[i].result.cycles != cpu.cycles || jobs[i].result.stop != (cpu.halted ? DDP24_STOP_HALTED : DDP24_STOP_BUDGET) ||
+            jobs[i].result.pages != 1) {
+            mismatches++;
+        }
+        ddp24_release(&cpu);
+        ddp24_image_release(jobs[i].image);
+    }
+    ddp24_image_release(image);
+
+    if (mismatches == 0) {
+        printf("PASS: Batch jobs\n");
+        passed++;
+    } else {
+        printf("FAIL: Batch jobs (%d of %d differ)\n", mismatches, JOBS);
+        failed++;
+    }
+
+    /* Job lists, good and bad, without a word on stdio */
+    char program[64], list[64];
+    snprintf(program, sizeof(program), "/tmp/ddp24-test-%ld.bin", (long)getpid());
+    snprintf(list, sizeof(list), "/tmp/ddp24-test-%ld.jobs", (long)getpid());
+    static const uint8_t hlt[3] = { 0, 0, 0 };
+    FILE *f = fopen(program, "wb");
+    if (f) {
+        fwrite(hlt, 1, sizeof(hlt), f);
+        fclose(f);
+    }
+    static const char *const lists[] = { "# jobs\n%s 100 A=7 @10=5\n\n", "%s 100\n\n%s 50 Q=1\n", "%s\n" };
+    int got[3];
+    ddp24_error_t errs[4];
+    int lines[4];
+    ddp24_job_t *parsed = NULL;
+    for (int i = 0; i < 3; i++) {
+        f = fopen(list, "w");
+        if (f) {
+            fprintf(f, lists[i], program, program);
+            fclose(f);
+        }
+        got[i] = ddp24_batch_parse(list, &parsed, &errs[i], &lines[i]);
+        if (got[i] > 0) {
+            bool fields = parsed[0].budget == 100 && parsed[0].npokes == 1;
+            ddp24_batch_free(parsed, got[i]);
+            got[i] = fields ? got[i] : -2;
+        }
+    }
+    remove(list);
+    int none = ddp24_batch_parse(list, &parsed, &errs[3], &lines[3]);
+    remove(program);
+    if (got[0] == 1 && got[1] == -1 && errs[1] == DDP24_ERR_FORMAT && lines[1] == 3 &&
+        got[2] == -1 && errs[2] == DDP24_ERR_FORMAT && lines[2] == 1 &&
+        none == -1 && errs[3] == DDP24_ERR_IO && lines[3] == 0) {
+        printf("PASS: Job lists\n");
+        passed++;
+    } else {
+        printf("FAIL: Job lists (%d, %d at %d, %d at %d, %d)\n", got[0], got[1], lines[1], got[2], lines[2], none);
+        failed++;
+    }
+
+    printf("\n=== Results: %d passed, %d failed ===\n", passed, failed);
+    return failed;
+}
+
+/* A trace read back must match the same program stepped by hand. Long
+ * enough to wrap the ring several times. */
+static int run_trace_tests(void) {
+    ddp24_t cpu, ref;
+    int passed = 0;
+    int failed = 0;
+
+    printf("=== DDP-24 Trace Tests ===\n\n");
+
+    ddp24_init(&cpu);
+    ddp24_write(&cpu, 0, (OP_LDA << OP_SHIFT) | 0x100);                  /* LDA 100 */
+    ddp24_write(&cpu, 1, (OP_SUB << OP_SHIFT) | 0x101);                  /* SUB 101 */
+    ddp24_write(&cpu, 2, (OP_STA << OP_SHIFT) | 0x100);                  /* STA 100 */
+    ddp24_write(&cpu, 3, (OP_LDB << OP_SHIFT) | INDIRECT_BIT | 0x102);   /* LDB* 102 */
+    ddp24_write(&cpu, 4, (OP_MPY << OP_SHIFT) | 0x100);                  /* MPY 100 */
+    ddp24_write(&cpu, 5, (OP_LDA << OP_SHIFT) | 0x100);                  /* LDA 100 */
+    ddp24_write(&cpu, 6, (OP_JNZ << OP_SHIFT));                          /* JNZ 0 */
+    ddp24_write(&cpu, 7, (OP_HLT << OP_SHIFT));
+    ddp24_write(&cpu, 0x100, 40000);
+    ddp24_write(&cpu, 0x101, 1);
+    ddp24_write(&cpu, 0x102, 0x100);
+    ddp24_image_t *image = ddp24_image_create(&cpu);
+    ddp24_release(&cpu);
+
+    FILE *f = tmpfile();
+    ddp24_trace_t *trace = f ? ddp24_trace_start(f) : NULL;
+    uint64_t records = 0;
+    int bad = -1;
+    long bytes = 0;
+    if (trace) {
+        ddp24_init_image(&cpu, image);
+        ddp24_trace_attach(&cpu, trace);
+        ddp24_run(&cpu, 0);
+        ddp24_trace_attach(&cpu, NULL);
+        records = ddp24_trace_records(trace);
+        bad = ddp24_trace_finish(trace) < 0 ? 1 : 0;
+        bytes = ftell(f);
+        ddp24_release(&cpu);
+    }
+
+    if (bad == 0) {
+        rewind(f);
+        ddp24_trace_reader_t *reader = ddp24_trace_reader(f);
+        ddp24_trace_rec_t rec;
+        uint64_t n = 0;
+        ddp24_init_image(&ref, image);
+        while (reader && ddp24_trace_next(reader, &rec) > 0) {
+            word_t pc = ref.PC;
+            word_t instr = ddp24_read(&ref, pc);
+            int cycles = ddp24_step(&ref);
+            if (rec.pc != pc || rec.instr != instr || rec.A != ref.A || rec.B != ref.B ||
+                rec.cycles != (uint32_t)cycles) {
+                bad++;
+            }
+            n++;
+        }
+        if (!reader || n != records || !ref.halted) {
+            bad++;
+        }
+        ddp24_trace_reader_free(reader);
+        ddp24_release(&ref);
+    }
+    if (f) {
+        fclose(f);
+    }
+    ddp24_image_release(image);
+
+    if (bad == 0 && records == 7 * 40000 + 1) {
+        printf("PASS: Trace round trip (%.2f bytes per instruction)\n", (double)bytes / records);
+        passed++;
+    } else {
+        printf("FAIL: Trace round trip (%llu records, %d mismatches)\n",
+               (unsigned long long)records, bad);
+        failed++;
+    }
+
+    printf("\n=== Results: %d passed, %d failed ===\n", passed, failed);
+    return failed;
+}
+
+static double wall_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Samples land on the period's grid, in memory, shared and over UDP */
+static int run_telemetry_tests(void) {
+    static ddp24_t cpu;
+    int passed = 0;
+    int failed = 0;
+
+    printf("=== DDP-24 Telemetry Tests ===\n\n");
+
+    /* Count in 0200 forever, with fixed values in 0300-0303 */
+    ddp24_telemetry_t *t = ddp24_telemetry_create(1000);
+    ddp24_init(&cpu);
+    ddp24_write(&cpu, 0, INSN(OP_LDA, 0, 0200));
+    ddp24_write(&cpu, 1, INSN(OP_ADD, 0, 0201));
+    ddp24_write(&cpu, 2, INSN(OP_STA, 0, 0200));
+    ddp24_write(&cpu, 3, INSN(OP_JMP, 0, 0));
+    ddp24_write(&cpu, 0201, 1);
+    for (int i = 0; i < 4; i++) {
+        ddp24_write(&cpu, 0300 + i, 0x10101 * (i + 1));
+    }
+    ddp24_telemetry_watch(t, 0200, 1);
+    ddp24_telemetry_watch(t, 0300, 4);
+
+    ddp24_sample_t s = { 0 };
+    word_t cells[8] = { 0 };
+    bool none = !ddp24_telemetry_read(ddp24_telemetry_segment(t), &s, cells, 8);
+    ddp24_telemetry_attach(&cpu, t);
+    ddp24_run_for(&cpu, 10500);
+    bool got = ddp24_telemetry_read(ddp24_telemetry_segment(t), &s, cells, 8);
+    bool fixed = cells[1] == 0x10101 && cells[2] == 0x20202 && cells[3] == 0x30303 && cells[4] == 0x40404;
+    if (none && got && ddp24_telemetry_samples(t) == 10 && s.seq == 9 && s.count == 5 &&
+        s.cycles >= 10000 && s.cycles < 10000 + 30 && s.PC <= 3 &&
+        cells[0] > 0 && cells[0] < ddp24_read(&cpu, 0200) && fixed) {
+        printf("PASS: Sampled in memory\n");
+        passed++;
+    } else {
+        printf("FAIL: Sampled in memory (%llu samples, seq %llu at %llu cycles, count %u)\n",
+               (unsigned long long)ddp24_telemetry_samples(t), (unsigned long long)s.seq,
+               (unsigned long long)s.cycles, s.count);
+        failed++;
+    }
+
+    /* Another reader of the shared segment sees the same */
+    char name[64];
+    snprintf(name, sizeof(name), "/ddp24-test-%ld", (long)getpid());
+    const ddp24_telemetry_segment_t *seg = NULL;
+    ddp24_sample_t shared = { 0 };
+    word_t shared_cells[8] = { 0 };
+    if (ddp24_telemetry_share(t, name) && (seg = ddp24_telemetry_open(name))) {
+        ddp24_run_for(&cpu, 1000);
+        got = ddp24_telemetry_read(seg, &shared, shared_cells, 8) &&
+              ddp24_telemetry_read(ddp24_telemetry_segment(t), &s, cells, 8);
+    } else {
+        got = false;
+    }
+    if (got && shared.seq == 10 && memcmp(&shared, &s, sizeof(s)) == 0 &&
+        memcmp(shared_cells, cells, sizeof(cells)) == 0) {
+        printf("PASS: Shared memory\n");
+        passed++;
+    } else {
+        printf("FAIL: Shared memory (%s, seq %llu)\n", seg ? "opened" : "not opened",
+               (unsigned long long)shared.seq);
+        failed++;
+    }
+    ddp24_telemetry_close(seg);
+
+    /* Datagrams to a socket on the loopback */
+    int rx = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = { 0 };
+    socklen_t len = sizeof(addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int datagrams = 0, bad = 0;
+    if (rx >= 0 && bind(rx, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+        getsockname(rx, (struct sockaddr *)&addr, &len) == 0 &&
+        ddp24_telemetry_send(t, "127.0.0.1", ntohs(addr.sin_port))) {
+        ddp24_run_for(&cpu, 3000);
+        uint8_t packet[256];
+        ssize_t n;
+        while ((n = recv(rx, packet, sizeof(packet), MSG_DONTWAIT)) > 0) {
+            uint32_t magic = packet[0] | packet[1] << 8 | packet[2] << 16 | (uint32_t)packet[3] << 24;
+            uint32_t cell4 = packet[68] | packet[69] << 8 | packet[70] << 16 | (uint32_t)packet[71] << 24;
+            bad += n != 52 + 5 * 4 || magic != DDP24_TELEMETRY_MAGIC || packet[48] != 5 ||
+                   packet[4] != 11 + datagrams || cell4 != 0x40404;
+            datagrams++;
+        }
+    }
+    if (datagrams == 3 && bad == 0) {
+        printf("PASS: UDP\n");
+        passed++;
+    } else {
+        printf("FAIL: UDP (%d datagrams, %d bad)\n", datagrams, bad);
+        failed++;
+    }
+    if (rx >= 0) {
+        close(rx);
+    }
+
+    ddp24_telemetry_detach(&cpu, t);
+    ddp24_release(&cpu);
+    ddp24_telemetry_free(t);
+
+    printf("\n=== Results: %d passed, %d failed ===\n", passed, failed);
+    return failed;
+}
+
+/* The isqrt routine again, as source, with a caller */
+static const char isqrt_source[] =
+    "; Integer square root of A\n"
+    "count   = 3\n"
+    "        .org 0100\n"
+    "        .entry main\n"
+    "main:   lda square\n"
+    "        jsl isqrt\n"
+    "        sta result\n"
+    "        lda table+1,2\n"
+    "        hlt\n"
+    "        .org 0300\n"
+    "isqrt:  .word 0             ; link\n"
+    "        sta n\n"
+    "        lda one\n"
+    "        sta odd\n"
+    "        lda zero\n"
+    "        sta r\n"
+    "loop:   lda n\n"
+    "        sub odd\n"
+    "        jmi done\n"
+    "        sta n\n"
+    "        lda odd\n"
+    "        add two\n"
+    "        sta odd\n"
+    "        lda r\n"
+    "        ADD one\n"
+    "        sta r\n"
+    "        jmp loop\n"
+    "done:   lda r\n"
+    "        jmp* isqrt\n"
+    "        .org isqrt + 030\n"
+    "        .data\n"
+    "n:      .space count\n"
+    "odd     = n + 1\n"
+    "r       = n + 2\n"
+    "        .const\n"
+    "one:    .word 1\n"
+    "two:    .word 2\n"
+    "zero:   .word 0\n"
+    "        .org 0200\n"
+    "        .data\n"
+    "square: .word 144\n"
+    "result: .word -1\n"
+    "table:  .word -5, 0x10, count, .\n";
+
+/* Hands out new blocks but never grows one */
+static void *no_grow_alloc(void *ctx, void *ptr, size_t size) {
+    (void)ctx;
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    return ptr ? NULL : malloc(size);
+}
+
+static int run_asm_tests(void) {
+    static ddp24_t cpu;
+    int passed = 0;
+    int failed = 0;
+
+    printf("=== DDP-24 Assembler Tests ===\n\n");
+
+    /* Words, sections and labels */
+    ddp24_asm_error_t err = { 0, "" };
+    ddp24_program_t *p = ddp24_assemble(isqrt_source, &err);
+    bool same = p != NULL;
+    for (int i = 0; same && i < ISQRT_LENGTH; i++) {
+        same = p->word[ISQRT_LINK + 1 + i] == isqrt_code[i];
+    }
+    word_t loop = 0;
+    bool words = same && p->word[0100] == INSN(OP_LDA, 0, 0200) && p->word[0101] == INSN(OP_JSL, 0, 0300) &&
+                 p->word[0103] == INSN(OP_LDA, 2, 0203) && p->word[0201] == (SIGN_BIT | 1) &&
+                 p->word[0202] == (SIGN_BIT | 5) && p->word[0204] == 3 && p->word[0205] == 0205;
+    bool map = p && p->entry == 0100 && p->nsections == 5 && p->nsymbols == 11 &&
+               p->section[1].start == 0200 && p->section[1].count == 6 &&
+               p->section[1].flags == DDP24_SECTION_DATA &&
+               p->section[2].start == 0300 && p->section[2].count == ISQRT_LENGTH + 1 &&
+               p->section[3].count == 3 && p->section[4].flags == (DDP24_SECTION_DATA | DDP24_SECTION_CONST) &&
+               ddp24_program_lookup(p, "loop", &loop) && loop == 0306 && !ddp24_program_lookup(p, "odd", &loop);
+    if (words && map) {
+        printf("PASS: Assembled\n");
+        passed++;
+    } else {
+        printf("FAIL: Assembled (%s, words %d, map %d)\n", p ? "ok" : err.message, words, map);
+        failed++;
+    }
+
+    /* Errors name their line */
+    static const struct {
+        const char *source;
+        int line;
+        const char *message;
+    } bad[] = {
+        { "        lda 1\n        frob 2\n", 2, "unknown instruction frob" },
+        { "        jmp nowhere\n", 1, "nowhere is not defined" },
+        { "        .org 077777\n        nop\n        nop\n", 3, "past the top of memory" },
+        { "a:      nop\n        .org a\n        nop\n", 3, "00000 assembled twice" },
+        { "\n        lda 0100,4\n", 2, "no index register 4" },
+        { "        .space n\nn = 1\n", 1, "n is not defined yet" },
+    };
+    int wrong = 0;
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        ddp24_asm_error_t e = { 0, "" };
+        ddp24_program_t *q = ddp24_assemble(bad[i].source, &e);
+        if (q || e.line != bad[i].line || strcmp(e.message, bad[i].message) != 0) {
+            printf("  case %zu: line %d, %s\n", i, e.line, e.message);
+            wrong++;
+        }
+        ddp24_program_free(q);
+    }
+    if (!wrong) {
+        printf("PASS: Assembly errors\n");
+        passed++;
+    } else {
+        printf("FAIL: Assembly errors\n");
+        failed++;
+    }
+
+    /* A source file that cannot be read whole is not assembled in part */
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/ddp24-test-%ld.s", (long)getpid());
+    FILE *f = fopen(path, "w");
+    for (int i = 0; f && i < 1000; i++) {
+        fputs("        nop\n", f);
+    }
+    ddp24_program_t *partial = NULL;
+    err = (ddp24_asm_error_t){ 0, "" };
+    if (f) {
+        fclose(f);
+        ddp24_set_allocator(no_grow_alloc, NULL);
+        partial = ddp24_assemble_file(path, &err);
+        ddp24_set_allocator(NULL, NULL);
+    }
+    remove(path);
+    if (f && !partial && strcmp(err.message, "out of memory") == 0) {
+        printf("PASS: Source out of memory\n");
+        passed++;
+    } else {
+        printf("FAIL: Source out of memory (%s)\n", partial ? "assembled" : err.message);
+        failed++;
+    }
+    ddp24_program_free(partial);
+
+    /* Saved and loaded back, by itself and as an ordinary image */
+    snprintf(path, sizeof(path), "/tmp/ddp24-test-%ld.sym", (long)getpid());
+    ddp24_program_t *back = NULL;
+    int loaded = -1;
+    char names[4][DDP24_SYMBOL_MAX + 16];
+    if (p && ddp24_program_save(p, path) == 0 && (back = ddp24_program_load(path))) {
+        ddp24_init(&cpu);
+        cpu.PC = 07000;
+        loaded = ddp24_load_image(&cpu, path, 01000);
+        ddp24_program_name(back, 0301, names[0], sizeof(names[0]));
+        ddp24_program_name(back, 0306, names[1], sizeof(names[1]));
+        ddp24_program_name(back, 0312, names[2], sizeof(names[2]));
+        ddp24_program_name(back, 0250, names[3], sizeof(names[3]));
+        ddp24_release(&cpu);
+    }
+    remove(path);
+    bool round = back && back->entry == p->entry && back->nsections == p->nsections &&
+                 back->nsymbols == p->nsymbols &&
+                 memcmp(back->section, p->section, p->nsections * sizeof(ddp24_section_t)) == 0 &&
+                 memcmp(back->symbol, p->symbol, p->nsymbols * sizeof(ddp24_symbol_t)) == 0 &&
+                 memcmp(back->word, p->word, sizeof(p->word)) == 0;
+    if (round && loaded == 5 + 6 + ISQRT_LENGTH + 1 + 3 + 3 && cpu.PC == 0100 &&
+        strcmp(names[0], "isqrt+1") == 0 && strcmp(names[1], "loop") == 0 &&
+        strcmp(names[2], "loop+4") == 0 && strcmp(names[3], "00250") == 0) {
+        printf("PASS: Symbolic images\n");
+        passed++;
+    } else {
+        printf("FAIL: Symbolic images (round trip %d, %d words, names %s %s %s %s)\n", round, loaded,
+               names[0], names[1], names[2], names[3]);
+        failed++;
+    }
+    ddp24_program_free(back);
+
+    /* A shared image predecodes the code only, and still runs */
+    ddp24_image_t *image = p ? ddp24_program_image(p) : NULL;
+    bool lazy = false;
+    if (image) {
+        ddp24_init_image(&cpu, image);
+        ddp24_image_release(image);
+        lazy = (cpu.page[0]->decoded[0306].flags & DDP24_DEC_VALID) &&
+               !(cpu.page[0]->decoded[0200].flags & DDP24_DEC_VALID) &&
+               !(cpu.page[0]->decoded[0333].flags & DDP24_DEC_VALID);
+        cpu.PC = p->entry;
+        ddp24_run(&cpu, 0);
+    }
+    if (lazy && cpu.halted && ddp24_read(&cpu, 0201) == 12 && cpu.A == 0x10) {
+        printf("PASS: Program image\n");
+        passed++;
+    } else {
+        printf("FAIL: Program image (lazy %d, result %o)\n", lazy, ddp24_read(&cpu, 0201));
+        failed++;
+    }
+    if (image) {
+        ddp24_release(&cpu);
+    }
+    ddp24_program_free(p);
+
+    printf("\n=== Results: %d passed, %d failed ===\n", passed, failed);
+    return failed;
+}
+
+/* Every engine against ddp24_step on random programs */
+static int run_fuzz_tests(void) {
+    int passed = 0;
+    int failed = 0;
+
+    printf("=== DDP-24 Fuzz Tests ===\n\n");
+
+    /* A case number always makes the same case */
+    ddp24_fuzz_config_t config = { .seed = 42, .cases = 200, .threads = 2, .length = 48 };
+    static ddp24_fuzz_case_t c1, c2, c3;
+    ddp24_fuzz_generate(&config, 99, &c1);
+    ddp24_fuzz_generate(&config, 99, &c2);
+    ddp24_fuzz_generate(&config, 100, &c3);
+    if (memcmp(&c1, &c2, sizeof(c1)) == 0 && memcmp(c1.word, c3.word, sizeof(c1.word)) != 0 &&
+        c1.length == 48 && c1.PC == c1.base && c1.budget > 0) {
+        printf("PASS: Generated cases\n");
+        passed++;
+    } else {
+        printf("FAIL: Generated cases\n");
+        failed++;
+    }
+
+    /* The engines and the fleet agree, on several threads */
+    static ddp24_fuzz_failure_t failure;
+    uint64_t ran = 0;
+    int found = ddp24_fuzz_run(&config, &failure, &ran);
+    if (found == 0 && ran == config.cases && ddp24_fuzz_check(&c1, 0, NULL) == 0) {
+        printf("PASS: Engines agree\n");
+        passed++;
+    } else {
+        printf("FAIL: Engines agree (%llu cases run)\n", (unsigned long long)ran);
+        if (found) {
+            ddp24_fuzz_print(stdout, &failure);
+        }
+        failed++;
+    }
+
+    /* A report assembles back into the case */
+    failure = (ddp24_fuzz_failure_t){ c1, DDP24_FUZZ_THREADED, "A", 1, 2 };
+    char *text = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&text, &size);
+    ddp24_program_t *p = NULL;
+    if (out) {
+        ddp24_fuzz_print(out, &failure);
+        fclose(out);
+        p = ddp24_assemble(text, NULL);
+    }
+    bool same = p && p->entry == c1.PC;
+    for (int i = 0; same && i < c1.length; i++) {
+        same = p->word[c1.base + i] == c1.word[i];
+    }
+    if (same && strstr(text, "threaded differs in A")) {
+        printf("PASS: Failure report\n");
+        passed++;
+    } else {
+        printf("FAIL: Failure report\n");
+        failed++;
+    }
+    ddp24_program_free(p);
+    free(text);
+
+    printf("\n=== Results: %d passed, %d failed ===\n", passed, failed);
+    return failed;
+}
+
+/* Paced runs must take as long as the real machine would have */
+static int run_pace_tests(void) {
+    static ddp24_t cpu;
+    int passed = 0;
+    int failed = 0;
+    const double speeds[2] = { 1.0, 2.0 };
+
+    printf("=== DDP-24 Pacing Tests ===\n\n");
+
+    for (int t = 0; t < 2; t++) {
+        ddp24_pace_stats_t stats = { 0 };
+        ddp24_init(&cpu);
+        ddp24_write(&cpu, 0, (OP_JMP << OP_SHIFT));     /* JMP 0 */
+
+        /* 20000 cycles is 10 ms at real time */
+        double start = wall_seconds();
+        ddp24_stop_t reason = ddp24_run_paced(&cpu, 20000, speeds[t], &stats);
+        double ms = (wall_seconds() - start) * 1e3;
+        double want = 10.0 / speeds[t];
+
+        if (reason == DDP24_STOP_BUDGET && cpu.cycles == 20000 && stats.bursts == 40 &&
+            ms >= want - 0.5 && ms < want + 50) {
+            printf("PASS: Paced at %gx (%.2f ms, %llu late)\n", speeds[t], ms,
+                   (unsigned long long)stats.misses);
+            passed++;
+        } else {
+            printf("FAIL: Paced at %gx (%s, %llu cycles, %llu bursts, %.2f ms)\n",
+                   speeds[t], ddp24_stop_name(reason), (unsigned long long)cpu.cycles,
+                   (unsigned long long)stats.bursts, ms);
+            failed++;
+        }
+        ddp24_release(&cpu);
+    }
+
+    printf("\n=== Results: %d passed, %d failed ===\n", passed, failed);
+    return failed;
+}
+
+/* A device whose input changes on every read and whose sense line
+ * flips on a timer that also raises and posts interrupts */
+typedef struct {
+    uint32_t seed;
+    bool ready;
+    int flips;
+} replay_dev_t;
+
+static word_t replay_input(ddp24_t *cpu, void *ctx, int function) {
+    replay_dev_t *dev = ctx;
+    (void)cpu;
+    (void)function;
+    dev->seed = dev->seed * 1103515245u + 12345u;
+    return dev->seed >> 8;
+}
+
+static bool replay_sense(ddp24_t *cpu, void *ctx, int function) {
+    (void)cpu;
+    (void)function;
+    return ((replay_dev_t *)ctx)->ready;
+}
+
+static void replay_flip(ddp24_t *cpu, void *arg) {
+    replay_dev_t *dev = arg;
+    dev->ready = !dev->ready;
+    if (++dev->flips % 3 == 0) {
+        ddp24_raise_interrupt(cpu, 2);
+    } else if (dev->flips % 5 == 0) {
+        ddp24_post_interrupt(cpu, 2);
+    }
+    ddp24_schedule(cpu, cpu->cycles + 700 + dev->flips % 7, replay_flip, dev);
+}
+
+/* Record a run, then replay every segment of it on worker threads */
+static int run_replay_tests(void) {
+    static ddp24_t cpu;
+    int passed = 0;
+    int failed = 0;
+    replay_dev_t dev = { 1, false, 0 };
+    ddp24_device_t device = { "replay", &dev, NULL, replay_input, NULL, replay_sense };
+    static const word_t program[][2] = {
+        { 0000, (OP_ITC << OP_SHIFT) | DDP24_ITC_ENABLE },
+        { 0001, (OP_SKS << OP_SHIFT) | 5 },             /* Wait for ready */
+        { 0002, (OP_JMP << OP_SHIFT) | 0001 },
+        { 0003, (OP_ITA << OP_SHIFT) | 5 },
+        { 0004, (OP_ADD << OP_SHIFT) | 0300 },
+        { 0005, (OP_STA << OP_SHIFT) | 0300 },
+        { 0006, (OP_XEC << OP_SHIFT) | 0020 },          /* Input from inside XEC */
+        { 0007, (OP_ERA << OP_SHIFT) | 0300 },
+        { 0010, (OP_STA << OP_SHIFT) | 0300 },
+        { 0011, (OP_JMP << OP_SHIFT) | 0001 },
+        { 0020, (OP_ITA << OP_SHIFT) | 5 },
+        { 0045, (OP_LDA << OP_SHIFT) | 0301 },          /* Line 2: count it */
+        { 0046, (OP_ADD << OP_SHIFT) | 0302 },
+        { 0047, (OP_STA << OP_SHIFT) | 0301 },
+        { 0050, (OP_ITC << OP_SHIFT) | DDP24_ITC_ENABLE },
+        { 0051, (OP_JMP << OP_SHIFT) | INDIRECT_BIT | 0044 },
+        { 0302, 1 },
+    };
+
+    printf("=== DDP-24 Replay Tests ===\n\n");
+
+    ddp24_init(&cpu);
+    ddp24_attach_device(&cpu, 5, &device);
+    for (size_t i = 0; i < sizeof(program) / sizeof(program[0]); i++) {
+        ddp24_write(&cpu, program[i][0], program[i][1]);
+    }
+    ddp24_schedule(&cpu, 500, replay_flip, &dev);
+
+    ddp24_recording_t *rec = ddp24_record_start(&cpu, 7000);
+    for (uint64_t t = 10000; t <= 200000; t += 10000) {
+        ddp24_run_until(&cpu, t);
+    }
+    bool recorded = rec && ddp24_record_stop(rec) && ddp24_recording_checkpoints(rec) > 20 &&
+                    ddp24_read(&cpu, 0301) != 0;
+    int last = rec ? ddp24_recording_checkpoints(rec) - 1 : 0;
+
+    for (int e = 0; e < 3; e++) {
+        ddp24_engine_t engine = (ddp24_engine_t)e;
+        if (!ddp24_engine_available(engine)) {
+            continue;
+        }
+        int bad = recorded ? ddp24_replay_verify(rec, 4, engine) : 0;
+        if (bad < 0) {
+            printf("PASS: %d segments replay on %s\n", last, ddp24_engine_name(engine));
+            passed++;
+        } else {
+            printf("FAIL: Segment %d replays differently on %s\n", bad, ddp24_engine_name(engine));
+            failed++;
+        }
+    }
+
+    /* The whole run from the start, and a replay knocked off course */
+    static ddp24_t replay;
+    ddp24_init(&replay);
+    bool whole = recorded && ddp24_replay_start(&replay, rec, 0);
+    if (whole) {
+        ddp24_run_until(&replay, ddp24_checkpoint_cycles(rec, last));
+        whole = ddp24_replay_matches(&replay, rec, last) && replay.A == cpu.A &&
+                ddp24_read(&replay, 0300) == ddp24_read(&cpu, 0300);
+    }
+    bool caught = recorded && ddp24_replay_start(&replay, rec, 3);
+    if (caught) {
+        ddp24_write(&replay, 0300, ddp24_read(&replay, 0300) ^ 1);
+        ddp24_run_until(&replay, ddp24_checkpoint_cycles(rec, 4));
+        caught = !ddp24_replay_matches(&replay, rec, 4);
+    }
+    ddp24_replay_finish(&replay);
+    ddp24_release(&replay);
+
+    if (whole && caught) {
+        printf("PASS: Replay from the start, and a divergence caught\n");
+        passed++;
+    } else {
+        printf("FAIL: Replay (recorded %d, whole %d, caught %d)\n", recorded, whole, caught);
+        failed++;
+    }
+
+    ddp24_recording_free(rec);
+    ddp24_release(&cpu);
+    printf("\n=== Results: %d passed, %d failed ===\n", passed, failed);
+    return failed;
+}
+
+/* Profile counts and the call tree for two nested subroutines */
+static int run_profile_tests(void) {
+    ddp24_t cpu;
+    int passed = 0;
+    int failed = 0;
+    char line[128];
+
+    printf("=== DDP-24 Profile Tests ===\n\n");
+
+    ddp24_init(&cpu);
+    cpu.PC = 0x10;
+    ddp24_write(&cpu, 0x10, (OP_JSL << OP_SHIFT) | 0x200);                 /* JSL 200 */
+    ddp24_write(&cpu, 0x11, (OP_LDA << OP_SHIFT) | 0x100);                 /* LDA 100 */
+    ddp24_write(&cpu, 0x12, (OP_SUB << OP_SHIFT) | 0x101);                 /* SUB 101 */
+    ddp24_write(&cpu, 0x13, (OP_STA << OP_SHIFT) | 0x100);                 /* STA 100 */
+    ddp24_write(&cpu, 0x14, (OP_JNZ << OP_SHIFT) | 0x010);                 /* JNZ 10 */
+    ddp24_write(&cpu, 0x15, (OP_HLT << OP_SHIFT));
+    ddp24_write(&cpu, 0x201, (OP_JSL << OP_SHIFT) | 0x300);                /* JSL 300 */
+    ddp24_write(&cpu, 0x202, (OP_JMP << OP_SHIFT) | INDIRECT_BIT | 0x200); /* JMP* 200 */
+    ddp24_write(&cpu, 0x301, (OP_NOP << OP_SHIFT));
+    ddp24_write(&cpu, 0x302, (OP_JMP << OP_SHIFT) | INDIRECT_BIT | 0x300); /* JMP* 300 */
+    ddp24_write(&cpu, 0x100, 3);
+    ddp24_write(&cpu, 0x101, 1);
+
+    ddp24_profile_t *prof = ddp24_profile_create();
+    ddp24_profile_attach(&cpu, prof);
+    ddp24_run(&cpu, 0);
+
+    if (prof->instructions == 3 * 9 + 1 && prof->cycles == cpu.cycles &&
+        prof->op_count[OP_JSL] == 6 && prof->hits[0x301] == 3 &&
+        prof->pc_cycles[0x202] == 15) {
+        printf("PASS: Profile counts\n");
+        passed++;
+    } else {
+        printf("FAIL: Profile counts (%llu instructions, %llu JSL)\n",
+               (unsigned long long)prof->instructions, (unsigned long long)prof->op_count[OP_JSL]);
+        failed++;
+    }
+
+    /* Self cycles per stack, adding up to the whole run */
+    FILE *f = tmpfile();
+    uint64_t total = 0, inner = 0;
+    if (f && ddp24_profile_write_folded(prof, f) == 0) {
+        rewind(f);
+        while (fgets(line, sizeof(line), f)) {
+            char *space = strrchr(line, ' ');
+            unsigned long long n = space ? strtoull(space + 1, NULL, 10) : 0;
+            total += n;
+            if (space && strncmp(line, "root;sub_01000;sub_01400 ", (size_t)(space - line) + 1) == 0) {
+                inner = n;
+            }
+        }
+    }
+    if (f) {
+        fclose(f);
+    }
+    if (total == cpu.cycles && inner == 3 * (5 + 5)) {
+        printf("PASS: Profile folded stacks\n");
+        passed++;
+    } else {
+        printf("FAIL: Profile folded stacks (total %llu, inner %llu)\n",
+               (unsigned long long)total, (unsigned long long)inner);
+        failed++;
+    }
+
+    ddp24_profile_free(prof);
+    ddp24_release(&cpu);
+
+    /* A hooked JSL is a call and its return: the stack does not grow
+     * with each one */
+    ddp24_hle_t *hle = ddp24_hle_create();
+    ddp24_init(&cpu);
+    load_isqrt(&cpu);
+    ddp24_hle_add(hle, ISQRT_LINK, ISQRT_LENGTH,
+                  ddp24_hle_checksum(&cpu, ISQRT_LINK + 1, ISQRT_LENGTH), native_isqrt, NULL);
+    ddp24_hle_attach(&cpu, hle);
+    for (word_t a = 0; a < 4; a++) {
+        ddp24_write(&cpu, a, INSN(OP_JSL, 0, ISQRT_LINK));
+    }
+    ddp24_write(&cpu, 4, (OP_HLT << OP_SHIFT));
+    cpu.A = 65536;
+    prof = ddp24_profile_create();
+    ddp24_profile_attach(&cpu, prof);
+    ddp24_run(&cpu, 0);
+
+    f = tmpfile();
+    total = 0;
+    uint64_t routine = 0;
+    int stacks = 0, strays = 0;
+    if (f && ddp24_profile_write_folded(prof, f) == 0) {
+        rewind(f);
+        while (fgets(line, sizeof(line), f)) {
+            char *space = strrchr(line, ' ');
+            unsigned long long n = space ? strtoull(space + 1, NULL, 10) : 0;
+            total += n;
+            stacks++;
+            if (space && strncmp(line, "root;sub_00300 ", (size_t)(space - line) + 1) == 0) {
+                routine = n;
+            } else if (!space || strncmp(line, "root ", (size_t)(space - line) + 1) != 0) {
+                strays++;
+            }
+        }
+    }
+    if (f) {
+        fclose(f);
+    }
+    if (ddp24_hle_hits(hle) == 4 && cpu.A == 2 && total == cpu.cycles && stacks == 2 &&
+        strays == 0 && routine > 0) {
+        printf("PASS: Profile native calls\n");
+        passed++;
+    } else {
+        printf("FAIL: Profile native calls (%llu hits, %d stacks, %d strays, total %llu)\n",
+               (unsigned long long)ddp24_hle_hits(hle), stacks, strays, (unsigned long long)total);
+        failed++;
+    }
+
+    ddp24_profile_free(prof);
+    ddp24_release(&cpu);
+    ddp24_hle_free(hle);
+
+    /* Returns from calls too deep to record leave the caller's frame be */
+    {
+        enum { EXTRA = 10, N = DDP24_PROFILE_DEPTH + EXTRA - 1 };
+        ddp24_init(&cpu);
+        load_recursion(&cpu, N);
+        prof = ddp24_profile_create();
+        ddp24_profile_attach(&cpu, prof);
+        ddp24_run(&cpu, 0);
+
+        uint64_t around = ddp24_timing_ddp24.op[OP_JSL] + ddp24_timing_ddp24.op[OP_HLT];
+        if (cpu.halted && cpu.PC == 1 && prof->dropped == EXTRA && prof->overflow == 0 &&
+            prof->current == 0 && prof->node[0].cycles == around) {
+            printf("PASS: Profile deep recursion\n");
+            passed++;
+        } else {
+            printf("FAIL: Profile deep recursion (%llu dropped, frame %d, root %llu cycles)\n",
+                   (unsigned long long)prof->dropped, prof->current,
+                   (unsigned long long)prof->node[0].cycles);
+            failed++;
+        }
+        ddp24_profile_free(prof);
+        ddp24_release(&cpu);
+    }
+
+    printf("\n=== Results: %d passed, %d failed ===\n", passed, failed);
+    return failed;
+}
+
+/* Counts the blocks the library holds through a host allocator */
+static void *counting_alloc(void *ctx, void *ptr, size_t size) {
+    long *live = ctx;
+    if (size == 0) {
+        *live -= ptr != NULL;
+        free(ptr);
+        return NULL;
+    }
+    void *p = realloc(ptr, size);
+    *live += p && !ptr;
+    return p;
+}
+
+/* Frees, but has nothing to give */
+static void *empty_alloc(void *ctx, void *ptr, size_t size) {
+    (void)ctx;
+    (void)size;
+    free(ptr);
+    return NULL;
+}
+
+/* Heap instances, error codes and the allocator hook */
+static int run_embed_tests(void) {
+    int passed = 0;
+    int failed = 0;
+    enum { INSTANCES = 100 };
+    static ddp24_t *cpus[INSTANCES];
+    long live = 0;
+
+    printf("=== DDP-24 Embedding Tests (API %d) ===\n\n", ddp24_api_version());
+
+    /* Many instances, every allocation going through the host */
+    ddp24_set_allocator(counting_alloc, &live);
+    ddp24_error_t err = DDP24_OK;
+    int faulted = 0;
+    for (int i = 0; i < INSTANCES && err == DDP24_OK; i++) {
+        cpus[i] = ddp24_create(DDP24_ENGINE_THREADED, &err);
+        if (cpus[i]) {
+            ddp24_write(cpus[i], 0, INSN(OP_LDA, 0, 0100));
+            ddp24_write(cpus[i], 1, INSN(01, 0, 0));    /* No such opcode */
+            ddp24_write(cpus[i], 0100, (word_t)i);
+            ddp24_run_for(cpus[i], 0);
+            faulted += cpus[i]->halted && cpus[i]->fault == DDP24_FAULT_ILLEGAL &&
+                       cpus[i]->fault_pc == 1 && cpus[i]->A == (word_t)i;
+        }
+    }
+    long held = live;
+    for (int i = 0; i < INSTANCES; i++) {
+        ddp24_destroy(cpus[i]);
+        cpus[i] = NULL;
+    }
+    ddp24_set_allocator(NULL, NULL);
+
+    if (err == DDP24_OK && faulted == INSTANCES && held >= 2 * INSTANCES && live == 0) {
+        printf("PASS: Instances\n");
+        passed++;
+    } else {
+        printf("FAIL: Instances (%s, %d faulted, %ld blocks held, %ld left)\n",
+               ddp24_error_name(err), faulted, held, live);
+        failed++;
+    }
+
+    /* Failures come back as codes */
+    ddp24_t *cpu = ddp24_create(DDP24_ENGINE_SWITCH, NULL);
+    int words = -1;
+    char state[256];
+    bool missing = ddp24_load_file(cpu, "/nonexistent/ddp24.bin", 0, &words) == DDP24_ERR_IO && words == 0;
+    bool engine = ddp24_engine_available(DDP24_ENGINE_JIT) ||
+                  (!ddp24_create(DDP24_ENGINE_JIT, &err) && err == DDP24_ERR_ENGINE);
+    int len = ddp24_format_state(cpu, state, sizeof(state));
+    bool format = len > 0 && (size_t)len == strlen(state) && strstr(state, "Cycles: 0\n");
+    ddp24_destroy(cpu);
+
+    if (missing && engine && format) {
+        printf("PASS: Error codes\n");
+        passed++;
+    } else {
+        printf("FAIL: Error codes (missing %d, engine %d, format %d)\n", missing, engine, format);
+        failed++;
+    }
+
+    /* A page that cannot be copied halts the CPU, not the host */
+    static const char source[] =
+        "        .org 0100\n"
+        "        .entry main\n"
+        "main:   sta 01000\n"        /* First store to a shared page */
+        "        hlt\n"
+        "        .org 0200\n"
+        "go:     jmp data\n"         /* Data is not predecoded */
+        "        .data\n"
+        "data:   .word 0\n";
+    ddp24_program_t *prog = ddp24_assemble(source, NULL);
+    ddp24_image_t *image = prog ? ddp24_program_image(prog) : NULL;
+    int stopped = 0, tried = 0;
+    for (int e = 0; image && e <= DDP24_ENGINE_JIT; e++) {
+        if (!ddp24_engine_available((ddp24_engine_t)e)) {
+            continue;
+        }
+        for (int decode = 0; decode < 2; decode++) {
+            ddp24_t *c = ddp24_create_image(image, (ddp24_engine_t)e, NULL);
+            if (!c) {
+                continue;
+            }
+            tried++;
+            c->PC = decode ? 0200 : 0100;
+            c->A = 7;
+            ddp24_set_allocator(empty_alloc, NULL);
+            ddp24_run_for(c, 1000);
+            ddp24_set_allocator(NULL, NULL);
+            word_t at = decode ? 0201 : 0100;
+            stopped += c->halted && c->fault == DDP24_FAULT_NOMEM && c->fault_pc == at &&
+                       ddp24_read(c, 01000) == 0 && ddp24_private_pages(c) == 0;
+            ddp24_destroy(c);
+        }
+    }
+    if (image) {
+        ddp24_image_release(image);
+    }
+    ddp24_program_free(prog);
+    if (tried > 0 && stopped == tried) {
+        printf("PASS: Out of memory fault\n");
+        passed++;
+    } else {
+        printf("FAIL: Out of memory fault (%d of %d)\n", stopped, tried);
+        failed++;
+    }
+
+    printf("\n=== Results: %d passed, %d failed ===\n", passed, failed);
+    return failed;
+}
+
+static int run_fuzz(ddp24_fuzz_config_t *config) {
+    ddp24_fuzz_failure_t failure;
+    uint64_t ran = 0;
+    double start = wall_seconds();
+    int found = ddp24_fuzz_run(config, &failure, &ran);
+    double seconds = wall_seconds() - start;
+
+    printf("Fuzzed %llu cases from seed %llu in %.2f s\n", (unsigned long long)ran,
+           (unsigned long long)config->seed, seconds);
+    if (!found) {
+        printf("No differences\n");
+        return 0;
+    }
+    printf("\n");
+    ddp24_fuzz_print(stdout, &failure);
+    return 1;
+}
+
+static int run_batch(const char *jobfile, int threads, const char *output, ddp24_engine_t engine) {
+    ddp24_job_t *jobs;
+    ddp24_error_t err;
+    int line;
+    int count = ddp24_batch_parse(jobfile, &jobs, &err, &line);
+    if (count < 0) {
+        fprintf(stderr, "%s:%d: %s\n", jobfile, line, err == DDP24_ERR_IO ? strerror(errno) : ddp24_error_name(err));
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (output && !(out = fopen(output, "w"))) {
+        perror(output);
+        ddp24_batch_free(jobs, count);
+        return 1;
+    }
+
+    ddp24_batch_run(jobs, count, threads, engine);
+    ddp24_batch_print(out, jobs, count);
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    ddp24_batch_free(jobs, count);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    ddp24_t cpu;
+    int interactive = 0;
+    int dump = 0;
+    int subroutines = 0;
+    int test = 0;
+    int bench = 0;
+    int engine_given = 0;
+    const char *program = NULL;
+    const char *batch = NULL;
+    ddp24_fuzz_config_t fuzz = { .seed = 1 };
+    const char *output = NULL;
+    const char *cache = NULL;
+    const char *assembled = NULL;
+    const char *folded = NULL;
+    const char *tracefile = NULL;
+    word_t base = 0;
+    int threads = 0;
+    double pace = 0;
+    const ddp24_timing_t *timing = NULL;
+    struct {
+        word_t first;
+        int count;
+    } watches[DDP24_TELEMETRY_RANGES];
+    int nwatches = 0;
+    uint64_t every = 20000;
+    const char *shm = NULL;
+    const char *udp = NULL;
+    ddp24_engine_t engine = DDP24_ENGINE_SWITCH;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-i") == 0) {
+            interactive = 1;
+        } else if (strcmp(argv[i], "-d") == 0) {
+            dump = 1;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            test = 1;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            bench = 1;
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            if (!parse_engine(argv[++i], &engine)) {
+                fprintf(stderr, "Unknown engine: %s\n", argv[i]);
+                return 1;
+            }
+            engine_given = 1;
+        } else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+            char *end;
+            word_t first = (word_t)strtoul(argv[++i], &end, 8);
+            int count = *end == ':' ? atoi(end + 1) : 1;
+            if (nwatches == DDP24_TELEMETRY_RANGES || count <= 0) {
+                fprintf(stderr, "Bad watch: %s\n", argv[i]);
+                return 1;
+            }
+            watches[nwatches].first = first;
+            watches[nwatches].count = count;
+            nwatches++;
+        } else if (strcmp(argv[i], "--every") == 0 && i + 1 < argc) {
+            every = strtoull(argv[++i], NULL, 10);
+            if (every == 0) {
+                fprintf(stderr, "Bad period: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+            shm = argv[++i];
+        } else if (strcmp(argv[i], "--udp") == 0 && i + 1 < argc) {
+            udp = argv[++i];
+        } else if (strcmp(argv[i], "--fuzz") == 0 && i + 1 < argc) {
+            fuzz.cases = strtoull(argv[++i], NULL, 10);
+            if (fuzz.cases == 0) {
+                fprintf(stderr, "Bad case count: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            fuzz.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch = argv[++i];
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            base = (word_t)strtoul(argv[++i], NULL, 8) & ADDR_MASK;
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            cache = argv[++i];
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            assembled = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            folded = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0) {
+            subroutines = 1;
+        } else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+            tracefile = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            pace = atof(argv[++i]);
+            if (pace <= 0) {
+                fprintf(stderr, "Bad pace: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            if (!(timing = ddp24_find_timing(argv[++i]))) {
+                fprintf(stderr, "Unknown timing profile: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-h") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (argv[i][0] != '-') {
+            program = argv[i];
+        }
+    }
+
+    if (test) {
+        int failures = run_tests(DDP24_ENGINE_SWITCH);
+        printf("\n");
+        failures += run_tests(DDP24_ENGINE_THREADED);
+        if (ddp24_engine_available(DDP24_ENGINE_JIT)) {
+            printf("\n");
+            failures += run_tests(DDP24_ENGINE_JIT);
+        }
+        printf("\n");
+        failures += run_fleet_tests();
+        printf("\n");
+        failures += run_batch_tests();
+        printf("\n");
+        failures += run_trace_tests();
+        printf("\n");
+        failures += run_pace_tests();
+        printf("\n");
+        failures += run_replay_tests();
+        printf("\n");
+        failures += run_embed_tests();
+        printf("\n");
+        failures += run_telemetry_tests();
+        printf("\n");
+        failures += run_asm_tests();
+        printf("\n");
+        failures += run_fuzz_tests();
+        if (DDP24_PROFILE_AVAILABLE) {
+            printf("\n");
+            failures += run_profile_tests();
+        }
+        return failures;
+    }
+
+    /* Before anything is decoded */
+    ddp24_set_timing(timing);
+
+    if (bench) {
+        if (engine_given) {
+            if (!ddp24_engine_available(engine)) {
+                fprintf(stderr, "Engine not available in this build: %s\n", ddp24_engine_name(engine));
+                return 1;
+            }
+            ddp24_bench(engine, stdout);
+            return 0;
+        }
+        ddp24_bench(DDP24_ENGINE_SWITCH, stdout);
+        printf("\n");
+        ddp24_bench(DDP24_ENGINE_THREADED, stdout);
+        if (ddp24_engine_available(DDP24_ENGINE_JIT)) {
+            printf("\n");
+            ddp24_bench(DDP24_ENGINE_JIT, stdout);
+        }
+        return 0;
+    }
+
+    if (fuzz.cases) {
+        if (!ddp24_engine_available(engine)) {
+            fprintf(stderr, "Engine not available in this build: %s\n", ddp24_engine_name(engine));
+            return 1;
+        }
+        fuzz.threads = threads;
+        fuzz.candidates = engine_given ? 1u << engine : DDP24_FUZZ_ALL;
+        return run_fuzz(&fuzz);
+    }
+
+    if (batch) {
+        if (!ddp24_engine_available(engine)) {
+            fprintf(stderr, "Engine not available in this build: %s\n", ddp24_engine_name(engine));
+            return 1;
+        }
+        return run_batch(batch, threads, output, engine);
+    }
+
+    if (cache) {
+        if (!program) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        int words = ddp24_cache_image(program, cache);
+        if (words < 0) {
+            perror(program);
+            return 1;
+        }
+        printf("Wrote %d words to %s\n", words, cache);
+        return 0;
+    }
+
+    if (assembled) {
+        if (!program) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        ddp24_asm_error_t err;
+        ddp24_program_t *p = ddp24_assemble_file(program, &err);
+        if (!p) {
+            if (err.line) {
+                fprintf(stderr, "%s:%d: %s\n", program, err.line, err.message);
+            } else {
+                fprintf(stderr, "%s\n", err.message);
+            }
+            return 1;
+        }
+        int status = 0;
+        if (ddp24_program_save(p, assembled) < 0) {
+            perror(assembled);
+            status = 1;
+        } else {
+            printf("Wrote %d sections, %d labels to %s\n", p->nsections, p->nsymbols, assembled);
+        }
+        ddp24_program_free(p);
+        return status;
+    }
+
+    if (!program && !interactive) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    ddp24_init(&cpu);
+    if (!ddp24_set_engine(&cpu, engine)) {
+        fprintf(stderr, "Engine not available in this build: %s\n", ddp24_engine_name(engine));
+        return 1;
+    }
+
+    /* A symbolic image starts at its entry and names routines in the reports */
+    ddp24_program_t *symbols = program ? ddp24_program_load(program) : NULL;
+    if (symbols) {
+        int words = ddp24_program_install(&cpu, symbols);
+        printf("Loaded %d words from %s, entry %05o\n", words, program, symbols->entry);
+    } else if (program) {
+        int words = ddp24_load_image(&cpu, program, base);
+        if (words < 0) {
+            perror(program);
+            ddp24_release(&cpu);
+            return 1;
+        }
+        printf("Loaded %d words from %s\n", words, program);
+        cpu.PC = base;
+    }
+
+    ddp24_profile_t *prof = NULL;
+    if (folded) {
+        prof = ddp24_profile_create();
+        if (!prof || !ddp24_profile_attach(&cpu, prof)) {
+            fprintf(stderr, "Profiler not available in this build (make PROFILE=1)\n");
+            ddp24_profile_free(prof);
+            ddp24_program_free(symbols);
+            ddp24_release(&cpu);
+            return 1;
+        }
+        prof->names = symbols;
+    }
+
+    ddp24_calls_t *calls = NULL;
+    if (subroutines) {
+        if (!(calls = ddp24_calls_create())) {
+            perror("ddp24");
+            ddp24_profile_free(prof);
+            ddp24_program_free(symbols);
+            ddp24_release(&cpu);
+            return 1;
+        }
+        ddp24_calls_names(calls, symbols);
+        ddp24_calls_attach(&cpu, calls);
+    }
+
+    ddp24_telemetry_t *telemetry = NULL;
+    if (nwatches) {
+        bool ok = (telemetry = ddp24_telemetry_create(every)) != NULL;
+        for (int w = 0; ok && w < nwatches; w++) {
+            ok = ddp24_telemetry_watch(telemetry, watches[w].first, watches[w].count);
+            if (!ok) {
+                fprintf(stderr, "More than %d cells watched\n", DDP24_TELEMETRY_CELLS);
+            }
+        }
+        if (ok && shm && !(ok = ddp24_telemetry_share(telemetry, shm))) {
+            perror(shm);
+        }
+        if (ok && udp) {
+            const char *colon = strrchr(udp, ':');
+            char host[256];
+            int len = colon ? (int)(colon - udp) : 0;
+            snprintf(host, sizeof(host), "%.*s", len, udp);
+            if (!colon || !(ok = ddp24_telemetry_send(telemetry, host, atoi(colon + 1)))) {
+                fprintf(stderr, "Cannot send to %s\n", udp);
+                ok = false;
+            }
+        }
+        if (!ok || !ddp24_telemetry_attach(&cpu, telemetry)) {
+            ddp24_telemetry_free(telemetry);
+            ddp24_calls_free(calls);
+            ddp24_profile_free(prof);
+            ddp24_program_free(symbols);
+            ddp24_release(&cpu);
+            return 1;
+        }
+    }
+
+    FILE *tf = NULL;
+    ddp24_trace_t *trace = NULL;
+    if (tracefile) {
+        tf = fopen(tracefile, "wb");
+        if (!tf || !(trace = ddp24_trace_start(tf))) {
+            perror(tracefile);
+            if (tf) {
+                fclose(tf);
+            }
+            ddp24_telemetry_free(telemetry);
+            ddp24_calls_free(calls);
+            ddp24_profile_free(prof);
+            ddp24_program_free(symbols);
+            ddp24_release(&cpu);
+            return 1;
+        }
+        ddp24_trace_attach(&cpu, trace);
+    }
+
+    if (interactive) {
+        interactive_mode(&cpu);
+    } else if (pace > 0) {
+        ddp24_pace_stats_t stats = { 0 };
+        ddp24_run_paced(&cpu, DDP24_FOREVER, pace, &stats);
+        ddp24_pace_report(&stats, stdout);
+        if (dump) {
+            ddp24_dump(&cpu);
+        }
+    } else {
+        ddp24_run(&cpu, 0);
+        if (dump) {
+            ddp24_dump(&cpu);
+        }
+    }
+    report_fault(&cpu);
+
+    int status = 0;
+    if (trace) {
+        ddp24_trace_attach(&cpu, NULL);
+        uint64_t records = ddp24_trace_records(trace);
+        int rc = ddp24_trace_finish(trace);
+        if (fclose(tf) != 0) {
+            rc = -1;
+        }
+        if (rc < 0) {
+            fprintf(stderr, "%s: write failed\n", tracefile);
+            status = 1;
+        } else {
+            printf("Traced %llu instructions to %s\n", (unsigned long long)records, tracefile);
+        }
+    }
+
+    if (telemetry) {
+        printf("Took %llu samples\n", (unsigned long long)ddp24_telemetry_samples(telemetry));
+        ddp24_telemetry_detach(&cpu, telemetry);
+        ddp24_telemetry_free(telemetry);
+    }
+
+    if (calls) {
+        ddp24_calls_attach(&cpu, NULL);
+        ddp24_calls_report(calls, stdout, 20);
+        ddp24_calls_free(calls);
+    }
+
+    if (prof) {
+        ddp24_profile_report(prof, stdout, 20);
+        FILE *f = fopen(folded, "w");
+        if (!f || ddp24_profile_write_folded(prof, f) < 0) {
+            perror(folded);
+            status = 1;
+        }
+        if (f) {
+            fclose(f);
+        }
+        ddp24_profile_free(prof);
+    }
+
+    ddp24_program_free(symbols);
+    ddp24_release(&cpu);
+    return status;
 }
@@ -0,0 +1,88 @@
+/*
+ * DDP-24 Emulator - Real-Time Pacing
+ * Viking Mars Lander Guidance Computer
+ *
+ * Waits sleep until shortly before the target and spin the rest, since
+ * sleeps wake late by tens of microseconds and bursts are only a few
+ * hundred long. Idle loops fast-forward to the end of the burst, so a
+ * program waiting on a device costs almost no host time.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <time.h>
+#include "../include/ddp24_pace.h"
+
+#define PACE_SPIN_NS    50000   /* Spin the last stretch of each wait */
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void wait_until(uint64_t target) {
+    uint64_t now = now_ns();
+    if (target > now + PACE_SPIN_NS) {
+        uint64_t wake = target - PACE_SPIN_NS;
+        struct timespec ts = { (time_t)(wake / 1000000000u), (long)(wake % 1000000000u) };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+            /* Interrupted by a signal: go back to sleep */
+        }
+    }
+    while (now_ns() < target) {
+        /* Spin */
+    }
+}
+
+ddp24_stop_t ddp24_run_paced(ddp24_t *cpu, uint64_t deadline, double speed,
+                             ddp24_pace_stats_t *stats) {
+    ddp24_pace_stats_t local = { 0 };
+    double ns_per_cycle = DDP24_NS_PER_CYCLE / (speed > 0 ? speed : 1.0);
+    uint64_t start_ns = now_ns();
+    uint64_t start_cycles = cpu->cycles;
+    ddp24_stop_t reason;
+
+    if (!stats) {
+        stats = &local;
+    }
+    do {
+        uint64_t end = cpu->cycles + DDP24_PACE_BURST;
+        if (end > deadline || end < cpu->cycles) {
+            end = deadline;
+        }
+        reason = ddp24_run_until(cpu, end);
+        stats->bursts++;
+
+        /* When the real machine would have got this far */
+        uint64_t due = start_ns + (uint64_t)((double)(cpu->cycles - start_cycles) * ns_per_cycle);
+        uint64_t now = now_ns();
+        if (now > due) {
+            uint64_t late = now - due;
+            stats->misses++;
+            stats->total_late_ns += late;
+            if (late > stats->worst_late_ns) {
+                stats->worst_late_ns = late;
+            }
+            if (late > DDP24_PACE_MAX_LAG) {
+                /* Stalled (a debugger, a suspended host): don't race to catch up */
+                stats->resyncs++;
+                start_ns = now;
+                start_cycles = cpu->cycles;
+            }
+        } else if (reason == DDP24_STOP_BUDGET) {
+            wait_until(due);
+            stats->waited_ns += now_ns() - now;
+        }
+    } while (reason == DDP24_STOP_BUDGET && cpu->cycles < deadline);
+    return reason;
+}
+
+void ddp24_pace_report(const ddp24_pace_stats_t *stats, FILE *out) {
+    fprintf(out, "Paced %llu bursts: %llu late (worst %.1f us, mean %.1f us), %llu resyncs, %.1f ms waiting\n",
+            (unsigned long long)stats->bursts, (unsigned long long)stats->misses,
+            stats->worst_late_ns / 1e3,
+            stats->misses ? stats->total_late_ns / 1e3 / stats->misses : 0.0,
+            (unsigned long long)stats->resyncs, stats->waited_ns / 1e6);
+}
@@ -0,0 +1,255 @@
+/*
+ * DDP-24 Emulator - Execution Profiler
+ * Viking Mars Lander Guidance Computer
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "../include/ddp24_profile.h"
+#include "../include/ddp24_asm.h"
+#include "ddp24_internal.h"
+
+#define NAME(name)  #name,
+static const char *const slot_name[64] = { DDP24_SLOTS(NAME) };
+#undef NAME
+
+static const char *op_name(int op, char buf[8]) {
+    if (strcmp(slot_name[op], "ILLEGAL") == 0) {
+        snprintf(buf, 8, "%03o", op);
+        return buf;
+    }
+    return slot_name[op];
+}
+
+ddp24_profile_t *ddp24_profile_create(void) {
+    ddp24_profile_t *prof = ddp24_calloc(1, sizeof(*prof));
+    if (!prof) {
+        return NULL;
+    }
+    prof->node = ddp24_malloc(DDP24_PROFILE_NODES * sizeof(ddp24_profile_node_t));
+    if (!prof->node) {
+        ddp24_free(prof);
+        return NULL;
+    }
+    ddp24_profile_clear(prof);
+    return prof;
+}
+
+void ddp24_profile_free(ddp24_profile_t *prof) {
+    if (!prof) {
+        return;
+    }
+    ddp24_free(prof->node);
+    ddp24_free(prof);
+}
+
+void ddp24_profile_clear(ddp24_profile_t *prof) {
+    ddp24_profile_node_t *node = prof->node;
+    const struct ddp24_program *names = prof->names;
+    memset(prof, 0, sizeof(*prof));
+    prof->node = node;
+    prof->names = names;
+    prof->node[0] = (ddp24_profile_node_t){ 0, -1, -1, -1, 0, 0 };
+    prof->nodes = 1;
+    prof->current = 0;
+}
+
+bool ddp24_profile_attach(ddp24_t *cpu, ddp24_profile_t *prof) {
+#ifdef DDP24_PROFILE
+    if (prof) {
+        ddp24_set_engine(cpu, DDP24_ENGINE_SWITCH);
+    }
+    cpu->profile = prof;
+    return true;
+#else
+    (void)cpu;
+    return prof == NULL;
+#endif
+}
+
+#ifdef DDP24_PROFILE
+
+/* Enter the callee at entry, reusing the node if this path was seen */
+static void call(ddp24_profile_t *prof, word_t entry) {
+    ddp24_profile_node_t *cur = &prof->node[prof->current];
+    int n;
+
+    for (n = cur->child; n >= 0; n = prof->node[n].sibling) {
+        if (prof->node[n].entry == entry) {
+            prof->current = n;
+            return;
+        }
+    }
+    if (prof->nodes == DDP24_PROFILE_NODES || cur->depth == DDP24_PROFILE_DEPTH) {
+        prof->dropped++;
+        prof->overflow++;
+        prof->deep[entry]++;
+        return;
+    }
+    n = prof->nodes++;
+    prof->node[n] = (ddp24_profile_node_t){ entry, prof->current, -1, cur->child, cur->depth + 1, 0 };
+    cur->child = n;
+    prof->current = n;
+}
+
+/* An indirect jump through a frame's link word returns from it (and
+ * from anything it called that never came back) */
+static void jump_through(ddp24_profile_t *prof, word_t link) {
+    if (prof->deep[link]) {
+        /* The innermost call through link was one not recorded */
+        prof->deep[link]--;
+        prof->overflow--;
+        return;
+    }
+    for (int n = prof->current; n > 0; n = prof->node[n].parent) {
+        if (prof->node[n].entry == link) {
+            prof->current = prof->node[n].parent;
+            if (prof->overflow) {
+                memset(prof->deep, 0, sizeof(prof->deep));
+                prof->overflow = 0;
+            }
+            return;
+        }
+    }
+}
+
+/* Called by ddp24_step after each instruction that started at pc, with
+ * ea its effective address */
+void ddp24_profile_record(ddp24_t *cpu, word_t pc, const ddp24_decoded_t *d, word_t ea, int cycles) {
+    ddp24_profile_t *prof = cpu->profile;
+
+    prof->instructions++;
+    prof->cycles += cycles;
+    prof->op_count[d->op]++;
+    prof->op_cycles[d->op] += cycles;
+    prof->hits[pc]++;
+    prof->pc_cycles[pc] += cycles;
+
+    if (d->op == OP_JSL) {
+        /* JSL stores the return in ea and continues after it, unless a
+         * native hook ran the routine: a call and its return at once,
+         * the hook's time the callee's */
+        bool hooked = cpu->PC != ((ea + 1) & ADDR_MASK);
+        if (!hooked) {
+            prof->node[prof->current].cycles += cycles;
+        }
+        call(prof, ea);
+        if (hooked) {
+            prof->node[prof->current].cycles += cycles;
+            jump_through(prof, ea);
+        }
+        return;
+    }
+    prof->node[prof->current].cycles += cycles;
+    if (d->op == OP_JMP && (d->flags & DDP24_DEC_INDIRECT)) {
+        jump_through(prof, (d->addr + cpu->X[d->index]) & ADDR_MASK);
+    }
+}
+
+#endif
+
+/* Reporting */
+
+typedef struct {
+    int key;
+    uint64_t count;
+    uint64_t cycles;
+} row_t;
+
+static int by_cycles(const void *a, const void *b) {
+    const row_t *x = a, *y = b;
+    if (x->cycles != y->cycles) {
+        return x->cycles < y->cycles ? 1 : -1;
+    }
+    return x->key - y->key;
+}
+
+static double percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * part / total : 0.0;
+}
+
+void ddp24_profile_report(const ddp24_profile_t *prof, FILE *out, int top) {
+    row_t ops[64];
+    int nops = 0;
+    char buf[8];
+
+    fprintf(out, "=== Profile: %llu instructions, %llu cycles ===\n\n",
+            (unsigned long long)prof->instructions, (unsigned long long)prof->cycles);
+
+    for (int op = 0; op < 64; op++) {
+        if (prof->op_count[op]) {
+            ops[nops++] = (row_t){ op, prof->op_count[op], prof->op_cycles[op] };
+        }
+    }
+    qsort(ops, nops, sizeof(row_t), by_cycles);
+    fprintf(out, "%-6s %14s %16s %7s\n", "op", "count", "cycles", "%");
+    for (int i = 0; i < nops; i++) {
+        fprintf(out, "%-6s %14llu %16llu %6.2f%%\n", op_name(ops[i].key, buf),
+                (unsigned long long)ops[i].count, (unsigned long long)ops[i].cycles,
+                percent(ops[i].cycles, prof->cycles));
+    }
+
+    row_t *pcs = ddp24_malloc(MEM_SIZE * sizeof(row_t));
+    if (!pcs) {
+        return;
+    }
+    int npcs = 0;
+    for (int a = 0; a < MEM_SIZE; a++) {
+        if (prof->hits[a]) {
+            pcs[npcs++] = (row_t){ a, prof->hits[a], prof->pc_cycles[a] };
+        }
+    }
+    qsort(pcs, npcs, sizeof(row_t), by_cycles);
+    if (top <= 0 || top > npcs) {
+        top = npcs;
+    }
+    fprintf(out, "\nHot spots (top %d of %d addresses):\n", top, npcs);
+    fprintf(out, "%-6s %14s %16s %7s%s\n", "addr", "hits", "cycles", "%", prof->names ? "  name" : "");
+    for (int i = 0; i < top; i++) {
+        char name[DDP24_SYMBOL_MAX + 16] = "";
+        if (prof->names) {
+            name[0] = name[1] = ' ';
+            ddp24_program_name(prof->names, pcs[i].key, name + 2, sizeof(name) - 2);
+        }
+        fprintf(out, "%05o  %14llu %16llu %6.2f%%%s\n", pcs[i].key,
+                (unsigned long long)pcs[i].count, (unsigned long long)pcs[i].cycles,
+                percent(pcs[i].cycles, prof->cycles), name);
+    }
+    ddp24_free(pcs);
+
+    if (prof->dropped) {
+        fprintf(out, "\n%llu calls not in the call tree (limit %d frames or depth %d)\n",
+                (unsigned long long)prof->dropped, DDP24_PROFILE_NODES, DDP24_PROFILE_DEPTH);
+    }
+}
+
+/* Frame names from the root down to n */
+static int write_stack(const ddp24_profile_t *prof, int n, FILE *out) {
+    if (n == 0) {
+        return fputs("root", out) < 0 ? -1 : 0;
+    }
+    if (write_stack(prof, prof->node[n].parent, out) < 0) {
+        return -1;
+    }
+    word_t entry = prof->node[n].entry;
+    char name[DDP24_SYMBOL_MAX + 16];
+    if (prof->names && !isdigit((unsigned char)*ddp24_program_name(prof->names, entry, name, sizeof(name)))) {
+        return fprintf(out, ";%s", name) < 0 ? -1 : 0;
+    }
+    return fprintf(out, ";sub_%05o", entry) < 0 ? -1 : 0;
+}
+
+int ddp24_profile_write_folded(const ddp24_profile_t *prof, FILE *out) {
+    for (int n = 0; n < prof->nodes; n++) {
+        if (!prof->node[n].cycles) {
+            continue;
+        }
+        if (write_stack(prof, n, out) < 0 ||
+            fprintf(out, " %llu\n", (unsigned long long)prof->node[n].cycles) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,331 @@
+/*
+ * DDP-24 Emulator - Record and Replay
+ * Viking Mars Lander Guidance Computer
+ *
+ * Checkpoints are delta snapshots, so a checkpoint costs only the pages
+ * written since the previous one. Replay applies each log entry from an
+ * event at its cycle, so runs split at every point where an input
+ * changes. This keeps idle-loop skipping exact: a sense line seen by a
+ * SKS spin loop only changes at the start of a stretch, as it did in
+ * the recorded run.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../include/ddp24_replay.h"
+#include "../include/ddp24_snapshot.h"
+#include "../include/ddp24_io.h"
+#include "ddp24_internal.h"
+
+#define LOGGED  0x80000000u     /* In last[]: a value has been logged */
+
+typedef struct {
+    uint64_t cycles;
+    uint16_t ea;
+    uint8_t kind;               /* DDP24_LOG_* */
+    word_t value;               /* Input word, sense bit or new interrupt lines */
+} entry_t;
+
+typedef struct {
+    ddp24_snapshot_t *snap;
+    uint64_t cycles;
+    size_t pos;                 /* First log entry after it */
+    uint64_t hash;
+} checkpoint_t;
+
+struct ddp24_recording {
+    ddp24_t *cpu;               /* NULL once stopped */
+    uint64_t interval;
+    int xec_limit;
+    bool failed;
+
+    entry_t *log;
+    size_t count, cap;
+    checkpoint_t *cp;
+    int checkpoints, cp_cap;
+
+    uint32_t last[2][MEM_SIZE]; /* Input and sense values as last logged */
+    uint32_t pending;           /* Interrupt lines pending as last logged */
+};
+
+/* One block, freed by ddp24_io_release if never finished */
+struct ddp24_replay {
+    const ddp24_recording_t *rec;
+    size_t next;                /* Entries before this have been applied */
+    uint32_t value[2][MEM_SIZE];
+};
+
+/* Recording */
+
+static void append(ddp24_recording_t *rec, uint64_t cycles, int kind, word_t ea, word_t value) {
+    if (rec->count == rec->cap) {
+        size_t cap = rec->cap ? rec->cap * 2 : 1024;
+        entry_t *log = ddp24_realloc(rec->log, cap * sizeof(entry_t));
+        if (!log) {
+            rec->failed = true;
+            return;
+        }
+        rec->log = log;
+        rec->cap = cap;
+    }
+    rec->log[rec->count++] = (entry_t){ cycles, (uint16_t)ea, (uint8_t)kind, value };
+}
+
+void ddp24_record_value(ddp24_recording_t *rec, uint64_t cycles, int kind, word_t ea, word_t value) {
+    uint32_t *last = &rec->last[kind][ea & ADDR_MASK];
+    if (*last != (value | LOGGED)) {
+        *last = value | LOGGED;
+        append(rec, cycles, kind, ea & ADDR_MASK, value);
+    }
+}
+
+void ddp24_record_irq(ddp24_recording_t *rec, const ddp24_t *cpu) {
+    uint32_t fresh = cpu->irq_pending & ~rec->pending;
+    if (fresh) {
+        append(rec, cpu->cycles, DDP24_LOG_IRQ, 0, fresh);
+    }
+    rec->pending = cpu->irq_pending;
+}
+
+static void checkpoint(ddp24_recording_t *rec) {
+    ddp24_t *cpu = rec->cpu;
+    if (rec->checkpoints == rec->cp_cap) {
+        int cap = rec->cp_cap ? rec->cp_cap * 2 : 16;
+        checkpoint_t *cp = ddp24_realloc(rec->cp, (size_t)cap * sizeof(checkpoint_t));
+        if (!cp) {
+            rec->failed = true;
+            return;
+        }
+        rec->cp = cp;
+        rec->cp_cap = cap;
+    }
+    ddp24_snapshot_t *snap = ddp24_snapshot(cpu);
+    if (!snap) {
+        rec->failed = true;
+        return;
+    }
+    rec->cp[rec->checkpoints++] = (checkpoint_t){ snap, cpu->cycles, rec->count, ddp24_state_hash(cpu) };
+
+    /* Restate what is known, so replay from here needs nothing earlier */
+    for (int kind = DDP24_LOG_INPUT; kind <= DDP24_LOG_SENSE; kind++) {
+        for (word_t ea = 0; ea < MEM_SIZE; ea++) {
+            if (rec->last[kind][ea] & LOGGED) {
+                append(rec, cpu->cycles, kind, ea, rec->last[kind][ea] & ~LOGGED);
+            }
+        }
+    }
+}
+
+static void checkpoint_event(ddp24_t *cpu, void *arg) {
+    ddp24_recording_t *rec = arg;
+    checkpoint(rec);
+    if (!ddp24_schedule(cpu, cpu->cycles + rec->interval, checkpoint_event, rec)) {
+        rec->failed = true;
+    }
+}
+
+ddp24_recording_t *ddp24_record_start(ddp24_t *cpu, uint64_t interval) {
+    ddp24_recording_t *rec = ddp24_calloc(1, sizeof(*rec));
+    if (!rec) {
+        return NULL;
+    }
+    rec->cpu = cpu;
+    rec->interval = interval;
+    rec->xec_limit = cpu->xec_limit;
+    rec->pending = cpu->irq_pending;
+    if (!ddp24_io_hook(cpu, rec, NULL)) {
+        ddp24_free(rec);
+        return NULL;
+    }
+    checkpoint(rec);
+    if (interval && !ddp24_schedule(cpu, cpu->cycles + interval, checkpoint_event, rec)) {
+        rec->failed = true;
+    }
+    return rec;
+}
+
+bool ddp24_record_stop(ddp24_recording_t *rec) {
+    ddp24_t *cpu = rec->cpu;
+    if (!cpu) {
+        return !rec->failed;
+    }
+    ddp24_cancel(cpu, checkpoint_event, rec);
+    if (rec->checkpoints == 0 || rec->cp[rec->checkpoints - 1].cycles != cpu->cycles) {
+        checkpoint(rec);
+    }
+    ddp24_io_hook(cpu, NULL, NULL);
+    rec->cpu = NULL;
+    return !rec->failed;
+}
+
+void ddp24_recording_free(ddp24_recording_t *rec) {
+    if (!rec) {
+        return;
+    }
+    if (rec->cpu) {
+        ddp24_record_stop(rec);
+    }
+    for (int k = 0; k < rec->checkpoints; k++) {
+        ddp24_snapshot_release(rec->cp[k].snap);
+    }
+    ddp24_free(rec->cp);
+    ddp24_free(rec->log);
+    ddp24_free(rec);
+}
+
+int ddp24_recording_checkpoints(const ddp24_recording_t *rec) {
+    return rec->checkpoints;
+}
+
+uint64_t ddp24_checkpoint_cycles(const ddp24_recording_t *rec, int checkpoint) {
+    return checkpoint >= 0 && checkpoint < rec->checkpoints ? rec->cp[checkpoint].cycles : 0;
+}
+
+/* Replay */
+
+/* Apply every entry that is due */
+static void catch_up(ddp24_t *cpu, struct ddp24_replay *replay) {
+    const ddp24_recording_t *rec = replay->rec;
+    for (; replay->next < rec->count && rec->log[replay->next].cycles <= cpu->cycles; replay->next++) {
+        const entry_t *e = &rec->log[replay->next];
+        if (e->kind == DDP24_LOG_IRQ) {
+            for (uint32_t lines = e->value; lines; lines &= lines - 1) {
+                ddp24_raise_interrupt(cpu, __builtin_ctz(lines));
+            }
+        } else {
+            replay->value[e->kind][e->ea] = e->value;
+        }
+    }
+}
+
+/* Catches up first: under XEC an access is logged at a cycle count
+ * partway through the instruction, where no event can fire */
+word_t ddp24_replay_value(ddp24_t *cpu, struct ddp24_replay *replay, int kind, word_t ea) {
+    catch_up(cpu, replay);
+    return replay->value[kind][ea & ADDR_MASK];
+}
+
+static void replay_event(ddp24_t *cpu, void *arg) {
+    struct ddp24_replay *replay = arg;
+    const ddp24_recording_t *rec = replay->rec;
+    catch_up(cpu, replay);
+    if (replay->next < rec->count) {
+        ddp24_schedule(cpu, rec->log[replay->next].cycles, replay_event, replay);
+    }
+}
+
+bool ddp24_replay_start(ddp24_t *cpu, const ddp24_recording_t *rec, int checkpoint) {
+    if (rec->failed || checkpoint < 0 || checkpoint >= rec->checkpoints) {
+        return false;
+    }
+    struct ddp24_replay *replay = ddp24_calloc(1, sizeof(*replay));
+    if (!replay) {
+        return false;
+    }
+    ddp24_replay_finish(cpu);
+    if (!ddp24_io_hook(cpu, NULL, replay)) {
+        ddp24_free(replay);
+        return false;
+    }
+    replay->rec = rec;
+    replay->next = rec->cp[checkpoint].pos;
+
+    ddp24_restore(cpu, rec->cp[checkpoint].snap);
+    cpu->xec_limit = rec->xec_limit;
+    replay_event(cpu, replay);
+    return true;
+}
+
+void ddp24_replay_finish(ddp24_t *cpu) {
+    struct ddp24_replay *replay = ddp24_io_replay(cpu);
+    if (replay) {
+        ddp24_cancel(cpu, replay_event, replay);
+        ddp24_io_hook(cpu, NULL, NULL);
+        ddp24_free(replay);
+    }
+}
+
+bool ddp24_replay_matches(const ddp24_t *cpu, const ddp24_recording_t *rec, int checkpoint) {
+    return checkpoint >= 0 && checkpoint < rec->checkpoints &&
+           cpu->cycles == rec->cp[checkpoint].cycles && ddp24_state_hash(cpu) == rec->cp[checkpoint].hash;
+}
+
+bool ddp24_replay_segment(const ddp24_recording_t *rec, int segment, ddp24_engine_t engine) {
+    if (segment < 0 || segment + 1 >= rec->checkpoints) {
+        return false;
+    }
+    ddp24_t cpu;
+    ddp24_init(&cpu);
+    ddp24_set_engine(&cpu, engine);     /* The switch engine if this one is missing */
+    bool ok = ddp24_replay_start(&cpu, rec, segment);
+    if (ok) {
+        ddp24_run_until(&cpu, rec->cp[segment + 1].cycles);
+        ok = ddp24_replay_matches(&cpu, rec, segment + 1);
+    }
+    ddp24_replay_finish(&cpu);
+    ddp24_release(&cpu);
+    return ok;
+}
+
+/* Parallel verification */
+
+typedef struct {
+    const ddp24_recording_t *rec;
+    ddp24_engine_t engine;
+    atomic_int next;
+    atomic_int first_bad;
+} verify_t;
+
+static void *verify_main(void *arg) {
+    verify_t *v = arg;
+    int segments = v->rec->checkpoints - 1;
+    int k;
+    while ((k = atomic_fetch_add(&v->next, 1)) < segments) {
+        if (!ddp24_replay_segment(v->rec, k, v->engine)) {
+            int bad = atomic_load(&v->first_bad);
+            while (k < bad && !atomic_compare_exchange_weak(&v->first_bad, &bad, k)) {
+            }
+        }
+    }
+    return NULL;
+}
+
+int ddp24_replay_verify(const ddp24_recording_t *rec, int threads, ddp24_engine_t engine) {
+    if (rec->failed) {
+        return 0;
+    }
+    if (threads <= 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = n > 0 ? (int)n : 1;
+    }
+    if (threads > rec->checkpoints - 1) {
+        threads = rec->checkpoints > 1 ? rec->checkpoints - 1 : 1;
+    }
+
+    verify_t v = { .rec = rec, .engine = engine };
+    atomic_init(&v.next, 0);
+    atomic_init(&v.first_bad, INT_MAX);
+
+    /* This thread is one of the workers */
+    pthread_t *tids = ddp24_calloc((size_t)threads, sizeof(pthread_t));
+    bool *started = ddp24_calloc((size_t)threads, sizeof(bool));
+    for (int i = 1; tids && started && i < threads; i++) {
+        started[i] = pthread_create(&tids[i], NULL, verify_main, &v) == 0;
+    }
+    verify_main(&v);
+    for (int i = 1; tids && started && i < threads; i++) {
+        if (started[i]) {
+            pthread_join(tids[i], NULL);
+        }
+    }
+    ddp24_free(tids);
+    ddp24_free(started);
+
+    int bad = atomic_load(&v.first_bad);
+    return bad == INT_MAX ? -1 : bad;
+}
@@ -0,0 +1,297 @@
+/*
+ * DDP-24 Emulator - Snapshots
+ * Viking Mars Lander Guidance Computer
+ *
+ * A snapshot's memory is an ordinary shared image. Pages the CPU owned
+ * when the snapshot was taken move into it; the rest stay with the
+ * image the CPU was already running on, which becomes its parent.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/ddp24_snapshot.h"
+#include "../include/ddp24_io.h"
+#include "ddp24_internal.h"
+
+#define SNAP_MAGIC      "DDP24SNP"
+#define SNAP_VERSION    2
+
+struct ddp24_snapshot {
+    word_t A, B, X[4], PC;
+    bool overflow;
+    bool halted;
+    bool interrupt_enabled;
+    bool interrupt_enable_next;
+    uint32_t irq_pending, irq_mask;
+    uint64_t cycles;
+    ddp24_image_t *image;
+};
+
+static void save_registers(ddp24_snapshot_t *snap, const ddp24_t *cpu) {
+    snap->A = cpu->A;
+    snap->B = cpu->B;
+    memcpy(snap->X, cpu->X, sizeof(snap->X));
+    snap->PC = cpu->PC;
+    snap->overflow = cpu->overflow;
+    snap->halted = cpu->halted;
+    snap->interrupt_enabled = cpu->interrupt_enabled;
+    snap->interrupt_enable_next = cpu->interrupt_enable_next;
+    snap->irq_pending = cpu->irq_pending;
+    snap->irq_mask = cpu->irq_mask;
+    snap->cycles = cpu->cycles;
+}
+
+ddp24_snapshot_t *ddp24_snapshot(ddp24_t *cpu) {
+    ddp24_snapshot_t *snap = ddp24_calloc(1, sizeof(*snap));
+    ddp24_image_t *image = ddp24_calloc(1, sizeof(*image));
+    if (!snap || !image) {
+        ddp24_free(snap);
+        ddp24_free(image);
+        return NULL;
+    }
+    atomic_init(&image->refs, 1);
+    image->parent = cpu->image;     /* The CPU's reference moves here */
+    image->timing = cpu->timing;
+
+    /* Image pages must be fully decoded, since misses copy the page */
+    for (int n = 0; n < DDP24_PAGES; n++) {
+        ddp24_page_t *p = cpu->page[n];
+        if (cpu->page_private & (1ull << n)) {
+            for (int i = 0; i < DDP24_PAGE_SIZE; i++) {
+                if (!(p->decoded[i].flags & DDP24_DEC_VALID)) {
+                    ddp24_predecode_with(image->timing, p->word[i], &p->decoded[i]);
+                }
+            }
+            image->owned |= 1ull << n;
+        }
+        image->page[n] = p;
+    }
+
+    /* Same pages, now shared: later stores copy again and so mark the
+     * dirty set for the next snapshot */
+    cpu->page_private = 0;
+    cpu->image = ddp24_image_retain(image);
+
+    save_registers(snap, cpu);
+    snap->image = image;
+    return snap;
+}
+
+void ddp24_restore(ddp24_t *cpu, const ddp24_snapshot_t *snap) {
+    ddp24_image_t *image = snap->image;
+
+    for (int n = 0; n < DDP24_PAGES; n++) {
+        if (cpu->page[n] == image->page[n]) {
+            continue;
+        }
+        if (cpu->page_private & (1ull << n)) {
+            ddp24_free(cpu->page[n]);
+            cpu->page_private &= ~(1ull << n);
+        }
+        cpu->page[n] = image->page[n];
+        if (cpu->hle_pages & (1ull << n)) {
+            ddp24_hle_forget(cpu, (word_t)n << DDP24_PAGE_SHIFT, DDP24_PAGE_SIZE);
+        }
+        if (cpu->jit) {
+            ddp24_invalidate(cpu, (word_t)n << DDP24_PAGE_SHIFT, DDP24_PAGE_SIZE);
+        }
+    }
+
+    if (cpu->image != image) {
+        ddp24_image_retain(image);
+        ddp24_image_release(cpu->image);
+        cpu->image = image;
+    }
+    if (cpu->jit && cpu->timing != image->timing) {
+        ddp24_invalidate(cpu, 0, MEM_SIZE);     /* Blocks carry the old costs */
+    }
+    cpu->timing = image->timing;
+
+    cpu->A = snap->A;
+    cpu->B = snap->B;
+    memcpy(cpu->X, snap->X, sizeof(cpu->X));
+    cpu->PC = snap->PC;
+    cpu->overflow = snap->overflow;
+    cpu->halted = snap->halted;
+    cpu->interrupt_enabled = snap->interrupt_enabled;
+    cpu->interrupt_enable_next = snap->interrupt_enable_next;
+    cpu->irq_pending = snap->irq_pending;
+    cpu->irq_mask = snap->irq_mask;
+    cpu->cycles = snap->cycles;
+    cpu->stop = DDP24_STOP_NONE;
+}
+
+void ddp24_snapshot_release(ddp24_snapshot_t *snap) {
+    if (!snap) {
+        return;
+    }
+    ddp24_image_release(snap->image);
+    ddp24_free(snap);
+}
+
+int ddp24_snapshot_pages(const ddp24_snapshot_t *snap) {
+    int count = 0;
+    for (uint64_t m = snap->image->owned; m; m &= m - 1) {
+        count++;
+    }
+    return count;
+}
+
+/* Binary form: little-endian throughout
+ *     magic[8] version:u32
+ *     A B X1 X2 X3 PC:u32 overflow halted interrupt_enabled interrupt_enable_next:u8
+ *     cycles:u64 pages:u64 (bit n set: page n follows)
+ *     irq_pending irq_mask:u32
+ *     page words:u32[DDP24_PAGE_SIZE]...
+ */
+
+static void put32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static void put64(uint8_t *p, uint64_t v) {
+    put32(p, (uint32_t)v);
+    put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get64(const uint8_t *p) {
+    return get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+#define SNAP_HEADER     64
+
+int ddp24_snapshot_write(const ddp24_snapshot_t *snap, FILE *f) {
+    const ddp24_image_t *image = snap->image;
+    uint8_t hdr[SNAP_HEADER];
+    uint64_t present = 0;
+
+    for (int n = 0; n < DDP24_PAGES; n++) {
+        if (image->page[n] != &ddp24_zero_page) {
+            present |= 1ull << n;
+        }
+    }
+
+    memcpy(hdr, SNAP_MAGIC, 8);
+    put32(hdr + 8, SNAP_VERSION);
+    put32(hdr + 12, snap->A);
+    put32(hdr + 16, snap->B);
+    put32(hdr + 20, snap->X[1]);
+    put32(hdr + 24, snap->X[2]);
+    put32(hdr + 28, snap->X[3]);
+    put32(hdr + 32, snap->PC);
+    hdr[36] = snap->overflow;
+    hdr[37] = snap->halted;
+    hdr[38] = snap->interrupt_enabled;
+    hdr[39] = snap->interrupt_enable_next;
+    put64(hdr + 40, snap->cycles);
+    put64(hdr + 48, present);
+    put32(hdr + 56, snap->irq_pending);
+    put32(hdr + 60, snap->irq_mask);
+    if (fwrite(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) {
+        return -1;
+    }
+
+    uint8_t buf[DDP24_PAGE_SIZE * 4];
+    for (int n = 0; n < DDP24_PAGES; n++) {
+        if (!(present & (1ull << n))) {
+            continue;
+        }
+        for (int i = 0; i < DDP24_PAGE_SIZE; i++) {
+            put32(buf + 4 * i, image->page[n]->word[i]);
+        }
+        if (fwrite(buf, 1, sizeof(buf), f) != sizeof(buf)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+ddp24_snapshot_t *ddp24_snapshot_read(FILE *f) {
+    uint8_t hdr[SNAP_HEADER];
+    if (fread(hdr, 1, SNAP_HEADER, f) != SNAP_HEADER || memcmp(hdr, SNAP_MAGIC, 8) != 0 ||
+        get32(hdr + 8) != SNAP_VERSION) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ddp24_snapshot_t *snap = ddp24_calloc(1, sizeof(*snap));
+    ddp24_image_t *image = ddp24_calloc(1, sizeof(*image));
+    if (!snap || !image) {
+        ddp24_free(snap);
+        ddp24_free(image);
+        return NULL;
+    }
+    atomic_init(&image->refs, 1);
+    image->timing = ddp24_active_timing;
+    snap->image = image;
+
+    snap->A = get32(hdr + 12) & WORD_MASK;
+    snap->B = get32(hdr + 16) & WORD_MASK;
+    snap->X[1] = get32(hdr + 20) & ADDR_MASK;
+    snap->X[2] = get32(hdr + 24) & ADDR_MASK;
+    snap->X[3] = get32(hdr + 28) & ADDR_MASK;
+    snap->PC = get32(hdr + 32) & ADDR_MASK;
+    snap->overflow = hdr[36] != 0;
+    snap->halted = hdr[37] != 0;
+    snap->interrupt_enabled = hdr[38] != 0;
+    snap->interrupt_enable_next = hdr[39] != 0;
+    snap->cycles = get64(hdr + 40);
+    uint64_t present = get64(hdr + 48);
+    snap->irq_pending = get32(hdr + 56) & ((1u << DDP24_IRQ_LINES) - 1);
+    snap->irq_mask = get32(hdr + 60) & ((1u << DDP24_IRQ_LINES) - 1);
+
+    uint8_t buf[DDP24_PAGE_SIZE * 4];
+    for (int n = 0; n < DDP24_PAGES; n++) {
+        image->page[n] = &ddp24_zero_page;
+        if (!(present & (1ull << n))) {
+            continue;
+        }
+        ddp24_page_t *p = ddp24_malloc(sizeof(ddp24_page_t));
+        if (!p || fread(buf, 1, sizeof(buf), f) != sizeof(buf)) {
+            if (p) {
+                errno = EINVAL;     /* Cut short */
+            }
+            ddp24_free(p);
+            ddp24_snapshot_release(snap);
+            return NULL;
+        }
+        for (int i = 0; i < DDP24_PAGE_SIZE; i++) {
+            p->word[i] = get32(buf + 4 * i) & WORD_MASK;
+            ddp24_predecode_with(image->timing, p->word[i], &p->decoded[i]);
+        }
+        p->hash = ddp24_page_hash(p, n);
+        image->page[n] = p;
+        image->owned |= 1ull << n;
+    }
+    return snap;
+}
+
+int ddp24_snapshot_save(const ddp24_snapshot_t *snap, const char *filename) {
+    FILE *f = fopen(filename, "wb");
+    if (!f) {
+        return -1;
+    }
+    int rc = ddp24_snapshot_write(snap, f);
+    if (fclose(f) != 0) {
+        rc = -1;
+    }
+    return rc;
+}
+
+ddp24_snapshot_t *ddp24_snapshot_load(const char *filename) {
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        return NULL;
+    }
+    ddp24_snapshot_t *snap = ddp24_snapshot_read(f);
+    fclose(f);
+    return snap;
+}
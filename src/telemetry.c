@@ -0,0 +1,308 @@
+/*
+ * DDP-24 Emulator - Telemetry
+ * Viking Mars Lander Guidance Computer
+ *
+ * Sample n goes to buffer n & 1, whose stamp is odd while it is being
+ * written; readers copy a buffer out and keep the copy only if its
+ * stamp did not move meanwhile.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include "../include/ddp24_telemetry.h"
+#include "../include/ddp24_io.h"
+#include "ddp24_internal.h"
+
+#define TELEMETRY_VERSION   1
+#define PACKET_HEADER       (4 + 8 + 8 + 4 * 8)
+
+typedef struct {
+    atomic_uint_least64_t stamp;    /* 2 * seq + 1 while written, 2 * seq + 2 after */
+    ddp24_sample_t sample;
+    word_t cell[DDP24_TELEMETRY_CELLS];
+} buffer_t;
+
+struct ddp24_telemetry_segment {
+    uint32_t magic, version;
+    atomic_uint_least64_t latest;   /* Newest complete sample's seq + 1, 0 for none */
+    buffer_t buffer[2];
+};
+
+struct ddp24_telemetry {
+    uint64_t period;
+    uint64_t due;               /* Time of the pending sample */
+    uint64_t samples;
+    int ranges, cells;
+    struct {
+        word_t first;
+        int count;
+    } range[DDP24_TELEMETRY_RANGES];
+    ddp24_telemetry_segment_t *seg;
+    char *name;                 /* Of the shared segment, NULL while on the heap */
+    int sock;                   /* -1 if not sending */
+    uint8_t packet[PACKET_HEADER + 4 * DDP24_TELEMETRY_CELLS];
+};
+
+static void put32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static void put64(uint8_t *p, uint64_t v) {
+    put32(p, (uint32_t)v);
+    put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static void segment_init(ddp24_telemetry_segment_t *seg) {
+    seg->magic = DDP24_TELEMETRY_MAGIC;
+    seg->version = TELEMETRY_VERSION;
+    atomic_init(&seg->latest, 0);
+    atomic_init(&seg->buffer[0].stamp, 0);
+    atomic_init(&seg->buffer[1].stamp, 0);
+}
+
+ddp24_telemetry_t *ddp24_telemetry_create(uint64_t period) {
+    if (period == 0) {
+        return NULL;
+    }
+    ddp24_telemetry_t *t = ddp24_calloc(1, sizeof(ddp24_telemetry_t));
+    if (!t) {
+        return NULL;
+    }
+    t->seg = ddp24_calloc(1, sizeof(ddp24_telemetry_segment_t));
+    if (!t->seg) {
+        ddp24_free(t);
+        return NULL;
+    }
+    segment_init(t->seg);
+    t->period = period;
+    t->sock = -1;
+    return t;
+}
+
+void ddp24_telemetry_free(ddp24_telemetry_t *t) {
+    if (!t) {
+        return;
+    }
+    if (t->name) {
+        munmap(t->seg, sizeof(ddp24_telemetry_segment_t));
+        shm_unlink(t->name);
+        ddp24_free(t->name);
+    } else {
+        ddp24_free(t->seg);
+    }
+    if (t->sock >= 0) {
+        close(t->sock);
+    }
+    ddp24_free(t);
+}
+
+bool ddp24_telemetry_watch(ddp24_telemetry_t *t, word_t first, int count) {
+    if (count <= 0 || t->ranges == DDP24_TELEMETRY_RANGES ||
+        count > DDP24_TELEMETRY_CELLS - t->cells) {
+        return false;
+    }
+    t->range[t->ranges].first = first & ADDR_MASK;
+    t->range[t->ranges].count = count;
+    t->ranges++;
+    t->cells += count;
+    return true;
+}
+
+bool ddp24_telemetry_share(ddp24_telemetry_t *t, const char *name) {
+    if (t->name) {
+        errno = EBUSY;
+        return false;
+    }
+    size_t len = strlen(name) + 1;
+    char *copy = ddp24_malloc(len);
+    if (!copy) {
+        errno = ENOMEM;
+        return false;
+    }
+    memcpy(copy, name, len);
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        ddp24_free(copy);
+        return false;
+    }
+    ddp24_telemetry_segment_t *seg = MAP_FAILED;
+    if (ftruncate(fd, sizeof(ddp24_telemetry_segment_t)) == 0) {
+        seg = mmap(NULL, sizeof(ddp24_telemetry_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    int saved = errno;
+    close(fd);
+    if (seg == MAP_FAILED) {
+        shm_unlink(name);
+        ddp24_free(copy);
+        errno = saved;
+        return false;
+    }
+
+    /* Carry over what has been sampled already */
+    memcpy(seg, t->seg, sizeof(ddp24_telemetry_segment_t));
+    ddp24_free(t->seg);
+    t->seg = seg;
+    t->name = copy;
+    return true;
+}
+
+bool ddp24_telemetry_send(ddp24_telemetry_t *t, const char *host, int port) {
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+    struct addrinfo hints = { 0 }, *res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    int rc = getaddrinfo(host, service, &hints, &res);
+    if (rc != 0) {
+        errno = rc == EAI_SYSTEM ? errno : EINVAL;
+        return false;
+    }
+    int sock = -1;
+    for (struct addrinfo *ai = res; ai && sock < 0; ai = ai->ai_next) {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock >= 0 && connect(sock, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(sock);
+            sock = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (sock < 0) {
+        return false;
+    }
+    if (t->sock >= 0) {
+        close(t->sock);
+    }
+    t->sock = sock;
+    return true;
+}
+
+static void send_sample(ddp24_telemetry_t *t, const ddp24_sample_t *s, const word_t *cells) {
+    uint8_t *p = t->packet;
+    put32(p, DDP24_TELEMETRY_MAGIC);
+    put64(p + 4, s->seq);
+    put64(p + 12, s->cycles);
+    const uint32_t regs[8] = { s->A, s->B, s->X[1], s->X[2], s->X[3], s->PC, s->flags, s->count };
+    for (int i = 0; i < 8; i++) {
+        put32(p + 20 + 4 * i, regs[i]);
+    }
+    p += PACKET_HEADER;
+    for (uint32_t i = 0; i < s->count; i++) {
+        put32(p + 4 * i, cells[i]);
+    }
+    /* A full socket buffer loses the sample rather than stalling the run */
+    (void)send(t->sock, t->packet, PACKET_HEADER + 4 * s->count, MSG_DONTWAIT);
+}
+
+/* The event: take a sample and book the next one */
+static void sample(ddp24_t *cpu, void *arg) {
+    ddp24_telemetry_t *t = arg;
+    ddp24_telemetry_segment_t *seg = t->seg;
+    uint64_t seq = t->samples++;
+    buffer_t *b = &seg->buffer[seq & 1];
+
+    atomic_store_explicit(&b->stamp, 2 * seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    b->sample = (ddp24_sample_t){
+        seq, cpu->cycles, cpu->A, cpu->B, { 0, cpu->X[1], cpu->X[2], cpu->X[3] }, cpu->PC,
+        (cpu->overflow ? DDP24_SAMPLE_OVERFLOW : 0) | (cpu->halted ? DDP24_SAMPLE_HALTED : 0) |
+            (cpu->interrupt_enabled ? DDP24_SAMPLE_INTERRUPTS : 0),
+        (uint32_t)t->cells,
+    };
+    word_t *cell = b->cell;
+    for (int r = 0; r < t->ranges; r++) {
+        for (int i = 0; i < t->range[r].count; i++) {
+            *cell++ = ddp24_read(cpu, (t->range[r].first + i) & ADDR_MASK);
+        }
+    }
+    atomic_store_explicit(&b->stamp, 2 * seq + 2, memory_order_release);
+    atomic_store_explicit(&seg->latest, seq + 1, memory_order_release);
+
+    if (t->sock >= 0) {
+        send_sample(t, &b->sample, b->cell);
+    }
+
+    /* Stay on the period's grid, skipping samples a long stretch ran past */
+    t->due += t->period * ((cpu->cycles - t->due) / t->period + 1);
+    ddp24_schedule(cpu, t->due, sample, t);
+}
+
+bool ddp24_telemetry_attach(ddp24_t *cpu, ddp24_telemetry_t *t) {
+    t->due = cpu->cycles + t->period;
+    return ddp24_schedule(cpu, t->due, sample, t);
+}
+
+void ddp24_telemetry_detach(ddp24_t *cpu, ddp24_telemetry_t *t) {
+    ddp24_cancel(cpu, sample, t);
+}
+
+uint64_t ddp24_telemetry_samples(const ddp24_telemetry_t *t) {
+    return t->samples;
+}
+
+const ddp24_telemetry_segment_t *ddp24_telemetry_segment(const ddp24_telemetry_t *t) {
+    return t->seg;
+}
+
+const ddp24_telemetry_segment_t *ddp24_telemetry_open(const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    const ddp24_telemetry_segment_t *seg =
+        mmap(NULL, sizeof(ddp24_telemetry_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+    int saved = errno;
+    close(fd);
+    if (seg == MAP_FAILED) {
+        errno = saved;
+        return NULL;
+    }
+    if (seg->magic != DDP24_TELEMETRY_MAGIC || seg->version != TELEMETRY_VERSION) {
+        munmap((void *)seg, sizeof(ddp24_telemetry_segment_t));
+        errno = EINVAL;
+        return NULL;
+    }
+    return seg;
+}
+
+void ddp24_telemetry_close(const ddp24_telemetry_segment_t *seg) {
+    if (seg) {
+        munmap((void *)seg, sizeof(ddp24_telemetry_segment_t));
+    }
+}
+
+bool ddp24_telemetry_read(const ddp24_telemetry_segment_t *seg, ddp24_sample_t *sample,
+                          word_t *cells, int max) {
+    for (;;) {
+        uint64_t n = atomic_load_explicit((atomic_uint_least64_t *)&seg->latest, memory_order_acquire);
+        if (n == 0) {
+            return false;
+        }
+        const buffer_t *b = &seg->buffer[(n - 1) & 1];
+        uint64_t stamp = atomic_load_explicit((atomic_uint_least64_t *)&b->stamp, memory_order_acquire);
+        if (stamp != 2 * n) {
+            continue;   /* Being overwritten by the sample after next */
+        }
+        *sample = b->sample;
+        int count = (int)sample->count < max ? (int)sample->count : max;
+        if (count > 0) {
+            memcpy(cells, b->cell, count * sizeof(word_t));
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit((atomic_uint_least64_t *)&b->stamp, memory_order_relaxed) == stamp) {
+            return true;
+        }
+    }
+}
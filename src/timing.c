@@ -0,0 +1,72 @@
+/*
+ * DDP-24 Emulator - Timing Profiles
+ * Viking Mars Lander Guidance Computer
+ *
+ * Both tables come from one list of the manual's costs. The DDP-124
+ * table is that list scaled to its faster core, which is close to 0.7
+ * of the DDP-24's times; entries can be replaced with measured figures
+ * one at a time.
+ */
+
+#include <string.h>
+#include "../include/ddp24_io.h"
+#include "../include/ddp24_timing.h"
+#include "ddp24_internal.h"
+
+/* DDP-24 cost of every implemented opcode, in 0.5 usec cycles */
+#define DDP24_TIMES(X) \
+    X(HLT, 5)  X(XEC, 5)  X(STB, 10) X(STA, 10) \
+    X(STC, 10) X(SAA, 10) X(INA, 10) \
+    X(ADD, 10) X(SUB, 10) X(SKG, 10) X(SKN, 10) \
+    X(ANA, 10) X(ORA, 10) X(ERA, 10) \
+    X(ADM, 10) X(SBM, 10) X(EAB, 5) \
+    X(LDB, 10) X(LDA, 10) X(JSL, 10) \
+    X(SMP, 20) \
+    X(FMB, 10) X(DMB, 10)   /* Plus per_fill or per_copy a word */ \
+    X(MPY, 28)              /* 14 usec average */ \
+    X(DIV, 44)              /* 22 usec */ \
+    X(BCD, 30) X(DCB, 30) \
+    X(ARS, 5)  X(ALS, 5)    /* Plus per_shift a place */ \
+    X(LRR, 5)  X(LLR, 5)  X(LRS, 5)  X(LLS, 5)  X(NRM, 5) \
+    X(SCR, 10) X(SCL, 10) X(RND, 5) \
+    X(TAB, 5)  X(LDX, 5)  X(IAB, 10) X(SIX, 10) \
+    X(SMX, 10) X(TAX, 5)  X(RIX, 10) \
+    X(JPL, 6)  X(JZE, 6)  X(JMI, 6)  X(JNZ, 6) \
+    X(JMP, 5)  X(JXI, 6)  X(NOP, 5) \
+    X(OCP, 5)  X(ITC, 5)  X(ITA, 10) X(OTA, 10) X(SKS, 10)
+
+#define SCALE_124(c)        (((c) * 7 + 9) / 10)    /* 0.7, rounded up */
+#define COST_24(op, c)      [OP_##op] = (c),
+#define COST_124(op, c)     [OP_##op] = SCALE_124(c),
+
+const ddp24_timing_t ddp24_timing_ddp24 = {
+    "ddp24",
+    { DDP24_TIMES(COST_24) },
+    1, 2, 4, DDP24_IRQ_CYCLES,
+};
+
+const ddp24_timing_t ddp24_timing_ddp124 = {
+    "ddp124",
+    { DDP24_TIMES(COST_124) },
+    SCALE_124(1), SCALE_124(2), SCALE_124(4), SCALE_124(DDP24_IRQ_CYCLES),
+};
+
+const ddp24_timing_t *ddp24_active_timing = &ddp24_timing_ddp24;
+
+void ddp24_set_timing(const ddp24_timing_t *timing) {
+    ddp24_active_timing = timing ? timing : &ddp24_timing_ddp24;
+}
+
+const ddp24_timing_t *ddp24_get_timing(void) {
+    return ddp24_active_timing;
+}
+
+const ddp24_timing_t *ddp24_find_timing(const char *name) {
+    if (strcmp(name, ddp24_timing_ddp24.name) == 0) {
+        return &ddp24_timing_ddp24;
+    }
+    if (strcmp(name, ddp24_timing_ddp124.name) == 0) {
+        return &ddp24_timing_ddp124;
+    }
+    return NULL;
+}
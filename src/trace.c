@@ -0,0 +1,340 @@
+/*
+ * DDP-24 Emulator - Execution Trace
+ * Viking Mars Lander Guidance Computer
+ *
+ * Single producer, single consumer: the CPU's thread only advances head,
+ * the writer only advances tail. Each side keeps the other's index in a
+ * plain field and rereads the atomic only when the ring looks full (or
+ * empty).
+ *
+ * Stream format, after a 16-byte header ("DDP24TRC", version:u32le, 0):
+ *     flags:u8, then a varint for each flag bit set, in bit order
+ *     TR_PC      pc, when it is not the previous pc + 1
+ *     TR_INSTR   instr, when not what this address held last time
+ *     TR_EA      ea, when not this address's last ea
+ *     TR_A       A xor previous A, when A changed
+ *     TR_B       B xor previous B, when B changed
+ *     TR_CYCLES  cycles, when not this address's last cost
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "../include/ddp24_trace.h"
+#include "ddp24_internal.h"
+
+#define TRACE_MAGIC     "DDP24TRC"
+#define TRACE_VERSION   1
+#define TRACE_HEADER    16
+#define TRACE_RING      (1 << 16)   /* Records */
+#define TRACE_BUFFER    (1 << 16)   /* Bytes of compressed output per write */
+
+#define TR_PC       0x01
+#define TR_INSTR    0x02
+#define TR_EA       0x04
+#define TR_A        0x08
+#define TR_B        0x10
+#define TR_CYCLES   0x20
+
+/* Predictor state, mirrored exactly by the reader */
+typedef struct {
+    word_t instr;
+    word_t ea;
+    uint32_t cycles;
+} last_t;
+
+typedef struct {
+    word_t pc;
+    word_t A;
+    word_t B;
+    last_t last[MEM_SIZE];  /* What each address did last time */
+} model_t;
+
+struct ddp24_trace {
+    ddp24_trace_rec_t *ring;
+
+    /* Producer */
+    size_t head_own;
+    size_t tail_seen;
+
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+    atomic_bool closing;
+
+    /* Writer */
+    pthread_t thread;
+    FILE *file;
+    model_t model;
+    uint8_t out[TRACE_BUFFER];
+    size_t used;
+    bool failed;
+};
+
+struct ddp24_trace_reader {
+    FILE *file;
+    model_t model;
+};
+
+static void nap(long ns) {
+    struct timespec ts = { 0, ns };
+    nanosleep(&ts, NULL);
+}
+
+/* Producer side */
+
+void ddp24_trace_record(ddp24_trace_t *t, const ddp24_trace_rec_t *rec) {
+    size_t head = t->head_own;
+    while (head - t->tail_seen == TRACE_RING) {
+        t->tail_seen = atomic_load_explicit(&t->tail, memory_order_acquire);
+        if (head - t->tail_seen == TRACE_RING) {
+            sched_yield();
+        }
+    }
+    t->ring[head & (TRACE_RING - 1)] = *rec;
+    t->head_own = head + 1;
+    atomic_store_explicit(&t->head, head + 1, memory_order_release);
+}
+
+void ddp24_trace_attach(ddp24_t *cpu, ddp24_trace_t *trace) {
+    cpu->trace = trace;
+}
+
+uint64_t ddp24_trace_records(const ddp24_trace_t *trace) {
+    return trace->head_own;
+}
+
+/* Writer side */
+
+static void flush(ddp24_trace_t *t) {
+    if (t->used && fwrite(t->out, 1, t->used, t->file) != t->used) {
+        t->failed = true;
+    }
+    t->used = 0;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint32_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static void encode(ddp24_trace_t *t, const ddp24_trace_rec_t *r) {
+    model_t *m = &t->model;
+    word_t pc = r->pc & ADDR_MASK;
+    last_t *last = &m->last[pc];
+
+    if (TRACE_BUFFER - t->used < 32) {
+        flush(t);
+    }
+    uint8_t *start = t->out + t->used;
+    uint8_t *p = start + 1;
+    uint8_t flags = 0;
+
+    if (pc != ((m->pc + 1) & ADDR_MASK)) {
+        flags |= TR_PC;
+        p = put_varint(p, pc);
+    }
+    if (r->instr != last->instr) {
+        flags |= TR_INSTR;
+        p = put_varint(p, r->instr);
+    }
+    if (r->ea != last->ea) {
+        flags |= TR_EA;
+        p = put_varint(p, r->ea);
+    }
+    if (r->A != m->A) {
+        flags |= TR_A;
+        p = put_varint(p, r->A ^ m->A);
+    }
+    if (r->B != m->B) {
+        flags |= TR_B;
+        p = put_varint(p, r->B ^ m->B);
+    }
+    if (r->cycles != last->cycles) {
+        flags |= TR_CYCLES;
+        p = put_varint(p, r->cycles);
+    }
+    *start = flags;
+    t->used = (size_t)(p - t->out);
+
+    m->pc = pc;
+    m->A = r->A;
+    m->B = r->B;
+    *last = (last_t){ r->instr, r->ea, r->cycles };
+}
+
+static void *writer_main(void *arg) {
+    ddp24_trace_t *t = arg;
+    size_t tail = 0;
+
+    for (;;) {
+        bool closing = atomic_load_explicit(&t->closing, memory_order_acquire);
+        size_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+        if (head == tail) {
+            if (closing) {
+                break;
+            }
+            nap(100000);
+            continue;
+        }
+        for (; tail != head; tail++) {
+            encode(t, &t->ring[tail & (TRACE_RING - 1)]);
+        }
+        atomic_store_explicit(&t->tail, tail, memory_order_release);
+    }
+    flush(t);
+    return NULL;
+}
+
+static void model_init(model_t *m) {
+    memset(m, 0, sizeof(*m));
+    m->pc = ADDR_MASK;      /* So the first record predicts PC 0 */
+}
+
+ddp24_trace_t *ddp24_trace_start(FILE *f) {
+    ddp24_trace_t *t = ddp24_calloc(1, sizeof(*t));
+    if (!t) {
+        return NULL;
+    }
+    t->ring = ddp24_malloc(TRACE_RING * sizeof(ddp24_trace_rec_t));
+    if (!t->ring) {
+        ddp24_free(t);
+        return NULL;
+    }
+    t->file = f;
+    model_init(&t->model);
+    atomic_init(&t->head, 0);
+    atomic_init(&t->tail, 0);
+    atomic_init(&t->closing, false);
+
+    uint8_t hdr[TRACE_HEADER] = { 0 };
+    memcpy(hdr, TRACE_MAGIC, 8);
+    hdr[8] = TRACE_VERSION;
+    if (fwrite(hdr, 1, sizeof(hdr), f) != sizeof(hdr) ||
+        pthread_create(&t->thread, NULL, writer_main, t) != 0) {
+        ddp24_free(t->ring);
+        ddp24_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+int ddp24_trace_finish(ddp24_trace_t *trace) {
+    atomic_store_explicit(&trace->closing, true, memory_order_release);
+    pthread_join(trace->thread, NULL);
+    int rc = trace->failed || fflush(trace->file) != 0 ? -1 : 0;
+    ddp24_free(trace->ring);
+    ddp24_free(trace);
+    return rc;
+}
+
+/* Decoding */
+
+ddp24_trace_reader_t *ddp24_trace_reader(FILE *f) {
+    uint8_t hdr[TRACE_HEADER];
+    if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr) ||
+        memcmp(hdr, TRACE_MAGIC, 8) != 0 || hdr[8] != TRACE_VERSION) {
+        return NULL;
+    }
+    ddp24_trace_reader_t *r = ddp24_malloc(sizeof(*r));
+    if (!r) {
+        return NULL;
+    }
+    r->file = f;
+    model_init(&r->model);
+    return r;
+}
+
+static bool get_varint(FILE *f, uint32_t *v) {
+    *v = 0;
+    for (int shift = 0; shift < 32; shift += 7) {
+        int c = getc(f);
+        if (c == EOF) {
+            return false;
+        }
+        *v |= (uint32_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int ddp24_trace_next(ddp24_trace_reader_t *reader, ddp24_trace_rec_t *rec) {
+    model_t *m = &reader->model;
+    FILE *f = reader->file;
+    uint32_t v;
+
+    int flags = getc(f);
+    if (flags == EOF) {
+        return 0;
+    }
+    if (flags & ~0x3F) {
+        return -1;
+    }
+
+    word_t pc = (m->pc + 1) & ADDR_MASK;
+    if (flags & TR_PC) {
+        if (!get_varint(f, &v) || v > ADDR_MASK) {
+            return -1;
+        }
+        pc = v;
+    }
+    last_t *last = &m->last[pc];
+    rec->pc = pc;
+    rec->instr = last->instr;
+    rec->ea = last->ea;
+    rec->A = m->A;
+    rec->B = m->B;
+    rec->cycles = last->cycles;
+
+    if (flags & TR_INSTR) {
+        if (!get_varint(f, &v)) {
+            return -1;
+        }
+        rec->instr = v;
+    }
+    if (flags & TR_EA) {
+        if (!get_varint(f, &v)) {
+            return -1;
+        }
+        rec->ea = v;
+    }
+    if (flags & TR_A) {
+        if (!get_varint(f, &v)) {
+            return -1;
+        }
+        rec->A ^= v;
+    }
+    if (flags & TR_B) {
+        if (!get_varint(f, &v)) {
+            return -1;
+        }
+        rec->B ^= v;
+    }
+    if (flags & TR_CYCLES) {
+        if (!get_varint(f, &v)) {
+            return -1;
+        }
+        rec->cycles = v;
+    }
+
+    m->pc = pc;
+    m->A = rec->A;
+    m->B = rec->B;
+    *last = (last_t){ rec->instr, rec->ea, rec->cycles };
+    return 1;
+}
+
+void ddp24_trace_reader_free(ddp24_trace_reader_t *reader) {
+    ddp24_free(reader);
+}
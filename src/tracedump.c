@@ -0,0 +1,82 @@
+/*
+ * DDP-24 Emulator - Trace Decoder
+ * Viking Mars Lander Guidance Computer
+ *
+ * Prints a trace written by ddp24 -T, one instruction per line.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "../include/ddp24_trace.h"
+#include "ddp24_internal.h"
+
+#define NAME(name)  #name,
+static const char *const slot_name[64] = { DDP24_SLOTS(NAME) };
+#undef NAME
+
+static void usage(const char *prog) {
+    printf("DDP-24 Trace Decoder\n\n");
+    printf("Usage: %s [-s] trace.bin\n\n", prog);
+    printf("  -s        Summary only\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *filename = NULL;
+    int summary = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0) {
+            summary = 1;
+        } else if (strcmp(argv[i], "-h") == 0) {
+            usage(argv[0]);
+            return 0;
+        } else if (argv[i][0] != '-') {
+            filename = argv[i];
+        }
+    }
+    if (!filename) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        perror(filename);
+        return 1;
+    }
+    ddp24_trace_reader_t *reader = ddp24_trace_reader(f);
+    if (!reader) {
+        fprintf(stderr, "%s: not a DDP-24 trace\n", filename);
+        fclose(f);
+        return 1;
+    }
+
+    ddp24_trace_rec_t rec;
+    unsigned long long records = 0, cycles = 0;
+    int rc;
+    while ((rc = ddp24_trace_next(reader, &rec)) > 0) {
+        records++;
+        cycles += rec.cycles;
+        if (!summary) {
+            const char *name = slot_name[decode_opcode(rec.instr)];
+            if (strcmp(name, "ILLEGAL") == 0) {
+                name = "???";
+            }
+            printf("%05o  %08o  %-4s %05o  A=%08o B=%08o  +%u\n",
+                   rec.pc, rec.instr, name, rec.ea, rec.A, rec.B, rec.cycles);
+        }
+    }
+    long bytes = ftell(f);
+    ddp24_trace_reader_free(reader);
+    fclose(f);
+
+    if (rc < 0) {
+        fprintf(stderr, "%s: damaged after %llu records\n", filename, records);
+        return 1;
+    }
+    if (summary) {
+        printf("%llu instructions, %llu cycles, %.2f bytes per instruction\n",
+               records, cycles, records ? (double)bytes / records : 0.0);
+    }
+    return 0;
+}